@@ -0,0 +1,300 @@
+#include "adjacency.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "geo_distance.h"
+#include "geometry.h"
+#include "geos_context.h"
+#include "sql_util.h"
+#include "thread_pool.h"
+
+namespace {
+
+// Largest overlap, relative to the area of the smaller feature, of two
+// features that are still neighbours: shared borders digitized twice
+// overlap by slivers, three of them in BR_UF_2022, the largest a few
+// 1e-14 of the area of Goias
+const double MAX_OVERLAP_RATIO = 1e-9;
+
+struct Feature {
+    sqlite3_value *id = nullptr;
+    Geometry geometry;
+    BBox bbox;
+};
+
+struct Pair {
+    size_t a = 0;
+    size_t b = 0;
+    bool adjacent = false;
+    bool failed = false;
+    double border_length = 0;
+};
+
+double line_length(const std::vector<Point> &line, bool geographic)
+{
+    double length = 0;
+    for (size_t i = 1; i < line.size(); i++) {
+        length += point_distance(line[i - 1], line[i], geographic);
+    }
+    return length;
+}
+
+/**
+ * Whether the interiors of two intersecting features overlap by more than
+ * a sliver
+ *
+ * @return 1 if they do, 0 if not, 2 on a GEOS error
+ */
+int overlap_exceeds_sliver(const GeosContext &geos, const GEOSGeometry *a, const GEOSGeometry *b)
+{
+    // 1 touches: the interiors are disjoint
+    const char touches = GEOSTouches_r(geos.handle(), a, b);
+    if (touches != 0) {
+        return touches == 1 ? 0 : 2;
+    }
+
+    GeosGeometry overlap = geos.wrap(GEOSIntersection_r(geos.handle(), a, b));
+    double overlap_area = 0;
+    double area_a = 0;
+    double area_b = 0;
+    if (!overlap || GEOSArea_r(geos.handle(), overlap.get(), &overlap_area) != 1 ||
+        GEOSArea_r(geos.handle(), a, &area_a) != 1 || GEOSArea_r(geos.handle(), b, &area_b) != 1) {
+        return 2;
+    }
+    return overlap_area > MAX_OVERLAP_RATIO * std::min(area_a, area_b) ? 1 : 0;
+}
+
+/**
+ * Checks whether two features meet and measures their shared border;
+ * runs on a worker thread
+ */
+void evaluate_pair(const GeosContext &geos, const std::vector<Feature> &features, Pair &pair, bool geographic)
+{
+    GeosGeometry a = geos.to_geos(features[pair.a].geometry);
+    GeosGeometry b = geos.to_geos(features[pair.b].geometry);
+    if (!a || !b) {
+        pair.failed = true;
+        return;
+    }
+
+    // 1 intersects, 0 disjoint, 2 exception. Features whose interiors
+    // overlap by more than a sliver are not neighbours, whatever their
+    // boundaries share.
+    const char intersects = GEOSIntersects_r(geos.handle(), a.get(), b.get());
+    if (intersects != 1) {
+        pair.failed = intersects != 0;
+        return;
+    }
+    const int overlaps = overlap_exceeds_sliver(geos, a.get(), b.get());
+    if (overlaps != 0) {
+        pair.failed = overlaps != 1;
+        return;
+    }
+    pair.adjacent = true;
+
+    GeosGeometry boundary_a = geos.wrap(GEOSBoundary_r(geos.handle(), a.get()));
+    GeosGeometry boundary_b = geos.wrap(GEOSBoundary_r(geos.handle(), b.get()));
+    if (!boundary_a || !boundary_b) {
+        pair.failed = true;
+        return;
+    }
+    GeosGeometry shared = geos.wrap(GEOSIntersection_r(geos.handle(), boundary_a.get(), boundary_b.get()));
+    if (!shared) {
+        pair.failed = true;
+        return;
+    }
+
+    // Point contacts come back as points, with no length
+    Geometry border;
+    if (!geos.from_geos(shared.get(), border)) return;
+    for (const auto &line : border.lines) {
+        pair.border_length += line_length(line, geographic);
+    }
+}
+
+/**
+ * Pairs of features whose bounding boxes intersect, from a sweep along x
+ */
+std::vector<Pair> candidate_pairs(const std::vector<Feature> &features)
+{
+    std::vector<size_t> order(features.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t i, size_t j) {
+        return features[i].bbox.min_x < features[j].bbox.min_x;
+    });
+
+    std::vector<Pair> pairs;
+    std::vector<size_t> active;
+    for (size_t i : order) {
+        const BBox &box = features[i].bbox;
+
+        // Drop the boxes that end before this one starts
+        active.erase(std::remove_if(active.begin(), active.end(),
+                                    [&](size_t j) { return features[j].bbox.max_x < box.min_x; }),
+                     active.end());
+
+        for (size_t j : active) {
+            const BBox &other = features[j].bbox;
+            if (other.min_y <= box.max_y && other.max_y >= box.min_y) {
+                Pair pair;
+                pair.a = std::min(i, j);
+                pair.b = std::max(i, j);
+                pairs.push_back(pair);
+            }
+        }
+        active.push_back(i);
+    }
+    return pairs;
+}
+
+/**
+ * Asks SpatiaLite whether an SRID uses longitude/latitude coordinates
+ */
+bool srid_is_geographic(sqlite3 *db_handle, int srid)
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db_handle, "SELECT SridIsGeographic(?)", -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, srid);
+    const bool geographic = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 1;
+    sqlite3_finalize(stmt);
+    return geographic;
+}
+
+/**
+ * Reads the id and geometry of every feature of a table
+ */
+int read_features(sqlite3 *db_handle, const std::string &table, const std::string &id_column,
+                  const std::string &geometry_column, std::vector<Feature> &features)
+{
+    sqlite3_stmt *stmt;
+    std::string sql_cmd = "SELECT " + id_column + ", " + geometry_column + " FROM " + table + " WHERE " +
+        geometry_column + " IS NOT NULL";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Feature feature;
+        const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 1));
+        if (!decode_spatialite_blob(blob, sqlite3_column_bytes(stmt, 1), feature.geometry)) continue;
+        feature.bbox = feature.geometry.bbox();
+        feature.id = sqlite3_value_dup(sqlite3_column_value(stmt, 0));
+        features.push_back(std::move(feature));
+    }
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+} // namespace
+
+int build_adjacency(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                    const std::string &id_column, const std::string &adjacency_table, ThreadPool &pool,
+                    AdjacencySummary *summary)
+{
+    const std::string adjacency = quote_identifier(adjacency_table);
+    AdjacencySummary counts;
+
+    std::vector<std::unique_ptr<GeosContext>> contexts;
+    try {
+        for (unsigned i = 0; i < pool.size(); i++) {
+            contexts.emplace_back(new GeosContext());
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error building adjacency: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::vector<Feature> features;
+    struct FeatureCleanup {
+        std::vector<Feature> &features;
+        ~FeatureCleanup()
+        {
+            for (Feature &feature : features) {
+                sqlite3_value_free(feature.id);
+            }
+        }
+    } cleanup{features};
+
+    if (read_features(db_handle, quote_identifier(table_name), quote_identifier(id_column),
+                      quote_identifier(geometry_column), features) != 0) {
+        return 1;
+    }
+    counts.features = features.size();
+
+    const bool geographic = !features.empty() && srid_is_geographic(db_handle, features[0].geometry.srid);
+
+    // Evaluate the candidate pairs in parallel
+    std::vector<Pair> pairs = candidate_pairs(features);
+    counts.candidates = pairs.size();
+    try {
+        pool.parallel_for(pairs.size(), [&](size_t index, unsigned worker) {
+            evaluate_pair(*contexts[worker], features, pairs[index], geographic);
+        });
+    } catch (const std::exception &e) {
+        std::cerr << "Error building adjacency: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Store the graph
+    if (exec(db_handle, "BEGIN TRANSACTION;", "starting transaction") != 0) {
+        return 1;
+    }
+    if (exec(db_handle, "DROP TABLE IF EXISTS " + adjacency, "dropping adjacency table") != 0 ||
+        exec(db_handle, "CREATE TABLE " + adjacency + " (id NOT NULL, neighbour_id NOT NULL, border_length DOUBLE, "
+             "PRIMARY KEY (id, neighbour_id)) WITHOUT ROWID", "creating adjacency table") != 0) {
+        exec(db_handle, "ROLLBACK;", "rolling back");
+        return 1;
+    }
+
+    sqlite3_stmt *stmt;
+    std::string sql_cmd = "INSERT INTO " + adjacency + " (id, neighbour_id, border_length) VALUES (?, ?, ?)";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        exec(db_handle, "ROLLBACK;", "rolling back");
+        return 1;
+    }
+
+    for (const Pair &pair : pairs) {
+        counts.failed += pair.failed ? 1 : 0;
+        if (!pair.adjacent) continue;
+        counts.adjacent++;
+
+        for (int direction = 0; direction < 2; direction++) {
+            const Feature &from = features[direction == 0 ? pair.a : pair.b];
+            const Feature &to = features[direction == 0 ? pair.b : pair.a];
+            sqlite3_bind_value(stmt, 1, from.id);
+            sqlite3_bind_value(stmt, 2, to.id);
+            sqlite3_bind_double(stmt, 3, pair.border_length);
+
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                std::cerr << "Error inserting adjacency: " << sqlite3_errmsg(db_handle) << std::endl;
+                sqlite3_finalize(stmt);
+                exec(db_handle, "ROLLBACK;", "rolling back");
+                return 1;
+            }
+            sqlite3_reset(stmt);
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    if (exec(db_handle, "COMMIT;", "committing transaction") != 0) {
+        return 1;
+    }
+
+    std::cout << "Built adjacency of " << table_name << " on " << pool.size() << " threads: " << counts.features
+        << " features, " << counts.candidates << " candidate pairs, " << counts.adjacent << " adjacent"
+        << (counts.failed > 0 ? ", " + std::to_string(counts.failed) + " failed" : "") << std::endl;
+
+    if (summary != NULL) {
+        *summary = counts;
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef ADJACENCY_H
+#define ADJACENCY_H
+
+#include <cstdint>
+#include <string>
+
+#include <sqlite3.h>
+
+class ThreadPool;
+
+struct AdjacencySummary {
+    uint64_t features = 0;     // features read
+    uint64_t candidates = 0;   // pairs whose bounding boxes intersect
+    uint64_t adjacent = 0;     // pairs whose geometries meet
+    uint64_t failed = 0;       // pairs GEOS could not evaluate
+};
+
+/**
+ * Builds the adjacency graph of a polygon layer and stores it as a table
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table holding the polygons
+ * @param geometry_column geometry column of the table
+ * @param id_column column identifying the features in the graph
+ * @param adjacency_table name of the table to (re)create
+ * @param pool threads to run GEOS on, each with its own GEOS context
+ * @param summary counts of candidate and adjacent pairs (may be NULL)
+ * @return 0 on success, 1 on failure
+ *
+ * Candidate pairs come from a sweep over the bounding boxes sorted by
+ * min_x, so pairs far apart are never handed to GEOS. The candidates are
+ * then evaluated in parallel: a pair is adjacent when its geometries
+ * intersect and their interiors overlap by a sliver at most, 1e-9 of the
+ * area of the smaller one (shared borders digitized twice overlap that
+ * little), and the length of their shared border is the length of the
+ * intersection of their boundaries.
+ *
+ * The table has columns (id, neighbour_id, border_length). Each pair is
+ * stored in both directions with (id, neighbour_id) as primary key, so
+ * the neighbours of a feature are a single index lookup. border_length
+ * is in meters (geodesic length for geographic SRIDs, CRS units
+ * otherwise); 0 means the two features only meet at a point.
+ */
+int build_adjacency(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                    const std::string &id_column, const std::string &adjacency_table, ThreadPool &pool,
+                    AdjacencySummary *summary = NULL);
+
+#endif // ADJACENCY_H
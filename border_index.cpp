@@ -0,0 +1,147 @@
+#include "border_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "geo_distance.h"
+#include "sql_util.h"
+
+namespace {
+
+/**
+ * Tells whether the SRID of a geometry column is geographic (longitude,
+ * latitude), from the SpatiaLite metadata
+ */
+bool is_geographic(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column)
+{
+    sqlite3_stmt *stmt;
+    const char *sql_cmd = "SELECT s.proj4text LIKE '%+proj=longlat%' FROM geometry_columns AS g "
+        "JOIN spatial_ref_sys AS s ON s.srid = g.srid "
+        "WHERE Lower(g.f_table_name) = Lower(?) AND Lower(g.f_geometry_column) = Lower(?)";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd, -1, &stmt, NULL) != SQLITE_OK) return false;
+    sqlite3_bind_text(stmt, 1, table_name.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, geometry_column.c_str(), -1, SQLITE_TRANSIENT);
+    const bool geographic = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 1;
+    sqlite3_finalize(stmt);
+    return geographic;
+}
+
+} // namespace
+
+BorderIndex::BorderIndex(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                         const std::string &label_column)
+{
+    geographic_ = is_geographic(db_handle, table_name, geometry_column);
+
+    sqlite3_stmt *stmt;
+    std::string sql_cmd = "SELECT " + quote_identifier(label_column) + ", " + quote_identifier(geometry_column) +
+        " FROM " + quote_identifier(table_name) + " WHERE " + quote_identifier(geometry_column) + " IS NOT NULL";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        throw std::runtime_error("Cannot read " + table_name + ": " + sqlite3_errmsg(db_handle));
+    }
+
+    // One leaf per run of consecutive segments of a ring
+    std::vector<NodeItem> items;
+    BBox extent;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Geometry geom;
+        const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 1));
+        if (!decode_spatialite_blob(blob, sqlite3_column_bytes(stmt, 1), geom)) continue;
+        if (geom.polygons.empty()) continue;
+
+        const uint32_t feature = static_cast<uint32_t>(labels_.size());
+        const unsigned char *label = sqlite3_column_text(stmt, 0);
+        labels_.push_back(label != NULL ? reinterpret_cast<const char *>(label) : "");
+
+        for (const auto &polygon : geom.polygons) {
+            for (const Ring &ring : polygon.rings) {
+                if (ring.size() < 2) continue;
+
+                const uint64_t ring_first = vertices_.size();
+                vertices_.insert(vertices_.end(), ring.begin(), ring.end());
+                const size_t segments = ring.size() - 1;
+                num_segments_ += segments;
+
+                for (size_t s = 0; s < segments; s += SEGMENTS_PER_LEAF) {
+                    const uint32_t count = static_cast<uint32_t>(std::min<size_t>(SEGMENTS_PER_LEAF, segments - s));
+                    BBox box;
+                    for (size_t i = s; i <= s + count; i++) {
+                        box.expand(ring[i].x, ring[i].y);
+                    }
+                    extent.expand(box);
+                    items.push_back(NodeItem{box.min_x, box.min_y, box.max_x, box.max_y, runs_.size()});
+                    runs_.push_back(Run{feature, count, ring_first + s});
+                }
+            }
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    hilbert_sort(items, extent);
+    index_ = PackedRTree(std::move(items));
+}
+
+BorderMatch BorderIndex::nearest(const Point &p, int64_t exclude_feature) const
+{
+    // Local equirectangular metric: a degree of longitude is cos(latitude)
+    // degrees of latitude long
+    const double kx = geographic_ ? std::cos(p.y * DEG_TO_RAD) : 1.0;
+
+    auto bound = [&](const NodeItem &node) {
+        const double dx = std::max(0.0, std::max(node.min_x - p.x, p.x - node.max_x)) * kx;
+        const double dy = std::max(0.0, std::max(node.min_y - p.y, p.y - node.max_y));
+        return dx * dx + dy * dy;
+    };
+
+    BorderMatch match;
+    double best = std::numeric_limits<double>::infinity();
+    index_.visit_nearest(bound, [&](const NodeItem &leaf, uint64_t, double leaf_bound) {
+        if (leaf_bound >= best) return false;
+
+        const Run &run = runs_[leaf.offset];
+        if (static_cast<int64_t>(run.feature) == exclude_feature) return true;
+
+        for (uint64_t i = run.first; i < run.first + run.count; i++) {
+            Point q;
+            const double d = nearest_on_segment(p, vertices_[i], vertices_[i + 1], kx, q);
+            if (d < best) {
+                best = d;
+                match.feature = run.feature;
+                match.nearest = q;
+            }
+        }
+        return true;
+    });
+
+    if (match.feature < 0) return match;
+
+    match.distance = geographic_ ? point_distance(p, match.nearest, true) : std::sqrt(best);
+    return match;
+}
+
+int64_t BorderIndex::containing(const Point &p) const
+{
+    BBox ray;
+    ray.expand(p.x, p.y);
+    ray.expand(std::max(p.x, index_.extent().max_x), p.y);
+
+    std::vector<uint8_t> parity(labels_.size(), 0);
+    visit_segments(ray, [&](int64_t feature, const Point &a, const Point &b) {
+        if ((a.y > p.y) != (b.y > p.y) && p.x < a.x + (b.x - a.x) * (p.y - a.y) / (b.y - a.y)) {
+            parity[feature] ^= 1;
+        }
+    });
+
+    for (size_t i = 0; i < parity.size(); i++) {
+        if (parity[i]) return static_cast<int64_t>(i);
+    }
+    return -1;
+}
+
+int64_t BorderIndex::feature(const std::string &label) const
+{
+    auto found = std::find(labels_.begin(), labels_.end(), label);
+    return found != labels_.end() ? found - labels_.begin() : -1;
+}
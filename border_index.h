@@ -0,0 +1,133 @@
+#ifndef BORDER_INDEX_H
+#define BORDER_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "geometry.h"
+#include "packed_rtree.h"
+
+/**
+ * Nearest boundary found by a BorderIndex
+ */
+struct BorderMatch {
+    int64_t feature = -1;   // feature whose boundary is nearest, -1 if none
+    Point nearest;          // nearest point of that boundary, in the SRID of the table
+    double distance = 0;    // metres for geographic tables, CRS units otherwise
+};
+
+/**
+ * In-memory index of the boundary segments of a polygon table, for
+ * distance-to-border queries
+ *
+ * ST_Distance against a state walks every vertex of its multipolygon, a
+ * few hundred thousand for the large ones, for every query. Here the
+ * rings are cut into runs of a few consecutive segments, each run indexed
+ * with its own bounding box in a packed Hilbert R-tree; a query walks the
+ * tree best first and stops as soon as no run can be nearer than the best
+ * segment found, so it usually tests a handful of runs.
+ *
+ * For geographic tables the search measures longitude differences scaled
+ * by the cosine of the latitude of the query point, and the distance
+ * returned is the geodesic distance to the nearest point, in metres.
+ *
+ * The index is immutable once built and can be shared between threads.
+ */
+class BorderIndex {
+public:
+    // Consecutive segments per leaf of the tree
+    static const uint32_t SEGMENTS_PER_LEAF = 8;
+
+    /**
+     * Loads the boundaries of the polygons of a table
+     *
+     * @param db_handle handle to the database connection
+     * @param table_name table holding the polygons
+     * @param geometry_column geometry column of the table
+     * @param label_column column returned for the matching feature
+     *
+     * Throws std::runtime_error if the table cannot be read.
+     */
+    BorderIndex(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                const std::string &label_column);
+
+    /**
+     * Finds the nearest boundary to a point
+     *
+     * @param p point, in the SRID of the table
+     * @param exclude_feature feature whose boundary is ignored, typically
+     *        the one containing the point, to get the nearest line with
+     *        another feature rather than its own coast; -1 for none
+     * @return nearest boundary; feature is -1 when there is none
+     */
+    BorderMatch nearest(const Point &p, int64_t exclude_feature = -1) const;
+
+    /**
+     * Finds the feature containing a point, by the even-odd rule along a
+     * ray from the point towards +x
+     *
+     * @param p point, in the SRID of the table
+     * @return index of the feature, -1 if no feature contains the point
+     */
+    int64_t containing(const Point &p) const;
+
+    /**
+     * Visits the boundary segments near a box
+     *
+     * @param box query box, in the SRID of the table
+     * @param visit callable invoked as visit(int64_t feature, const Point &a,
+     *              const Point &b) for every segment of every run whose box
+     *              intersects the query box
+     */
+    template <typename Visitor>
+    void visit_segments(const BBox &box, Visitor &&visit) const;
+
+    /**
+     * @param label value of the label column
+     * @return index of the first feature with that label, -1 if none
+     */
+    int64_t feature(const std::string &label) const;
+
+    /**
+     * @param feature feature index returned by nearest()
+     * @return value of the label column for the feature
+     */
+    const std::string &label(int64_t feature) const { return labels_[feature]; }
+
+    size_t num_features() const { return labels_.size(); }
+    size_t num_segments() const { return num_segments_; }
+    size_t num_leaves() const { return index_.num_items(); }
+    BBox extent() const { return index_.extent(); }
+    bool geographic() const { return geographic_; }
+
+private:
+    struct Run {
+        uint32_t feature;
+        uint32_t count;   // segments, from vertices_[first] to vertices_[first + count]
+        uint64_t first;
+    };
+
+    std::vector<std::string> labels_;
+    std::vector<Point> vertices_;   // all rings, one after the other
+    std::vector<Run> runs_;
+    size_t num_segments_ = 0;
+    bool geographic_ = false;
+    PackedRTree index_;   // one leaf per run, offsets are indexes into runs_
+};
+
+template <typename Visitor>
+void BorderIndex::visit_segments(const BBox &box, Visitor &&visit) const
+{
+    index_.visit(box, [&](const NodeItem &leaf, uint64_t) {
+        const Run &run = runs_[leaf.offset];
+        for (uint64_t i = run.first; i < run.first + run.count; i++) {
+            visit(static_cast<int64_t>(run.feature), vertices_[i], vertices_[i + 1]);
+        }
+        return true;
+    });
+}
+
+#endif // BORDER_INDEX_H
@@ -0,0 +1,238 @@
+#include "bulk_load.h"
+
+#include <iostream>
+#include <vector>
+
+#include "geometry.h"
+#include "packed_rtree.h"
+#include "sql_util.h"
+
+namespace {
+
+// Bulk-load profile
+const int BULK_CACHE_SIZE_KIB = 256 * 1024;
+const int BULK_PAGE_SIZE = 8192;
+
+// Layout of SQLite's R-tree module: each node uses a page minus 64 bytes,
+// a 4 byte header, and 24 bytes per 2D cell (rowid + 4 floats)
+const int RTREE_NODE_OVERHEAD = 64 + 4;
+const int RTREE_CELL_SIZE = 24;
+
+/**
+ * Runs CreateSpatialIndex(), which fills the R-tree with a scan of the
+ * table in rowid order
+ */
+int create_spatial_index(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column)
+{
+    int created = 0;
+    const std::string sql_cmd = "SELECT CreateSpatialIndex(" + quote_literal(table_name) + ", " +
+        quote_literal(geometry_column) + ")";
+    if (!query_int(db_handle, sql_cmd, created) || created != 1) {
+        std::cerr << "Error creating spatial index on " << table_name << "." << geometry_column << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace
+
+int begin_bulk_load(sqlite3 *db_handle, BulkLoadSettings &saved)
+{
+    if (!query_text(db_handle, "PRAGMA journal_mode", saved.journal_mode) ||
+        !query_int(db_handle, "PRAGMA synchronous", saved.synchronous) ||
+        !query_int(db_handle, "PRAGMA cache_size", saved.cache_size)) {
+        std::cerr << "Error reading connection settings" << std::endl;
+        return 1;
+    }
+
+    // The page size can only change before the first table is created
+    int page_count = 0;
+    if (query_int(db_handle, "PRAGMA page_count", page_count) && page_count == 0) {
+        if (exec(db_handle, "PRAGMA page_size = " + std::to_string(BULK_PAGE_SIZE), "setting page size") != 0) {
+            return 1;
+        }
+    }
+
+    std::string journal_mode;
+    if (!query_text(db_handle, "PRAGMA journal_mode = MEMORY", journal_mode)) {
+        std::cerr << "Error setting journal mode" << std::endl;
+        return 1;
+    }
+
+    if (exec(db_handle, "PRAGMA synchronous = OFF", "setting synchronous mode") != 0 ||
+        exec(db_handle, "PRAGMA cache_size = -" + std::to_string(BULK_CACHE_SIZE_KIB), "setting cache size") != 0 ||
+        exec(db_handle, "PRAGMA temp_store = MEMORY", "setting temp store") != 0) {
+        return 1;
+    }
+
+    std::cout << "Bulk-load profile: journal_mode=" << journal_mode << ", synchronous=OFF, cache_size="
+        << BULK_CACHE_SIZE_KIB / 1024 << " MiB" << std::endl;
+    return 0;
+}
+
+int end_bulk_load(sqlite3 *db_handle, const BulkLoadSettings &saved)
+{
+    std::string journal_mode;
+    if (!query_text(db_handle, "PRAGMA journal_mode = " + saved.journal_mode, journal_mode)) {
+        std::cerr << "Error restoring journal mode" << std::endl;
+        return 1;
+    }
+
+    if (exec(db_handle, "PRAGMA synchronous = " + std::to_string(saved.synchronous), "restoring synchronous mode") != 0 ||
+        exec(db_handle, "PRAGMA cache_size = " + std::to_string(saved.cache_size), "restoring cache size") != 0) {
+        return 1;
+    }
+    return 0;
+}
+
+int build_str_spatial_index(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                            bool renumber_rows)
+{
+    const std::string table = quote_identifier(table_name);
+    const std::string column = quote_identifier(geometry_column);
+    std::string sql_cmd;
+    sqlite3_stmt *stmt;
+
+    // SpatiaLite stores the names in lower case
+    int enabled = 0;
+    sql_cmd = "SELECT spatial_index_enabled FROM geometry_columns WHERE f_table_name = lower(" +
+        quote_literal(table_name) + ") AND f_geometry_column = lower(" + quote_literal(geometry_column) + ")";
+    if (!query_int(db_handle, sql_cmd, enabled)) {
+        std::cerr << "Error reading the metadata of " << table_name << "." << geometry_column << std::endl;
+        return 1;
+    }
+
+    // With no index to replace and rows that keep their order, the tree
+    // CreateSpatialIndex() fills in rowid order is kept: refilling it in STR
+    // order would build it twice
+    if (enabled == 0 && !renumber_rows) {
+        std::cout << "Building spatial index on " << table_name << "." << geometry_column << " in rowid order"
+            << std::endl;
+        return create_spatial_index(db_handle, table_name, geometry_column);
+    }
+
+    // Read every MBR straight from the BLOB headers
+    std::vector<NodeItem> items;
+    std::vector<uint64_t> empty_rows;
+
+    sql_cmd = "SELECT rowid, " + column + " FROM " + table;
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const uint64_t rowid = sqlite3_column_int64(stmt, 0);
+        const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 1));
+        BBox box;
+        if (blob != NULL && spatialite_blob_mbr(blob, sqlite3_column_bytes(stmt, 1), box)) {
+            items.push_back({box.min_x, box.min_y, box.max_x, box.max_y, rowid});
+        } else {
+            empty_rows.push_back(rowid);
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    int page_size = 4096;
+    query_int(db_handle, "PRAGMA page_size", page_size);
+    const size_t node_capacity = (page_size - RTREE_NODE_OVERHEAD) / RTREE_CELL_SIZE;
+    str_sort(items, node_capacity);
+
+    std::cout << "Building STR-packed spatial index on " << table_name << "." << geometry_column
+        << " (" << items.size() << " geometries, " << node_capacity << " entries per node)" << std::endl;
+
+    if (exec(db_handle, "BEGIN TRANSACTION;", "starting transaction") != 0) {
+        return 1;
+    }
+
+    if (renumber_rows) {
+        // Renumber the rows in STR order. Rows without a geometry go last.
+        if (exec(db_handle, "CREATE TEMP TABLE str_order (src INTEGER PRIMARY KEY, position INTEGER NOT NULL)",
+                 "creating STR order table") != 0) {
+            exec(db_handle, "ROLLBACK;", "rolling back");
+            return 1;
+        }
+
+        if (sqlite3_prepare_v2(db_handle, "INSERT INTO temp.str_order (src, position) VALUES (?, ?)", -1, &stmt,
+                               NULL) != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+            exec(db_handle, "ROLLBACK;", "rolling back");
+            return 1;
+        }
+
+        int64_t position = 0;
+        auto insert_position = [&](uint64_t rowid) {
+            sqlite3_bind_int64(stmt, 1, rowid);
+            sqlite3_bind_int64(stmt, 2, ++position);
+            bool ok = (sqlite3_step(stmt) == SQLITE_DONE);
+            sqlite3_reset(stmt);
+            return ok;
+        };
+
+        bool ok = true;
+        for (auto &item : items) {
+            ok = ok && insert_position(item.offset);
+            item.offset = position;
+        }
+        for (uint64_t rowid : empty_rows) {
+            ok = ok && insert_position(rowid);
+        }
+        sqlite3_finalize(stmt);
+
+        if (!ok) {
+            std::cerr << "Error recording STR order: " << sqlite3_errmsg(db_handle) << std::endl;
+            exec(db_handle, "ROLLBACK;", "rolling back");
+            return 1;
+        }
+
+        // Go through negative rowids so that no two rows ever collide
+        sql_cmd = "UPDATE " + table + " SET rowid = -(SELECT position FROM temp.str_order WHERE src = " + table +
+            ".rowid)";
+        if (exec(db_handle, sql_cmd, "renumbering rows") != 0 ||
+            exec(db_handle, "UPDATE " + table + " SET rowid = -rowid", "renumbering rows") != 0 ||
+            exec(db_handle, "DROP TABLE temp.str_order", "dropping STR order table") != 0) {
+            exec(db_handle, "ROLLBACK;", "rolling back");
+            return 1;
+        }
+    }
+
+    // On renumbered rows, one scan in rowid order fills the R-tree tile by tile
+    if (enabled == 0) {
+        if (create_spatial_index(db_handle, table_name, geometry_column) != 0) {
+            exec(db_handle, "ROLLBACK;", "rolling back");
+            return 1;
+        }
+        return exec(db_handle, "COMMIT;", "committing transaction");
+    }
+
+    // Otherwise the existing R-tree is emptied and refilled in STR order
+    const std::string rtree = quote_identifier("idx_" + table_name + "_" + geometry_column);
+    if (exec(db_handle, "DELETE FROM " + rtree, "emptying spatial index") != 0) {
+        exec(db_handle, "ROLLBACK;", "rolling back");
+        return 1;
+    }
+
+    sql_cmd = "INSERT INTO " + rtree + " (pkid, xmin, xmax, ymin, ymax) VALUES (?, ?, ?, ?, ?)";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        exec(db_handle, "ROLLBACK;", "rolling back");
+        return 1;
+    }
+
+    for (const auto &item : items) {
+        sqlite3_bind_int64(stmt, 1, item.offset);
+        sqlite3_bind_double(stmt, 2, item.min_x);
+        sqlite3_bind_double(stmt, 3, item.max_x);
+        sqlite3_bind_double(stmt, 4, item.min_y);
+        sqlite3_bind_double(stmt, 5, item.max_y);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "Error filling spatial index: " << sqlite3_errmsg(db_handle) << std::endl;
+            sqlite3_finalize(stmt);
+            exec(db_handle, "ROLLBACK;", "rolling back");
+            return 1;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    return exec(db_handle, "COMMIT;", "committing transaction");
+}
@@ -0,0 +1,67 @@
+#ifndef BULK_LOAD_H
+#define BULK_LOAD_H
+
+#include <string>
+
+#include <sqlite3.h>
+
+/**
+ * Connection settings changed by begin_bulk_load(), to be restored by
+ * end_bulk_load()
+ */
+struct BulkLoadSettings {
+    std::string journal_mode;
+    int synchronous = 2;
+    int cache_size = -2000;
+};
+
+/**
+ * Switches a connection to the bulk-load profile for first-time imports
+ *
+ * @param db_handle handle to the database connection
+ * @param saved settings in effect before the switch
+ * @return 0 on success, 1 on failure
+ *
+ * Uses an in-memory rollback journal, no fsync, a 256 MiB page cache and
+ * in-memory temporary storage. On a database that is still empty the page
+ * size is also raised to 8 KiB, which suits large geometry BLOBs; call this
+ * right after opening the database, before InitSpatialMetaData(), for that
+ * to take effect. A crash during the load can corrupt the database, which
+ * is acceptable for a load that can simply be redone from the sources.
+ */
+int begin_bulk_load(sqlite3 *db_handle, BulkLoadSettings &saved);
+
+/**
+ * Restores the settings saved by begin_bulk_load()
+ *
+ * @param db_handle handle to the database connection
+ * @param saved settings returned by begin_bulk_load()
+ * @return 0 on success, 1 on failure
+ */
+int end_bulk_load(sqlite3 *db_handle, const BulkLoadSettings &saved);
+
+/**
+ * Builds the SpatiaLite spatial index of a freshly loaded table in one
+ * Sort-Tile-Recursive packed pass
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table holding the geometries
+ * @param geometry_column geometry column to index
+ * @param renumber_rows true if the current load created every row of the
+ *        table, which may then be renumbered
+ * @return 0 on success, 1 on failure
+ *
+ * The MBRs are read from the BLOB headers and sorted in STR order. When the
+ * rows may be renumbered, their rowids are rewritten to follow that order
+ * and CreateSpatialIndex() fills the R-tree with a single scan in rowid
+ * order, so each R-tree node receives a compact tile of neighbouring
+ * geometries instead of rows in import order, and neighbouring geometries
+ * also share table pages. Otherwise the rows keep their primary keys: an
+ * existing R-tree is emptied and refilled in STR order, while a table with
+ * no spatial index yet gets the one CreateSpatialIndex() fills in rowid
+ * order, rather than building the R-tree twice.
+ */
+int build_str_spatial_index(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                            bool renumber_rows);
+
+#endif // BULK_LOAD_H
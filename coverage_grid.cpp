@@ -0,0 +1,172 @@
+#include "coverage_grid.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Cells not classified yet
+const int32_t UNVISITED = -3;
+
+uint32_t clamp_index(double value, uint32_t size)
+{
+    if (!(value > 0)) return 0;   // also catches NaN
+    return std::min(static_cast<uint32_t>(value), size - 1);
+}
+
+} // namespace
+
+CoverageGrid::CoverageGrid(const BBox &extent, uint32_t size)
+    : extent_(extent), size_(size)
+{
+    if (size_ == 0 || extent_.empty()) {
+        size_ = 0;
+        return;
+    }
+    cell_width_ = (extent_.max_x - extent_.min_x) / size_;
+    cell_height_ = (extent_.max_y - extent_.min_y) / size_;
+    if (!(cell_width_ > 0) || !(cell_height_ > 0)) {
+        size_ = 0;
+        return;
+    }
+    cells_.assign(static_cast<size_t>(size_) * size_, UNVISITED);
+}
+
+void CoverageGrid::mark_segment(const Point &a, const Point &b)
+{
+    if (cells_.empty()) return;
+
+    // Walk the segment in steps of at most half a cell and mark the cells
+    // under the box of each step, which covers every cell it crosses
+    const double span = std::max(std::fabs(b.x - a.x) / cell_width_, std::fabs(b.y - a.y) / cell_height_);
+    const int steps = static_cast<int>(std::ceil(span * 2)) + 1;
+
+    Point from = a;
+    for (int i = 1; i <= steps; i++) {
+        const double t = static_cast<double>(i) / steps;
+        const Point to{a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t};
+
+        const uint32_t col0 = clamp_index((std::min(from.x, to.x) - extent_.min_x) / cell_width_, size_);
+        const uint32_t col1 = clamp_index((std::max(from.x, to.x) - extent_.min_x) / cell_width_, size_);
+        const uint32_t row0 = clamp_index((std::min(from.y, to.y) - extent_.min_y) / cell_height_, size_);
+        const uint32_t row1 = clamp_index((std::max(from.y, to.y) - extent_.min_y) / cell_height_, size_);
+        for (uint32_t row = row0; row <= row1; row++) {
+            for (uint32_t col = col0; col <= col1; col++) {
+                cells_[static_cast<size_t>(row) * size_ + col] = MIXED;
+            }
+        }
+        from = to;
+    }
+}
+
+void CoverageGrid::fill(const std::function<int64_t(const Point &)> &classify)
+{
+    std::vector<size_t> stack;
+    for (size_t start = 0; start < cells_.size(); start++) {
+        if (cells_[start] != UNVISITED) continue;
+
+        const uint32_t start_row = static_cast<uint32_t>(start / size_);
+        const uint32_t start_col = static_cast<uint32_t>(start % size_);
+        const Point center{extent_.min_x + (start_col + 0.5) * cell_width_,
+                           extent_.min_y + (start_row + 0.5) * cell_height_};
+        const int64_t feature = classify(center);
+        const int32_t value = feature >= 0 ? static_cast<int32_t>(feature) : EMPTY;
+
+        // Flood the region no edge crosses
+        cells_[start] = value;
+        stack.push_back(start);
+        while (!stack.empty()) {
+            const size_t cell = stack.back();
+            stack.pop_back();
+            const uint32_t row = static_cast<uint32_t>(cell / size_);
+            const uint32_t col = static_cast<uint32_t>(cell % size_);
+
+            const size_t neighbours[4] = {
+                col > 0 ? cell - 1 : cell,
+                col + 1 < size_ ? cell + 1 : cell,
+                row > 0 ? cell - size_ : cell,
+                row + 1 < size_ ? cell + size_ : cell,
+            };
+            for (size_t neighbour : neighbours) {
+                if (cells_[neighbour] == UNVISITED) {
+                    cells_[neighbour] = value;
+                    stack.push_back(neighbour);
+                }
+            }
+        }
+    }
+}
+
+bool CoverageGrid::cell_of(const Point &p, uint32_t &col, uint32_t &row) const
+{
+    if (cells_.empty() || !extent_.contains(p.x, p.y)) return false;
+    col = clamp_index((p.x - extent_.min_x) / cell_width_, size_);
+    row = clamp_index((p.y - extent_.min_y) / cell_height_, size_);
+    return true;
+}
+
+int32_t CoverageGrid::value(const Point &p) const
+{
+    if (cells_.empty()) return MIXED;
+
+    uint32_t col, row;
+    if (!cell_of(p, col, row)) return EMPTY;
+    return cells_[static_cast<size_t>(row) * size_ + col];
+}
+
+size_t CoverageGrid::count(int32_t value) const
+{
+    return static_cast<size_t>(std::count(cells_.begin(), cells_.end(), value));
+}
+
+bool NegativeCache::contains(uint64_t key) const
+{
+    const Shard &s = shard(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.keys.count(key) > 0;
+}
+
+void NegativeCache::insert(uint64_t key)
+{
+    Shard &s = shard(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.keys.size() < max_entries_per_shard_) {
+        s.keys.insert(key);
+    }
+}
+
+size_t NegativeCache::size() const
+{
+    size_t total = 0;
+    for (const Shard &s : shards_) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        total += s.keys.size();
+    }
+    return total;
+}
+
+bool segment_intersects_box(const Point &a, const Point &b, const BBox &box)
+{
+    // Liang-Barsky clipping of the segment against the box
+    double t0 = 0;
+    double t1 = 1;
+    const double dx = b.x - a.x;
+    const double dy = b.y - a.y;
+    const double p[4] = {-dx, dx, -dy, dy};
+    const double q[4] = {a.x - box.min_x, box.max_x - a.x, a.y - box.min_y, box.max_y - a.y};
+
+    for (int i = 0; i < 4; i++) {
+        if (p[i] == 0) {
+            if (q[i] < 0) return false;
+            continue;
+        }
+        const double t = q[i] / p[i];
+        if (p[i] < 0) {
+            t0 = std::max(t0, t);
+        } else {
+            t1 = std::min(t1, t);
+        }
+        if (t0 > t1) return false;
+    }
+    return true;
+}
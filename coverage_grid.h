@@ -0,0 +1,115 @@
+#ifndef COVERAGE_GRID_H
+#define COVERAGE_GRID_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include "geometry.h"
+
+/**
+ * Coarse raster of the coverage of a polygon dataset
+ *
+ * Every cell crossed by a ring edge is MIXED. The other cells are either
+ * entirely inside one feature or entirely EMPTY, and connected cells that
+ * no edge separates share the same answer, so fill() classifies a single
+ * cell center per connected region. Points outside the extent, in an
+ * EMPTY cell or in a cell covered by one feature are answered from the
+ * grid in O(1); only MIXED cells need a point-in-polygon test.
+ */
+class CoverageGrid {
+public:
+    static const int32_t EMPTY = -1;   // no feature in the cell
+    static const int32_t MIXED = -2;   // a ring edge crosses the cell
+
+    CoverageGrid() = default;
+
+    /**
+     * @param extent area covered by the grid, usually the dataset extent
+     * @param size number of cells per side
+     */
+    CoverageGrid(const BBox &extent, uint32_t size);
+
+    bool empty() const { return cells_.empty(); }
+    uint32_t size() const { return size_; }
+
+    /**
+     * Marks the cells crossed by a segment as MIXED
+     */
+    void mark_segment(const Point &a, const Point &b);
+
+    /**
+     * Classifies the cells not marked MIXED
+     *
+     * @param classify returns the feature containing a point, or -1
+     */
+    void fill(const std::function<int64_t(const Point &)> &classify);
+
+    /**
+     * @param p point to look up
+     * @return feature covering the cell of the point, EMPTY (also outside
+     *         the extent) or MIXED
+     */
+    int32_t value(const Point &p) const;
+
+    /**
+     * Locates the cell of a point
+     *
+     * @return false if the point is outside the grid
+     */
+    bool cell_of(const Point &p, uint32_t &col, uint32_t &row) const;
+
+    /**
+     * @return number of cells holding the given value
+     */
+    size_t count(int32_t value) const;
+
+    double cell_width() const { return cell_width_; }
+    double cell_height() const { return cell_height_; }
+    const BBox &extent() const { return extent_; }
+
+private:
+    BBox extent_;
+    uint32_t size_ = 0;
+    double cell_width_ = 0;
+    double cell_height_ = 0;
+    std::vector<int32_t> cells_;   // row major, row 0 at min_y
+};
+
+/**
+ * Thread-safe set of cells known to contain no feature
+ *
+ * Keys are split over independently locked shards, so lookups from many
+ * threads rarely wait on each other. The cache stops growing once it
+ * holds max_entries keys.
+ */
+class NegativeCache {
+public:
+    explicit NegativeCache(size_t max_entries = 1 << 20) : max_entries_per_shard_(max_entries / SHARDS) {}
+
+    bool contains(uint64_t key) const;
+    void insert(uint64_t key);
+    size_t size() const;
+
+private:
+    static const size_t SHARDS = 16;
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_set<uint64_t> keys;
+    };
+
+    Shard &shard(uint64_t key) const { return shards_[(key * 0x9E3779B97F4A7C15ULL) >> 60]; }
+
+    size_t max_entries_per_shard_;
+    mutable Shard shards_[SHARDS];
+};
+
+/**
+ * @return true if the segment ab crosses or touches the box
+ */
+bool segment_intersects_box(const Point &a, const Point &b, const BBox &box);
+
+#endif // COVERAGE_GRID_H
@@ -0,0 +1,201 @@
+#include "density_clustering.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#include "geo_distance.h"
+#include "packed_rtree.h"
+#include "sql_util.h"
+#include "thread_pool.h"
+
+namespace {
+
+// Points per partition
+const size_t CLUSTER_PARTITION_SIZE = 4096;
+
+/**
+ * Box around a point holding everything within the distance of it
+ */
+BBox neighbourhood(const Point &p, double distance, bool geographic)
+{
+    double dx, dy;
+    search_window(distance, geographic, std::fabs(p.y), dx, dy);
+    BBox box;
+    box.expand(p.x - dx, p.y - dy);
+    box.expand(p.x + dx, p.y + dy);
+    return box;
+}
+
+size_t find_root(std::vector<size_t> &parent, size_t i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+void unite(std::vector<size_t> &parent, size_t a, size_t b)
+{
+    a = find_root(parent, a);
+    b = find_root(parent, b);
+    if (a != b) parent[std::max(a, b)] = std::min(a, b);
+}
+
+} // namespace
+
+std::vector<int64_t> dbscan(const std::vector<JoinPoint> &points, double distance, size_t min_points,
+                            bool geographic, ThreadPool &pool, DbscanStats *stats)
+{
+    // Hilbert order: a leaf of the tree is at the same position in the
+    // sorted points, and its partition is position / partition size
+    std::vector<NodeItem> items;
+    BBox extent;
+    for (size_t i = 0; i < points.size(); i++) {
+        const Point &p = points[i].point;
+        extent.expand(p.x, p.y);
+        items.push_back(NodeItem{p.x, p.y, p.x, p.y, i});
+    }
+    hilbert_sort(items, extent);
+    const PackedRTree index(items);
+
+    const size_t num_points = items.size();
+    const size_t num_partitions = (num_points + CLUSTER_PARTITION_SIZE - 1) / CLUSTER_PARTITION_SIZE;
+    auto point_at = [&](size_t position) { return Point{items[position].min_x, items[position].min_y}; };
+
+    // Core points
+    std::vector<uint8_t> core(num_points, 0);
+    pool.parallel_for(num_partitions, [&](size_t partition, unsigned) {
+        const size_t first = partition * CLUSTER_PARTITION_SIZE;
+        const size_t last = std::min(first + CLUSTER_PARTITION_SIZE, num_points);
+        for (size_t i = first; i < last; i++) {
+            const Point p = point_at(i);
+            size_t neighbours = 0;
+            index.visit(neighbourhood(p, distance, geographic), [&](const NodeItem &leaf, uint64_t) {
+                if (point_distance(p, Point{leaf.min_x, leaf.min_y}, geographic) <= distance) neighbours++;
+                return neighbours < min_points;
+            });
+            core[i] = neighbours >= min_points ? 1 : 0;
+        }
+    });
+
+    // Clusters of each partition, the links leaving it, and the nearest
+    // core point of the others. A partition only ever touches the parents
+    // of its own points, so the union-finds run side by side.
+    const size_t NONE = std::numeric_limits<size_t>::max();
+    std::vector<size_t> parent(num_points);
+    std::vector<size_t> attached(num_points, NONE);
+    std::vector<std::vector<std::pair<size_t, size_t>>> links(num_partitions);
+    for (size_t i = 0; i < num_points; i++) parent[i] = i;
+
+    pool.parallel_for(num_partitions, [&](size_t partition, unsigned) {
+        const size_t first = partition * CLUSTER_PARTITION_SIZE;
+        const size_t last = std::min(first + CLUSTER_PARTITION_SIZE, num_points);
+        for (size_t i = first; i < last; i++) {
+            const Point p = point_at(i);
+            double nearest = std::numeric_limits<double>::infinity();
+            index.visit(neighbourhood(p, distance, geographic), [&](const NodeItem &leaf, uint64_t j) {
+                if (j == i || !core[j]) return true;
+                // Each link between two core points is seen from both
+                // ends; the partition holding the lower one records it
+                if (core[i] && j < i) return true;
+
+                const double d = point_distance(p, Point{leaf.min_x, leaf.min_y}, geographic);
+                if (d > distance) return true;
+
+                if (!core[i]) {
+                    if (d < nearest || (d == nearest && j < attached[i])) {
+                        nearest = d;
+                        attached[i] = j;
+                    }
+                } else if (j < last) {
+                    unite(parent, i, j);
+                } else {
+                    links[partition].emplace_back(i, j);
+                }
+                return true;
+            });
+        }
+    });
+
+    // Merge the clusters across partitions
+    uint64_t cross_links = 0;
+    for (const auto &partition_links : links) {
+        for (const auto &link : partition_links) {
+            unite(parent, link.first, link.second);
+        }
+        cross_links += partition_links.size();
+    }
+
+    // Number the clusters in the order of the input points
+    std::vector<int64_t> clusters(points.size(), -1);
+    std::vector<int64_t> root_cluster(num_points, -1);
+    std::vector<size_t> position(points.size());
+    for (size_t i = 0; i < num_points; i++) position[items[i].offset] = i;
+
+    int64_t num_clusters = 0;
+    uint64_t core_points = 0;
+    for (size_t k = 0; k < points.size(); k++) {
+        const size_t i = position[k];
+        const size_t owner = core[i] ? i : attached[i];
+        if (owner == NONE) continue;
+
+        const size_t root = find_root(parent, owner);
+        if (root_cluster[root] < 0) root_cluster[root] = num_clusters++;
+        clusters[k] = root_cluster[root];
+        core_points += core[i];
+    }
+
+    if (stats != NULL) {
+        stats->partitions += num_partitions;
+        stats->core_points += core_points;
+        stats->clusters += num_clusters;
+        stats->noise += std::count(clusters.begin(), clusters.end(), -1);
+        stats->cross_links += cross_links;
+    }
+    return clusters;
+}
+
+int store_clusters(sqlite3 *db_handle, const std::string &table_name, const std::vector<JoinPoint> &points,
+                   const std::vector<int64_t> &clusters)
+{
+    const std::string table = quote_identifier(table_name);
+    if (add_column(db_handle, table, "cluster_id", "INTEGER") != 0) {
+        return 1;
+    }
+
+    sqlite3_stmt *stmt;
+    const std::string sql_cmd = "UPDATE " + table + " SET cluster_id = ? WHERE rowid = ?";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+
+    if (exec(db_handle, "BEGIN TRANSACTION;", "starting transaction") != 0) {
+        sqlite3_finalize(stmt);
+        return 1;
+    }
+
+    // Noise is written too, as NULL, over the clusters of an earlier run
+    for (size_t i = 0; i < points.size(); i++) {
+        if (clusters[i] >= 0) {
+            sqlite3_bind_int64(stmt, 1, clusters[i]);
+        } else {
+            sqlite3_bind_null(stmt, 1);
+        }
+        sqlite3_bind_int64(stmt, 2, points[i].id);
+
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "Error updating point " << points[i].id << ": " << sqlite3_errmsg(db_handle) << std::endl;
+            sqlite3_finalize(stmt);
+            exec(db_handle, "ROLLBACK;", "rolling back");
+            return 1;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    return exec(db_handle, "COMMIT;", "committing transaction");
+}
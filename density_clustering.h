@@ -0,0 +1,61 @@
+#ifndef DENSITY_CLUSTERING_H
+#define DENSITY_CLUSTERING_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "distance_join.h"
+
+class ThreadPool;
+
+struct DbscanStats {
+    uint64_t partitions = 0;    // tasks the points were split into
+    uint64_t core_points = 0;   // points with at least min_points neighbours
+    uint64_t clusters = 0;
+    uint64_t noise = 0;         // points in no cluster
+    uint64_t cross_links = 0;   // core pairs joining clusters of two partitions
+};
+
+/**
+ * Clusters points by density (DBSCAN)
+ *
+ * @param points points to cluster
+ * @param distance neighbourhood radius, in metres for geographic data
+ * @param min_points neighbours (the point included) that make a point a
+ *        core point
+ * @param geographic true if the points are longitude/latitude
+ * @param pool threads running the partitions
+ * @param stats counters (may be NULL)
+ * @return cluster of each point, in the order of points: 0, 1... numbered
+ *         in order of first appearance, -1 for noise
+ *
+ * The points are sorted along a Hilbert curve, indexed in a packed R-tree
+ * and cut into partitions of nearby points. In parallel, each partition
+ * first finds its core points, then links each of them to the core points
+ * within the distance in a union-find restricted to the partition, and
+ * attaches every other point to its nearest core point, if any. The links
+ * crossing two partitions are kept aside and merge the clusters of the
+ * partitions at the end, in one pass. A border point reachable from two
+ * clusters goes to the one of its nearest core point, so the result does
+ * not depend on the number of threads.
+ */
+std::vector<int64_t> dbscan(const std::vector<JoinPoint> &points, double distance, size_t min_points,
+                            bool geographic, ThreadPool &pool, DbscanStats *stats = NULL);
+
+/**
+ * Stores the cluster of every point in a `cluster_id` column
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table the points were read from
+ * @param points points, with their rowid
+ * @param clusters cluster of each point, as returned by dbscan(); noise
+ *        is stored as NULL
+ * @return 0 on success, 1 on failure
+ */
+int store_clusters(sqlite3 *db_handle, const std::string &table_name, const std::vector<JoinPoint> &points,
+                   const std::vector<int64_t> &clusters);
+
+#endif // DENSITY_CLUSTERING_H
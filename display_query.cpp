@@ -0,0 +1,385 @@
+#include "display_query.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+#include "sql_util.h"
+#include "thread_pool.h"
+
+namespace {
+
+BBox ring_bbox(const Ring &ring)
+{
+    BBox box;
+    for (const Point &p : ring) {
+        box.expand(p.x, p.y);
+    }
+    return box;
+}
+
+bool box_contains(const BBox &outer, const BBox &inner)
+{
+    return inner.min_x >= outer.min_x && inner.max_x <= outer.max_x &&
+           inner.min_y >= outer.min_y && inner.max_y <= outer.max_y;
+}
+
+// Clips an open polygon against one side of a box; inside(p) tells
+// whether p is on the kept side and cross(a, b) where ab crosses it
+template <typename Inside, typename Cross>
+void clip_side(const std::vector<Point> &input, std::vector<Point> &output, Inside inside, Cross cross)
+{
+    output.clear();
+    if (input.empty()) return;
+
+    Point previous = input.back();
+    bool previous_inside = inside(previous);
+    for (const Point &p : input) {
+        const bool p_inside = inside(p);
+        if (p_inside != previous_inside) output.push_back(cross(previous, p));
+        if (p_inside) output.push_back(p);
+        previous = p;
+        previous_inside = p_inside;
+    }
+}
+
+double squared_segment_distance(const Point &p, const Point &a, const Point &b)
+{
+    double x = a.x;
+    double y = a.y;
+    const double dx = b.x - a.x;
+    const double dy = b.y - a.y;
+    if (dx != 0 || dy != 0) {
+        const double t = ((p.x - a.x) * dx + (p.y - a.y) * dy) / (dx * dx + dy * dy);
+        if (t > 1) {
+            x = b.x;
+            y = b.y;
+        } else if (t > 0) {
+            x += dx * t;
+            y += dy * t;
+        }
+    }
+    return (p.x - x) * (p.x - x) + (p.y - y) * (p.y - y);
+}
+
+/**
+ * Marks the vertices Douglas-Peucker keeps between the ends of each span
+ * of the stack, the ends being kept already
+ */
+void douglas_peucker(const std::vector<Point> &points, std::vector<std::pair<size_t, size_t>> stack, double tolerance,
+                     std::vector<bool> &keep)
+{
+    const double squared_tolerance = tolerance * tolerance;
+    while (!stack.empty()) {
+        const size_t first = stack.back().first;
+        const size_t last = stack.back().second;
+        stack.pop_back();
+
+        size_t index = 0;
+        double max_squared = squared_tolerance;
+        for (size_t i = first + 1; i < last; i++) {
+            const double d = squared_segment_distance(points[i], points[first], points[last]);
+            if (d > max_squared) {
+                max_squared = d;
+                index = i;
+            }
+        }
+        if (index != 0) {
+            keep[index] = true;
+            stack.emplace_back(first, index);
+            stack.emplace_back(index, last);
+        }
+    }
+}
+
+} // namespace
+
+Ring clip_ring(const Ring &ring, const BBox &box)
+{
+    if (ring.size() < 4) return Ring();
+
+    // Open ring, clipped against each side in turn
+    std::vector<Point> current(ring.begin(), ring.end() - 1);
+    std::vector<Point> next;
+
+    clip_side(current, next, [&](const Point &p) { return p.x >= box.min_x; },
+              [&](const Point &a, const Point &b) {
+                  return Point{box.min_x, a.y + (b.y - a.y) * (box.min_x - a.x) / (b.x - a.x)};
+              });
+    std::swap(current, next);
+    clip_side(current, next, [&](const Point &p) { return p.x <= box.max_x; },
+              [&](const Point &a, const Point &b) {
+                  return Point{box.max_x, a.y + (b.y - a.y) * (box.max_x - a.x) / (b.x - a.x)};
+              });
+    std::swap(current, next);
+    clip_side(current, next, [&](const Point &p) { return p.y >= box.min_y; },
+              [&](const Point &a, const Point &b) {
+                  return Point{a.x + (b.x - a.x) * (box.min_y - a.y) / (b.y - a.y), box.min_y};
+              });
+    std::swap(current, next);
+    clip_side(current, next, [&](const Point &p) { return p.y <= box.max_y; },
+              [&](const Point &a, const Point &b) {
+                  return Point{a.x + (b.x - a.x) * (box.max_y - a.y) / (b.y - a.y), box.max_y};
+              });
+
+    if (next.size() < 3) return Ring();
+    next.push_back(next.front());
+    return next;
+}
+
+Ring simplify_ring(const Ring &ring, double tolerance)
+{
+    const size_t n = ring.size();
+    if (n <= 4 || !(tolerance > 0)) return ring;
+
+    // The first and last vertices are the same point: split the ring at
+    // the vertex farthest from it and simplify both halves
+    size_t farthest = 0;
+    double max_distance = -1;
+    for (size_t i = 1; i + 1 < n; i++) {
+        const double dx = ring[i].x - ring[0].x;
+        const double dy = ring[i].y - ring[0].y;
+        if (dx * dx + dy * dy > max_distance) {
+            max_distance = dx * dx + dy * dy;
+            farthest = i;
+        }
+    }
+
+    std::vector<bool> keep(n, false);
+    keep[0] = keep[farthest] = keep[n - 1] = true;
+    douglas_peucker(ring, {{0, farthest}, {farthest, n - 1}}, tolerance, keep);
+
+    Ring simplified;
+    for (size_t i = 0; i < n; i++) {
+        if (keep[i]) simplified.push_back(ring[i]);
+    }
+    return simplified;
+}
+
+std::vector<Point> simplify_arc(const std::vector<Point> &arc, double tolerance)
+{
+    const size_t n = arc.size();
+    if (n <= 2 || !(tolerance > 0)) return arc;
+    if (arc.front().x == arc.back().x && arc.front().y == arc.back().y) return simplify_ring(arc, tolerance);
+
+    std::vector<bool> keep(n, false);
+    keep[0] = keep[n - 1] = true;
+    douglas_peucker(arc, {{0, n - 1}}, tolerance, keep);
+
+    std::vector<Point> simplified;
+    for (size_t i = 0; i < n; i++) {
+        if (keep[i]) simplified.push_back(arc[i]);
+    }
+    return simplified;
+}
+
+DisplayQuery::DisplayQuery(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                           const std::string &label_column, ThreadPool &pool, size_t cache_capacity,
+                           const std::string &topology_prefix)
+    : pool_(pool), cache_(cache_capacity)
+{
+    sqlite3_stmt *stmt;
+    std::vector<std::string> labels;
+    if (!topology_prefix.empty()) {
+        std::vector<int64_t> feature_ids;
+        if (read_topology_tables(db_handle, topology_prefix, topology_, feature_ids, srid_) != 0) {
+            throw std::runtime_error("Cannot read the topology of " + table_name);
+        }
+
+        // The rings reference the features by rowid
+        std::string sql_cmd = "SELECT rowid, " + quote_identifier(label_column) + " FROM " +
+            quote_identifier(table_name);
+        if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+            throw std::runtime_error("Cannot read " + table_name + ": " + sqlite3_errmsg(db_handle));
+        }
+        labels.resize(feature_ids.size());
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            auto it = std::lower_bound(feature_ids.begin(), feature_ids.end(), sqlite3_column_int64(stmt, 0));
+            const unsigned char *label = sqlite3_column_text(stmt, 1);
+            if (it != feature_ids.end() && *it == sqlite3_column_int64(stmt, 0) && label != NULL) {
+                labels[it - feature_ids.begin()] = reinterpret_cast<const char *>(label);
+            }
+        }
+        sqlite3_finalize(stmt);
+    } else {
+        std::string sql_cmd = "SELECT " + quote_identifier(label_column) + ", " + quote_identifier(geometry_column) +
+            " FROM " + quote_identifier(table_name) + " WHERE " + quote_identifier(geometry_column) + " IS NOT NULL";
+        if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+            throw std::runtime_error("Cannot read " + table_name + ": " + sqlite3_errmsg(db_handle));
+        }
+
+        std::vector<Geometry> geometries;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            Geometry geometry;
+            const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 1));
+            if (!decode_spatialite_blob(blob, sqlite3_column_bytes(stmt, 1), geometry)) continue;
+            if (geometry.polygons.empty()) continue;
+
+            const unsigned char *label = sqlite3_column_text(stmt, 0);
+            labels.push_back(label != NULL ? reinterpret_cast<const char *>(label) : "");
+            srid_ = geometry.srid;
+            geometries.push_back(std::move(geometry));
+        }
+        sqlite3_finalize(stmt);
+        topology_ = build_topology(geometries);
+    }
+
+    features_.resize(labels.size());
+    for (size_t i = 0; i < labels.size(); i++) {
+        features_[i].label = std::move(labels[i]);
+    }
+    index_features();
+
+    BBox extent;
+    for (const Feature &feature : features_) {
+        extent.expand(feature.box);
+    }
+    if (!extent.empty()) {
+        world_size_ = std::max(extent.max_x - extent.min_x, extent.max_y - extent.min_y);
+        origin_x_ = extent.min_x;
+        origin_y_ = extent.max_y;
+    }
+}
+
+void DisplayQuery::index_features()
+{
+    // Rings come sorted by feature, polygon and ring
+    std::vector<size_t> last_polygon(features_.size(), SIZE_MAX);
+    for (size_t k = 0; k < topology_.rings.size(); k++) {
+        const TopoRing &ring = topology_.rings[k];
+        Feature &feature = features_[ring.feature];
+        if (ring.ring == 0) {
+            feature.polygons.emplace_back();
+            last_polygon[ring.feature] = ring.polygon;
+        } else if (last_polygon[ring.feature] != ring.polygon) {
+            continue;   // no exterior ring, no holes
+        }
+        feature.polygons.back().push_back(k);
+
+        // Consecutive arcs share a vertex
+        feature.num_vertices += 1;
+        for (int64_t ref : ring.arcs) {
+            const std::vector<Point> &arc = topology_.arcs[ref < 0 ? ~ref : ref];
+            feature.num_vertices += arc.size() - 1;
+            if (ring.ring == 0) feature.box.expand(ring_bbox(arc));
+        }
+    }
+}
+
+const std::vector<std::vector<Point>> &DisplayQuery::simplified_arcs(const std::vector<size_t> &features,
+                                                                     double pixel_size) const
+{
+    if (simplified_.size() != topology_.arcs.size() || simplified_pixel_size_ != pixel_size) {
+        simplified_.assign(topology_.arcs.size(), std::vector<Point>());
+        simplified_pixel_size_ = pixel_size;
+    }
+
+    // Arcs of the features not simplified at this pixel size yet
+    std::vector<size_t> missing;
+    std::vector<bool> queued(topology_.arcs.size(), false);
+    for (size_t f : features) {
+        for (const auto &polygon : features_[f].polygons) {
+            for (size_t k : polygon) {
+                for (int64_t ref : topology_.rings[k].arcs) {
+                    const size_t arc = static_cast<size_t>(ref < 0 ? ~ref : ref);
+                    if (simplified_[arc].empty() && !queued[arc]) {
+                        queued[arc] = true;
+                        missing.push_back(arc);
+                    }
+                }
+            }
+        }
+    }
+
+    pool_.parallel_for(missing.size(), [&](size_t index, unsigned) {
+        simplified_[missing[index]] = simplify_arc(topology_.arcs[missing[index]], pixel_size);
+    });
+    return simplified_;
+}
+
+DisplayTile DisplayQuery::query(const BBox &bbox, double pixel_size) const
+{
+    // A one pixel margin keeps the clipped edges out of sight
+    BBox clip = bbox;
+    clip.expand(bbox.min_x - pixel_size, bbox.min_y - pixel_size);
+    clip.expand(bbox.max_x + pixel_size, bbox.max_y + pixel_size);
+
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < features_.size(); i++) {
+        if (features_[i].box.intersects(clip)) candidates.push_back(i);
+    }
+
+    struct Result {
+        Geometry geometry;
+        uint64_t output_vertices = 0;
+    };
+    std::vector<Result> results(candidates.size());
+
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    const std::vector<std::vector<Point>> &arcs = simplified_arcs(candidates, pixel_size);
+
+    // One task per feature: a few large states take most of the time
+    pool_.parallel_for(candidates.size(), [&](size_t index, unsigned) {
+        const Feature &feature = features_[candidates[index]];
+        Result &result = results[index];
+        result.geometry.type = GeometryType::MultiPolygon;
+        result.geometry.srid = srid_;
+
+        for (const auto &polygon : feature.polygons) {
+            Polygon display;
+            for (size_t r = 0; r < polygon.size(); r++) {
+                Ring ring = topology_ring(arcs, topology_.rings[polygon[r]].arcs);
+                const BBox box = ring_bbox(ring);
+                Ring clipped;
+                if (box_contains(clip, box)) {
+                    clipped = std::move(ring);
+                } else if (box.intersects(clip)) {
+                    clipped = clip_ring(ring, clip);
+                }
+
+                if (clipped.size() < 4) {
+                    if (r == 0) break;   // no exterior ring, no holes
+                    continue;
+                }
+                result.output_vertices += clipped.size();
+                display.rings.push_back(std::move(clipped));
+            }
+            if (!display.rings.empty()) result.geometry.polygons.push_back(std::move(display));
+        }
+    });
+
+    DisplayTile tile;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        Result &result = results[i];
+        tile.input_vertices += features_[candidates[i]].num_vertices;
+        if (result.geometry.polygons.empty()) continue;
+
+        tile.output_vertices += result.output_vertices;
+        const int64_t feature = static_cast<int64_t>(candidates[i]);
+        tile.features.push_back(DisplayFeature{feature, features_[feature].label, std::move(result.geometry)});
+    }
+    return tile;
+}
+
+BBox DisplayQuery::tile_bbox(uint32_t z, uint32_t x, uint32_t y) const
+{
+    const double size = world_size_ / (1u << z);
+    BBox box;
+    box.expand(origin_x_ + x * size, origin_y_ - (y + 1) * size);
+    box.expand(origin_x_ + (x + 1) * size, origin_y_ - y * size);
+    return box;
+}
+
+std::shared_ptr<const DisplayTile> DisplayQuery::tile(uint32_t z, uint32_t x, uint32_t y)
+{
+    if (z > MAX_ZOOM || x >= (1u << z) || y >= (1u << z)) {
+        throw std::runtime_error("No tile " + std::to_string(z) + "/" + std::to_string(x) + "/" + std::to_string(y));
+    }
+
+    const uint64_t key = (static_cast<uint64_t>(z) << 48) | (static_cast<uint64_t>(x) << 24) | y;
+    return cache_.get(key, [&]() {
+        const BBox box = tile_bbox(z, x, y);
+        return std::make_shared<const DisplayTile>(query(box, (box.max_x - box.min_x) / TILE_PIXELS));
+    });
+}
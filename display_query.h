@@ -0,0 +1,169 @@
+#ifndef DISPLAY_QUERY_H
+#define DISPLAY_QUERY_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "geometry.h"
+#include "result_cache.h"
+#include "topology.h"
+
+class ThreadPool;
+
+/**
+ * A feature prepared for display
+ */
+struct DisplayFeature {
+    int64_t feature;     // index of the feature in the table scan
+    std::string label;
+    Geometry geometry;   // MultiPolygon, clipped and simplified
+};
+
+/**
+ * Result of a display query
+ */
+struct DisplayTile {
+    std::vector<DisplayFeature> features;
+    uint64_t input_vertices = 0;    // vertices of the features before clipping
+    uint64_t output_vertices = 0;   // vertices sent to the client
+};
+
+/**
+ * Polygons of a table clipped to a viewport and simplified to its pixel
+ * size, for map clients
+ *
+ * At a given resolution every vertex closer than a pixel to the line
+ * through its neighbours is invisible, and so is everything outside the
+ * viewport; a state polygon of 200,000 vertices shown in a 256 pixel tile
+ * needs a few hundred. Features are loaded once as shared-edge topology
+ * (see build_topology()). Each query simplifies (Douglas-Peucker) the
+ * arcs of the features it touches, keeping their end points, rebuilds the
+ * rings from them and clips them (Sutherland-Hodgman), in parallel. A
+ * border shared by two features is one arc, simplified once, so
+ * neighbours never show gaps or overlaps along it. Simplified arcs are
+ * kept for the pixel size of the last query, which all the tiles of a
+ * zoom level share.
+ *
+ * Tiles are addressed as z/x/y on a quadtree over the square enclosing
+ * the extent of the table, row 0 at the top as in web map tiles, and the
+ * rendered tiles are kept in a sharded LRU cache. Queries can come from
+ * several threads: cache hits never wait, and misses take turns on the
+ * thread pool.
+ */
+class DisplayQuery {
+public:
+    // Pixels per tile side
+    static const uint32_t TILE_PIXELS = 256;
+
+    // Deepest zoom level, so that a tile key fits in 64 bits
+    static const uint32_t MAX_ZOOM = 24;
+
+    /**
+     * Loads the polygons of a table
+     *
+     * @param db_handle handle to the database connection
+     * @param table_name table holding the polygons
+     * @param geometry_column geometry column of the table
+     * @param label_column column returned with each feature
+     * @param pool threads clipping and simplifying the features
+     * @param cache_capacity number of tiles kept in the cache
+     * @param topology_prefix prefix of the topology tables stored for the
+     *        table by build_topology_tables(), read instead of the
+     *        geometries; empty to build the topology in memory
+     *
+     * Throws std::runtime_error if the tables cannot be read.
+     */
+    DisplayQuery(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                 const std::string &label_column, ThreadPool &pool, size_t cache_capacity = 1024,
+                 const std::string &topology_prefix = "");
+
+    /**
+     * Clips and simplifies the features intersecting a viewport
+     *
+     * @param bbox viewport, in the SRID of the table
+     * @param pixel_size size of a pixel in the units of the SRID, used as
+     *        simplification tolerance
+     * @return features, clipped to the viewport plus a one pixel margin
+     */
+    DisplayTile query(const BBox &bbox, double pixel_size) const;
+
+    /**
+     * Renders a tile of TILE_PIXELS pixels per side, or returns it from
+     * the cache
+     *
+     * Throws std::runtime_error if the tile does not exist.
+     */
+    std::shared_ptr<const DisplayTile> tile(uint32_t z, uint32_t x, uint32_t y);
+
+    /**
+     * @return area covered by a tile
+     */
+    BBox tile_bbox(uint32_t z, uint32_t x, uint32_t y) const;
+
+    CacheStats cache_stats() const { return cache_.stats(); }
+    size_t num_features() const { return features_.size(); }
+
+private:
+    struct Feature {
+        std::string label;
+        std::vector<std::vector<size_t>> polygons;   // rings of each polygon, exterior first, in topology_.rings
+        uint64_t num_vertices = 0;                   // vertices of the rings
+        BBox box;
+    };
+
+    void index_features();
+    const std::vector<std::vector<Point>> &simplified_arcs(const std::vector<size_t> &features,
+                                                           double pixel_size) const;
+
+    Topology topology_;
+    std::vector<Feature> features_;
+    int srid_ = 0;
+    double origin_x_ = 0;      // top left corner of tile 0/0/0
+    double origin_y_ = 0;
+    double world_size_ = 0;    // side of tile 0/0/0
+    ThreadPool &pool_;
+    mutable std::mutex pool_mutex_;   // also guards the simplified arcs
+    mutable double simplified_pixel_size_ = 0;
+    mutable std::vector<std::vector<Point>> simplified_;   // empty until simplified at that size
+    ShardedLruCache<uint64_t, std::shared_ptr<const DisplayTile>> cache_;
+};
+
+/**
+ * Clips a ring to a box (Sutherland-Hodgman)
+ *
+ * Parts of the ring outside the box are replaced by runs along the box
+ * edges, which is what a renderer needs.
+ *
+ * @param ring closed ring
+ * @param box clipping box
+ * @return closed clipped ring, empty if nothing is left
+ */
+Ring clip_ring(const Ring &ring, const BBox &box);
+
+/**
+ * Simplifies a ring (Douglas-Peucker)
+ *
+ * @param ring closed ring
+ * @param tolerance maximum distance between the ring and its
+ *        simplification
+ * @return closed simplified ring, with fewer than 4 vertices if the ring
+ *         collapses at that tolerance
+ */
+Ring simplify_ring(const Ring &ring, double tolerance);
+
+/**
+ * Simplifies an arc (Douglas-Peucker), keeping its end points
+ *
+ * @param arc open arc, or closed if its end points are the same
+ * @param tolerance maximum distance between the arc and its
+ *        simplification
+ * @return simplified arc, with the same end points
+ */
+std::vector<Point> simplify_arc(const std::vector<Point> &arc, double tolerance);
+
+#endif // DISPLAY_QUERY_H
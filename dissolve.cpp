@@ -0,0 +1,284 @@
+#include "dissolve.h"
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "geometry.h"
+#include "geos_context.h"
+#include "packed_rtree.h"
+#include "sql_util.h"
+#include "thread_pool.h"
+
+namespace {
+
+/**
+ * A region being merged
+ */
+struct Region {
+    std::string name;
+    uint64_t num_features = 0;
+    std::vector<Geometry> parts;   // current level of the cascade
+};
+
+/**
+ * Sorts the parts of a region along a Hilbert curve over their extent
+ */
+void hilbert_order(std::vector<Geometry> &parts)
+{
+    std::vector<NodeItem> items;
+    BBox extent;
+    for (size_t i = 0; i < parts.size(); i++) {
+        const BBox box = parts[i].bbox();
+        extent.expand(box);
+        items.push_back(NodeItem{box.min_x, box.min_y, box.max_x, box.max_y, i});
+    }
+    hilbert_sort(items, extent);
+
+    std::vector<Geometry> sorted;
+    sorted.reserve(parts.size());
+    for (const NodeItem &item : items) {
+        sorted.push_back(std::move(parts[item.offset]));
+    }
+    parts = std::move(sorted);
+}
+
+/**
+ * Unions two polygonal geometries; when GEOS fails even on repaired
+ * input, the polygons of both are kept side by side
+ *
+ * @return false if the union failed
+ */
+bool union_pair(const GeosContext &geos, const Geometry &a, const Geometry &b, Geometry &result)
+{
+    GeosGeometry geos_a = geos.to_geos(a);
+    GeosGeometry geos_b = geos.to_geos(b);
+    if (geos_a && geos_b) {
+        GeosGeometry merged = geos.wrap(GEOSUnion_r(geos.handle(), geos_a.get(), geos_b.get()));
+        if (!merged) {
+            // Slightly invalid borders: repair both and retry
+            GeosGeometry valid_a = geos.wrap(GEOSMakeValid_r(geos.handle(), geos_a.get()));
+            GeosGeometry valid_b = geos.wrap(GEOSMakeValid_r(geos.handle(), geos_b.get()));
+            if (valid_a && valid_b) {
+                merged = geos.wrap(GEOSUnion_r(geos.handle(), valid_a.get(), valid_b.get()));
+            }
+        }
+        if (merged && geos.from_geos(merged.get(), result, a.srid)) {
+            result.type = GeometryType::MultiPolygon;
+            return true;
+        }
+    }
+
+    result = a;
+    result.type = GeometryType::MultiPolygon;
+    result.polygons.insert(result.polygons.end(), b.polygons.begin(), b.polygons.end());
+    return false;
+}
+
+} // namespace
+
+int read_region_mapping(const std::string &path, std::string &key_column, std::map<std::string, std::string> &regions)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Error opening region mapping " << path << std::endl;
+        return 1;
+    }
+
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        if (trim(line).empty()) continue;
+
+        const size_t comma = line.find(',');
+        if (comma == std::string::npos) {
+            std::cerr << "Error in region mapping " << path << ", line " << line_number << ": expected key,region"
+                << std::endl;
+            return 1;
+        }
+        const std::string key = trim(line.substr(0, comma));
+        const std::string region = trim(line.substr(comma + 1));
+        if (key_column.empty()) {
+            key_column = key;   // header
+        } else {
+            regions[key] = region;
+        }
+    }
+
+    if (key_column.empty() || regions.empty()) {
+        std::cerr << "Error in region mapping " << path << ": no header or no regions" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int dissolve(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+             const std::string &group_column, const std::map<std::string, std::string> &regions,
+             const std::string &output_table, ThreadPool &pool, DissolveSummary *summary)
+{
+    DissolveSummary counts;
+
+    std::vector<std::unique_ptr<GeosContext>> contexts;
+    try {
+        for (unsigned i = 0; i < pool.size(); i++) {
+            contexts.emplace_back(new GeosContext());
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error dissolving " << table_name << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Group the features by region
+    sqlite3_stmt *stmt;
+    std::string sql_cmd = "SELECT CAST(" + quote_identifier(group_column) + " AS TEXT), " +
+        quote_identifier(geometry_column) + " FROM " + quote_identifier(table_name) + " WHERE " +
+        quote_identifier(geometry_column) + " IS NOT NULL";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, Region> by_name;
+    int srid = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Geometry geom;
+        const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 1));
+        if (!decode_spatialite_blob(blob, sqlite3_column_bytes(stmt, 1), geom) || geom.polygons.empty()) continue;
+        counts.features++;
+
+        const unsigned char *value = sqlite3_column_text(stmt, 0);
+        std::string name;
+        if (value != NULL) {
+            // BR_UF_2022 has line breaks at the end of some NM_REGIAO values
+            name = trim(reinterpret_cast<const char *>(value));
+            if (!regions.empty()) {
+                auto found = regions.find(name);
+                name = found != regions.end() ? found->second : std::string();
+            }
+        }
+        if (name.empty()) {
+            counts.unmapped++;
+            continue;
+        }
+
+        srid = geom.srid;
+        geom.type = GeometryType::MultiPolygon;
+        Region &region = by_name[name];
+        region.name = name;
+        region.num_features++;
+        region.parts.push_back(std::move(geom));
+    }
+    sqlite3_finalize(stmt);
+
+    std::vector<Region> merged;
+    for (auto &entry : by_name) {
+        hilbert_order(entry.second.parts);
+        merged.push_back(std::move(entry.second));
+    }
+
+    // Cascade: merge neighbouring pairs, one level at a time, every pair
+    // of every region in parallel
+    struct Task {
+        size_t region;
+        size_t first;   // parts[first] and parts[first + 1]
+        Geometry result;
+        bool failed = false;
+    };
+    while (true) {
+        std::vector<Task> tasks;
+        for (size_t r = 0; r < merged.size(); r++) {
+            for (size_t i = 0; i + 1 < merged[r].parts.size(); i += 2) {
+                tasks.push_back(Task{r, i, Geometry(), false});
+            }
+        }
+        if (tasks.empty()) break;
+
+        try {
+            pool.parallel_for(tasks.size(), [&](size_t index, unsigned worker) {
+                Task &task = tasks[index];
+                const std::vector<Geometry> &parts = merged[task.region].parts;
+                task.failed = !union_pair(*contexts[worker], parts[task.first], parts[task.first + 1], task.result);
+            });
+        } catch (const std::exception &e) {
+            std::cerr << "Error dissolving " << table_name << ": " << e.what() << std::endl;
+            return 1;
+        }
+
+        // Next level: the unions in order, then the odd part out
+        std::vector<std::vector<Geometry>> next(merged.size());
+        for (Task &task : tasks) {
+            counts.unions++;
+            if (task.failed) {
+                std::cerr << "Cannot merge two parts of region " << merged[task.region].name
+                    << ", keeping them side by side" << std::endl;
+                counts.failed++;
+            }
+            next[task.region].push_back(std::move(task.result));
+        }
+        for (size_t r = 0; r < merged.size(); r++) {
+            if (merged[r].parts.size() % 2 == 1) {
+                next[r].push_back(std::move(merged[r].parts.back()));
+            }
+            merged[r].parts = std::move(next[r]);
+        }
+    }
+
+    // Store the regions
+    if (exec(db_handle, "BEGIN TRANSACTION;", "starting transaction") != 0) {
+        return 1;
+    }
+    auto fail = [&]() {
+        exec(db_handle, "ROLLBACK;", "rolling back");
+        return 1;
+    };
+
+    if (exec(db_handle, "SELECT DropTable(NULL, " + quote_literal(output_table) + ", 1)", "dropping regions table") != 0 ||
+        exec(db_handle, "CREATE TABLE " + quote_identifier(output_table) +
+             " (id INTEGER PRIMARY KEY, region TEXT NOT NULL UNIQUE, num_features INTEGER)",
+             "creating regions table") != 0 ||
+        exec(db_handle, "SELECT AddGeometryColumn(" + quote_literal(output_table) + ", 'Geometry', " +
+             std::to_string(srid) + ", 'MULTIPOLYGON', 'XY')", "adding geometry column") != 0) {
+        return fail();
+    }
+
+    sql_cmd = "INSERT INTO " + quote_identifier(output_table) + " (region, num_features, Geometry) VALUES (?, ?, ?)";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return fail();
+    }
+    for (const Region &region : merged) {
+        if (region.parts.empty()) continue;
+
+        const std::vector<uint8_t> blob = encode_spatialite_blob(region.parts[0]);
+        sqlite3_bind_text(stmt, 1, region.name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 2, static_cast<int64_t>(region.num_features));
+        sqlite3_bind_blob(stmt, 3, blob.data(), blob.size(), SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "Error inserting region " << region.name << ": " << sqlite3_errmsg(db_handle) << std::endl;
+            sqlite3_finalize(stmt);
+            return fail();
+        }
+        sqlite3_reset(stmt);
+        counts.regions++;
+    }
+    sqlite3_finalize(stmt);
+
+    if (exec(db_handle, "SELECT CreateSpatialIndex(" + quote_literal(output_table) + ", 'Geometry')",
+             "creating spatial index") != 0 ||
+        exec(db_handle, "COMMIT;", "committing transaction") != 0) {
+        return fail();
+    }
+
+    std::cout << "Dissolved " << table_name << " by " << group_column << " on " << pool.size() << " threads: "
+        << counts.features << " features into " << counts.regions << " regions, " << counts.unions << " unions"
+        << (counts.failed > 0 ? ", " + std::to_string(counts.failed) + " failed" : "")
+        << (counts.unmapped > 0 ? ", " + std::to_string(counts.unmapped) + " features without region" : "")
+        << std::endl;
+
+    if (summary != NULL) {
+        *summary = counts;
+    }
+    return 0;
+}
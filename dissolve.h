@@ -0,0 +1,62 @@
+#ifndef DISSOLVE_H
+#define DISSOLVE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <sqlite3.h>
+
+class ThreadPool;
+
+struct DissolveSummary {
+    uint64_t features = 0;   // features read
+    uint64_t unmapped = 0;   // features skipped: NULL or unmapped group value
+    uint64_t regions = 0;    // regions written
+    uint64_t unions = 0;     // pairwise unions computed
+    uint64_t failed = 0;     // unions GEOS could not compute, parts kept side by side
+};
+
+/**
+ * Reads a region mapping from a CSV file
+ *
+ * @param path file to read; the header names the key column and the
+ *        region, e.g. "SIGLA_UF,region", then one "key,region" per line
+ * @param key_column name of the key column, from the header
+ * @param regions region of each key value
+ * @return 0 on success, 1 on failure
+ */
+int read_region_mapping(const std::string &path, std::string &key_column, std::map<std::string, std::string> &regions);
+
+/**
+ * Merges the polygons of a table by region and stores the regions in
+ * their own table
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table holding the polygons
+ * @param geometry_column geometry column of the table
+ * @param group_column column the features are grouped by
+ * @param regions region of each value of group_column; if empty, each
+ *        distinct value is a region. Values are compared without their
+ *        leading and trailing white space.
+ * @param output_table name of the table to (re)create
+ * @param pool threads to run GEOS on, each with its own GEOS context
+ * @param summary counts of features, regions and unions (may be NULL)
+ * @return 0 on success, 1 on failure
+ *
+ * The union is cascaded: the features of each region are sorted along a
+ * Hilbert curve by their bounding box, then neighbours in that order are
+ * merged pairwise, level after level, like the nodes of a tree built
+ * bottom up. Each union thus combines two geometries of similar size that
+ * are close to each other, and the pairs of a level, across all regions,
+ * are computed in parallel.
+ *
+ * The table has columns (id, region, num_features) and a MULTIPOLYGON
+ * "Geometry" column in the SRID of the source table, with a spatial
+ * index, so region lookups are plain indexed queries.
+ */
+int dissolve(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+             const std::string &group_column, const std::map<std::string, std::string> &regions,
+             const std::string &output_table, ThreadPool &pool, DissolveSummary *summary = NULL);
+
+#endif // DISSOLVE_H
@@ -0,0 +1,224 @@
+#include "distance_join.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#include "border_index.h"
+#include "geo_distance.h"
+#include "packed_rtree.h"
+#include "sql_util.h"
+#include "thread_pool.h"
+
+namespace {
+
+// Points per partition of the plane sweep, and of the border join
+const size_t SWEEP_PARTITION_SIZE = 1024;
+const size_t BORDER_PARTITION_SIZE = 256;
+
+// The local equirectangular metric picks the segments to measure
+// geodesically; it is within a few percent of the geodesic distance at
+// the scale of a join, so segments this much beyond the distance are
+// measured too
+const double SEGMENT_MARGIN = 0.05;
+
+/**
+ * Merges the results of the partitions, in order
+ */
+std::vector<DistanceMatch> merge_partitions(std::vector<std::vector<DistanceMatch>> &partitions)
+{
+    std::vector<DistanceMatch> matches;
+    for (auto &partition : partitions) {
+        matches.insert(matches.end(), partition.begin(), partition.end());
+    }
+    std::sort(matches.begin(), matches.end(), [](const DistanceMatch &a, const DistanceMatch &b) {
+        return a.left != b.left ? a.left < b.left : a.right < b.right;
+    });
+    return matches;
+}
+
+} // namespace
+
+int read_join_points(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                     std::vector<JoinPoint> &points)
+{
+    sqlite3_stmt *stmt;
+    const std::string sql_cmd = "SELECT rowid, " + quote_identifier(geometry_column) + " FROM " +
+        quote_identifier(table_name) + " WHERE " + quote_identifier(geometry_column) + " IS NOT NULL";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Geometry geom;
+        const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 1));
+        if (!decode_spatialite_blob(blob, sqlite3_column_bytes(stmt, 1), geom) || geom.points.empty()) continue;
+        points.push_back(JoinPoint{sqlite3_column_int64(stmt, 0), geom.points[0]});
+    }
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+std::vector<DistanceMatch> points_within_distance(const std::vector<JoinPoint> &left,
+                                                  const std::vector<JoinPoint> &right, double distance,
+                                                  bool geographic, ThreadPool &pool, DistanceJoinStats *stats)
+{
+    auto by_x = [](const JoinPoint &a, const JoinPoint &b) { return a.point.x < b.point.x; };
+    std::vector<JoinPoint> sorted_left(left);
+    std::vector<JoinPoint> sorted_right(right);
+    std::sort(sorted_left.begin(), sorted_left.end(), by_x);
+    std::sort(sorted_right.begin(), sorted_right.end(), by_x);
+
+    const size_t num_partitions = (sorted_left.size() + SWEEP_PARTITION_SIZE - 1) / SWEEP_PARTITION_SIZE;
+    std::vector<std::vector<DistanceMatch>> results(num_partitions);
+    std::vector<uint64_t> candidates(num_partitions, 0);
+
+    pool.parallel_for(num_partitions, [&](size_t partition, unsigned) {
+        const size_t first = partition * SWEEP_PARTITION_SIZE;
+        const size_t last = std::min(first + SWEEP_PARTITION_SIZE, sorted_left.size());
+
+        // One window for the strip, wide enough for its highest latitude
+        double max_abs_y = 0;
+        for (size_t i = first; i < last; i++) {
+            max_abs_y = std::max(max_abs_y, std::fabs(sorted_left[i].point.y));
+        }
+        double dx, dy;
+        search_window(distance, geographic, max_abs_y, dx, dy);
+
+        // Sweep: begin is the first right point not left of the window
+        auto begin = std::lower_bound(sorted_right.begin(), sorted_right.end(),
+                                      JoinPoint{0, Point{sorted_left[first].point.x - dx, 0}}, by_x);
+        for (size_t i = first; i < last; i++) {
+            const Point &p = sorted_left[i].point;
+            while (begin != sorted_right.end() && begin->point.x < p.x - dx) ++begin;
+
+            for (auto it = begin; it != sorted_right.end() && it->point.x <= p.x + dx; ++it) {
+                if (std::fabs(it->point.y - p.y) > dy) continue;
+
+                candidates[partition]++;
+                const double d = point_distance(p, it->point, geographic);
+                if (d <= distance) {
+                    results[partition].push_back(DistanceMatch{sorted_left[i].id, it->id, d});
+                }
+            }
+        }
+    });
+
+    std::vector<DistanceMatch> matches = merge_partitions(results);
+    if (stats != NULL) {
+        stats->partitions += num_partitions;
+        for (uint64_t count : candidates) stats->candidates += count;
+        stats->matches += matches.size();
+    }
+    return matches;
+}
+
+std::vector<DistanceMatch> points_near_borders(const std::vector<JoinPoint> &points, const BorderIndex &borders,
+                                               double distance, ThreadPool &pool, int64_t feature,
+                                               DistanceJoinStats *stats)
+{
+    const bool geographic = borders.geographic();
+
+    // Partitions of nearby points, along a Hilbert curve
+    std::vector<NodeItem> items;
+    BBox extent;
+    for (size_t i = 0; i < points.size(); i++) {
+        const Point &p = points[i].point;
+        extent.expand(p.x, p.y);
+        items.push_back(NodeItem{p.x, p.y, p.x, p.y, i});
+    }
+    hilbert_sort(items, extent);
+
+    const size_t num_partitions = (items.size() + BORDER_PARTITION_SIZE - 1) / BORDER_PARTITION_SIZE;
+    std::vector<std::vector<DistanceMatch>> results(num_partitions);
+    std::vector<uint64_t> candidates(num_partitions, 0);
+
+    struct Segment {
+        int64_t feature;
+        Point a;
+        Point b;
+        BBox box;
+    };
+
+    pool.parallel_for(num_partitions, [&](size_t partition, unsigned) {
+        const size_t first = partition * BORDER_PARTITION_SIZE;
+        const size_t last = std::min(first + BORDER_PARTITION_SIZE, items.size());
+
+        BBox box;
+        double max_abs_y = 0;
+        for (size_t i = first; i < last; i++) {
+            box.expand(items[i].min_x, items[i].min_y);
+            max_abs_y = std::max(max_abs_y, std::fabs(items[i].min_y));
+        }
+        double dx, dy;
+        search_window(distance, geographic, max_abs_y, dx, dy);
+        box.expand(box.min_x - dx, box.min_y - dy);
+        box.expand(box.max_x + dx, box.max_y + dy);
+
+        // The segments within reach of the partition, fetched once
+        std::vector<Segment> segments;
+        borders.visit_segments(box, [&](int64_t segment_feature, const Point &a, const Point &b) {
+            if (feature >= 0 && segment_feature != feature) return;
+            Segment segment{segment_feature, a, b, BBox()};
+            segment.box.expand(a.x, a.y);
+            segment.box.expand(b.x, b.y);
+            segments.push_back(segment);
+        });
+        if (segments.empty()) return;
+
+        // Nearest segment of each feature, for each point. The local metric
+        // only shortlists the segments: each one it puts within the
+        // distance, widened by the margin, is measured geodesically, so the
+        // nearest segment on the ellipsoid is never missed for another one
+        // nearer in the local metric.
+        const double limit = distance * (1 + SEGMENT_MARGIN);
+        const double metres_per_unit = geographic ? MIN_METRES_PER_DEGREE_LAT : 1.0;
+        struct Best {
+            int64_t feature;
+            double distance;
+        };
+        std::vector<Best> best;
+        for (size_t i = first; i < last; i++) {
+            const JoinPoint &join_point = points[items[i].offset];
+            const Point &p = join_point.point;
+            const double kx = geographic ? std::cos(p.y * DEG_TO_RAD) : 1.0;
+
+            best.clear();
+            for (const Segment &segment : segments) {
+                if (p.x < segment.box.min_x - dx || p.x > segment.box.max_x + dx ||
+                    p.y < segment.box.min_y - dy || p.y > segment.box.max_y + dy) {
+                    continue;
+                }
+                Point q;
+                const double squared = nearest_on_segment(p, segment.a, segment.b, kx, q);
+                if (std::sqrt(squared) * metres_per_unit > limit) continue;
+
+                candidates[partition]++;
+                const double d = point_distance(p, q, geographic);
+                if (d > distance) continue;
+
+                auto found = std::find_if(best.begin(), best.end(),
+                                          [&](const Best &b) { return b.feature == segment.feature; });
+                if (found == best.end()) {
+                    best.push_back(Best{segment.feature, d});
+                } else if (d < found->distance) {
+                    found->distance = d;
+                }
+            }
+
+            for (const Best &b : best) {
+                results[partition].push_back(DistanceMatch{join_point.id, b.feature, b.distance});
+            }
+        }
+    });
+
+    std::vector<DistanceMatch> matches = merge_partitions(results);
+    if (stats != NULL) {
+        stats->partitions += num_partitions;
+        for (uint64_t count : candidates) stats->candidates += count;
+        stats->matches += matches.size();
+    }
+    return matches;
+}
@@ -0,0 +1,97 @@
+#ifndef DISTANCE_JOIN_H
+#define DISTANCE_JOIN_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "geometry.h"
+
+class BorderIndex;
+class ThreadPool;
+
+/**
+ * A point taking part in a join, with the id of its row
+ */
+struct JoinPoint {
+    int64_t id;
+    Point point;
+};
+
+/**
+ * A pair found by a within-distance join
+ */
+struct DistanceMatch {
+    int64_t left;      // id of the point
+    int64_t right;     // id of the other point, or index of the BorderIndex feature
+    double distance;   // metres for geographic data, CRS units otherwise
+};
+
+struct DistanceJoinStats {
+    uint64_t partitions = 0;   // tasks the join was split into
+    uint64_t candidates = 0;   // pairs whose exact distance was computed
+    uint64_t matches = 0;      // pairs within the distance
+};
+
+/**
+ * Reads the points of a table
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table holding the points
+ * @param geometry_column POINT or MULTIPOINT geometry column (the first
+ *        point of a MULTIPOINT is used)
+ * @param points rowid and point of each row
+ * @return 0 on success, 1 on failure
+ */
+int read_join_points(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                     std::vector<JoinPoint> &points);
+
+/**
+ * Finds every pair of points of two sets closer than a distance
+ *
+ * @param left first point set
+ * @param right second point set, in the same SRID
+ * @param distance maximum distance, in metres for geographic data
+ * @param geographic true if the points are longitude/latitude
+ * @param pool threads running the partitions
+ * @param stats counters (may be NULL)
+ * @return pairs, sorted by left then right id
+ *
+ * A partitioned plane sweep: both sets are sorted by x, the left set is
+ * cut into strips of consecutive points, and each strip sweeps the right
+ * points whose x is within the distance of its own, in parallel. Only
+ * pairs that also pass the y window get an exact (geodesic) distance,
+ * where a correlated ST_Distance subquery computes all n x m of them.
+ */
+std::vector<DistanceMatch> points_within_distance(const std::vector<JoinPoint> &left,
+                                                  const std::vector<JoinPoint> &right, double distance,
+                                                  bool geographic, ThreadPool &pool,
+                                                  DistanceJoinStats *stats = NULL);
+
+/**
+ * Finds every point closer than a distance to the boundary of a feature
+ *
+ * @param points points, in the SRID of the border index
+ * @param borders boundary segments of the features
+ * @param distance maximum distance, in metres for geographic data
+ * @param pool threads running the partitions
+ * @param feature feature whose boundary is searched, -1 for all of them
+ * @param stats counters (may be NULL)
+ * @return one pair per point and feature, with the distance to the nearest
+ *         segment of that feature, sorted by point then feature
+ *
+ * The points are sorted along a Hilbert curve and cut into partitions of
+ * nearby points. Each partition, in parallel, fetches the segments of the
+ * border index within the distance of its bounding box once, then tests
+ * its points against them only: an R-tree to R-tree join at the level of
+ * partitions. On longitude/latitude, a local equirectangular metric
+ * shortlists the segments within the distance plus a 5% margin, and the
+ * geodesic distance to each of them decides.
+ */
+std::vector<DistanceMatch> points_near_borders(const std::vector<JoinPoint> &points, const BorderIndex &borders,
+                                               double distance, ThreadPool &pool, int64_t feature = -1,
+                                               DistanceJoinStats *stats = NULL);
+
+#endif // DISTANCE_JOIN_H
@@ -0,0 +1,642 @@
+#include "flatgeobuf.h"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "import_stats.h"
+#include "sql_util.h"
+
+namespace {
+
+const uint8_t FGB_MAGIC[] = {'f', 'g', 'b', 3, 'f', 'g', 'b'};
+
+// Field ids of the FlatGeobuf schema tables we read
+enum HeaderField { H_NAME = 0, H_ENVELOPE = 1, H_GEOMETRY_TYPE = 2, H_COLUMNS = 7,
+                   H_FEATURES_COUNT = 8, H_INDEX_NODE_SIZE = 9, H_CRS = 10 };
+enum ColumnField { C_NAME = 0, C_TYPE = 1 };
+enum CrsField { CRS_ORG = 0, CRS_CODE = 1 };
+enum FeatureField { F_GEOMETRY = 0, F_PROPERTIES = 1 };
+enum GeometryField { G_ENDS = 0, G_XY = 1, G_TYPE = 6, G_PARTS = 7 };
+
+[[noreturn]] void corrupt()
+{
+    throw std::runtime_error("Corrupt FlatGeobuf data");
+}
+
+/**
+ * Minimal, bounds-checked reader for a FlatBuffers table
+ *
+ * Only what the FlatGeobuf schema needs: scalars, strings, vectors of
+ * scalars and (vectors of) sub-tables. All offsets are little-endian.
+ */
+class FbTable {
+public:
+    FbTable() = default;
+    FbTable(const uint8_t *buf, size_t size, size_t pos) : buf_(buf), size_(size), pos_(pos) {}
+
+    static FbTable root(const uint8_t *buf, size_t size)
+    {
+        FbTable table(buf, size, 0);
+        return FbTable(buf, size, table.load<uint32_t>(0));
+    }
+
+    template <typename T>
+    T load(size_t offset) const
+    {
+        if (offset + sizeof(T) > size_ || offset + sizeof(T) < offset) corrupt();
+        T value;
+        std::memcpy(&value, buf_ + offset, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    T scalar(int id, T default_value) const
+    {
+        const uint16_t offset = field(id);
+        return offset ? load<T>(pos_ + offset) : default_value;
+    }
+
+    /**
+     * @param id field id
+     * @param elem_size size of one vector element in bytes
+     * @param start position of the first element
+     * @param length number of elements
+     * @return false if the field is absent
+     */
+    bool vector(int id, size_t elem_size, size_t &start, uint32_t &length) const
+    {
+        const uint16_t offset = field(id);
+        if (!offset) return false;
+
+        const size_t ref = pos_ + offset;
+        const size_t target = ref + load<uint32_t>(ref);
+        length = load<uint32_t>(target);
+        start = target + 4;
+        if (start + static_cast<uint64_t>(length) * elem_size > size_) corrupt();
+        return true;
+    }
+
+    std::string string(int id) const
+    {
+        size_t start;
+        uint32_t length;
+        if (!vector(id, 1, start, length)) return std::string();
+        return std::string(reinterpret_cast<const char *>(buf_ + start), length);
+    }
+
+    bool table(int id, FbTable &out) const
+    {
+        const uint16_t offset = field(id);
+        if (!offset) return false;
+
+        const size_t ref = pos_ + offset;
+        out = FbTable(buf_, size_, ref + load<uint32_t>(ref));
+        return true;
+    }
+
+    FbTable vector_table(size_t start, uint32_t i) const
+    {
+        const size_t ref = start + static_cast<size_t>(i) * 4;
+        return FbTable(buf_, size_, ref + load<uint32_t>(ref));
+    }
+
+    const uint8_t *data() const { return buf_; }
+
+private:
+    uint16_t field(int id) const
+    {
+        const size_t vtable = pos_ - load<int32_t>(pos_);
+        const uint16_t vtable_size = load<uint16_t>(vtable);
+        const size_t entry = 4 + 2 * static_cast<size_t>(id);
+        if (entry + 2 > vtable_size) return 0;
+        return load<uint16_t>(vtable + entry);
+    }
+
+    const uint8_t *buf_ = nullptr;
+    size_t size_ = 0;
+    size_t pos_ = 0;
+};
+
+std::vector<Point> read_points(const FbTable &geom, size_t xy_start, uint32_t from, uint32_t to)
+{
+    std::vector<Point> points;
+    points.reserve(to - from);
+    for (uint32_t i = from; i < to; i++) {
+        Point p;
+        const size_t offset = xy_start + static_cast<uint64_t>(i) * 16;
+        std::memcpy(&p.x, geom.data() + offset, 8);
+        std::memcpy(&p.y, geom.data() + offset + 8, 8);
+        points.push_back(p);
+    }
+    return points;
+}
+
+/**
+ * Splits the xy array of a geometry table at its "ends" (vertex counts
+ * at which each ring or line ends)
+ */
+std::vector<std::vector<Point>> read_parts(const FbTable &geom)
+{
+    std::vector<std::vector<Point>> parts;
+    size_t xy_start;
+    uint32_t xy_length;
+    if (!geom.vector(G_XY, 8, xy_start, xy_length)) return parts;
+    const uint32_t num_points = xy_length / 2;
+
+    size_t ends_start;
+    uint32_t ends_length;
+    if (!geom.vector(G_ENDS, 4, ends_start, ends_length) || ends_length == 0) {
+        parts.push_back(read_points(geom, xy_start, 0, num_points));
+        return parts;
+    }
+
+    uint32_t from = 0;
+    for (uint32_t i = 0; i < ends_length; i++) {
+        const uint32_t to = geom.load<uint32_t>(ends_start + i * 4);
+        if (to < from || to > num_points) corrupt();
+        parts.push_back(read_points(geom, xy_start, from, to));
+        from = to;
+    }
+    return parts;
+}
+
+void parse_geometry(const FbTable &table, GeometryType type, Geometry &geom)
+{
+    if (type == GeometryType::Unknown) {
+        type = static_cast<GeometryType>(table.scalar<uint8_t>(G_TYPE, 0));
+    }
+    geom.type = type;
+
+    switch (type) {
+        case GeometryType::Point:
+        case GeometryType::MultiPoint:
+            for (auto &part : read_parts(table)) {
+                geom.points.insert(geom.points.end(), part.begin(), part.end());
+            }
+            if (type == GeometryType::Point && geom.points.size() > 1) {
+                geom.points.resize(1);
+            }
+            break;
+        case GeometryType::LineString: {
+            auto parts = read_parts(table);
+            if (!parts.empty()) {
+                geom.lines.push_back(std::move(parts[0]));
+            }
+            break;
+        }
+        case GeometryType::MultiLineString:
+            geom.lines = read_parts(table);
+            break;
+        case GeometryType::Polygon:
+            geom.polygons.emplace_back();
+            geom.polygons.back().rings = read_parts(table);
+            break;
+        case GeometryType::MultiPolygon: {
+            size_t parts_start;
+            uint32_t parts_length;
+            if (!table.vector(G_PARTS, 4, parts_start, parts_length)) {
+                // writers may store a single-part multipolygon flat
+                geom.polygons.emplace_back();
+                geom.polygons.back().rings = read_parts(table);
+                break;
+            }
+            for (uint32_t i = 0; i < parts_length; i++) {
+                geom.polygons.emplace_back();
+                geom.polygons.back().rings = read_parts(table.vector_table(parts_start, i));
+            }
+            break;
+        }
+        default:
+            throw std::runtime_error("Unsupported FlatGeobuf geometry type: " +
+                                     std::to_string(static_cast<int>(type)));
+    }
+}
+
+void parse_properties(const FbTable &feature, const std::vector<FgbColumn> &columns,
+                      std::vector<FgbValue> &values)
+{
+    values.assign(columns.size(), FgbValue());
+
+    size_t start;
+    uint32_t length;
+    if (!feature.vector(F_PROPERTIES, 1, start, length)) return;
+
+    size_t pos = start;
+    const size_t end = start + length;
+    while (pos + 2 <= end) {
+        const uint16_t column_index = feature.load<uint16_t>(pos);
+        pos += 2;
+        if (column_index >= columns.size()) corrupt();
+
+        FgbValue &value = values[column_index];
+        switch (columns[column_index].type) {
+            case FgbColumnType::Byte:
+                value.kind = FgbValue::Integer;
+                value.integer = feature.load<int8_t>(pos);
+                pos += 1;
+                break;
+            case FgbColumnType::UByte:
+            case FgbColumnType::Bool:
+                value.kind = FgbValue::Integer;
+                value.integer = feature.load<uint8_t>(pos);
+                pos += 1;
+                break;
+            case FgbColumnType::Short:
+                value.kind = FgbValue::Integer;
+                value.integer = feature.load<int16_t>(pos);
+                pos += 2;
+                break;
+            case FgbColumnType::UShort:
+                value.kind = FgbValue::Integer;
+                value.integer = feature.load<uint16_t>(pos);
+                pos += 2;
+                break;
+            case FgbColumnType::Int:
+                value.kind = FgbValue::Integer;
+                value.integer = feature.load<int32_t>(pos);
+                pos += 4;
+                break;
+            case FgbColumnType::UInt:
+                value.kind = FgbValue::Integer;
+                value.integer = feature.load<uint32_t>(pos);
+                pos += 4;
+                break;
+            case FgbColumnType::Long:
+            case FgbColumnType::ULong:
+                value.kind = FgbValue::Integer;
+                value.integer = feature.load<int64_t>(pos);
+                pos += 8;
+                break;
+            case FgbColumnType::Float:
+                value.kind = FgbValue::Real;
+                value.real = feature.load<float>(pos);
+                pos += 4;
+                break;
+            case FgbColumnType::Double:
+                value.kind = FgbValue::Real;
+                value.real = feature.load<double>(pos);
+                pos += 8;
+                break;
+            case FgbColumnType::String:
+            case FgbColumnType::Json:
+            case FgbColumnType::DateTime:
+            case FgbColumnType::Binary: {
+                const uint32_t size = feature.load<uint32_t>(pos);
+                pos += 4;
+                if (pos + size > end) corrupt();
+                value.kind = columns[column_index].type == FgbColumnType::Binary ? FgbValue::Blob : FgbValue::Text;
+                value.bytes.assign(reinterpret_cast<const char *>(feature.data() + pos), size);
+                pos += size;
+                break;
+            }
+            default:
+                corrupt();
+        }
+    }
+}
+
+const char *sql_column_type(FgbColumnType type)
+{
+    switch (type) {
+        case FgbColumnType::Float:
+        case FgbColumnType::Double:
+            return "DOUBLE";
+        case FgbColumnType::String:
+        case FgbColumnType::Json:
+        case FgbColumnType::DateTime:
+            return "TEXT";
+        case FgbColumnType::Binary:
+            return "BLOB";
+        default:
+            return "INTEGER";
+    }
+}
+
+/**
+ * Geometry column type used for a FlatGeobuf geometry type; single types
+ * are promoted the way ImportSHP does it
+ */
+GeometryType column_geometry_type(GeometryType type)
+{
+    switch (type) {
+        case GeometryType::LineString: return GeometryType::MultiLineString;
+        case GeometryType::Polygon: return GeometryType::MultiPolygon;
+        default: return type;
+    }
+}
+
+} // namespace
+
+FlatGeobufReader::FlatGeobufReader(const std::string &path) : path_(path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open FlatGeobuf file: " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 12) {
+        close(fd);
+        throw std::runtime_error("Not a FlatGeobuf file: " + path);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+
+    void *mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("Cannot map FlatGeobuf file: " + path);
+    }
+    data_ = static_cast<const uint8_t *>(mapped);
+
+    try {
+        parse_header();
+    } catch (...) {
+        munmap(const_cast<uint8_t *>(data_), size_);
+        throw;
+    }
+}
+
+FlatGeobufReader::~FlatGeobufReader()
+{
+    if (data_ != nullptr) {
+        munmap(const_cast<uint8_t *>(data_), size_);
+    }
+}
+
+void FlatGeobufReader::parse_header()
+{
+    if (std::memcmp(data_, FGB_MAGIC, sizeof(FGB_MAGIC)) != 0) {
+        throw std::runtime_error("Not a FlatGeobuf v3 file: " + path_);
+    }
+
+    uint32_t header_size;
+    std::memcpy(&header_size, data_ + 8, 4);
+    if (12 + static_cast<uint64_t>(header_size) > size_) corrupt();
+
+    const FbTable header = FbTable::root(data_ + 12, header_size);
+    name_ = header.string(H_NAME);
+    geometry_type_ = static_cast<GeometryType>(header.scalar<uint8_t>(H_GEOMETRY_TYPE, 0));
+    features_count_ = header.scalar<uint64_t>(H_FEATURES_COUNT, 0);
+    const uint16_t index_node_size = header.scalar<uint16_t>(H_INDEX_NODE_SIZE, 16);
+
+    size_t start;
+    uint32_t length;
+    if (header.vector(H_ENVELOPE, 8, start, length) && length >= 4) {
+        envelope_.min_x = header.load<double>(start);
+        envelope_.min_y = header.load<double>(start + 8);
+        envelope_.max_x = header.load<double>(start + 16);
+        envelope_.max_y = header.load<double>(start + 24);
+    }
+
+    if (header.vector(H_COLUMNS, 4, start, length)) {
+        for (uint32_t i = 0; i < length; i++) {
+            const FbTable column = header.vector_table(start, i);
+            columns_.push_back({column.string(C_NAME),
+                                static_cast<FgbColumnType>(column.scalar<uint8_t>(C_TYPE, 0))});
+        }
+    }
+
+    FbTable crs;
+    if (header.table(H_CRS, crs)) {
+        const std::string org = crs.string(CRS_ORG);
+        const int32_t code = crs.scalar<int32_t>(CRS_CODE, 0);
+        if (code > 0 && (org.empty() || org == "EPSG" || org == "epsg")) {
+            srid_ = code;
+        }
+    }
+
+    uint64_t index_size = 0;
+    const uint64_t index_start = 12 + static_cast<uint64_t>(header_size);
+    if (index_node_size > 1 && features_count_ > 0) {
+        index_size = PackedRTree::tree_size(features_count_, index_node_size);
+        if (index_start + index_size > size_) corrupt();
+        index_ = PackedRTree(data_ + index_start, features_count_, index_node_size);
+        // The index is small and hot, features are paged in on demand
+        madvise(const_cast<uint8_t *>(data_), index_start + index_size, MADV_WILLNEED);
+    }
+    features_start_ = index_start + index_size;
+}
+
+void FlatGeobufReader::read_feature(uint64_t offset, FgbFeature &feature, uint64_t *size) const
+{
+    const uint64_t start = features_start_ + offset;
+    if (start + 4 > size_) corrupt();
+
+    uint32_t feature_size;
+    std::memcpy(&feature_size, data_ + start, 4);
+    if (start + 4 + feature_size > size_) corrupt();
+
+    const FbTable table = FbTable::root(data_ + start + 4, feature_size);
+    feature.geometry = Geometry();
+    feature.geometry.srid = srid_;
+
+    FbTable geometry;
+    if (table.table(F_GEOMETRY, geometry)) {
+        parse_geometry(geometry, geometry_type_, feature.geometry);
+    }
+    parse_properties(table, columns_, feature.values);
+
+    if (size != nullptr) {
+        *size = 4 + static_cast<uint64_t>(feature_size);
+    }
+}
+
+bool FlatGeobufReader::next(FgbFeature &feature)
+{
+    if (features_start_ + cursor_ >= size_) return false;
+
+    uint64_t feature_size;
+    read_feature(cursor_, feature, &feature_size);
+    cursor_ += feature_size;
+    return true;
+}
+
+void FlatGeobufReader::rewind()
+{
+    cursor_ = 0;
+}
+
+std::vector<FgbFeature> FlatGeobufReader::query(const BBox &box) const
+{
+    std::vector<FgbFeature> features;
+
+    if (has_index()) {
+        index_.visit(box, [&](const NodeItem &item, uint64_t) {
+            features.emplace_back();
+            read_feature(item.offset, features.back(), nullptr);
+            return true;
+        });
+        return features;
+    }
+
+    uint64_t offset = 0;
+    while (features_start_ + offset < size_) {
+        FgbFeature feature;
+        uint64_t feature_size;
+        read_feature(offset, feature, &feature_size);
+        offset += feature_size;
+        if (feature.geometry.bbox().intersects(box)) {
+            features.push_back(std::move(feature));
+        }
+    }
+    return features;
+}
+
+int import_flatgeobuf(sqlite3 *db_handle, const std::string &fgb_file_path, const std::string &table_name,
+                      const BlobEncoding &encoding, ImportStats *stats)
+{
+    std::string sql_cmd;
+    int ret;
+    char *err_msg = NULL;
+    sqlite3_stmt *stmt = NULL;
+
+    try {
+        FlatGeobufReader reader(fgb_file_path);
+        if (stats != NULL) {
+            stats->set_total_bytes(reader.file_size());
+        }
+        const GeometryType column_type = column_geometry_type(reader.geometry_type());
+
+        // Create the table the way ImportSHP would, and stream every
+        // feature into it, in a single transaction
+        ret = sqlite3_exec(db_handle, "BEGIN TRANSACTION;", NULL, NULL, &err_msg);
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error starting transaction: " << err_msg << std::endl;
+            sqlite3_free(err_msg);
+            return 1;
+        }
+
+        sql_cmd = "CREATE TABLE " + quote_identifier(table_name) + " (PK_UID INTEGER PRIMARY KEY AUTOINCREMENT";
+        std::string insert_columns;
+        std::string insert_values;
+        for (const auto &column : reader.columns()) {
+            sql_cmd += ", " + quote_identifier(column.name) + " " + sql_column_type(column.type);
+            insert_columns += quote_identifier(column.name) + ", ";
+            insert_values += "?, ";
+        }
+        sql_cmd += ")";
+
+        ret = sqlite3_exec(db_handle, sql_cmd.c_str(), NULL, NULL, &err_msg);
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error creating table: " << err_msg << std::endl;
+            sqlite3_free(err_msg);
+            sqlite3_exec(db_handle, "ROLLBACK;", NULL, NULL, NULL);
+            return 1;
+        }
+
+        sql_cmd = "SELECT AddGeometryColumn('" + table_name + "', 'Geometry', " + std::to_string(reader.srid()) +
+            ", '" + geometry_type_name(column_type) + "', 'XY')";
+        ret = sqlite3_exec(db_handle, sql_cmd.c_str(), NULL, NULL, &err_msg);
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error adding geometry column: " << err_msg << std::endl;
+            sqlite3_free(err_msg);
+            sqlite3_exec(db_handle, "ROLLBACK;", NULL, NULL, NULL);
+            return 1;
+        }
+
+        sql_cmd = "INSERT INTO " + quote_identifier(table_name) + " (" + insert_columns +
+            "Geometry) VALUES (" + insert_values + "?)";
+        ret = sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL);
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+            sqlite3_exec(db_handle, "ROLLBACK;", NULL, NULL, NULL);
+            return 1;
+        }
+
+        FgbFeature feature;
+        std::vector<uint8_t> blob;
+        uint64_t count = 0;
+        uint64_t bytes_counted = 0;
+        while (true) {
+            ImportStats::Timer parse_timer(stats, ImportStats::Parse);
+            if (!reader.next(feature)) break;
+            parse_timer.stop();
+
+            ImportStats::Timer encode_timer(stats, ImportStats::Encode);
+            quantize_geometry(feature.geometry, encoding.precision);
+            const bool has_geometry = feature.geometry.type != GeometryType::Unknown;
+            if (has_geometry) {
+                if (column_type != GeometryType::Unknown) {
+                    promote_to_multi(feature.geometry);
+                }
+                blob = encode_spatialite_blob(feature.geometry, encoding.compressed);
+            }
+            encode_timer.stop();
+
+            ImportStats::Timer insert_timer(stats, ImportStats::Insert);
+            for (size_t i = 0; i < feature.values.size(); i++) {
+                const FgbValue &value = feature.values[i];
+                const int index = static_cast<int>(i) + 1;
+                switch (value.kind) {
+                    case FgbValue::Integer:
+                        sqlite3_bind_int64(stmt, index, value.integer);
+                        break;
+                    case FgbValue::Real:
+                        sqlite3_bind_double(stmt, index, value.real);
+                        break;
+                    case FgbValue::Text:
+                        sqlite3_bind_text(stmt, index, value.bytes.data(), value.bytes.size(), SQLITE_STATIC);
+                        break;
+                    case FgbValue::Blob:
+                        sqlite3_bind_blob(stmt, index, value.bytes.data(), value.bytes.size(), SQLITE_STATIC);
+                        break;
+                    default:
+                        sqlite3_bind_null(stmt, index);
+                        break;
+                }
+            }
+
+            const int geometry_index = static_cast<int>(feature.values.size()) + 1;
+            if (has_geometry) {
+                sqlite3_bind_blob(stmt, geometry_index, blob.data(), blob.size(), SQLITE_STATIC);
+            } else {
+                sqlite3_bind_null(stmt, geometry_index);
+            }
+
+            ret = sqlite3_step(stmt);
+            if (ret != SQLITE_DONE) {
+                std::cerr << "Error inserting feature " << count << ": " << sqlite3_errmsg(db_handle) << std::endl;
+                sqlite3_finalize(stmt);
+                sqlite3_exec(db_handle, "ROLLBACK;", NULL, NULL, NULL);
+                return 1;
+            }
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+            insert_timer.stop();
+            count++;
+
+            // The header and index are attributed to the first feature
+            if (stats != NULL) {
+                stats->add_record(reader.position() - bytes_counted, feature.geometry.num_vertices());
+                bytes_counted = reader.position();
+                stats->progress();
+            }
+        }
+        sqlite3_finalize(stmt);
+        stmt = NULL;
+
+        ImportStats::Timer commit_timer(stats, ImportStats::Insert);
+        ret = sqlite3_exec(db_handle, "COMMIT;", NULL, NULL, &err_msg);
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error committing transaction: " << err_msg << std::endl;
+            sqlite3_free(err_msg);
+            return 1;
+        }
+        commit_timer.stop();
+
+        std::cout << "Imported " << count << " features into " << table_name << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << "Error importing FlatGeobuf: " << e.what() << std::endl;
+        sqlite3_finalize(stmt);
+        sqlite3_exec(db_handle, "ROLLBACK;", NULL, NULL, NULL);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+#ifndef FLATGEOBUF_H
+#define FLATGEOBUF_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "geometry.h"
+#include "packed_rtree.h"
+
+class ImportStats;
+
+/**
+ * FlatGeobuf column types, as numbered in the FlatGeobuf schema
+ */
+enum class FgbColumnType : uint8_t {
+    Byte = 0,
+    UByte,
+    Bool,
+    Short,
+    UShort,
+    Int,
+    UInt,
+    Long,
+    ULong,
+    Float,
+    Double,
+    String,
+    Json,
+    DateTime,
+    Binary,
+};
+
+struct FgbColumn {
+    std::string name;
+    FgbColumnType type;
+};
+
+/**
+ * An attribute value, already mapped to the SQLite storage class it
+ * will be bound as
+ */
+struct FgbValue {
+    enum Kind { Null, Integer, Real, Text, Blob };
+
+    Kind kind = Null;
+    int64_t integer = 0;
+    double real = 0.0;
+    std::string bytes;  // Text and Blob payload
+};
+
+struct FgbFeature {
+    Geometry geometry;
+    std::vector<FgbValue> values;  // one per header column
+};
+
+/**
+ * Native, dependency free FlatGeobuf reader
+ *
+ * The file is memory mapped and decoded in place: features are streamed
+ * one at a time with next(), and when the file carries its packed Hilbert
+ * R-tree, query() answers bounding box queries from that index directly,
+ * touching only the matching features.
+ *
+ * The constructor throws std::runtime_error if the file cannot be mapped
+ * or is not a FlatGeobuf file.
+ */
+class FlatGeobufReader {
+public:
+    explicit FlatGeobufReader(const std::string &path);
+    ~FlatGeobufReader();
+
+    FlatGeobufReader(const FlatGeobufReader &) = delete;
+    FlatGeobufReader &operator=(const FlatGeobufReader &) = delete;
+
+    const std::string &name() const { return name_; }
+    GeometryType geometry_type() const { return geometry_type_; }
+    const std::vector<FgbColumn> &columns() const { return columns_; }
+    uint64_t features_count() const { return features_count_; }
+    int srid() const { return srid_; }
+    bool has_index() const { return !index_.empty(); }
+    const BBox &envelope() const { return envelope_; }
+
+    /**
+     * Size in bytes of the file
+     */
+    uint64_t file_size() const { return size_; }
+
+    /**
+     * Offset in the file of the next feature of the sequential stream
+     */
+    uint64_t position() const { return features_start_ + cursor_; }
+
+    /**
+     * Reads the next feature of the sequential stream
+     *
+     * @param feature decoded feature
+     * @return true if a feature was read, false at the end of the file
+     */
+    bool next(FgbFeature &feature);
+
+    /**
+     * Restarts the sequential stream at the first feature
+     */
+    void rewind();
+
+    /**
+     * Answers a bounding box query from the file's spatial index
+     *
+     * @param box query box
+     * @return features whose bounding box intersects the query box, in
+     *         index order. Falls back to a full scan when the file has
+     *         no index.
+     */
+    std::vector<FgbFeature> query(const BBox &box) const;
+
+private:
+    void parse_header();
+    void read_feature(uint64_t offset, FgbFeature &feature, uint64_t *size) const;
+
+    std::string path_;
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+
+    std::string name_;
+    GeometryType geometry_type_ = GeometryType::Unknown;
+    std::vector<FgbColumn> columns_;
+    uint64_t features_count_ = 0;
+    int srid_ = 0;
+    BBox envelope_;
+    PackedRTree index_;
+
+    uint64_t features_start_ = 0;  // file offset of the first feature
+    uint64_t cursor_ = 0;          // offset of the next feature, relative to features_start_
+};
+
+/**
+ * Imports a FlatGeobuf file into a new SpatiaLite table
+ *
+ * @param db_handle handle to the database connection
+ * @param fgb_file_path path to the .fgb file
+ * @param table_name name of the table to create
+ * @param encoding how geometries are stored (compression, quantization)
+ * @param stats throughput counters to update (may be NULL)
+ * @return 0 on success, 1 on failure
+ *
+ * The table is laid out like the ones ImportSHP creates: a PK_UID primary
+ * key, one column per FlatGeobuf column and a "Geometry" column. Polygons
+ * are stored as MULTIPOLYGON so the table can be queried exactly like the
+ * `location` table imported from shapefiles.
+ */
+int import_flatgeobuf(sqlite3 *db_handle, const std::string &fgb_file_path, const std::string &table_name,
+                      const BlobEncoding &encoding = BlobEncoding(), ImportStats *stats = NULL);
+
+#endif // FLATGEOBUF_H
@@ -0,0 +1,49 @@
+#include "geo_distance.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <geodesic.h>
+
+void search_window(double distance, bool geographic, double max_abs_y, double &dx, double &dy)
+{
+    if (!geographic) {
+        dx = dy = distance;
+        return;
+    }
+    dy = distance / MIN_METRES_PER_DEGREE_LAT;
+    const double latitude = std::min(89.9, max_abs_y + dy);
+    dx = std::min(360.0, distance / (MIN_METRES_PER_DEGREE_LON * std::cos(latitude * DEG_TO_RAD)));
+}
+
+double point_distance(const Point &a, const Point &b, bool geographic)
+{
+    if (!geographic) {
+        return std::sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y));
+    }
+    // GRS 80 and WGS 84 differ by a tenth of a millimetre in semi-minor
+    // axis; either gives the same distance at this precision
+    static const geod_geodesic geod = []() {
+        geod_geodesic g;
+        geod_init(&g, 6378137, 1 / 298.257222101);
+        return g;
+    }();
+    double distance = 0;
+    geod_inverse(&geod, a.y, a.x, b.y, b.x, &distance, NULL, NULL);
+    return distance;
+}
+
+double nearest_on_segment(const Point &p, const Point &a, const Point &b, double kx, Point &nearest)
+{
+    const double dx = (b.x - a.x) * kx;
+    const double dy = b.y - a.y;
+    double t = 0;
+    if (dx != 0 || dy != 0) {
+        t = ((p.x - a.x) * kx * dx + (p.y - a.y) * dy) / (dx * dx + dy * dy);
+        t = std::min(1.0, std::max(0.0, t));
+    }
+    nearest = Point{a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t};
+    const double ex = (p.x - nearest.x) * kx;
+    const double ey = p.y - nearest.y;
+    return ex * ex + ey * ey;
+}
@@ -0,0 +1,45 @@
+#ifndef GEO_DISTANCE_H
+#define GEO_DISTANCE_H
+
+#include "geometry.h"
+
+// Lower bounds of the length of a degree on the ellipsoid: a degree of
+// latitude is at least 110,574 m long (at the equator), a degree of
+// longitude at least 111,319 m times the cosine of the latitude
+const double MIN_METRES_PER_DEGREE_LAT = 110574;
+const double MIN_METRES_PER_DEGREE_LON = 111319;
+
+// Degrees to radians
+const double DEG_TO_RAD = 3.14159265358979323846 / 180;
+
+/**
+ * Search window around points whose latitude is at most max_abs_y in
+ * absolute value: anything within the distance of them is within dx and dy
+ *
+ * @param distance distance, in metres for geographic data
+ * @param geographic true if the points are longitude/latitude
+ * @param max_abs_y highest absolute latitude of the points
+ * @param dx half width of the window, in CRS units
+ * @param dy half height of the window, in CRS units
+ */
+void search_window(double distance, bool geographic, double max_abs_y, double &dx, double &dy);
+
+/**
+ * Exact distance between two points: geodesic on GRS 80 for longitude and
+ * latitude, Euclidean otherwise
+ *
+ * @return distance, in metres for geographic data
+ */
+double point_distance(const Point &a, const Point &b, bool geographic);
+
+/**
+ * Nearest point of segment ab to p, with x distances scaled by kx: 1 in a
+ * projected CRS, the cosine of the latitude of p for a local equirectangular
+ * metric on longitude/latitude
+ *
+ * @param nearest nearest point of the segment
+ * @return squared scaled distance from p to that point
+ */
+double nearest_on_segment(const Point &p, const Point &a, const Point &b, double kx, Point &nearest);
+
+#endif // GEO_DISTANCE_H
@@ -0,0 +1,284 @@
+#include "geodesic_measures.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <geodesic.h>
+
+#include "geometry.h"
+#include "projection.h"
+#include "sql_util.h"
+#include "thread_pool.h"
+
+namespace {
+
+// Rows read, measured in parallel and written back at a time
+const int MEASURE_BATCH_SIZE = 256;
+
+struct Row {
+    int64_t rowid = 0;
+    Geometry geometry;   // in the geographic CRS of the table
+    bool measured = false;
+    double area = 0;
+    double perimeter = 0;
+};
+
+/**
+ * One ring of a row; holes have is_hole set
+ */
+struct RingTask {
+    size_t row;
+    const Ring *ring;
+    bool is_hole;
+    double area;
+    double perimeter;
+};
+
+/**
+ * Reads the SRID of a geometry column from the SpatiaLite metadata
+ */
+int column_srid(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column)
+{
+    sqlite3_stmt *stmt;
+    const char *sql_cmd = "SELECT srid FROM geometry_columns "
+        "WHERE Lower(f_table_name) = Lower(?) AND Lower(f_geometry_column) = Lower(?)";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd, -1, &stmt, NULL) != SQLITE_OK) return 0;
+    sqlite3_bind_text(stmt, 1, table_name.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, geometry_column.c_str(), -1, SQLITE_TRANSIENT);
+    const int srid = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+    sqlite3_finalize(stmt);
+    return srid;
+}
+
+/**
+ * Finds the geographic CRS a CRS is based on, and its ellipsoid
+ *
+ * @param srid EPSG code of the CRS
+ * @param geographic_srid EPSG code of its geographic CRS; srid itself for
+ *        a geographic CRS
+ * @param a semi-major axis, in metres
+ * @param f flattening, 0 for a sphere
+ * @return false if PROJ does not know the CRS
+ */
+bool geodetic_crs(const ProjContext &proj, int srid, int &geographic_srid, double &a, double &f)
+{
+    const std::string definition = "EPSG:" + std::to_string(srid);
+    PJ *crs = proj_create(proj.handle(), definition.c_str());
+    if (crs == nullptr) return false;
+    PJ *geodetic = proj_crs_get_geodetic_crs(proj.handle(), crs);
+    proj_destroy(crs);
+    if (geodetic == nullptr) return false;
+
+    const char *auth = proj_get_id_auth_name(geodetic, 0);
+    const char *code = proj_get_id_code(geodetic, 0);
+    geographic_srid = auth != nullptr && code != nullptr && strcmp(auth, "EPSG") == 0 ? std::atoi(code) : 0;
+
+    PJ *ellipsoid = proj_get_ellipsoid(proj.handle(), geodetic);
+    proj_destroy(geodetic);
+    if (ellipsoid == nullptr) return false;
+
+    double inverse_flattening = 0;
+    const int ok = proj_ellipsoid_get_parameters(proj.handle(), ellipsoid, &a, NULL, NULL, &inverse_flattening);
+    proj_destroy(ellipsoid);
+    f = inverse_flattening > 0 ? 1 / inverse_flattening : 0;
+    return ok != 0 && geographic_srid > 0;
+}
+
+/**
+ * Measures a ring on the ellipsoid; runs on a worker thread
+ *
+ * The coordinates are copied to two contiguous latitude and longitude
+ * arrays, the layout geod_polygonarea walks edge after edge.
+ */
+void measure_ring(const geod_geodesic &geod, RingTask &task, std::vector<double> &lats, std::vector<double> &lons)
+{
+    const Ring &ring = *task.ring;
+    // The closing vertex repeats the first one
+    const size_t n = ring.size() > 1 && ring.front().x == ring.back().x && ring.front().y == ring.back().y
+        ? ring.size() - 1 : ring.size();
+
+    lats.resize(n);
+    lons.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        lons[i] = ring[i].x;
+        lats[i] = ring[i].y;
+    }
+
+    double area = 0;
+    double perimeter = 0;
+    geod_polygonarea(&geod, lats.data(), lons.data(), static_cast<int>(n), &area, &perimeter);
+    // Positive counterclockwise, negative clockwise
+    task.area = std::fabs(area);
+    task.perimeter = perimeter;
+}
+
+} // namespace
+
+int compute_geodesic_measures(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                              ThreadPool &pool, GeodesicSummary *summary)
+{
+    const std::string table = quote_identifier(table_name);
+    const std::string column = quote_identifier(geometry_column);
+    GeodesicSummary counts;
+
+    // One PROJ context per worker, for the projected tables
+    std::vector<std::unique_ptr<ProjContext>> contexts;
+    int srid = column_srid(db_handle, table_name, geometry_column);
+    int geographic_srid = 0;
+    double a = 0;
+    double f = 0;
+    try {
+        for (unsigned i = 0; i < pool.size(); i++) {
+            contexts.emplace_back(new ProjContext());
+        }
+        if (!geodetic_crs(*contexts[0], srid, geographic_srid, a, f)) {
+            std::cerr << "Error measuring " << table_name << ": no ellipsoid for SRID " << srid << std::endl;
+            return 1;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error measuring " << table_name << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    geod_geodesic geod;
+    geod_init(&geod, a, f);
+
+    if (add_column(db_handle, table, "geodesic_area", "REAL") != 0 ||
+        add_column(db_handle, table, "geodesic_perimeter", "REAL") != 0) {
+        return 1;
+    }
+
+    sqlite3_stmt *select_stmt;
+    std::string sql_cmd = "SELECT rowid, " + column + " FROM " + table + " WHERE rowid > ? ORDER BY rowid LIMIT " +
+        std::to_string(MEASURE_BATCH_SIZE);
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &select_stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+
+    sqlite3_stmt *update_stmt;
+    sql_cmd = "UPDATE " + table + " SET geodesic_area = ?1, geodesic_perimeter = ?2 WHERE rowid = ?3";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &update_stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        sqlite3_finalize(select_stmt);
+        return 1;
+    }
+
+    auto fail = [&]() {
+        sqlite3_finalize(select_stmt);
+        sqlite3_finalize(update_stmt);
+        exec(db_handle, "ROLLBACK;", "rolling back");
+        return 1;
+    };
+
+    if (exec(db_handle, "BEGIN TRANSACTION;", "starting transaction") != 0) {
+        sqlite3_finalize(select_stmt);
+        sqlite3_finalize(update_stmt);
+        return 1;
+    }
+
+    // Coordinate arrays of each worker, reused from ring to ring
+    std::vector<std::vector<double>> lats(pool.size());
+    std::vector<std::vector<double>> lons(pool.size());
+
+    std::vector<Row> rows;
+    std::vector<std::vector<uint8_t>> blobs;
+    int64_t last_rowid = INT64_MIN;
+    while (true) {
+        // Read a batch
+        rows.clear();
+        blobs.clear();
+        sqlite3_bind_int64(select_stmt, 1, last_rowid);
+        while (sqlite3_step(select_stmt) == SQLITE_ROW) {
+            rows.emplace_back();
+            rows.back().rowid = sqlite3_column_int64(select_stmt, 0);
+            const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_column_blob(select_stmt, 1));
+            blobs.emplace_back(blob, blob + sqlite3_column_bytes(select_stmt, 1));
+        }
+        sqlite3_reset(select_stmt);
+        if (rows.empty()) break;
+        last_rowid = rows.back().rowid;
+
+        try {
+            // Decode, and reproject the projected tables, one row per task
+            pool.parallel_for(rows.size(), [&](size_t index, unsigned worker) {
+                Row &row = rows[index];
+                const std::vector<uint8_t> &blob = blobs[index];
+                if (!decode_spatialite_blob(blob.data(), blob.size(), row.geometry) ||
+                    row.geometry.polygons.empty() || !contexts[worker]->transform(row.geometry, geographic_srid)) {
+                    row.geometry = Geometry();
+                    return;
+                }
+                row.measured = true;
+            });
+
+            // Measure, one ring per task: the largest states are a handful
+            // of rings of a hundred thousand vertices each
+            std::vector<RingTask> tasks;
+            for (size_t r = 0; r < rows.size(); r++) {
+                for (const auto &polygon : rows[r].geometry.polygons) {
+                    for (size_t i = 0; i < polygon.rings.size(); i++) {
+                        tasks.push_back(RingTask{r, &polygon.rings[i], i > 0, 0, 0});
+                    }
+                }
+            }
+            pool.parallel_for(tasks.size(), [&](size_t index, unsigned worker) {
+                measure_ring(geod, tasks[index], lats[worker], lons[worker]);
+            });
+
+            for (const RingTask &task : tasks) {
+                Row &row = rows[task.row];
+                row.area += task.is_hole ? -task.area : task.area;
+                row.perimeter += task.perimeter;
+            }
+            counts.rings += tasks.size();
+        } catch (const std::exception &e) {
+            std::cerr << "Error measuring " << table_name << ": " << e.what() << std::endl;
+            return fail();
+        }
+
+        // Write it back
+        for (size_t i = 0; i < rows.size(); i++) {
+            const Row &row = rows[i];
+            if (blobs[i].empty()) continue;  // NULL geometry
+
+            if (row.measured) {
+                sqlite3_bind_double(update_stmt, 1, row.area);
+                sqlite3_bind_double(update_stmt, 2, row.perimeter);
+            } else {
+                sqlite3_bind_null(update_stmt, 1);
+                sqlite3_bind_null(update_stmt, 2);
+            }
+            sqlite3_bind_int64(update_stmt, 3, row.rowid);
+
+            if (sqlite3_step(update_stmt) != SQLITE_DONE) {
+                std::cerr << "Error updating geometry " << row.rowid << ": " << sqlite3_errmsg(db_handle) << std::endl;
+                return fail();
+            }
+            sqlite3_reset(update_stmt);
+
+            counts.measured += row.measured ? 1 : 0;
+            counts.failed += row.measured ? 0 : 1;
+        }
+    }
+    sqlite3_finalize(select_stmt);
+    sqlite3_finalize(update_stmt);
+
+    if (exec(db_handle, "COMMIT;", "committing transaction") != 0) {
+        return 1;
+    }
+
+    std::cout << "Measured " << counts.measured << " geometries of " << table_name << " (" << counts.rings
+        << " rings) on the ellipsoid of EPSG:" << geographic_srid << ", on " << pool.size() << " threads"
+        << (counts.failed > 0 ? ", " + std::to_string(counts.failed) + " left without measures" : "")
+        << std::endl;
+
+    if (summary != NULL) {
+        *summary = counts;
+    }
+    return 0;
+}
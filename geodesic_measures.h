@@ -0,0 +1,40 @@
+#ifndef GEODESIC_MEASURES_H
+#define GEODESIC_MEASURES_H
+
+#include <cstdint>
+#include <string>
+
+#include <sqlite3.h>
+
+class ThreadPool;
+
+struct GeodesicSummary {
+    uint64_t measured = 0;   // geometries measured
+    uint64_t rings = 0;      // rings the measures were computed over
+    uint64_t failed = 0;     // geometries left without measures (not polygonal, or not reprojectable)
+};
+
+/**
+ * Stores the ellipsoidal area and perimeter of every polygon of a table
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table holding the polygons
+ * @param geometry_column geometry column to measure
+ * @param pool threads computing the measures, one ring per task
+ * @param summary counts of measured geometries and rings (may be NULL)
+ * @return 0 on success, 1 on failure
+ *
+ * Adds `geodesic_area` (square metres) and `geodesic_perimeter` (metres,
+ * holes included) columns to the table, the values ST_Area(geometry, 1)
+ * and ST_Perimeter(geometry, 1) return, so reports read a column instead
+ * of walking hundreds of thousands of vertices on every query.
+ *
+ * Each ring is measured on the ellipsoid of the table's CRS with Karney's
+ * geodesic polygon algorithm (PROJ geod_polygonarea), accurate to a few
+ * square millimetres whatever the size of the ring. Rings of projected
+ * tables are first reprojected to the geographic CRS they are based on.
+ */
+int compute_geodesic_measures(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                              ThreadPool &pool, GeodesicSummary *summary = NULL);
+
+#endif // GEODESIC_MEASURES_H
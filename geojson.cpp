@@ -0,0 +1,881 @@
+#include "geojson.h"
+
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#include "import_stats.h"
+#include "sql_util.h"
+
+namespace {
+
+const size_t READ_CHUNK_SIZE = 1 << 16;
+
+[[noreturn]] void syntax_error(const char *what)
+{
+    throw std::runtime_error(std::string("Malformed GeoJSON: ") + what);
+}
+
+void append_utf8(std::string &out, uint32_t code_point)
+{
+    if (code_point < 0x80) {
+        out += static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+        out += static_cast<char>(0xC0 | (code_point >> 6));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        out += static_cast<char>(0xE0 | (code_point >> 12));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code_point >> 18));
+        out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+}
+
+void append_json_string(std::string &out, const std::string &value)
+{
+    out += '"';
+    for (unsigned char c : value) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    out += '"';
+}
+
+/**
+ * Incremental, SAX-style JSON parser
+ *
+ * Input can be fed in arbitrary chunks: tokens split across chunk
+ * boundaries are carried over. Events are delivered to the handler as
+ * soon as each token completes. Several top-level values may follow each
+ * other, which is what newline-delimited JSON needs.
+ */
+template <typename Handler>
+class JsonSaxParser {
+public:
+    explicit JsonSaxParser(Handler &handler) : handler_(handler) {}
+
+    void feed(const char *data, size_t size)
+    {
+        size_t i = 0;
+        while (i < size) {
+            switch (lex_) {
+                case Lex::String:
+                    i = scan_string(data, size, i);
+                    break;
+                case Lex::Escape:
+                    i = scan_escape(data[i], i);
+                    break;
+                case Lex::Unicode:
+                    scan_unicode(data[i]);
+                    i++;
+                    break;
+                case Lex::Number:
+                    if (is_number_char(data[i])) {
+                        token_ += data[i++];
+                    } else {
+                        emit_number();
+                    }
+                    break;
+                case Lex::Literal:
+                    if (data[i] >= 'a' && data[i] <= 'z') {
+                        token_ += data[i++];
+                    } else {
+                        emit_literal();
+                    }
+                    break;
+                default:
+                    structural(data[i]);
+                    i++;
+                    break;
+            }
+        }
+    }
+
+    void finish()
+    {
+        if (lex_ == Lex::Number) emit_number();
+        if (lex_ == Lex::Literal) emit_literal();
+        if (lex_ != Lex::Between || !stack_.empty()) syntax_error("unexpected end of input");
+    }
+
+private:
+    enum class Lex { Between, String, Escape, Unicode, Number, Literal };
+    enum class Expect { Value, ValueOrEnd, Key, KeyOrEnd, Colon, CommaOrEnd };
+
+    static bool is_number_char(char c)
+    {
+        return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+    }
+
+    bool expecting_value() const { return expect_ == Expect::Value || expect_ == Expect::ValueOrEnd; }
+
+    void after_value()
+    {
+        expect_ = stack_.empty() ? Expect::Value : Expect::CommaOrEnd;
+    }
+
+    void structural(char c)
+    {
+        switch (c) {
+            case ' ': case '\t': case '\n': case '\r':
+                return;
+            case '{':
+                if (!expecting_value()) syntax_error("unexpected '{'");
+                stack_.push_back('{');
+                expect_ = Expect::KeyOrEnd;
+                handler_.start_object();
+                return;
+            case '[':
+                if (!expecting_value()) syntax_error("unexpected '['");
+                stack_.push_back('[');
+                expect_ = Expect::ValueOrEnd;
+                handler_.start_array();
+                return;
+            case '}':
+                if (stack_.empty() || stack_.back() != '{' ||
+                    (expect_ != Expect::KeyOrEnd && expect_ != Expect::CommaOrEnd)) {
+                    syntax_error("unexpected '}'");
+                }
+                stack_.pop_back();
+                handler_.end_object();
+                after_value();
+                return;
+            case ']':
+                if (stack_.empty() || stack_.back() != '[' ||
+                    (expect_ != Expect::ValueOrEnd && expect_ != Expect::CommaOrEnd)) {
+                    syntax_error("unexpected ']'");
+                }
+                stack_.pop_back();
+                handler_.end_array();
+                after_value();
+                return;
+            case ':':
+                if (expect_ != Expect::Colon) syntax_error("unexpected ':'");
+                expect_ = Expect::Value;
+                return;
+            case ',':
+                if (expect_ != Expect::CommaOrEnd) syntax_error("unexpected ','");
+                expect_ = stack_.back() == '{' ? Expect::Key : Expect::Value;
+                return;
+            case '"':
+                if (!expecting_value() && expect_ != Expect::Key && expect_ != Expect::KeyOrEnd) {
+                    syntax_error("unexpected string");
+                }
+                token_.clear();
+                lex_ = Lex::String;
+                return;
+            default:
+                if (!expecting_value()) syntax_error("unexpected character");
+                token_.clear();
+                token_ += c;
+                if (c == '-' || (c >= '0' && c <= '9')) {
+                    lex_ = Lex::Number;
+                } else if (c >= 'a' && c <= 'z') {
+                    lex_ = Lex::Literal;
+                } else if (c == '\xEF' || c == '\xBB' || c == '\xBF') {
+                    // UTF-8 byte order mark before the first value
+                    if (!stack_.empty()) syntax_error("unexpected character");
+                    token_.clear();
+                } else {
+                    syntax_error("unexpected character");
+                }
+                return;
+        }
+    }
+
+    size_t scan_string(const char *data, size_t size, size_t i)
+    {
+        const size_t start = i;
+        while (i < size && data[i] != '"' && data[i] != '\\') {
+            i++;
+        }
+        token_.append(data + start, i - start);
+        if (i == size) return i;
+
+        if (data[i] == '\\') {
+            lex_ = Lex::Escape;
+            return i + 1;
+        }
+
+        // closing quote
+        lex_ = Lex::Between;
+        if (expect_ == Expect::Key || expect_ == Expect::KeyOrEnd) {
+            handler_.key(token_);
+            expect_ = Expect::Colon;
+        } else {
+            handler_.string_value(token_);
+            after_value();
+        }
+        return i + 1;
+    }
+
+    size_t scan_escape(char c, size_t i)
+    {
+        lex_ = Lex::String;
+        switch (c) {
+            case '"': token_ += '"'; break;
+            case '\\': token_ += '\\'; break;
+            case '/': token_ += '/'; break;
+            case 'b': token_ += '\b'; break;
+            case 'f': token_ += '\f'; break;
+            case 'n': token_ += '\n'; break;
+            case 'r': token_ += '\r'; break;
+            case 't': token_ += '\t'; break;
+            case 'u':
+                lex_ = Lex::Unicode;
+                unicode_digits_ = 0;
+                unicode_value_ = 0;
+                break;
+            default:
+                syntax_error("invalid escape sequence");
+        }
+        return i + 1;
+    }
+
+    void scan_unicode(char c)
+    {
+        uint32_t digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else syntax_error("invalid \\u escape");
+
+        unicode_value_ = (unicode_value_ << 4) | digit;
+        if (++unicode_digits_ < 4) return;
+
+        lex_ = Lex::String;
+        if (unicode_value_ >= 0xD800 && unicode_value_ <= 0xDBFF) {
+            high_surrogate_ = unicode_value_;
+        } else if (unicode_value_ >= 0xDC00 && unicode_value_ <= 0xDFFF && high_surrogate_ != 0) {
+            append_utf8(token_, 0x10000 + ((high_surrogate_ - 0xD800) << 10) + (unicode_value_ - 0xDC00));
+            high_surrogate_ = 0;
+        } else {
+            append_utf8(token_, unicode_value_);
+            high_surrogate_ = 0;
+        }
+    }
+
+    void emit_number()
+    {
+        double value;
+        auto result = std::from_chars(token_.data(), token_.data() + token_.size(), value);
+        if (result.ec != std::errc() || result.ptr != token_.data() + token_.size()) {
+            syntax_error("invalid number");
+        }
+        lex_ = Lex::Between;
+        handler_.number_value(value, token_);
+        after_value();
+    }
+
+    void emit_literal()
+    {
+        lex_ = Lex::Between;
+        if (token_ == "true") handler_.bool_value(true);
+        else if (token_ == "false") handler_.bool_value(false);
+        else if (token_ == "null") handler_.null_value();
+        else syntax_error("invalid literal");
+        after_value();
+    }
+
+    Handler &handler_;
+    Lex lex_ = Lex::Between;
+    Expect expect_ = Expect::Value;
+    std::vector<char> stack_;
+    std::string token_;
+    int unicode_digits_ = 0;
+    uint32_t unicode_value_ = 0;
+    uint32_t high_surrogate_ = 0;
+};
+
+} // namespace
+
+/**
+ * Turns JSON events into GeoJSON features
+ *
+ * Any top-level object, and any object inside a "features" array, is a
+ * feature candidate; it is emitted when it closes if it had a "geometry"
+ * member. Coordinates are collected into a flat list of positions plus
+ * the end offsets of each nesting level, and only turned into a geometry
+ * once the geometry's "type" is known (members may come in any order).
+ */
+class GeoJsonFeatureBuilder {
+public:
+    explicit GeoJsonFeatureBuilder(std::deque<GeoJsonFeature> &ready) : ready_(ready), parser_(*this) {}
+
+    void feed(const char *data, size_t size) { parser_.feed(data, size); }
+    void finish() { parser_.finish(); }
+    uint64_t skipped() const { return skipped_; }
+
+    // JSON events
+
+    void start_object()
+    {
+        Frame *top = top_frame();
+        if (top == nullptr || top->kind == FeaturesArray) {
+            begin_feature();
+            frames_.emplace_back(FeatureObject);
+        } else if (top->kind == FeatureObject && top->key == "geometry") {
+            begin_geometry();
+            frames_.emplace_back(GeometryObject);
+        } else if (top->kind == FeatureObject && top->key == "properties") {
+            properties_.assign("{");
+            frames_.emplace_back(Properties);
+        } else if (top->kind == Properties) {
+            begin_property_value();
+            properties_ += '{';
+            frames_.emplace_back(Properties);
+        } else {
+            frames_.emplace_back(Ignored);
+        }
+    }
+
+    void end_object()
+    {
+        Frame frame = std::move(frames_.back());
+        frames_.pop_back();
+
+        switch (frame.kind) {
+            case FeatureObject:
+                if (!frame.is_collection && has_geometry_) {
+                    emit_feature();
+                }
+                break;
+            case GeometryObject:
+                build_geometry();
+                break;
+            case Properties:
+                properties_ += '}';
+                break;
+            default:
+                break;
+        }
+    }
+
+    void start_array()
+    {
+        Frame *top = top_frame();
+        if (top != nullptr && top->kind == FeatureObject && top->key == "features") {
+            top->is_collection = true;
+            frames_.emplace_back(FeaturesArray);
+        } else if (top != nullptr && (top->kind == Coordinates ||
+                                      (top->kind == GeometryObject && top->key == "coordinates"))) {
+            frames_.emplace_back(Coordinates);
+            num_values_ = 0;
+        } else if (top != nullptr && top->kind == Properties) {
+            begin_property_value();
+            properties_ += '[';
+            frames_.emplace_back(Properties);
+        } else {
+            if (top != nullptr && top->kind == GeometryObject && top->key == "geometries") {
+                geometry_supported_ = false;
+            }
+            frames_.emplace_back(Ignored);
+        }
+    }
+
+    void end_array()
+    {
+        Frame frame = std::move(frames_.back());
+        frames_.pop_back();
+
+        if (frame.kind == Properties) {
+            properties_ += ']';
+        } else if (frame.kind == Coordinates) {
+            end_coordinates(frame);
+        }
+    }
+
+    void key(const std::string &name)
+    {
+        Frame &top = frames_.back();
+        if (top.kind == Properties) {
+            if (!top.first) properties_ += ',';
+            top.first = false;
+            append_json_string(properties_, name);
+            properties_ += ':';
+            after_key_ = true;
+        }
+        top.key = name;
+    }
+
+    void string_value(const std::string &value)
+    {
+        Frame *top = top_frame();
+        if (top == nullptr) return;
+
+        if (top->kind == GeometryObject && top->key == "type") {
+            geometry_type_ = value;
+        } else if (top->kind == Properties) {
+            begin_property_value();
+            append_json_string(properties_, value);
+            if (frames_.size() >= 2 && frames_[frames_.size() - 2].kind == FeatureObject && top->key == "name") {
+                name_ = value;
+            }
+        }
+    }
+
+    void number_value(double value, const std::string &text)
+    {
+        Frame *top = top_frame();
+        if (top == nullptr) return;
+
+        if (top->kind == Coordinates) {
+            top->has_numbers = true;
+            if (num_values_ < 2) values_[num_values_] = value;
+            num_values_++;
+        } else if (top->kind == Properties) {
+            begin_property_value();
+            properties_ += text;
+        }
+    }
+
+    void bool_value(bool value)
+    {
+        Frame *top = top_frame();
+        if (top != nullptr && top->kind == Properties) {
+            begin_property_value();
+            properties_ += value ? "true" : "false";
+        }
+    }
+
+    void null_value()
+    {
+        Frame *top = top_frame();
+        if (top == nullptr) return;
+
+        if (top->kind == Properties) {
+            begin_property_value();
+            properties_ += "null";
+        } else if (top->kind == FeatureObject && top->key == "geometry") {
+            // a feature without geometry is still a feature
+            has_geometry_ = true;
+            geometry_ok_ = true;
+            geometry_ = Geometry();
+        }
+    }
+
+private:
+    enum FrameKind { FeatureObject, FeaturesArray, GeometryObject, Coordinates, Properties, Ignored };
+
+    struct Frame {
+        explicit Frame(FrameKind frame_kind) : kind(frame_kind) {}
+
+        FrameKind kind;
+        std::string key;            // last key seen, for objects
+        bool first = true;          // no member written yet (Properties)
+        bool is_collection = false; // has a "features" array (FeatureObject)
+        bool has_numbers = false;   // holds a position (Coordinates)
+        int child_level = -1;       // deepest nested level (Coordinates)
+    };
+
+    Frame *top_frame() { return frames_.empty() ? nullptr : &frames_.back(); }
+
+    void begin_feature()
+    {
+        geometry_ = Geometry();
+        has_geometry_ = false;
+        geometry_ok_ = false;
+        name_.clear();
+        properties_.clear();
+    }
+
+    void begin_geometry()
+    {
+        geometry_type_.clear();
+        geometry_supported_ = true;
+        positions_.clear();
+        for (auto &ends : ends_) {
+            ends.clear();
+        }
+    }
+
+    void begin_property_value()
+    {
+        Frame &top = frames_.back();
+        if (after_key_) {
+            after_key_ = false;
+        } else {
+            if (!top.first) properties_ += ',';
+            top.first = false;
+        }
+    }
+
+    /**
+     * Closes a coordinates array. Level 0 arrays are positions, level 1
+     * arrays are lists of positions, level 2 lists of those, and so on;
+     * each closed array records where it ends in the level below.
+     */
+    void end_coordinates(const Frame &frame)
+    {
+        int level;
+        if (frame.has_numbers) {
+            if (num_values_ < 2) syntax_error("position with less than two coordinates");
+            positions_.push_back({values_[0], values_[1]});
+            num_values_ = 0;
+            level = 0;
+        } else if (frame.child_level >= 0) {
+            level = frame.child_level + 1;
+            if (level >= static_cast<int>(ends_.size())) {
+                geometry_supported_ = false;
+                return;
+            }
+            const size_t end = level == 1 ? positions_.size() : ends_[level - 1].size();
+            ends_[level].push_back(static_cast<uint32_t>(end));
+        } else {
+            return;  // empty array
+        }
+
+        Frame *parent = top_frame();
+        if (parent != nullptr && parent->kind == Coordinates && level > parent->child_level) {
+            parent->child_level = level;
+        }
+    }
+
+    std::vector<Point> slice_positions(uint32_t from, uint32_t to) const
+    {
+        return std::vector<Point>(positions_.begin() + from, positions_.begin() + to);
+    }
+
+    std::vector<std::vector<Point>> split_lines(size_t first_end, size_t last_end) const
+    {
+        std::vector<std::vector<Point>> lines;
+        uint32_t from = first_end == 0 ? 0 : ends_[1][first_end - 1];
+        for (size_t i = first_end; i < last_end; i++) {
+            lines.push_back(slice_positions(from, ends_[1][i]));
+            from = ends_[1][i];
+        }
+        return lines;
+    }
+
+    void build_geometry()
+    {
+        has_geometry_ = true;
+        geometry_ok_ = false;
+        geometry_ = Geometry();
+        geometry_.srid = 4326;
+        if (!geometry_supported_) return;
+
+        if (geometry_type_ == "Point" && !positions_.empty()) {
+            geometry_.type = GeometryType::Point;
+            geometry_.points.push_back(positions_[0]);
+        } else if (geometry_type_ == "MultiPoint") {
+            geometry_.type = GeometryType::MultiPoint;
+            geometry_.points = positions_;
+        } else if (geometry_type_ == "LineString") {
+            geometry_.type = GeometryType::LineString;
+            geometry_.lines.push_back(positions_);
+        } else if (geometry_type_ == "MultiLineString") {
+            geometry_.type = GeometryType::MultiLineString;
+            geometry_.lines = split_lines(0, ends_[1].size());
+        } else if (geometry_type_ == "Polygon") {
+            geometry_.type = GeometryType::Polygon;
+            geometry_.polygons.emplace_back();
+            geometry_.polygons.back().rings = split_lines(0, ends_[1].size());
+        } else if (geometry_type_ == "MultiPolygon") {
+            geometry_.type = GeometryType::MultiPolygon;
+            size_t from = 0;
+            for (uint32_t end : ends_[2]) {
+                geometry_.polygons.emplace_back();
+                geometry_.polygons.back().rings = split_lines(from, end);
+                from = end;
+            }
+        }
+        geometry_ok_ = geometry_.type != GeometryType::Unknown;
+    }
+
+    void emit_feature()
+    {
+        if (!geometry_ok_) {
+            skipped_++;
+            begin_feature();
+            return;
+        }
+        ready_.push_back({std::move(geometry_), std::move(name_), std::move(properties_)});
+        begin_feature();
+    }
+
+    std::deque<GeoJsonFeature> &ready_;
+    JsonSaxParser<GeoJsonFeatureBuilder> parser_;
+    std::vector<Frame> frames_;
+    bool after_key_ = false;
+
+    // feature being built
+    Geometry geometry_;
+    bool has_geometry_ = false;
+    bool geometry_ok_ = false;
+    std::string name_;
+    std::string properties_;
+
+    // geometry being built
+    std::string geometry_type_;
+    bool geometry_supported_ = true;
+    std::vector<Point> positions_;
+    std::array<std::vector<uint32_t>, 4> ends_;
+    double values_[2] = {0.0, 0.0};
+    int num_values_ = 0;
+
+    uint64_t skipped_ = 0;
+};
+
+GeoJsonReader::GeoJsonReader(const std::string &path)
+    : buffer_(READ_CHUNK_SIZE), builder_(new GeoJsonFeatureBuilder(ready_))
+{
+    file_ = std::fopen(path.c_str(), "rb");
+    if (file_ == nullptr) {
+        throw std::runtime_error("Cannot open GeoJSON file: " + path);
+    }
+
+    struct stat st;
+    if (fstat(fileno(file_), &st) == 0) {
+        file_size_ = static_cast<uint64_t>(st.st_size);
+    }
+}
+
+GeoJsonReader::~GeoJsonReader()
+{
+    if (file_ != nullptr) {
+        std::fclose(file_);
+    }
+}
+
+bool GeoJsonReader::next(GeoJsonFeature &feature)
+{
+    while (ready_.empty() && file_ != nullptr) {
+        size_t n = std::fread(buffer_.data(), 1, buffer_.size(), file_);
+        if (n == 0) {
+            std::fclose(file_);
+            file_ = nullptr;
+            builder_->finish();
+            break;
+        }
+        bytes_read_ += n;
+        builder_->feed(buffer_.data(), n);
+    }
+
+    if (ready_.empty()) return false;
+
+    feature = std::move(ready_.front());
+    ready_.pop_front();
+    return true;
+}
+
+uint64_t GeoJsonReader::skipped() const
+{
+    return builder_->skipped();
+}
+
+int import_geojson(sqlite3 *db_handle, const std::string &geojson_file_path, const std::string &table_name,
+                   GeometryType geometry_type, int batch_size, ImportStats *stats)
+{
+    std::string sql_cmd;
+    int ret;
+    char *err_msg = NULL;
+    sqlite3_stmt *stmt = NULL;
+
+    const bool is_multi = geometry_type == GeometryType::MultiPoint ||
+                          geometry_type == GeometryType::MultiLineString ||
+                          geometry_type == GeometryType::MultiPolygon;
+
+    try {
+        GeoJsonReader reader(geojson_file_path);
+        if (stats != NULL) {
+            stats->set_total_bytes(reader.file_size());
+        }
+
+        // Create the table, or add the properties column to an existing one
+        const std::string table = quote_identifier(table_name);
+        sql_cmd = "CREATE TABLE IF NOT EXISTS " + table +
+            " (id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, name TEXT, properties TEXT)";
+        ret = sqlite3_exec(db_handle, sql_cmd.c_str(), NULL, NULL, &err_msg);
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error creating table: " << err_msg << std::endl;
+            sqlite3_free(err_msg);
+            return 1;
+        }
+
+        bool has_properties = false;
+        bool has_geometry = false;
+        sql_cmd = "PRAGMA table_info(" + table + ")";
+        ret = sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL);
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+            return 1;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const std::string column = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+            has_properties = has_properties || sqlite3_stricmp(column.c_str(), "properties") == 0;
+            has_geometry = has_geometry || sqlite3_stricmp(column.c_str(), "geometry") == 0;
+        }
+        sqlite3_finalize(stmt);
+        stmt = NULL;
+
+        if (!has_properties) {
+            sql_cmd = "ALTER TABLE " + table + " ADD COLUMN properties TEXT";
+            ret = sqlite3_exec(db_handle, sql_cmd.c_str(), NULL, NULL, &err_msg);
+            if (ret != SQLITE_OK) {
+                std::cerr << "Error adding properties column: " << err_msg << std::endl;
+                sqlite3_free(err_msg);
+                return 1;
+            }
+        }
+
+        // AddGeometryColumn() returns 0 instead of failing, e.g. on an
+        // unknown geometry type
+        if (!has_geometry) {
+            int added = 0;
+            sql_cmd = "SELECT AddGeometryColumn(" + quote_literal(table_name) + ", 'geometry', 4326, " +
+                quote_literal(geometry_type_name(geometry_type)) + ", 'XY')";
+            if (!query_int(db_handle, sql_cmd, added) || added != 1) {
+                std::cerr << "Error adding geometry column to " << table_name << std::endl;
+                return 1;
+            }
+        }
+
+        sql_cmd = "INSERT INTO " + table + " (name, properties, geometry) VALUES (?, ?, ?)";
+        ret = sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL);
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+            return 1;
+        }
+
+        GeoJsonFeature feature;
+        uint64_t count = 0;
+        uint64_t mismatched = 0;
+        int in_batch = 0;
+        uint64_t bytes_counted = 0;
+
+        while (true) {
+            ImportStats::Timer parse_timer(stats, ImportStats::Parse);
+            if (!reader.next(feature)) break;
+            parse_timer.stop();
+
+            if (is_multi) {
+                promote_to_multi(feature.geometry);
+            }
+            if (geometry_type != GeometryType::Unknown && feature.geometry.type != GeometryType::Unknown &&
+                feature.geometry.type != geometry_type) {
+                mismatched++;
+                continue;
+            }
+
+            ImportStats::Timer encode_timer(stats, ImportStats::Encode);
+            std::vector<uint8_t> blob;
+            if (feature.geometry.type != GeometryType::Unknown) {
+                blob = encode_spatialite_blob(feature.geometry);
+            }
+            encode_timer.stop();
+
+            ImportStats::Timer insert_timer(stats, ImportStats::Insert);
+            if (in_batch == 0) {
+                ret = sqlite3_exec(db_handle, "BEGIN TRANSACTION;", NULL, NULL, &err_msg);
+                if (ret != SQLITE_OK) {
+                    std::cerr << "Error starting transaction: " << err_msg << std::endl;
+                    sqlite3_free(err_msg);
+                    sqlite3_finalize(stmt);
+                    return 1;
+                }
+            }
+
+            if (feature.name.empty()) {
+                sqlite3_bind_null(stmt, 1);
+            } else {
+                sqlite3_bind_text(stmt, 1, feature.name.data(), feature.name.size(), SQLITE_STATIC);
+            }
+            if (feature.properties.empty()) {
+                sqlite3_bind_null(stmt, 2);
+            } else {
+                sqlite3_bind_text(stmt, 2, feature.properties.data(), feature.properties.size(), SQLITE_STATIC);
+            }
+
+            if (!blob.empty()) {
+                sqlite3_bind_blob(stmt, 3, blob.data(), blob.size(), SQLITE_STATIC);
+            } else {
+                sqlite3_bind_null(stmt, 3);
+            }
+
+            ret = sqlite3_step(stmt);
+            if (ret != SQLITE_DONE) {
+                std::cerr << "Error inserting feature " << count << ": " << sqlite3_errmsg(db_handle) << std::endl;
+                sqlite3_finalize(stmt);
+                sqlite3_exec(db_handle, "ROLLBACK;", NULL, NULL, NULL);
+                return 1;
+            }
+            sqlite3_reset(stmt);
+            count++;
+
+            // Commit in batches so the journal stays small on huge files
+            if (++in_batch == batch_size) {
+                in_batch = 0;
+                ret = sqlite3_exec(db_handle, "COMMIT;", NULL, NULL, &err_msg);
+                if (ret != SQLITE_OK) {
+                    std::cerr << "Error committing transaction: " << err_msg << std::endl;
+                    sqlite3_free(err_msg);
+                    sqlite3_finalize(stmt);
+                    return 1;
+                }
+            }
+            insert_timer.stop();
+
+            // The reader works in chunks, so bytes are attributed to the
+            // record that made it read the next chunk
+            if (stats != NULL) {
+                stats->add_record(reader.bytes_read() - bytes_counted, feature.geometry.num_vertices());
+                bytes_counted = reader.bytes_read();
+                stats->progress();
+            }
+        }
+        sqlite3_finalize(stmt);
+        stmt = NULL;
+
+        if (in_batch > 0) {
+            ImportStats::Timer commit_timer(stats, ImportStats::Insert);
+            ret = sqlite3_exec(db_handle, "COMMIT;", NULL, NULL, &err_msg);
+            if (ret != SQLITE_OK) {
+                std::cerr << "Error committing transaction: " << err_msg << std::endl;
+                sqlite3_free(err_msg);
+                return 1;
+            }
+        }
+        if (stats != NULL) {
+            stats->add_bytes(reader.bytes_read() - bytes_counted);
+        }
+
+        std::cout << "Imported " << count << " features into " << table_name << std::endl;
+        if (mismatched > 0 || reader.skipped() > 0) {
+            std::cout << "Skipped " << mismatched << " features not of type " << geometry_type_name(geometry_type)
+                << " and " << reader.skipped() << " with unsupported geometries" << std::endl;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error importing GeoJSON: " << e.what() << std::endl;
+        if (stmt != NULL) {
+            sqlite3_finalize(stmt);
+        }
+        if (!sqlite3_get_autocommit(db_handle)) {
+            sqlite3_exec(db_handle, "ROLLBACK;", NULL, NULL, NULL);
+        }
+        return 1;
+    }
+
+    return 0;
+}
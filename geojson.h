@@ -0,0 +1,90 @@
+#ifndef GEOJSON_H
+#define GEOJSON_H
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "geometry.h"
+
+struct GeoJsonFeature {
+    Geometry geometry;
+    std::string name;        // properties.name, if it is a string
+    std::string properties;  // properties object, re-serialized as compact JSON
+};
+
+class GeoJsonFeatureBuilder;
+class ImportStats;
+
+/**
+ * Streaming GeoJSON reader
+ *
+ * Accepts a FeatureCollection, a single Feature, or newline-delimited
+ * GeoJSON (one Feature per line). The file is read in fixed-size chunks
+ * and fed to an incremental SAX-style JSON parser, so only the feature
+ * being parsed is ever held in memory, whatever the size of the file.
+ *
+ * The constructor throws std::runtime_error if the file cannot be opened;
+ * next() throws std::runtime_error on malformed JSON.
+ */
+class GeoJsonReader {
+public:
+    explicit GeoJsonReader(const std::string &path);
+    ~GeoJsonReader();
+
+    GeoJsonReader(const GeoJsonReader &) = delete;
+    GeoJsonReader &operator=(const GeoJsonReader &) = delete;
+
+    /**
+     * Reads the next feature
+     *
+     * @param feature decoded feature
+     * @return true if a feature was read, false at the end of the file
+     */
+    bool next(GeoJsonFeature &feature);
+
+    /** Size of the file in bytes */
+    uint64_t file_size() const { return file_size_; }
+
+    /** Number of bytes consumed from the file so far */
+    uint64_t bytes_read() const { return bytes_read_; }
+
+    /** Number of features skipped because their geometry is unsupported */
+    uint64_t skipped() const;
+
+private:
+    FILE *file_ = nullptr;
+    std::vector<char> buffer_;
+    uint64_t file_size_ = 0;
+    uint64_t bytes_read_ = 0;
+    std::deque<GeoJsonFeature> ready_;
+    std::unique_ptr<GeoJsonFeatureBuilder> builder_;
+};
+
+/**
+ * Imports a GeoJSON or newline-delimited GeoJSON file into a SpatiaLite table
+ *
+ * @param db_handle handle to the database connection
+ * @param geojson_file_path path to the file
+ * @param table_name table to import into; created with (id, name,
+ *        properties) and a `geometry` column if it does not exist yet
+ * @param geometry_type geometry type of the column; features of another
+ *        type are skipped. Polygon and LineString features are promoted
+ *        when the column is of the Multi* type. Unknown accepts anything.
+ * @param batch_size number of rows inserted per transaction
+ * @param stats throughput counters to update (may be NULL)
+ * @return 0 on success, 1 on failure
+ *
+ * Geometries are encoded straight to SpatiaLite BLOBs (SRID 4326, as
+ * mandated by RFC 7946) and bound to a single prepared INSERT, committed
+ * every batch_size rows, so memory use does not grow with the file size.
+ */
+int import_geojson(sqlite3 *db_handle, const std::string &geojson_file_path, const std::string &table_name,
+                   GeometryType geometry_type, int batch_size = 10000, ImportStats *stats = NULL);
+
+#endif // GEOJSON_H
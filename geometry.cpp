@@ -0,0 +1,504 @@
+#include "geometry.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// SpatiaLite BLOB markers
+const uint8_t GAIA_MARK_START = 0x00;
+const uint8_t GAIA_LITTLE_ENDIAN = 0x01;
+const uint8_t GAIA_BIG_ENDIAN = 0x00;
+const uint8_t GAIA_MARK_MBR = 0x7C;
+const uint8_t GAIA_MARK_ENTITY = 0x69;
+const uint8_t GAIA_MARK_END = 0xFE;
+
+// Added to the class type of compressed linestrings and polygons
+const int32_t GAIA_COMPRESSED = 1000000;
+
+void put_int32(std::vector<uint8_t> &out, int32_t value)
+{
+    uint8_t bytes[4];
+    std::memcpy(bytes, &value, 4);
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+void put_double(std::vector<uint8_t> &out, double value)
+{
+    uint8_t bytes[8];
+    std::memcpy(bytes, &value, 8);
+    out.insert(out.end(), bytes, bytes + 8);
+}
+
+void put_points(std::vector<uint8_t> &out, const std::vector<Point> &points)
+{
+    put_int32(out, static_cast<int32_t>(points.size()));
+    for (const auto &p : points) {
+        put_double(out, p.x);
+        put_double(out, p.y);
+    }
+}
+
+void put_float(std::vector<uint8_t> &out, float value)
+{
+    uint8_t bytes[4];
+    std::memcpy(bytes, &value, 4);
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+/**
+ * SpatiaLite's compressed form: the first and last points are stored as
+ * doubles, every other point as float offsets from the point before it.
+ * Offsets are taken from the previous point as a reader will decode it,
+ * so rounding errors do not add up along the line.
+ */
+void put_compressed_points(std::vector<uint8_t> &out, const std::vector<Point> &points)
+{
+    put_int32(out, static_cast<int32_t>(points.size()));
+    Point last = {0.0, 0.0};
+    for (size_t i = 0; i < points.size(); i++) {
+        if (i == 0 || i == points.size() - 1) {
+            put_double(out, points[i].x);
+            put_double(out, points[i].y);
+            last = points[i];
+        } else {
+            const float dx = static_cast<float>(points[i].x - last.x);
+            const float dy = static_cast<float>(points[i].y - last.y);
+            put_float(out, dx);
+            put_float(out, dy);
+            last.x += dx;
+            last.y += dy;
+        }
+    }
+}
+
+void put_line(std::vector<uint8_t> &out, const std::vector<Point> &points, bool compressed)
+{
+    if (compressed) {
+        put_compressed_points(out, points);
+    } else {
+        put_points(out, points);
+    }
+}
+
+void put_polygon(std::vector<uint8_t> &out, const Polygon &polygon, bool compressed)
+{
+    put_int32(out, static_cast<int32_t>(polygon.rings.size()));
+    for (const auto &ring : polygon.rings) {
+        put_line(out, ring, compressed);
+    }
+}
+
+/**
+ * Snaps the points of a line or ring to the grid and drops the points
+ * that fall onto the previous one
+ */
+void quantize_points(std::vector<Point> &points, double scale)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        const Point p = {std::round(points[i].x * scale) / scale, std::round(points[i].y * scale) / scale};
+        if (kept > 0 && p.x == points[kept - 1].x && p.y == points[kept - 1].y) continue;
+        points[kept++] = p;
+    }
+    points.resize(kept);
+}
+
+/**
+ * Bounds-checked cursor over a BLOB, honouring the endianness flag
+ */
+class BlobReader {
+public:
+    BlobReader(const uint8_t *data, size_t size, bool little_endian)
+        : data_(data), size_(size), little_endian_(little_endian) {}
+
+    bool read_byte(uint8_t &value)
+    {
+        if (pos_ + 1 > size_) return false;
+        value = data_[pos_++];
+        return true;
+    }
+
+    bool read_int32(int32_t &value)
+    {
+        uint8_t bytes[4];
+        if (!read_raw(bytes, 4)) return false;
+        std::memcpy(&value, bytes, 4);
+        return true;
+    }
+
+    bool read_double(double &value)
+    {
+        uint8_t bytes[8];
+        if (!read_raw(bytes, 8)) return false;
+        std::memcpy(&value, bytes, 8);
+        return true;
+    }
+
+    bool read_count(int32_t &count, size_t item_size)
+    {
+        if (!read_int32(count) || count < 0) return false;
+        return static_cast<size_t>(count) * item_size <= size_ - pos_;
+    }
+
+    bool read_float(float &value)
+    {
+        uint8_t bytes[4];
+        if (!read_raw(bytes, 4)) return false;
+        std::memcpy(&value, bytes, 4);
+        return true;
+    }
+
+    bool read_points(std::vector<Point> &points)
+    {
+        int32_t count;
+        if (!read_count(count, 16)) return false;
+        points.resize(count);
+        for (auto &p : points) {
+            if (!read_double(p.x) || !read_double(p.y)) return false;
+        }
+        return true;
+    }
+
+    bool read_compressed_points(std::vector<Point> &points)
+    {
+        int32_t count;
+        if (!read_count(count, 8)) return false;
+        points.resize(count);
+        for (int32_t i = 0; i < count; i++) {
+            Point &p = points[i];
+            if (i == 0 || i == count - 1) {
+                if (!read_double(p.x) || !read_double(p.y)) return false;
+            } else {
+                float dx, dy;
+                if (!read_float(dx) || !read_float(dy)) return false;
+                p.x = points[i - 1].x + dx;
+                p.y = points[i - 1].y + dy;
+            }
+        }
+        return true;
+    }
+
+    bool read_line(std::vector<Point> &points, bool compressed)
+    {
+        return compressed ? read_compressed_points(points) : read_points(points);
+    }
+
+    bool read_polygon(Polygon &polygon, bool compressed)
+    {
+        int32_t count;
+        if (!read_count(count, 4)) return false;
+        polygon.rings.resize(count);
+        for (auto &ring : polygon.rings) {
+            if (!read_line(ring, compressed)) return false;
+        }
+        return true;
+    }
+
+    size_t position() const { return pos_; }
+
+private:
+    bool read_raw(uint8_t *bytes, size_t n)
+    {
+        if (pos_ + n > size_) return false;
+        if (little_endian_) {
+            std::memcpy(bytes, data_ + pos_, n);
+        } else {
+            for (size_t i = 0; i < n; i++) {
+                bytes[i] = data_[pos_ + n - 1 - i];
+            }
+        }
+        pos_ += n;
+        return true;
+    }
+
+    const uint8_t *data_;
+    size_t size_;
+    size_t pos_ = 0;
+    bool little_endian_;
+};
+
+bool read_header(const uint8_t *blob, size_t size, bool &little_endian)
+{
+    // start, endian, srid, mbr, mbr marker, class type and end marker
+    if (blob == nullptr || size < 44) return false;
+    if (blob[0] != GAIA_MARK_START || blob[38] != GAIA_MARK_MBR || blob[size - 1] != GAIA_MARK_END) {
+        return false;
+    }
+    if (blob[1] != GAIA_LITTLE_ENDIAN && blob[1] != GAIA_BIG_ENDIAN) return false;
+    little_endian = (blob[1] == GAIA_LITTLE_ENDIAN);
+    return true;
+}
+
+} // namespace
+
+BBox Geometry::bbox() const
+{
+    BBox box;
+    for (const auto &p : points) {
+        box.expand(p.x, p.y);
+    }
+    for (const auto &line : lines) {
+        for (const auto &p : line) {
+            box.expand(p.x, p.y);
+        }
+    }
+    for (const auto &polygon : polygons) {
+        // the exterior ring bounds the holes
+        if (!polygon.rings.empty()) {
+            for (const auto &p : polygon.rings[0]) {
+                box.expand(p.x, p.y);
+            }
+        }
+    }
+    return box;
+}
+
+size_t Geometry::num_vertices() const
+{
+    size_t count = points.size();
+    for (const auto &line : lines) {
+        count += line.size();
+    }
+    for (const auto &polygon : polygons) {
+        for (const auto &ring : polygon.rings) {
+            count += ring.size();
+        }
+    }
+    return count;
+}
+
+bool ring_contains(const Ring &ring, const Point &p)
+{
+    if (ring.size() < 3) return false;
+
+    bool inside = false;
+    for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+        const Point &a = ring[i];
+        const Point &b = ring[j];
+        if ((a.y > p.y) != (b.y > p.y) && p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+const char *geometry_type_name(GeometryType type)
+{
+    switch (type) {
+        case GeometryType::Point: return "POINT";
+        case GeometryType::LineString: return "LINESTRING";
+        case GeometryType::Polygon: return "POLYGON";
+        case GeometryType::MultiPoint: return "MULTIPOINT";
+        case GeometryType::MultiLineString: return "MULTILINESTRING";
+        case GeometryType::MultiPolygon: return "MULTIPOLYGON";
+        default: return "GEOMETRY";
+    }
+}
+
+void promote_to_multi(Geometry &geom)
+{
+    switch (geom.type) {
+        case GeometryType::Point: geom.type = GeometryType::MultiPoint; break;
+        case GeometryType::LineString: geom.type = GeometryType::MultiLineString; break;
+        case GeometryType::Polygon: geom.type = GeometryType::MultiPolygon; break;
+        default: break;
+    }
+}
+
+void quantize_geometry(Geometry &geom, int precision)
+{
+    if (precision < 0) return;
+    const double scale = std::pow(10.0, precision);
+
+    for (auto &p : geom.points) {
+        p.x = std::round(p.x * scale) / scale;
+        p.y = std::round(p.y * scale) / scale;
+    }
+
+    size_t kept_lines = 0;
+    for (size_t i = 0; i < geom.lines.size(); i++) {
+        quantize_points(geom.lines[i], scale);
+        if (geom.lines[i].size() < 2) continue;
+        if (kept_lines != i) geom.lines[kept_lines] = std::move(geom.lines[i]);
+        kept_lines++;
+    }
+    geom.lines.resize(kept_lines);
+
+    // Rings collapsed below four points are dropped, with their polygon if
+    // it is the exterior ring
+    size_t kept_polygons = 0;
+    for (size_t i = 0; i < geom.polygons.size(); i++) {
+        Polygon &polygon = geom.polygons[i];
+        size_t kept_rings = 0;
+        for (size_t j = 0; j < polygon.rings.size(); j++) {
+            quantize_points(polygon.rings[j], scale);
+            if (polygon.rings[j].size() < 4) {
+                if (j == 0) break;
+                continue;
+            }
+            if (kept_rings != j) polygon.rings[kept_rings] = std::move(polygon.rings[j]);
+            kept_rings++;
+        }
+        polygon.rings.resize(kept_rings);
+        if (polygon.rings.empty()) continue;
+        if (kept_polygons != i) geom.polygons[kept_polygons] = std::move(polygon);
+        kept_polygons++;
+    }
+    geom.polygons.resize(kept_polygons);
+
+    if (geom.points.empty() && geom.lines.empty() && geom.polygons.empty()) {
+        geom.type = GeometryType::Unknown;
+    }
+}
+
+std::vector<uint8_t> encode_spatialite_blob(const Geometry &geom, bool compressed)
+{
+    const int32_t compressed_offset = compressed ? GAIA_COMPRESSED : 0;
+
+    std::vector<uint8_t> out;
+    out.reserve(48 + geom.num_vertices() * 16 + geom.polygons.size() * 16);
+
+    BBox box = geom.bbox();
+    if (box.empty()) {
+        box.min_x = box.min_y = box.max_x = box.max_y = 0.0;
+    }
+
+    out.push_back(GAIA_MARK_START);
+    out.push_back(GAIA_LITTLE_ENDIAN);
+    put_int32(out, geom.srid);
+    put_double(out, box.min_x);
+    put_double(out, box.min_y);
+    put_double(out, box.max_x);
+    put_double(out, box.max_y);
+    out.push_back(GAIA_MARK_MBR);
+    const bool single_line = geom.type == GeometryType::LineString || geom.type == GeometryType::Polygon;
+    put_int32(out, static_cast<int32_t>(geom.type) + (single_line ? compressed_offset : 0));
+
+    switch (geom.type) {
+        case GeometryType::Point: {
+            const Point p = geom.points.empty() ? Point{0.0, 0.0} : geom.points[0];
+            put_double(out, p.x);
+            put_double(out, p.y);
+            break;
+        }
+        case GeometryType::LineString:
+            put_line(out, geom.lines.empty() ? std::vector<Point>() : geom.lines[0], compressed);
+            break;
+        case GeometryType::Polygon:
+            put_polygon(out, geom.polygons.empty() ? Polygon() : geom.polygons[0], compressed);
+            break;
+        case GeometryType::MultiPoint:
+            put_int32(out, static_cast<int32_t>(geom.points.size()));
+            for (const auto &p : geom.points) {
+                out.push_back(GAIA_MARK_ENTITY);
+                put_int32(out, static_cast<int32_t>(GeometryType::Point));
+                put_double(out, p.x);
+                put_double(out, p.y);
+            }
+            break;
+        case GeometryType::MultiLineString:
+            put_int32(out, static_cast<int32_t>(geom.lines.size()));
+            for (const auto &line : geom.lines) {
+                out.push_back(GAIA_MARK_ENTITY);
+                put_int32(out, static_cast<int32_t>(GeometryType::LineString) + compressed_offset);
+                put_line(out, line, compressed);
+            }
+            break;
+        case GeometryType::MultiPolygon:
+            put_int32(out, static_cast<int32_t>(geom.polygons.size()));
+            for (const auto &polygon : geom.polygons) {
+                out.push_back(GAIA_MARK_ENTITY);
+                put_int32(out, static_cast<int32_t>(GeometryType::Polygon) + compressed_offset);
+                put_polygon(out, polygon, compressed);
+            }
+            break;
+        default:
+            break;
+    }
+
+    out.push_back(GAIA_MARK_END);
+    return out;
+}
+
+bool decode_spatialite_blob(const uint8_t *blob, size_t size, Geometry &geom)
+{
+    bool little_endian;
+    if (!read_header(blob, size, little_endian)) return false;
+
+    BlobReader reader(blob + 2, size - 3, little_endian);
+    int32_t srid;
+    double mbr[4];
+    uint8_t marker;
+    int32_t class_type;
+
+    if (!reader.read_int32(srid)) return false;
+    for (double &v : mbr) {
+        if (!reader.read_double(v)) return false;
+    }
+    if (!reader.read_byte(marker) || !reader.read_int32(class_type)) return false;
+
+    const bool compressed = class_type == static_cast<int32_t>(GeometryType::LineString) + GAIA_COMPRESSED ||
+                            class_type == static_cast<int32_t>(GeometryType::Polygon) + GAIA_COMPRESSED;
+    if (compressed) {
+        class_type -= GAIA_COMPRESSED;
+    }
+
+    geom = Geometry();
+    geom.srid = srid;
+    geom.type = static_cast<GeometryType>(class_type);
+
+    switch (geom.type) {
+        case GeometryType::Point: {
+            Point p;
+            if (!reader.read_double(p.x) || !reader.read_double(p.y)) return false;
+            geom.points.push_back(p);
+            return true;
+        }
+        case GeometryType::LineString:
+            geom.lines.emplace_back();
+            return reader.read_line(geom.lines.back(), compressed);
+        case GeometryType::Polygon:
+            geom.polygons.emplace_back();
+            return reader.read_polygon(geom.polygons.back(), compressed);
+        case GeometryType::MultiPoint:
+        case GeometryType::MultiLineString:
+        case GeometryType::MultiPolygon: {
+            int32_t count;
+            if (!reader.read_count(count, 5)) return false;
+            for (int32_t i = 0; i < count; i++) {
+                int32_t entity_type;
+                if (!reader.read_byte(marker) || marker != GAIA_MARK_ENTITY) return false;
+                if (!reader.read_int32(entity_type)) return false;
+                const bool compressed_entity = entity_type == class_type - 3 + GAIA_COMPRESSED &&
+                                               geom.type != GeometryType::MultiPoint;
+                if (entity_type != class_type - 3 && !compressed_entity) return false;
+
+                if (geom.type == GeometryType::MultiPoint) {
+                    Point p;
+                    if (!reader.read_double(p.x) || !reader.read_double(p.y)) return false;
+                    geom.points.push_back(p);
+                } else if (geom.type == GeometryType::MultiLineString) {
+                    geom.lines.emplace_back();
+                    if (!reader.read_line(geom.lines.back(), compressed_entity)) return false;
+                } else {
+                    geom.polygons.emplace_back();
+                    if (!reader.read_polygon(geom.polygons.back(), compressed_entity)) return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+bool spatialite_blob_mbr(const uint8_t *blob, size_t size, BBox &bbox)
+{
+    bool little_endian;
+    if (!read_header(blob, size, little_endian)) return false;
+
+    BlobReader reader(blob + 6, 32, little_endian);
+    return reader.read_double(bbox.min_x) && reader.read_double(bbox.min_y) &&
+           reader.read_double(bbox.max_x) && reader.read_double(bbox.max_y);
+}
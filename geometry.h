@@ -0,0 +1,184 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+/**
+ * Geometry classes, using the same numbering as SpatiaLite BLOBs,
+ * WKB and FlatGeobuf.
+ */
+enum class GeometryType : int32_t {
+    Unknown = 0,
+    Point = 1,
+    LineString = 2,
+    Polygon = 3,
+    MultiPoint = 4,
+    MultiLineString = 5,
+    MultiPolygon = 6,
+};
+
+struct Point {
+    double x;
+    double y;
+};
+
+/**
+ * Axis aligned bounding box. A default constructed box is empty and
+ * grows as points are added to it.
+ */
+struct BBox {
+    double min_x = std::numeric_limits<double>::infinity();
+    double min_y = std::numeric_limits<double>::infinity();
+    double max_x = -std::numeric_limits<double>::infinity();
+    double max_y = -std::numeric_limits<double>::infinity();
+
+    bool empty() const { return min_x > max_x; }
+
+    void expand(double x, double y)
+    {
+        if (x < min_x) min_x = x;
+        if (y < min_y) min_y = y;
+        if (x > max_x) max_x = x;
+        if (y > max_y) max_y = y;
+    }
+
+    void expand(const BBox &other)
+    {
+        if (other.min_x < min_x) min_x = other.min_x;
+        if (other.min_y < min_y) min_y = other.min_y;
+        if (other.max_x > max_x) max_x = other.max_x;
+        if (other.max_y > max_y) max_y = other.max_y;
+    }
+
+    bool intersects(const BBox &other) const
+    {
+        return !(other.min_x > max_x || other.max_x < min_x ||
+                 other.min_y > max_y || other.max_y < min_y);
+    }
+
+    bool contains(double x, double y) const
+    {
+        return x >= min_x && x <= max_x && y >= min_y && y <= max_y;
+    }
+};
+
+using Ring = std::vector<Point>;
+
+/**
+ * A polygon: the first ring is the exterior ring, the others are holes.
+ */
+struct Polygon {
+    std::vector<Ring> rings;
+};
+
+/**
+ * A simple-features geometry restricted to the XY types we import.
+ *
+ * Only the member matching the type is populated: points for Point and
+ * MultiPoint, lines for LineString and MultiLineString, polygons for
+ * Polygon and MultiPolygon.
+ */
+struct Geometry {
+    GeometryType type = GeometryType::Unknown;
+    int srid = 0;
+    std::vector<Point> points;
+    std::vector<std::vector<Point>> lines;
+    std::vector<Polygon> polygons;
+
+    BBox bbox() const;
+    size_t num_vertices() const;
+};
+
+/**
+ * Even-odd test of a point against a closed ring
+ *
+ * @param ring ring, first vertex repeated at the end
+ * @param p point to test
+ * @return true if the point is inside the ring
+ */
+bool ring_contains(const Ring &ring, const Point &p);
+
+/**
+ * Name of a geometry type as used by AddGeometryColumn(), e.g. "MULTIPOLYGON"
+ *
+ * @param type geometry type
+ * @return upper case type name, "GEOMETRY" for Unknown
+ */
+const char *geometry_type_name(GeometryType type);
+
+/**
+ * Promotes single geometries to their Multi* counterpart, which is what
+ * ImportSHP stores and what a MULTIPOLYGON column accepts.
+ *
+ * @param geom geometry to promote in place
+ */
+void promote_to_multi(Geometry &geom);
+
+/**
+ * How geometries are stored by the importers
+ */
+struct BlobEncoding {
+    bool compressed = false;  // SpatiaLite compressed linestrings and rings
+    int precision = -1;       // decimal digits kept by quantize_geometry(), -1 keeps full precision
+};
+
+/**
+ * Snaps every coordinate to a grid of 10^-precision and removes the
+ * vertices that collapse onto their predecessor
+ *
+ * @param geom geometry to quantize in place; its type becomes Unknown if
+ *             nothing is left of it
+ * @param precision number of decimal digits to keep, -1 does nothing
+ *
+ * With geographic coordinates 6 digits is about 0.1 m. Dense boundaries
+ * lose the vertices that were closer together than that, which also
+ * makes the float offsets of compressed BLOBs smaller and more exact.
+ */
+void quantize_geometry(Geometry &geom, int precision);
+
+/**
+ * Encodes a geometry as a SpatiaLite BLOB
+ *
+ * @param geom geometry to encode
+ * @param compressed store linestrings and polygon rings in SpatiaLite's
+ *        compressed form, as CompressGeometry() does
+ * @return BLOB bytes, ready to be bound to a geometry column
+ *
+ * The layout is the one documented for SpatiaLite's internal BLOB format:
+ * start marker, endianness, SRID, MBR, class type, geometry data and end
+ * marker. Values are always written little-endian.
+ *
+ * In the compressed form the first and last vertex of each linestring or
+ * ring are kept as doubles and every other vertex is stored as two float
+ * offsets from the previous one, which takes 8 bytes instead of 16. The
+ * MBR in the header is exact, so index lookups are unaffected, and
+ * SpatiaLite's SQL functions read these BLOBs transparently.
+ */
+std::vector<uint8_t> encode_spatialite_blob(const Geometry &geom, bool compressed = false);
+
+/**
+ * Decodes a SpatiaLite BLOB
+ *
+ * @param blob pointer to the BLOB bytes
+ * @param size size of the BLOB in bytes
+ * @param geom decoded geometry
+ * @return true on success, false if the BLOB is malformed or uses an
+ *         unsupported class (Z/M dimensions, collections). Compressed
+ *         BLOBs are expanded back to doubles.
+ */
+bool decode_spatialite_blob(const uint8_t *blob, size_t size, Geometry &geom);
+
+/**
+ * Reads only the MBR stored in the header of a SpatiaLite BLOB
+ *
+ * @param blob pointer to the BLOB bytes
+ * @param size size of the BLOB in bytes
+ * @param bbox MBR read from the header
+ * @return true on success, false if the BLOB is malformed
+ */
+bool spatialite_blob_mbr(const uint8_t *blob, size_t size, BBox &bbox);
+
+#endif // GEOMETRY_H
@@ -0,0 +1,240 @@
+#include "geos_context.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Dimension of the parts kept from a geometry collection
+int dimension_of(int type_id)
+{
+    switch (type_id) {
+        case GEOS_POLYGON:
+        case GEOS_MULTIPOLYGON:
+            return 2;
+        case GEOS_LINESTRING:
+        case GEOS_LINEARRING:
+        case GEOS_MULTILINESTRING:
+            return 1;
+        case GEOS_POINT:
+        case GEOS_MULTIPOINT:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+GEOSCoordSequence *make_sequence(GEOSContextHandle_t handle, const std::vector<Point> &points)
+{
+    static_assert(sizeof(Point) == 2 * sizeof(double), "Point must be two packed doubles");
+    return GEOSCoordSeq_copyFromBuffer_r(handle, reinterpret_cast<const double *>(points.data()),
+                                         static_cast<unsigned int>(points.size()), 0, 0);
+}
+
+bool read_sequence(GEOSContextHandle_t handle, const GEOSGeometry *geom, std::vector<Point> &points)
+{
+    const GEOSCoordSequence *seq = GEOSGeom_getCoordSeq_r(handle, geom);
+    unsigned int size;
+    if (seq == nullptr || !GEOSCoordSeq_getSize_r(handle, seq, &size)) return false;
+    points.resize(size);
+    return size == 0 || GEOSCoordSeq_copyToBuffer_r(handle, seq, reinterpret_cast<double *>(points.data()), 0, 0);
+}
+
+GEOSGeometry *make_line(GEOSContextHandle_t handle, const std::vector<Point> &points, bool ring)
+{
+    GEOSCoordSequence *seq = make_sequence(handle, points);
+    if (seq == nullptr) return nullptr;
+    return ring ? GEOSGeom_createLinearRing_r(handle, seq) : GEOSGeom_createLineString_r(handle, seq);
+}
+
+GEOSGeometry *make_polygon(GEOSContextHandle_t handle, const Polygon &polygon)
+{
+    if (polygon.rings.empty()) return nullptr;
+
+    std::vector<GEOSGeometry *> rings;
+    for (const auto &ring : polygon.rings) {
+        GEOSGeometry *geos_ring = make_line(handle, ring, true);
+        if (geos_ring == nullptr) {
+            for (GEOSGeometry *created : rings) {
+                GEOSGeom_destroy_r(handle, created);
+            }
+            return nullptr;
+        }
+        rings.push_back(geos_ring);
+    }
+    return GEOSGeom_createPolygon_r(handle, rings[0], rings.data() + 1, static_cast<unsigned int>(rings.size() - 1));
+}
+
+bool read_polygon(GEOSContextHandle_t handle, const GEOSGeometry *geom, Polygon &polygon)
+{
+    const GEOSGeometry *exterior = GEOSGetExteriorRing_r(handle, geom);
+    if (exterior == nullptr) return false;
+
+    polygon.rings.emplace_back();
+    if (!read_sequence(handle, exterior, polygon.rings.back())) return false;
+
+    const int num_holes = GEOSGetNumInteriorRings_r(handle, geom);
+    for (int i = 0; i < num_holes; i++) {
+        polygon.rings.emplace_back();
+        if (!read_sequence(handle, GEOSGetInteriorRingN_r(handle, geom, i), polygon.rings.back())) return false;
+    }
+    return true;
+}
+
+/**
+ * Appends the parts of the given dimension of a geometry to geom
+ */
+bool collect_parts(GEOSContextHandle_t handle, const GEOSGeometry *part, int dimension, Geometry &geom)
+{
+    const int type_id = GEOSGeomTypeId_r(handle, part);
+    if (GEOSisEmpty_r(handle, part) == 1) return true;
+
+    switch (type_id) {
+        case GEOS_POINT: {
+            if (dimension != 0) return true;
+            std::vector<Point> points;
+            if (!read_sequence(handle, part, points)) return false;
+            geom.points.insert(geom.points.end(), points.begin(), points.end());
+            return true;
+        }
+        case GEOS_LINESTRING:
+        case GEOS_LINEARRING:
+            if (dimension != 1) return true;
+            geom.lines.emplace_back();
+            return read_sequence(handle, part, geom.lines.back());
+        case GEOS_POLYGON:
+            if (dimension != 2) return true;
+            geom.polygons.emplace_back();
+            return read_polygon(handle, part, geom.polygons.back());
+        default: {
+            const int count = GEOSGetNumGeometries_r(handle, part);
+            for (int i = 0; i < count; i++) {
+                if (!collect_parts(handle, GEOSGetGeometryN_r(handle, part, i), dimension, geom)) return false;
+            }
+            return true;
+        }
+    }
+}
+
+int max_dimension(GEOSContextHandle_t handle, const GEOSGeometry *geom)
+{
+    const int type_id = GEOSGeomTypeId_r(handle, geom);
+    if (type_id != GEOS_GEOMETRYCOLLECTION) {
+        return GEOSisEmpty_r(handle, geom) == 1 ? -1 : dimension_of(type_id);
+    }
+
+    int dimension = -1;
+    const int count = GEOSGetNumGeometries_r(handle, geom);
+    for (int i = 0; i < count; i++) {
+        dimension = std::max(dimension, max_dimension(handle, GEOSGetGeometryN_r(handle, geom, i)));
+    }
+    return dimension;
+}
+
+} // namespace
+
+GeosContext::GeosContext()
+{
+    handle_ = GEOS_init_r();
+    if (handle_ == nullptr) {
+        throw std::runtime_error("Cannot initialize GEOS");
+    }
+    GEOSContext_setErrorMessageHandler_r(handle_, &GeosContext::error_handler, this);
+    GEOSContext_setNoticeMessageHandler_r(handle_, NULL, NULL);
+}
+
+GeosContext::~GeosContext()
+{
+    GEOS_finish_r(handle_);
+}
+
+void GeosContext::error_handler(const char *message, void *context)
+{
+    static_cast<GeosContext *>(context)->last_error_ = message;
+}
+
+GeosGeometry GeosContext::to_geos(const Geometry &geom) const
+{
+    GEOSGeometry *result = nullptr;
+    std::vector<GEOSGeometry *> parts;
+    int collection_type = -1;
+
+    switch (geom.type) {
+        case GeometryType::Point:
+            if (!geom.points.empty()) {
+                result = GEOSGeom_createPointFromXY_r(handle_, geom.points[0].x, geom.points[0].y);
+            }
+            break;
+        case GeometryType::LineString:
+            if (!geom.lines.empty()) {
+                result = make_line(handle_, geom.lines[0], false);
+            }
+            break;
+        case GeometryType::Polygon:
+            if (!geom.polygons.empty()) {
+                result = make_polygon(handle_, geom.polygons[0]);
+            }
+            break;
+        case GeometryType::MultiPoint:
+            collection_type = GEOS_MULTIPOINT;
+            for (const auto &p : geom.points) {
+                parts.push_back(GEOSGeom_createPointFromXY_r(handle_, p.x, p.y));
+            }
+            break;
+        case GeometryType::MultiLineString:
+            collection_type = GEOS_MULTILINESTRING;
+            for (const auto &line : geom.lines) {
+                parts.push_back(make_line(handle_, line, false));
+            }
+            break;
+        case GeometryType::MultiPolygon:
+            collection_type = GEOS_MULTIPOLYGON;
+            for (const auto &polygon : geom.polygons) {
+                parts.push_back(make_polygon(handle_, polygon));
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (collection_type >= 0) {
+        bool ok = true;
+        for (GEOSGeometry *part : parts) {
+            ok = ok && part != nullptr;
+        }
+        if (ok) {
+            result = GEOSGeom_createCollection_r(handle_, collection_type, parts.data(),
+                                                 static_cast<unsigned int>(parts.size()));
+        } else {
+            for (GEOSGeometry *part : parts) {
+                if (part != nullptr) GEOSGeom_destroy_r(handle_, part);
+            }
+        }
+    }
+
+    return GeosGeometry(handle_, result);
+}
+
+bool GeosContext::from_geos(const GEOSGeometry *geos_geom, Geometry &geom, int srid) const
+{
+    geom = Geometry();
+    geom.srid = srid;
+    if (geos_geom == nullptr) return false;
+
+    const int type_id = GEOSGeomTypeId_r(handle_, geos_geom);
+    const int dimension = max_dimension(handle_, geos_geom);
+    if (dimension < 0 || !collect_parts(handle_, geos_geom, dimension, geom)) {
+        geom = Geometry();
+        return false;
+    }
+
+    const bool single = type_id == GEOS_POINT || type_id == GEOS_LINESTRING || type_id == GEOS_LINEARRING ||
+                        type_id == GEOS_POLYGON;
+    switch (dimension) {
+        case 0: geom.type = single ? GeometryType::Point : GeometryType::MultiPoint; break;
+        case 1: geom.type = single ? GeometryType::LineString : GeometryType::MultiLineString; break;
+        default: geom.type = single ? GeometryType::Polygon : GeometryType::MultiPolygon; break;
+    }
+    return true;
+}
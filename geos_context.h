@@ -0,0 +1,118 @@
+#ifndef GEOS_CONTEXT_H
+#define GEOS_CONTEXT_H
+
+#include <string>
+
+#define GEOS_USE_ONLY_R_API
+#include <geos_c.h>
+
+#include "geometry.h"
+
+/**
+ * Owning handle to a GEOS geometry, destroyed with the context it was
+ * created in
+ */
+class GeosGeometry {
+public:
+    GeosGeometry() = default;
+    GeosGeometry(GEOSContextHandle_t handle, GEOSGeometry *geom) : handle_(handle), geom_(geom) {}
+    ~GeosGeometry() { reset(); }
+
+    GeosGeometry(const GeosGeometry &) = delete;
+    GeosGeometry &operator=(const GeosGeometry &) = delete;
+
+    GeosGeometry(GeosGeometry &&other) : handle_(other.handle_), geom_(other.release()) {}
+
+    GeosGeometry &operator=(GeosGeometry &&other)
+    {
+        if (this != &other) {
+            reset();
+            handle_ = other.handle_;
+            geom_ = other.release();
+        }
+        return *this;
+    }
+
+    GEOSGeometry *get() const { return geom_; }
+    explicit operator bool() const { return geom_ != nullptr; }
+
+    GEOSGeometry *release()
+    {
+        GEOSGeometry *geom = geom_;
+        geom_ = nullptr;
+        return geom;
+    }
+
+    void reset()
+    {
+        if (geom_ != nullptr) {
+            GEOSGeom_destroy_r(handle_, geom_);
+            geom_ = nullptr;
+        }
+    }
+
+private:
+    GEOSContextHandle_t handle_ = nullptr;
+    GEOSGeometry *geom_ = nullptr;
+};
+
+/**
+ * A GEOS reentrant API context
+ *
+ * GEOS contexts must not be shared between threads: create one per
+ * worker (see ThreadPool) and use each only from its own thread. GEOS
+ * errors are caught in the context instead of being printed, and can be
+ * read back with last_error().
+ *
+ * The constructor throws std::runtime_error if GEOS cannot be initialized.
+ */
+class GeosContext {
+public:
+    GeosContext();
+    ~GeosContext();
+
+    GeosContext(const GeosContext &) = delete;
+    GeosContext &operator=(const GeosContext &) = delete;
+
+    GEOSContextHandle_t handle() const { return handle_; }
+
+    /**
+     * Wraps a geometry returned by a GEOS function of this context
+     */
+    GeosGeometry wrap(GEOSGeometry *geom) const { return GeosGeometry(handle_, geom); }
+
+    /**
+     * Converts a geometry to GEOS
+     *
+     * @param geom geometry to convert
+     * @return GEOS geometry, empty on failure (see last_error())
+     */
+    GeosGeometry to_geos(const Geometry &geom) const;
+
+    /**
+     * Converts a GEOS geometry back
+     *
+     * @param geos_geom geometry to convert
+     * @param geom converted geometry, with the given SRID
+     * @param srid SRID to set
+     * @return false if the geometry is empty or cannot be read
+     *
+     * Geometry collections, as returned by GEOSMakeValid_r() for instance,
+     * keep only their parts of the highest dimension: the polygons of a
+     * collection of polygons and dangling lines.
+     */
+    bool from_geos(const GEOSGeometry *geos_geom, Geometry &geom, int srid = 0) const;
+
+    /**
+     * Message of the last GEOS error raised in this context
+     */
+    const std::string &last_error() const { return last_error_; }
+
+private:
+    static void error_handler(const char *message, void *context);
+
+    GEOSContextHandle_t handle_;
+    std::string last_error_;
+};
+
+#endif // GEOS_CONTEXT_H
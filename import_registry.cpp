@@ -0,0 +1,387 @@
+#include "import_registry.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <sys/stat.h>
+
+#include "sql_util.h"
+
+namespace {
+
+const size_t HASH_CHUNK_SIZE = 1 << 20;
+
+/**
+ * Streaming XXH64, seed 0
+ *
+ * Fast enough to hash boundary files at disk speed, and stable across
+ * platforms and releases, so the value can be stored in the registry.
+ */
+class Xxh64 {
+public:
+    void update(const uint8_t *data, size_t size)
+    {
+        total_ += size;
+
+        if (buffered_ + size < 32) {
+            std::memcpy(buffer_ + buffered_, data, size);
+            buffered_ += size;
+            return;
+        }
+
+        if (buffered_ > 0) {
+            const size_t fill = 32 - buffered_;
+            std::memcpy(buffer_ + buffered_, data, fill);
+            stripe(buffer_);
+            data += fill;
+            size -= fill;
+            buffered_ = 0;
+        }
+
+        while (size >= 32) {
+            stripe(data);
+            data += 32;
+            size -= 32;
+        }
+
+        std::memcpy(buffer_, data, size);
+        buffered_ = size;
+    }
+
+    uint64_t digest() const
+    {
+        uint64_t h;
+        if (total_ >= 32) {
+            h = rotl(v_[0], 1) + rotl(v_[1], 7) + rotl(v_[2], 12) + rotl(v_[3], 18);
+            for (uint64_t v : v_) {
+                h ^= round(0, v);
+                h = h * P1 + P4;
+            }
+        } else {
+            h = P5;
+        }
+        h += total_;
+
+        const uint8_t *p = buffer_;
+        size_t remaining = buffered_;
+        while (remaining >= 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * P1 + P4;
+            p += 8;
+            remaining -= 8;
+        }
+        if (remaining >= 4) {
+            h ^= static_cast<uint64_t>(read32(p)) * P1;
+            h = rotl(h, 23) * P2 + P3;
+            p += 4;
+            remaining -= 4;
+        }
+        while (remaining > 0) {
+            h ^= (*p) * P5;
+            h = rotl(h, 11) * P1;
+            p++;
+            remaining--;
+        }
+
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static constexpr uint64_t P1 = 0x9E3779B185EBCA87ULL;
+    static constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+    static constexpr uint64_t P3 = 0x165667B19E3779F9ULL;
+    static constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+    static constexpr uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static uint64_t round(uint64_t acc, uint64_t input)
+    {
+        acc += input * P2;
+        acc = rotl(acc, 31);
+        return acc * P1;
+    }
+
+    static uint64_t read64(const uint8_t *p)
+    {
+        uint64_t value;
+        std::memcpy(&value, p, 8);
+        return value;
+    }
+
+    static uint32_t read32(const uint8_t *p)
+    {
+        uint32_t value;
+        std::memcpy(&value, p, 4);
+        return value;
+    }
+
+    void stripe(const uint8_t *p)
+    {
+        for (int i = 0; i < 4; i++) {
+            v_[i] = round(v_[i], read64(p + 8 * i));
+        }
+    }
+
+    uint64_t v_[4] = {P1 + P2, P2, 0, 0 - P1};
+    uint8_t buffer_[32];
+    size_t buffered_ = 0;
+    uint64_t total_ = 0;
+};
+
+struct Fingerprint {
+    int64_t size = 0;
+    int64_t mtime = 0;  // nanoseconds since the epoch, latest of all files
+};
+
+bool stat_sources(const std::vector<std::string> &files, Fingerprint &fingerprint)
+{
+    for (const auto &file : files) {
+        struct stat st;
+        if (stat(file.c_str(), &st) != 0) {
+            std::cerr << "Error reading source file: " << file << std::endl;
+            return false;
+        }
+        const int64_t mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        fingerprint.size += st.st_size;
+        if (mtime > fingerprint.mtime) {
+            fingerprint.mtime = mtime;
+        }
+    }
+    return true;
+}
+
+bool hash_sources(const std::vector<std::string> &files, std::string &content_hash)
+{
+    Xxh64 hash;
+    std::vector<uint8_t> buffer(HASH_CHUNK_SIZE);
+
+    for (const auto &file : files) {
+        FILE *fp = std::fopen(file.c_str(), "rb");
+        if (fp == NULL) {
+            std::cerr << "Error reading source file: " << file << std::endl;
+            return false;
+        }
+        size_t n;
+        while ((n = std::fread(buffer.data(), 1, buffer.size(), fp)) > 0) {
+            hash.update(buffer.data(), n);
+        }
+        std::fclose(fp);
+    }
+
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash.digest()));
+    content_hash = hex;
+    return true;
+}
+
+bool table_exists(sqlite3 *db_handle, const std::string &table_name)
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db_handle, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, table_name.c_str(), -1, SQLITE_TRANSIENT);
+    bool exists = (sqlite3_step(stmt) == SQLITE_ROW);
+    sqlite3_finalize(stmt);
+    return exists;
+}
+
+/**
+ * Looks up the registry entry of the source last imported into a table
+ *
+ * @return true if that source is the given one
+ */
+bool registry_lookup(sqlite3 *db_handle, const std::string &source_name, const std::string &table_name,
+                     Fingerprint &fingerprint, std::string &content_hash)
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db_handle,
+                           "SELECT size, mtime, content_hash FROM import_registry WHERE table_name = ? AND source = ?",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, table_name.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, source_name.c_str(), -1, SQLITE_TRANSIENT);
+
+    bool found = (sqlite3_step(stmt) == SQLITE_ROW);
+    if (found) {
+        fingerprint.size = sqlite3_column_int64(stmt, 0);
+        fingerprint.mtime = sqlite3_column_int64(stmt, 1);
+        content_hash = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+int registry_store(sqlite3 *db_handle, const std::string &source_name, const std::string &table_name,
+                   const Fingerprint &fingerprint, const std::string &content_hash)
+{
+    sqlite3_stmt *stmt;
+
+    // A table holds one source at a time
+    if (sqlite3_prepare_v2(db_handle, "DELETE FROM import_registry WHERE table_name = ? AND source <> ?",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+    sqlite3_bind_text(stmt, 1, table_name.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, source_name.c_str(), -1, SQLITE_TRANSIENT);
+    int ret = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (ret != SQLITE_DONE) {
+        std::cerr << "Error updating import registry: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+
+    if (sqlite3_prepare_v2(db_handle,
+                           "INSERT OR REPLACE INTO import_registry (source, table_name, size, mtime, content_hash, imported_at) "
+                           "VALUES (?, ?, ?, ?, ?, datetime('now'))",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+    sqlite3_bind_text(stmt, 1, source_name.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, table_name.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 3, fingerprint.size);
+    sqlite3_bind_int64(stmt, 4, fingerprint.mtime);
+    sqlite3_bind_text(stmt, 5, content_hash.c_str(), -1, SQLITE_TRANSIENT);
+
+    ret = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (ret != SQLITE_DONE) {
+        std::cerr << "Error updating import registry: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace
+
+std::vector<std::string> shapefile_components(const std::string &shp_path)
+{
+    std::vector<std::string> files;
+    for (const char *extension : {".shp", ".shx", ".dbf", ".prj", ".cpg"}) {
+        struct stat st;
+        const std::string file = shp_path + extension;
+        if (stat(file.c_str(), &st) == 0) {
+            files.push_back(file);
+        }
+    }
+    return files;
+}
+
+int import_if_changed(sqlite3 *db_handle, const std::string &source_name,
+                      const std::vector<std::string> &source_files, const std::string &table_name,
+                      const ImportFunction &import_into, const std::vector<std::string> &sidecar_suffixes,
+                      bool *imported)
+{
+    if (imported != NULL) {
+        *imported = false;
+    }
+
+    if (source_files.empty()) {
+        std::cerr << "Error: no files found for source " << source_name << std::endl;
+        return 1;
+    }
+
+    if (exec(db_handle,
+             "CREATE TABLE IF NOT EXISTS import_registry ("
+             "source TEXT NOT NULL, "
+             "table_name TEXT NOT NULL, "
+             "size INTEGER NOT NULL, "
+             "mtime INTEGER NOT NULL, "
+             "content_hash TEXT NOT NULL, "
+             "imported_at TEXT NOT NULL, "
+             "PRIMARY KEY (source, table_name))",
+             "creating import registry") != 0) {
+        return 1;
+    }
+
+    Fingerprint current;
+    if (!stat_sources(source_files, current)) {
+        return 1;
+    }
+
+    Fingerprint registered;
+    std::string registered_hash;
+    const bool known = registry_lookup(db_handle, source_name, table_name, registered, registered_hash) &&
+                       table_exists(db_handle, table_name);
+
+    // Same size and mtime: skip without reading the files
+    if (known && registered.size == current.size && registered.mtime == current.mtime) {
+        std::cout << "Source unchanged since last import, skipping: " << source_name << std::endl;
+        return 0;
+    }
+
+    std::string current_hash;
+    if (!hash_sources(source_files, current_hash)) {
+        return 1;
+    }
+
+    // Touched but identical: remember the new mtime and skip
+    if (known && registered_hash == current_hash) {
+        std::cout << "Source content unchanged (" << current_hash << "), skipping: " << source_name << std::endl;
+        return registry_store(db_handle, source_name, table_name, current, current_hash);
+    }
+
+    // Import into a shadow table, left over ones come from interrupted runs
+    const std::string shadow_name = table_name + "__shadow";
+    auto drop_shadow_tables = [&]() {
+        int ret = exec(db_handle, "SELECT DropTable(NULL, " + quote_literal(shadow_name) + ", 1)",
+                       "dropping shadow table");
+        for (const auto &suffix : sidecar_suffixes) {
+            ret |= exec(db_handle, "SELECT DropTable(NULL, " + quote_literal(shadow_name + suffix) + ", 1)",
+                        "dropping shadow table");
+        }
+        return ret;
+    };
+    if (drop_shadow_tables() != 0) {
+        return 1;
+    }
+
+    std::cout << (known ? "Source changed" : "New source") << " (" << current_hash << "), importing "
+        << source_name << " into " << shadow_name << std::endl;
+    if (import_into(db_handle, shadow_name) != 0) {
+        drop_shadow_tables();
+        return 1;
+    }
+
+    // Swap the shadow tables in atomically. The sidecar tables of the
+    // previous import go with it, even those this import did not build.
+    if (exec(db_handle, "BEGIN TRANSACTION;", "starting transaction") != 0) {
+        return 1;
+    }
+    bool ok = exec(db_handle, "SELECT DropTable(NULL, " + quote_literal(table_name) + ", 1)",
+                   "dropping previous table") == 0 &&
+              exec(db_handle, "SELECT RenameTable(NULL, " + quote_literal(shadow_name) + ", " +
+                   quote_literal(table_name) + ")", "renaming shadow table") == 0;
+    for (const auto &suffix : sidecar_suffixes) {
+        ok = ok && exec(db_handle, "SELECT DropTable(NULL, " + quote_literal(table_name + suffix) + ", 1)",
+                        "dropping previous table") == 0;
+        if (ok && table_exists(db_handle, shadow_name + suffix)) {
+            ok = exec(db_handle, "SELECT RenameTable(NULL, " + quote_literal(shadow_name + suffix) + ", " +
+                      quote_literal(table_name + suffix) + ")", "renaming shadow table") == 0;
+        }
+    }
+    if (!ok || registry_store(db_handle, source_name, table_name, current, current_hash) != 0) {
+        exec(db_handle, "ROLLBACK;", "rolling back");
+        return 1;
+    }
+    if (exec(db_handle, "COMMIT;", "committing transaction") != 0) {
+        return 1;
+    }
+
+    if (imported != NULL) {
+        *imported = true;
+    }
+    return 0;
+}
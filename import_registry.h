@@ -0,0 +1,61 @@
+#ifndef IMPORT_REGISTRY_H
+#define IMPORT_REGISTRY_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+/**
+ * Imports a source into the given table; used to fill the shadow table
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table to create and fill
+ * @return 0 on success, 1 on failure
+ */
+using ImportFunction = std::function<int(sqlite3 *db_handle, const std::string &table_name)>;
+
+/**
+ * Lists the files making up a shapefile
+ *
+ * @param shp_path shapefile path without extension, as given to ImportSHP
+ * @return the .shp, .shx, .dbf, .prj and .cpg files that exist
+ */
+std::vector<std::string> shapefile_components(const std::string &shp_path);
+
+/**
+ * Imports a source only if it changed since it was last imported
+ *
+ * @param db_handle handle to the database connection
+ * @param source_name name identifying the source and the import settings
+ *        in the registry
+ * @param source_files files whose size, mtime and content identify the source
+ * @param table_name table the source is imported into
+ * @param import_into function that imports the source into a given table
+ * @param sidecar_suffixes suffixes of the tables derived from the table,
+ *        e.g. "_adjacency"; import_into builds them under the name of the
+ *        table it is given followed by the suffix
+ * @param imported set to whether the import actually ran (may be NULL)
+ * @return 0 on success (including a skipped import), 1 on failure
+ *
+ * Every import is recorded in the `import_registry` table with the total
+ * size, latest mtime and a 64 bit content hash of the source files. When
+ * size and mtime still match the registry the import is skipped without
+ * reading the files. When they differ, the content hash decides: a source
+ * that was only touched is skipped too. A changed source is imported into
+ * a shadow table first and swapped in, with its sidecar tables and the
+ * registry update, inside a single transaction, so an interrupted import
+ * never leaves a half-loaded table behind, nor sidecar tables out of step
+ * with it.
+ *
+ * A table holds one source at a time: importing another source, or the
+ * same files with different settings, under a new source_name replaces the
+ * table and its registry entry.
+ */
+int import_if_changed(sqlite3 *db_handle, const std::string &source_name,
+                      const std::vector<std::string> &source_files, const std::string &table_name,
+                      const ImportFunction &import_into, const std::vector<std::string> &sidecar_suffixes,
+                      bool *imported = NULL);
+
+#endif // IMPORT_REGISTRY_H
@@ -0,0 +1,91 @@
+#include "import_stats.h"
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+#include <unistd.h>
+
+namespace {
+
+// Minimum delay between two redraws of the progress line
+const std::chrono::milliseconds PROGRESS_INTERVAL(200);
+
+const char *const PHASE_NAMES[ImportStats::PhaseCount] = {"parse", "reproject", "encode", "insert", "validate", "index"};
+
+std::string format_bytes(double bytes)
+{
+    char text[32];
+    if (bytes >= 1024.0 * 1024.0 * 1024.0) {
+        std::snprintf(text, sizeof(text), "%.1f GiB", bytes / (1024.0 * 1024.0 * 1024.0));
+    } else if (bytes >= 1024.0 * 1024.0) {
+        std::snprintf(text, sizeof(text), "%.1f MiB", bytes / (1024.0 * 1024.0));
+    } else {
+        std::snprintf(text, sizeof(text), "%.1f KiB", bytes / 1024.0);
+    }
+    return text;
+}
+
+double seconds(ImportStats::Clock::duration elapsed)
+{
+    return std::chrono::duration<double>(elapsed).count();
+}
+
+} // namespace
+
+ImportStats::ImportStats(const std::string &label)
+    : label_(label), start_(Clock::now()), last_progress_(start_),
+      live_(isatty(fileno(stdout)) != 0)
+{
+}
+
+void ImportStats::progress()
+{
+    if (!live_) return;
+
+    const Clock::time_point now = Clock::now();
+    if (now - last_progress_ < PROGRESS_INTERVAL) return;
+    last_progress_ = now;
+
+    const double elapsed = seconds(now - start_);
+    std::ostringstream line;
+    line << "\r  " << label_ << ": " << records_ << " records, " << format_bytes(bytes_);
+    if (total_bytes_ > 0) {
+        line << " of " << format_bytes(total_bytes_) << " (" << (100 * bytes_ / total_bytes_) << "%)";
+    }
+    if (elapsed > 0) {
+        line << ", " << static_cast<uint64_t>(records_ / elapsed) << " records/s";
+    }
+    line << "   ";
+
+    std::cout << line.str() << std::flush;
+    progress_shown_ = true;
+}
+
+void ImportStats::report()
+{
+    if (progress_shown_) {
+        std::cout << std::endl;
+        progress_shown_ = false;
+    }
+
+    const double elapsed = seconds(Clock::now() - start_);
+    const double rate_base = elapsed > 0 ? elapsed : 1;
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "%.2f s", elapsed);
+    std::cout << "Import of " << label_ << ": " << records_ << " records, " << format_bytes(bytes_) << ", "
+        << vertices_ << " vertices in " << line << std::endl;
+    std::snprintf(line, sizeof(line), "%.0f records/s, %s/s, %.0f vertices/s", records_ / rate_base,
+                  format_bytes(bytes_ / rate_base).c_str(), vertices_ / rate_base);
+    std::cout << "  " << line << std::endl;
+
+    std::cout << " ";
+    for (int phase = 0; phase < PhaseCount; phase++) {
+        const double phase_seconds = seconds(phase_time_[phase]);
+        std::snprintf(line, sizeof(line), " %s %.3f s (%.0f%%)%s", PHASE_NAMES[phase], phase_seconds,
+                      100 * phase_seconds / rate_base, phase + 1 < PhaseCount ? "," : "");
+        std::cout << line;
+    }
+    std::cout << std::endl;
+}
@@ -0,0 +1,109 @@
+#ifndef IMPORT_STATS_H
+#define IMPORT_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * Throughput counters and phase timings of one import
+ *
+ * Importers count every record with its size in the source file and its
+ * number of vertices, and time their parse, reproject, encode and insert
+ * steps; the caller times the validation pass and the index build. While
+ * the import runs, progress() redraws a single status line on the
+ * terminal; report() prints the totals, the records, bytes and vertices
+ * per second, and how the time was split between the phases.
+ */
+class ImportStats {
+public:
+    enum Phase { Parse, Reproject, Encode, Insert, Validate, Index, PhaseCount };
+
+    using Clock = std::chrono::high_resolution_clock;
+
+    /**
+     * Times a phase for as long as it is in scope
+     */
+    class Timer {
+    public:
+        Timer(ImportStats *stats, Phase phase) : stats_(stats), phase_(phase), start_(Clock::now()) {}
+        ~Timer() { stop(); }
+
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+
+        void stop()
+        {
+            if (stats_ != NULL) {
+                stats_->add_time(phase_, Clock::now() - start_);
+                stats_ = NULL;
+            }
+        }
+
+    private:
+        ImportStats *stats_;
+        Phase phase_;
+        Clock::time_point start_;
+    };
+
+    /**
+     * @param label name shown in the progress line and the report
+     */
+    explicit ImportStats(const std::string &label);
+
+    /**
+     * Sets the size of the source, once the importer knows it, so that the
+     * progress line can show a percentage
+     */
+    void set_total_bytes(uint64_t total_bytes) { total_bytes_ = total_bytes; }
+
+    /**
+     * Counts one imported record
+     *
+     * @param bytes size of the record in the source file
+     * @param vertices number of vertices of its geometry
+     */
+    void add_record(uint64_t bytes, uint64_t vertices)
+    {
+        records_++;
+        bytes_ += bytes;
+        vertices_ += vertices;
+    }
+
+    /**
+     * Counts source bytes not attributed to any record (headers, skipped
+     * records)
+     */
+    void add_bytes(uint64_t bytes) { bytes_ += bytes; }
+
+    void add_time(Phase phase, Clock::duration elapsed) { phase_time_[phase] += elapsed; }
+
+    /**
+     * Redraws the live progress line, at most a few times per second and
+     * only when stdout is a terminal
+     */
+    void progress();
+
+    /**
+     * Ends the progress line and prints the throughput summary
+     */
+    void report();
+
+    uint64_t records() const { return records_; }
+    uint64_t bytes() const { return bytes_; }
+    uint64_t vertices() const { return vertices_; }
+
+private:
+    std::string label_;
+    uint64_t total_bytes_ = 0;
+    uint64_t records_ = 0;
+    uint64_t bytes_ = 0;
+    uint64_t vertices_ = 0;
+    Clock::time_point start_;
+    Clock::time_point last_progress_;
+    Clock::duration phase_time_[PhaseCount] = {};
+    bool live_;
+    bool progress_shown_ = false;
+};
+
+#endif // IMPORT_STATS_H
@@ -0,0 +1,292 @@
+#include "kernel_density.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "thread_pool.h"
+
+namespace {
+
+// Cells per side of a tile
+const int64_t DENSITY_TILE_SIZE = 256;
+
+// Reach of the Gaussian kernel, in bandwidths; it keeps 98.9% of the weight
+const double GAUSSIAN_CUTOFF = 3;
+
+const double PI = 3.14159265358979323846;
+const double DEG_TO_RAD = PI / 180;
+
+/**
+ * Reach and weight of the kernel of one point
+ */
+struct Footprint {
+    double metres_per_x;   // metres per CRS unit, along x and y
+    double metres_per_y;
+    float weight;          // kernel value at the point, in points per km^2
+    int64_t first_column;
+    int64_t last_column;
+    int64_t first_row;
+    int64_t last_row;
+};
+
+Footprint kernel_footprint(const Point &p, const DensityGrid &grid, DensityKernel kernel, double bandwidth,
+                           bool geographic)
+{
+    Footprint footprint;
+    footprint.metres_per_x = 1;
+    footprint.metres_per_y = 1;
+    if (geographic) {
+        // Length of a degree of latitude and of longitude on the ellipsoid
+        const double phi = p.y * DEG_TO_RAD;
+        footprint.metres_per_y = 111132.954 - 559.822 * std::cos(2 * phi) + 1.175 * std::cos(4 * phi);
+        footprint.metres_per_x = std::max(1.0, 111412.84 * std::cos(phi) - 93.5 * std::cos(3 * phi));
+    }
+
+    // Normalized so that the kernel integrates to one point over the plane
+    double scale = 0;
+    const double reach = kernel_reach(kernel, bandwidth);
+    switch (kernel) {
+        case DensityKernel::Gaussian:
+            scale = 1 / (2 * PI);
+            break;
+        case DensityKernel::Epanechnikov:
+            scale = 2 / PI;
+            break;
+        case DensityKernel::Quartic:
+            scale = 3 / PI;
+            break;
+    }
+    footprint.weight = static_cast<float>(scale / (bandwidth * bandwidth) * 1e6);
+
+    // Cells whose centre is within reach, along each axis
+    const double reach_x = reach / footprint.metres_per_x / grid.cell_size;
+    const double reach_y = reach / footprint.metres_per_y / grid.cell_size;
+    const double column = (p.x - grid.bbox.min_x) / grid.cell_size - 0.5;
+    const double row = (grid.bbox.max_y - p.y) / grid.cell_size - 0.5;
+    footprint.first_column = std::max<int64_t>(0, static_cast<int64_t>(std::ceil(column - reach_x)));
+    footprint.last_column = std::min<int64_t>(grid.width - 1, static_cast<int64_t>(std::floor(column + reach_x)));
+    footprint.first_row = std::max<int64_t>(0, static_cast<int64_t>(std::ceil(row - reach_y)));
+    footprint.last_row = std::min<int64_t>(grid.height - 1, static_cast<int64_t>(std::floor(row + reach_y)));
+    return footprint;
+}
+
+// Row kernels: cells[k] += the kernel at u = ux[k] + uy, u being the
+// squared distance in bandwidths. Cells go by blocks of ROW_BLOCK with no
+// branch, which compilers turn into SIMD code even at -O2, where loops of
+// unknown length are not vectorized.
+const size_t ROW_BLOCK = 8;
+
+void add_gaussian_row(float *__restrict cells, const float *__restrict gx, float gy, size_t count)
+{
+    size_t k = 0;
+    for (; k + ROW_BLOCK <= count; k += ROW_BLOCK) {
+        for (size_t j = 0; j < ROW_BLOCK; j++) {
+            cells[k + j] += gy * gx[k + j];
+        }
+    }
+    for (; k < count; k++) {
+        cells[k] += gy * gx[k];
+    }
+}
+
+void add_epanechnikov_row(float *__restrict cells, const float *__restrict ux, float uy, float weight, size_t count)
+{
+    size_t k = 0;
+    for (; k + ROW_BLOCK <= count; k += ROW_BLOCK) {
+        for (size_t j = 0; j < ROW_BLOCK; j++) {
+            const float t = std::max(0.0f, 1.0f - (ux[k + j] + uy));
+            cells[k + j] += weight * t;
+        }
+    }
+    for (; k < count; k++) {
+        const float t = std::max(0.0f, 1.0f - (ux[k] + uy));
+        cells[k] += weight * t;
+    }
+}
+
+void add_quartic_row(float *__restrict cells, const float *__restrict ux, float uy, float weight, size_t count)
+{
+    size_t k = 0;
+    for (; k + ROW_BLOCK <= count; k += ROW_BLOCK) {
+        for (size_t j = 0; j < ROW_BLOCK; j++) {
+            const float t = std::max(0.0f, 1.0f - (ux[k + j] + uy));
+            cells[k + j] += weight * t * t;
+        }
+    }
+    for (; k < count; k++) {
+        const float t = std::max(0.0f, 1.0f - (ux[k] + uy));
+        cells[k] += weight * t * t;
+    }
+}
+
+} // namespace
+
+bool parse_density_kernel(const std::string &name, DensityKernel &kernel)
+{
+    if (name == "gaussian") {
+        kernel = DensityKernel::Gaussian;
+    } else if (name == "epanechnikov") {
+        kernel = DensityKernel::Epanechnikov;
+    } else if (name == "quartic") {
+        kernel = DensityKernel::Quartic;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+double kernel_reach(DensityKernel kernel, double bandwidth)
+{
+    return kernel == DensityKernel::Gaussian ? GAUSSIAN_CUTOFF * bandwidth : bandwidth;
+}
+
+int kernel_density(const std::vector<Point> &points, const BBox &bbox, uint32_t max_cells, DensityKernel kernel,
+                   double bandwidth, bool geographic, ThreadPool &pool, DensityGrid &grid, DensityStats *stats)
+{
+    if (bbox.empty() || !(bbox.max_x > bbox.min_x) || !(bbox.max_y > bbox.min_y) || max_cells == 0) {
+        std::cerr << "Invalid density grid area or size" << std::endl;
+        return 1;
+    }
+    if (!(bandwidth > 0)) {
+        std::cerr << "Invalid kernel bandwidth: " << bandwidth << std::endl;
+        return 1;
+    }
+
+    // Square cells, max_cells along the longer side
+    grid.cell_size = std::max(bbox.max_x - bbox.min_x, bbox.max_y - bbox.min_y) / max_cells;
+    grid.width = std::max<uint32_t>(1, static_cast<uint32_t>(std::ceil((bbox.max_x - bbox.min_x) / grid.cell_size)));
+    grid.height = std::max<uint32_t>(1, static_cast<uint32_t>(std::ceil((bbox.max_y - bbox.min_y) / grid.cell_size)));
+    grid.width = std::min(grid.width, max_cells);
+    grid.height = std::min(grid.height, max_cells);
+    if (static_cast<uint64_t>(grid.width) * grid.height > MAX_DENSITY_CELLS) {
+        std::cerr << "Density grid too large: " << grid.width << "x" << grid.height << " cells, at most "
+            << MAX_DENSITY_CELLS << std::endl;
+        return 1;
+    }
+    grid.bbox = BBox();
+    grid.bbox.expand(bbox.min_x, bbox.max_y - grid.height * grid.cell_size);
+    grid.bbox.expand(bbox.min_x + grid.width * grid.cell_size, bbox.max_y);
+    grid.values.assign(static_cast<size_t>(grid.width) * grid.height, 0.0f);
+
+    // Bin the points into the tiles their kernel reaches
+    const int64_t tiles_x = (grid.width + DENSITY_TILE_SIZE - 1) / DENSITY_TILE_SIZE;
+    const int64_t tiles_y = (grid.height + DENSITY_TILE_SIZE - 1) / DENSITY_TILE_SIZE;
+    std::vector<std::vector<size_t>> bins(tiles_x * tiles_y);
+    uint64_t tile_points = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        const Footprint footprint = kernel_footprint(points[i], grid, kernel, bandwidth, geographic);
+        if (footprint.first_column > footprint.last_column || footprint.first_row > footprint.last_row) continue;
+
+        for (int64_t ty = footprint.first_row / DENSITY_TILE_SIZE; ty <= footprint.last_row / DENSITY_TILE_SIZE; ty++) {
+            for (int64_t tx = footprint.first_column / DENSITY_TILE_SIZE;
+                 tx <= footprint.last_column / DENSITY_TILE_SIZE; tx++) {
+                bins[ty * tiles_x + tx].push_back(i);
+                tile_points++;
+            }
+        }
+    }
+
+    // Accumulate, one tile per task; the per-column terms of each worker
+    // are reused from point to point
+    std::vector<std::vector<float>> columns(pool.size(), std::vector<float>(DENSITY_TILE_SIZE));
+    pool.parallel_for(bins.size(), [&](size_t tile, unsigned worker) {
+        const int64_t tile_column = static_cast<int64_t>(tile % tiles_x) * DENSITY_TILE_SIZE;
+        const int64_t tile_row = static_cast<int64_t>(tile / tiles_x) * DENSITY_TILE_SIZE;
+        const int64_t tile_last_column = std::min<int64_t>(tile_column + DENSITY_TILE_SIZE, grid.width) - 1;
+        const int64_t tile_last_row = std::min<int64_t>(tile_row + DENSITY_TILE_SIZE, grid.height) - 1;
+        float *ux = columns[worker].data();
+
+        for (size_t i : bins[tile]) {
+            const Point &p = points[i];
+            const Footprint footprint = kernel_footprint(p, grid, kernel, bandwidth, geographic);
+            const int64_t first_column = std::max(footprint.first_column, tile_column);
+            const int64_t last_column = std::min(footprint.last_column, tile_last_column);
+            const int64_t first_row = std::max(footprint.first_row, tile_row);
+            const int64_t last_row = std::min(footprint.last_row, tile_last_row);
+            const size_t count = static_cast<size_t>(last_column - first_column + 1);
+
+            // Squared distances along x, in bandwidths, or their Gaussian
+            for (size_t k = 0; k < count; k++) {
+                const double x = grid.bbox.min_x + (first_column + k + 0.5) * grid.cell_size;
+                const double dx = (x - p.x) * footprint.metres_per_x / bandwidth;
+                ux[k] = static_cast<float>(dx * dx);
+                if (kernel == DensityKernel::Gaussian) ux[k] = std::exp(-0.5f * ux[k]);
+            }
+
+            for (int64_t row = first_row; row <= last_row; row++) {
+                const double y = grid.bbox.max_y - (row + 0.5) * grid.cell_size;
+                const double dy = (y - p.y) * footprint.metres_per_y / bandwidth;
+                const float uy = static_cast<float>(dy * dy);
+                float *cells = &grid.values[static_cast<size_t>(row) * grid.width + first_column];
+                switch (kernel) {
+                    case DensityKernel::Gaussian:
+                        add_gaussian_row(cells, ux, footprint.weight * std::exp(-0.5f * uy), count);
+                        break;
+                    case DensityKernel::Epanechnikov:
+                        add_epanechnikov_row(cells, ux, uy, footprint.weight, count);
+                        break;
+                    case DensityKernel::Quartic:
+                        add_quartic_row(cells, ux, uy, footprint.weight, count);
+                        break;
+                }
+            }
+        }
+    });
+
+    if (stats != NULL) {
+        stats->tiles += bins.size();
+        for (const auto &bin : bins) stats->busy_tiles += bin.empty() ? 0 : 1;
+        stats->tile_points += tile_points;
+    }
+    return 0;
+}
+
+int write_density_grid(const DensityGrid &grid, const std::string &path)
+{
+    std::ofstream data(path, std::ios::binary);
+    if (!data) {
+        std::cerr << "Cannot create " << path << std::endl;
+        return 1;
+    }
+    data.write(reinterpret_cast<const char *>(grid.values.data()), grid.values.size() * sizeof(float));
+    data.close();
+    if (!data) {
+        std::cerr << "Error writing " << path << std::endl;
+        return 1;
+    }
+
+    const size_t dot = path.find_last_of('.');
+    const size_t slash = path.find_last_of('/');
+    const std::string header_path =
+        (dot != std::string::npos && (slash == std::string::npos || dot > slash) ? path.substr(0, dot) : path) + ".hdr";
+    std::ofstream header(header_path);
+    if (!header) {
+        std::cerr << "Cannot create " << header_path << std::endl;
+        return 1;
+    }
+
+    // The floats are written in the byte order of this machine
+    const uint16_t one = 1;
+    const bool little_endian = *reinterpret_cast<const uint8_t *>(&one) == 1;
+
+    char line[64];
+    header << "ncols " << grid.width << "\n";
+    header << "nrows " << grid.height << "\n";
+    std::snprintf(line, sizeof(line), "%.17g", grid.bbox.min_x);
+    header << "xllcorner " << line << "\n";
+    std::snprintf(line, sizeof(line), "%.17g", grid.bbox.min_y);
+    header << "yllcorner " << line << "\n";
+    std::snprintf(line, sizeof(line), "%.17g", grid.cell_size);
+    header << "cellsize " << line << "\n";
+    header << "NODATA_value -9999\n";
+    header << "byteorder " << (little_endian ? "LSBFIRST" : "MSBFIRST") << "\n";
+    header.close();
+    if (!header) {
+        std::cerr << "Error writing " << header_path << std::endl;
+        return 1;
+    }
+    return 0;
+}
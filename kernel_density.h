@@ -0,0 +1,99 @@
+#ifndef KERNEL_DENSITY_H
+#define KERNEL_DENSITY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+
+class ThreadPool;
+
+/**
+ * Kernel spreading each point over the cells around it, within its
+ * bandwidth h
+ */
+enum class DensityKernel {
+    Gaussian,       // exp(-d^2 / 2h^2), cut at 3h
+    Epanechnikov,   // 1 - d^2 / h^2
+    Quartic         // (1 - d^2 / h^2)^2, the kernel of most GIS heatmaps
+};
+
+/**
+ * @param name "gaussian", "epanechnikov" or "quartic"
+ * @param kernel parsed kernel
+ * @return true if the name is known
+ */
+bool parse_density_kernel(const std::string &name, DensityKernel &kernel);
+
+/**
+ * @param kernel kernel
+ * @param bandwidth kernel bandwidth, in metres
+ * @return distance beyond which the kernel adds nothing, in metres
+ */
+double kernel_reach(DensityKernel kernel, double bandwidth);
+
+// Most cells of a density grid: 2^28 floats, 1 GiB, i.e. a square grid
+// of 16384 x 16384 cells
+const uint64_t MAX_DENSITY_CELLS = 268435456;
+const uint32_t MAX_DENSITY_RESOLUTION = 16384;
+
+/**
+ * A raster of densities, in points per square kilometre
+ */
+struct DensityGrid {
+    BBox bbox;                  // outer edges of the cells
+    double cell_size = 0;       // in CRS units; cells are square
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<float> values;  // row-major, northernmost row first
+};
+
+struct DensityStats {
+    uint64_t tiles = 0;          // tiles of the grid
+    uint64_t busy_tiles = 0;     // tiles reached by at least one point
+    uint64_t tile_points = 0;    // (tile, point) pairs accumulated
+};
+
+/**
+ * Rasterizes points into a kernel density grid
+ *
+ * @param points points to rasterize
+ * @param bbox area of the grid, in the CRS of the points
+ * @param max_cells number of cells along the longer side of the bbox
+ * @param kernel kernel to spread each point with
+ * @param bandwidth kernel bandwidth, in metres
+ * @param geographic true if the points are longitude/latitude; metres are
+ *        then converted to degrees at the latitude of each point,
+ *        otherwise the CRS unit is taken to be the metre
+ * @param pool threads, one tile per task
+ * @param grid the density grid
+ * @param stats counters (may be NULL)
+ * @return 0 on success, 1 if the bbox, size or bandwidth is invalid, or
+ *         if the grid would have more than MAX_DENSITY_CELLS cells
+ *
+ * The grid is cut into tiles of 256 x 256 cells. Each point is binned
+ * into the tiles its kernel reaches, then every tile, in parallel,
+ * accumulates its points into its own cells, so no two threads ever
+ * write the same cell. Per point, the kernel is evaluated row by row
+ * over contiguous float arrays with no branch in the inner loop, which
+ * the compiler turns into SIMD code in optimized builds; the Gaussian
+ * kernel is separable and costs a multiply-add per cell.
+ */
+int kernel_density(const std::vector<Point> &points, const BBox &bbox, uint32_t max_cells, DensityKernel kernel,
+                   double bandwidth, bool geographic, ThreadPool &pool, DensityGrid &grid,
+                   DensityStats *stats = NULL);
+
+/**
+ * Writes a density grid as an ESRI float grid, which GDAL and GIS read:
+ * raw 32 bit floats, row by row, in a .flt file, and the georeferencing
+ * in a .hdr text file next to it
+ *
+ * @param grid grid to write
+ * @param path path of the .flt file; the .hdr file gets the same name
+ *        with the .hdr extension
+ * @return 0 on success, 1 on failure
+ */
+int write_density_grid(const DensityGrid &grid, const std::string &path);
+
+#endif // KERNEL_DENSITY_H
@@ -1,5 +1,14 @@
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
 #include <vector>
 
 #include <sqlite3.h>
@@ -7,6 +16,67 @@
 
 #include <getopt.h>
 
+#include "adjacency.h"
+#include "border_index.h"
+#include "bulk_load.h"
+#include "density_clustering.h"
+#include "display_query.h"
+#include "distance_join.h"
+#include "dissolve.h"
+#include "flatgeobuf.h"
+#include "geo_distance.h"
+#include "geodesic_measures.h"
+#include "geojson.h"
+#include "geometry.h"
+#include "import_registry.h"
+#include "import_stats.h"
+#include "kernel_density.h"
+#include "nearest_site.h"
+#include "projection.h"
+#include "result_cache.h"
+#include "shapefile.h"
+#include "slab_lookup.h"
+#include "state_lookup.h"
+#include "thread_pool.h"
+#include "topology.h"
+#include "trajectory.h"
+#include "triangle_lookup.h"
+#include "validation.h"
+#include "viewport_cursor.h"
+
+
+/**
+ * Options shared by the examples, filled from the command line
+ */
+struct ExampleOptions {
+    std::string fgb_file_path;
+    std::string geojson_file_path;
+    bool has_bbox = false;
+    bool bulk_load = false;
+    BBox bbox;
+    BlobEncoding encoding;
+    bool validate = false;
+    unsigned threads = 0;
+    int target_srid = 0;
+    std::string charset = "UTF-8";   // of the shapefile attributes, without a .cpg file
+    bool adjacency = false;
+    bool topology = false;
+    bool measures = false;
+    bool nearest_border = false;
+    double within_km = 0;
+    std::string tracks_file_path;
+    double cluster_distance = 0;   // DBSCAN radius in metres, 0 to skip clustering
+    int cluster_min_points = 0;
+    std::string heatmap_path;
+    DensityKernel kernel = DensityKernel::Quartic;
+    double kernel_bandwidth = 1000;   // metres
+    uint32_t heatmap_cells = 1024;    // along the longer side
+    std::string engine = "sql";
+    int cache_precision = -1;
+    int display_zoom = -1;
+    std::string dissolve;   // column, or CSV file mapping a column to regions
+};
+
 
 /**
  * Handle a SQLite error
@@ -213,15 +283,659 @@ int run_example_1(std::string db_name)
     return 0;
 }
 
+/**
+ * Imports the states shapefile into a table, unless the same content was
+ * already imported with the same settings, then builds the tables derived
+ * from it that the options ask for
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table of the states
+ * @param shp_file_path path of the shapefile, without extension
+ * @param options command-line options
+ * @param table_srid SRID of the table
+ * @return 0 on success, 1 on failure
+ */
+static int import_states(sqlite3 *db_handle, const std::string &table_name, const std::string &shp_file_path,
+                         const ExampleOptions &options, int &table_srid)
+{
+    std::cout << "Importing shapefile: " << shp_file_path << std::endl;
+
+    // The SRID comes from the .prj file, the table uses the target SRID if one is given
+    int source_srid = shapefile_srid(shp_file_path);
+    if (source_srid == 0) {
+        std::cerr << "Unknown coordinate reference system for " << shp_file_path << ", assuming EPSG:4326" << std::endl;
+        source_srid = 4326;
+    }
+    table_srid = options.target_srid > 0 ? options.target_srid : source_srid;
+    std::cout << "Shapefile SRID: " << source_srid << ", table SRID: " << table_srid << std::endl;
+
+    // Dissolving by a column, or by a region mapping read from a CSV file
+    std::string dissolve_column = options.dissolve;
+    std::map<std::string, std::string> dissolve_regions;
+    std::vector<std::string> components = shapefile_components(shp_file_path);
+    const std::string csv_suffix = ".csv";
+    if (options.dissolve.size() > csv_suffix.size() &&
+        options.dissolve.compare(options.dissolve.size() - csv_suffix.size(), csv_suffix.size(), csv_suffix) == 0) {
+        dissolve_column.clear();
+        if (read_region_mapping(options.dissolve, dissolve_column, dissolve_regions) != 0) {
+            return 1;
+        }
+        components.push_back(options.dissolve);
+    }
+
+    ImportStats stats(table_name);
+    auto import_source = [&](sqlite3 *db, const std::string &target_table) {
+        ThreadPool pool(options.threads);
+        if (import_shapefile(db, shp_file_path, target_table, source_srid, options.encoding, &stats,
+                             options.target_srid, &pool, options.charset) != 0) {
+            return 1;
+        }
+
+        // Check and repair the geometries before anything queries them
+        if (options.validate) {
+            ImportStats::Timer validate_timer(&stats, ImportStats::Validate);
+            if (validate_geometries(db, target_table, "Geometry", pool, options.encoding) != 0) {
+                return 1;
+            }
+        }
+
+        // Store the area and perimeter on the ellipsoid, once
+        if (options.measures &&
+            compute_geodesic_measures(db, target_table, "Geometry", pool) != 0) {
+            return 1;
+        }
+
+        // Precompute which states share a border, and its length
+        if (options.adjacency &&
+            build_adjacency(db, target_table, "Geometry", "SIGLA_UF", target_table + "_adjacency", pool) != 0) {
+            return 1;
+        }
+
+        // Build the spatial index in one STR-packed pass
+        if (options.bulk_load) {
+            ImportStats::Timer index_timer(&stats, ImportStats::Index);
+            if (build_str_spatial_index(db, target_table, "Geometry", true) != 0) {
+                return 1;
+            }
+        }
+
+        // Store each border once, as arcs shared by the neighbouring states;
+        // the rings reference rowids, so this comes after the index build
+        if (options.topology &&
+            build_topology_tables(db, target_table, "Geometry", target_table + "_topo") != 0) {
+            return 1;
+        }
+
+        // Merge the states into regions
+        if (!dissolve_column.empty()) {
+            return dissolve(db, target_table, "Geometry", dissolve_column, dissolve_regions, target_table + "_regions",
+                            pool);
+        }
+        return 0;
+    };
+
+    // The registry entry covers the import settings too
+    std::string source_name = shp_file_path;
+    if (options.encoding.compressed) {
+        source_name += " compressed";
+    }
+    if (options.encoding.precision >= 0) {
+        source_name += " precision=" + std::to_string(options.encoding.precision);
+    }
+    if (options.validate) {
+        source_name += " validated";
+    }
+    if (options.target_srid > 0) {
+        source_name += " srid=" + std::to_string(options.target_srid);
+    }
+    if (options.charset != "UTF-8") {
+        source_name += " charset=" + options.charset;
+    }
+    if (options.measures) {
+        source_name += " measures";
+    }
+    if (options.adjacency) {
+        source_name += " adjacency";
+    }
+    if (options.topology) {
+        source_name += " topology";
+    }
+    if (!options.dissolve.empty()) {
+        source_name += " dissolve=" + options.dissolve;
+    }
+
+    // Tables derived from the states, built next to the shadow table and swapped in with it
+    const std::vector<std::string> sidecar_suffixes = {"_adjacency", "_topo_arcs", "_topo_rings", "_regions"};
+
+    bool imported = false;
+    const int ret = import_if_changed(db_handle, source_name, components, table_name, import_source, sidecar_suffixes,
+                            &imported);
+    if (imported) {
+        stats.report();
+    }
+    return ret;
+}
+
+/**
+ * Finds the state of each place, with ST_Within or the in-memory engine
+ * of the options, through the result cache if there is one, and compares
+ * the engine with ST_Within on random points
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table of the states
+ * @param table_srid SRID of the table
+ * @param places names and longitude/latitude of the places
+ * @param options command-line options
+ * @return 0 on success, 1 on failure
+ */
+static int locate_places(sqlite3 *db_handle, const std::string &table_name, int table_srid,
+                         const std::vector<std::pair<std::string, Point>> &places, const ExampleOptions &options)
+{
+    // The points are WGS 84; each is reprojected once to the table SRID
+    // here, so the query never runs ST_Transform on the table rows
+    const std::string sql_cmd = "SELECT NM_UF FROM " + table_name + " WHERE ST_Within(?, geometry) =1";
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+
+    try {
+        // The in-memory engines: one indexes every polygon part on its own,
+        // one the triangles of every polygon, one the slabs of every state
+        std::unique_ptr<StateLookup> lookup;
+        std::unique_ptr<TriangleLookup> triangles;
+        std::unique_ptr<SlabLookup> slabs;
+        std::function<std::string(const Point &)> find_in_memory;
+        BBox extent;
+        LookupStats lookup_stats;
+        auto build_start = std::chrono::high_resolution_clock::now();
+        if (options.engine == "parts") {
+            lookup.reset(new StateLookup(db_handle, table_name, "Geometry", "NM_UF"));
+            std::cout << "Lookup engine: " << lookup->num_features() << " states, " << lookup->num_parts()
+                << " indexed parts, coverage grid of " << lookup->grid().size() << "x" << lookup->grid().size()
+                << " with " << lookup->grid().count(CoverageGrid::MIXED) << " border cells" << std::endl;
+            find_in_memory = [&](const Point &p) -> std::string {
+                const int64_t state = lookup->find(p, &lookup_stats);
+                return state >= 0 ? lookup->label(state) : "Not found";
+            };
+            extent = lookup->extent();
+        } else if (options.engine == "triangles") {
+            triangles.reset(new TriangleLookup(db_handle, table_name, "Geometry", "NM_UF"));
+            std::cout << "Lookup engine: " << triangles->num_features() << " states, " << triangles->num_triangles()
+                << " indexed triangles" << std::endl;
+            find_in_memory = [&](const Point &p) -> std::string {
+                const int64_t state = triangles->find(p, &lookup_stats);
+                return state >= 0 ? triangles->label(state) : "Not found";
+            };
+            extent = triangles->extent();
+        } else if (options.engine == "slabs") {
+            slabs.reset(new SlabLookup(db_handle, table_name, "Geometry", "NM_UF"));
+            std::cout << "Lookup engine: " << slabs->num_features() << " states, " << slabs->num_slabs()
+                << " slabs holding " << slabs->num_slab_edges() << " edges" << std::endl;
+            find_in_memory = [&](const Point &p) -> std::string {
+                const int64_t state = slabs->find(p, &lookup_stats);
+                return state >= 0 ? slabs->label(state) : "Not found";
+            };
+            extent = slabs->extent();
+        }
+        if (find_in_memory) {
+            std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - build_start;
+            std::cout << "Time to build the lookup engine: " << elapsed.count() << " seconds" << std::endl;
+        }
+
+        // Finds the state of a point in the table SRID with SpatiaLite
+        auto find_in_sql = [&](const Point &p) -> std::string {
+            Geometry point;
+            point.type = GeometryType::Point;
+            point.srid = table_srid;
+            point.points.push_back(p);
+            const std::vector<uint8_t> blob = encode_spatialite_blob(point);
+            sqlite3_bind_blob(stmt, 1, blob.data(), blob.size(), SQLITE_TRANSIENT);
+
+            std::string state = "Not found";
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                state = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+            }
+            sqlite3_reset(stmt);
+            return state;
+        };
+
+        // Finds the state of a point in the table SRID with the chosen engine
+        auto locate = [&](const Point &p) -> std::string {
+            return find_in_memory ? find_in_memory(p) : find_in_sql(p);
+        };
+
+        // Repeated lookups of the same places are answered from the result
+        // cache, keyed by their longitude/latitude
+        std::unique_ptr<ResultCache<std::string>> results;
+        if (options.cache_precision >= 0) {
+            results.reset(new ResultCache<std::string>(options.cache_precision));
+        }
+        auto cached_locate = [&](const Point &lon_lat, const Point &p) {
+            return results ? results->get(lon_lat, [&](const Point &) { return locate(p); }) : locate(p);
+        };
+
+        ProjContext proj;
+        std::vector<std::pair<Point, Point>> located;
+        for (const auto& place : places) {
+            Geometry point;
+            point.type = GeometryType::Point;
+            point.srid = 4326;
+            point.points.push_back(place.second);
+            if (!proj.transform(point, table_srid)) {
+                std::cout << place.first << " ---> " << "Cannot reproject: " << proj.last_error() << std::endl;
+                continue;
+            }
+
+            std::cout << place.first << " ---> " << cached_locate(place.second, point.points[0]) << std::endl;
+            located.emplace_back(place.second, point.points[0]);
+        }
+
+        // Replay the places as repetitive traffic: the same depots, the
+        // same parking spots, over and over
+        if (results && !located.empty()) {
+            const int replays = 10000;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < replays; i++) {
+                const auto &place = located[i % located.size()];
+                cached_locate(place.first, place.second);
+            }
+            std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+            const CacheStats cache_stats = results->stats();
+            std::cout << "Result cache: " << replays << " replayed lookups in " << elapsed.count() << " s, "
+                << cache_stats.hits << " hits, " << cache_stats.misses << " misses ("
+                << 100 * cache_stats.hit_rate() << "% hit rate), " << cache_stats.evictions << " evictions, "
+                << cache_stats.entries << " entries" << std::endl;
+        }
+
+        // Benchmark the in-memory engine against ST_Within on random
+        // points over the extent of the states
+        if (find_in_memory && !extent.empty()) {
+            const int samples = 2000;
+            std::mt19937 rng(42);
+            std::uniform_real_distribution<double> random_x(extent.min_x, extent.max_x);
+            std::uniform_real_distribution<double> random_y(extent.min_y, extent.max_y);
+            std::vector<Point> points;
+            for (int i = 0; i < samples; i++) {
+                const double x = random_x(rng);
+                points.push_back(Point{x, random_y(rng)});
+            }
+
+            std::vector<std::string> expected;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (const Point &p : points) {
+                expected.push_back(find_in_sql(p));
+            }
+            std::chrono::duration<double> sql_elapsed = std::chrono::high_resolution_clock::now() - start;
+
+            int mismatches = 0;
+            start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < samples; i++) {
+                if (find_in_memory(points[i]) != expected[i]) mismatches++;
+            }
+            std::chrono::duration<double> engine_elapsed = std::chrono::high_resolution_clock::now() - start;
+
+            std::cout << "Benchmark on " << samples << " random points: ST_Within " << sql_elapsed.count() << " s, "
+                << options.engine << " engine " << engine_elapsed.count() << " s, " << mismatches
+                << " different answers" << std::endl;
+        }
+
+        if (lookup) {
+            std::cout << "Lookup engine: " << lookup_stats.lookups << " lookups, " << lookup_stats.grid_hits
+                << " answered by the coverage grid, " << lookup_stats.cache_hits << " by the negative cache, "
+                << lookup_stats.parts_tested << " parts tested, " << lookup_stats.rings_tested << " rings traversed"
+                << std::endl;
+        } else if (triangles) {
+            std::cout << "Lookup engine: " << lookup_stats.lookups << " lookups, " << lookup_stats.triangles_tested
+                << " triangles tested" << std::endl;
+        } else if (slabs) {
+            std::cout << "Lookup engine: " << lookup_stats.lookups << " lookups, " << lookup_stats.slabs_searched
+                << " states searched" << std::endl;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error looking up the query points: " << e.what() << std::endl;
+    }
+
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+/**
+ * Lists the neighbours of SP from the precomputed adjacency table
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table of the states
+ */
+static void list_neighbours(sqlite3 *db_handle, const std::string &table_name)
+{
+    std::string sql_cmd;
+    int ret;
+    sqlite3_stmt *stmt;
+
+    std::cout << "Neighbours of SP (border length in km):" << std::endl;
+
+    sql_cmd = "SELECT neighbour_id, border_length / 1000 FROM " + table_name + "_adjacency WHERE id = 'SP' "
+        "ORDER BY border_length DESC";
+    ret = sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL);
+    if (ret != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+    } else {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            std::cout << "SP ---> " << sqlite3_column_text(stmt, 0) << " (" << sqlite3_column_int(stmt, 1)
+                << " km)" << std::endl;
+        }
+        sqlite3_finalize(stmt);
+    }
+}
+
+/**
+ * Reports the largest states from the precomputed measures, and the cost
+ * of recomputing them on every query
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table of the states
+ */
+static void report_measures(sqlite3 *db_handle, const std::string &table_name)
+{
+    std::string sql_cmd;
+    int ret;
+    sqlite3_stmt *stmt;
+
+    std::cout << "Largest states (geodesic area in km2, perimeter in km):" << std::endl;
+
+    sql_cmd = "SELECT NM_UF, geodesic_area / 1e6, geodesic_perimeter / 1e3 FROM " + table_name +
+        " ORDER BY geodesic_area DESC LIMIT 3";
+    ret = sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL);
+    if (ret != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+    } else {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            std::printf("%s ---> %.0f km2, %.0f km\n", sqlite3_column_text(stmt, 0),
+                        sqlite3_column_double(stmt, 1), sqlite3_column_double(stmt, 2));
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    for (const char *area : {"geodesic_area", "ST_Area(Geometry, 1)"}) {
+        sql_cmd = std::string("SELECT Sum(") + area + ") / 1e6 FROM " + table_name;
+        auto start = std::chrono::high_resolution_clock::now();
+        ret = sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL);
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+            continue;
+        }
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+            std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+            std::printf("Total area from %s: %.0f km2 in %f seconds\n", area, sqlite3_column_double(stmt, 0),
+                        elapsed.count());
+        }
+        sqlite3_finalize(stmt);
+    }
+}
+
+/**
+ * Reports the distance from each place to the nearest state line, from
+ * an index of the border segments rather than of the whole states
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table of the states
+ * @param table_srid SRID of the table
+ * @param places names and longitude/latitude of the places
+ */
+static void report_nearest_borders(sqlite3 *db_handle, const std::string &table_name, int table_srid,
+                                   const std::vector<std::pair<std::string, Point>> &places)
+{
+    std::string sql_cmd;
+    int ret;
+    sqlite3_stmt *stmt;
+
+    sql_cmd = "SELECT NM_UF FROM " + table_name + " WHERE ST_Within(?, Geometry) = 1";
+    ret = sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL);
+    if (ret != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+    } else {
+        try {
+            auto start = std::chrono::high_resolution_clock::now();
+            BorderIndex borders(db_handle, table_name, "Geometry", "NM_UF");
+            std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+            std::cout << "Border index: " << borders.num_segments() << " segments of " << borders.num_features()
+                << " states in " << borders.num_leaves() << " leaves, built in " << elapsed.count()
+                << " seconds" << std::endl;
+
+            ProjContext proj;
+            for (const auto &place : places) {
+                Geometry point;
+                point.type = GeometryType::Point;
+                point.srid = 4326;
+                point.points.push_back(place.second);
+                if (!proj.transform(point, table_srid)) {
+                    std::cout << place.first << " ---> " << "Cannot reproject: " << proj.last_error() << std::endl;
+                    continue;
+                }
+
+                // Inside a state, the nearest line with another state;
+                // outside, the nearest state
+                const std::vector<uint8_t> blob = encode_spatialite_blob(point);
+                sqlite3_bind_blob(stmt, 1, blob.data(), blob.size(), SQLITE_TRANSIENT);
+                std::string state;
+                if (sqlite3_step(stmt) == SQLITE_ROW) {
+                    state = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+                }
+                sqlite3_reset(stmt);
+
+                const BorderMatch match = borders.nearest(point.points[0], borders.feature(state));
+                if (match.feature < 0) {
+                    std::cout << place.first << " ---> " << "No border" << std::endl;
+                    continue;
+                }
+                std::printf("%s ---> %.1f km from %s%s\n", place.first.c_str(), match.distance / 1000,
+                            state.empty() ? "" : "the line with ", borders.label(match.feature).c_str());
+            }
+
+            // Query cost on random points over the states
+            const BBox extent = borders.extent();
+            std::mt19937 random(42);
+            std::uniform_real_distribution<double> random_x(extent.min_x, extent.max_x);
+            std::uniform_real_distribution<double> random_y(extent.min_y, extent.max_y);
+            const int samples = 100000;
+            double total_distance = 0;
+            start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < samples; i++) {
+                total_distance += borders.nearest(Point{random_x(random), random_y(random)}).distance;
+            }
+            elapsed = std::chrono::high_resolution_clock::now() - start;
+            std::printf("Nearest border of %d random points in %f seconds, mean distance %.1f km\n", samples,
+                        elapsed.count(), total_distance / samples / 1000);
+        } catch (const std::exception &e) {
+            std::cerr << "Error building the border index: " << e.what() << std::endl;
+        }
+        sqlite3_finalize(stmt);
+    }
+}
+
+/**
+ * Imports GPS tracks and lists where they cross state lines
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table of the states
+ * @param table_srid SRID of the table
+ * @param options command-line options
+ */
+static void report_border_crossings(sqlite3 *db_handle, const std::string &table_name, int table_srid,
+                                    const ExampleOptions &options)
+{
+    try {
+        std::vector<Track> tracks;
+        if (read_tracks_csv(options.tracks_file_path, tracks) != 0) {
+            throw std::runtime_error("cannot read " + options.tracks_file_path);
+        }
+
+        // The fixes are WGS 84; the tracks are stored in the table SRID
+        ProjContext proj;
+        size_t num_fixes = 0;
+        for (Track &track : tracks) {
+            Geometry line;
+            line.type = GeometryType::LineString;
+            line.srid = 4326;
+            line.lines.push_back(track.points);
+            if (!proj.transform(line, table_srid)) {
+                throw std::runtime_error("cannot reproject track " + track.name + ": " + proj.last_error());
+            }
+            track.points = line.lines[0];
+            num_fixes += track.points.size();
+        }
+        if (store_tracks(db_handle, table_name + "_tracks", tracks, table_srid) != 0) {
+            throw std::runtime_error("cannot store the tracks");
+        }
+
+        BorderIndex borders(db_handle, table_name, "Geometry", "NM_UF");
+        ThreadPool pool(options.threads);
+        auto start = std::chrono::high_resolution_clock::now();
+        const std::vector<BorderCrossing> crossings = find_border_crossings(tracks, borders, pool);
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        std::cout << "State line crossings of " << tracks.size() << " tracks (" << num_fixes << " fixes):"
+            << std::endl;
+        for (const BorderCrossing &crossing : crossings) {
+            Geometry point;
+            point.type = GeometryType::Point;
+            point.srid = table_srid;
+            point.points.push_back(crossing.point);
+            if (!proj.transform(point, 4326)) {
+                throw std::runtime_error("cannot reproject a crossing of track " +
+                                         tracks[crossing.track].name + ": " + proj.last_error());
+            }
+            std::printf("%s %s at (%.5f, %.5f): %s -> %s\n", tracks[crossing.track].name.c_str(),
+                        format_time(crossing.time).c_str(), point.points[0].x, point.points[0].y,
+                        crossing.from >= 0 ? borders.label(crossing.from).c_str() : "outside",
+                        crossing.to >= 0 ? borders.label(crossing.to).c_str() : "outside");
+        }
+        std::cout << crossings.size() << " crossings found in " << elapsed.count() << " seconds on "
+            << pool.size() << " threads" << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << "Error processing the tracks: " << e.what() << std::endl;
+    }
+}
+
+/**
+ * Finds the region of each place in the dissolved table, through its
+ * spatial index
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table of the states
+ * @param table_srid SRID of the table
+ * @param places names and longitude/latitude of the places
+ */
+static void report_regions(sqlite3 *db_handle, const std::string &table_name, int table_srid,
+                           const std::vector<std::pair<std::string, Point>> &places)
+{
+    std::string sql_cmd;
+    int ret;
+    sqlite3_stmt *stmt;
+
+    std::cout << "Regions of the places:" << std::endl;
+
+    // The places are reprojected once here, not by the query
+    sql_cmd = "SELECT r.region FROM " + table_name + "_regions AS r, "
+        "(SELECT MakePoint(?, ?, " + std::to_string(table_srid) + ") AS p) AS q "
+        "WHERE ST_Within(q.p, r.Geometry) = 1 AND r.rowid IN (SELECT rowid FROM SpatialIndex "
+        "WHERE f_table_name = '" + table_name + "_regions' AND search_frame = q.p)";
+    ret = sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL);
+    if (ret != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+    } else {
+        ProjContext proj;
+        for (const auto &place : places) {
+            Geometry point;
+            point.type = GeometryType::Point;
+            point.srid = 4326;
+            point.points.push_back(place.second);
+            if (!proj.transform(point, table_srid)) {
+                std::cout << place.first << " ---> " << "Cannot reproject: " << proj.last_error() << std::endl;
+                continue;
+            }
+
+            sqlite3_bind_double(stmt, 1, point.points[0].x);
+            sqlite3_bind_double(stmt, 2, point.points[0].y);
+            std::cout << place.first << " ---> ";
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                std::cout << sqlite3_column_text(stmt, 0) << std::endl;
+            } else {
+                std::cout << "Not found" << std::endl;
+            }
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+    }
+}
+
+/**
+ * Renders the states as map tiles, clipped and simplified to the pixel
+ * size of the zoom level, twice to show the tile cache
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table of the states
+ * @param options command-line options
+ */
+static void render_tiles(sqlite3 *db_handle, const std::string &table_name, const ExampleOptions &options)
+{
+    try {
+        ThreadPool pool(options.threads);
+        // The stored topology, when -T built it, saves building it again
+        const std::string topology_prefix = options.topology ? table_name + "_topo" : "";
+        DisplayQuery display(db_handle, table_name, "Geometry", "NM_UF", pool, 1024, topology_prefix);
+        const uint32_t zoom = static_cast<uint32_t>(options.display_zoom);
+        const uint32_t tiles = 1u << zoom;
+
+        // Every tile of the low zoom levels; from zoom 5 on, only a
+        // window of 16 x 16 tiles in the middle of the extent
+        const uint32_t window = std::min<uint32_t>(tiles, 16);
+        const uint32_t first = (tiles - window) / 2;
+        const uint64_t rendered = static_cast<uint64_t>(window) * window;
+
+        // The second pass is served from the tile cache
+        for (int pass = 1; pass <= 2; pass++) {
+            uint64_t features = 0;
+            uint64_t input_vertices = 0;
+            uint64_t output_vertices = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (uint32_t y = first; y < first + window; y++) {
+                for (uint32_t x = first; x < first + window; x++) {
+                    const std::shared_ptr<const DisplayTile> tile = display.tile(zoom, x, y);
+                    features += tile->features.size();
+                    input_vertices += tile->input_vertices;
+                    output_vertices += tile->output_vertices;
+                }
+            }
+            std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+            std::cout << "Tiles of zoom " << zoom << ", pass " << pass << ": " << rendered << " of "
+                << static_cast<uint64_t>(tiles) * tiles << " tiles, "
+                << features << " clipped features, " << output_vertices << " of " << input_vertices
+                << " vertices sent, in " << elapsed.count() << " seconds" << std::endl;
+        }
+
+        const CacheStats cache_stats = display.cache_stats();
+        std::cout << "Tile cache: " << cache_stats.hits << " hits, " << cache_stats.misses << " misses, "
+            << cache_stats.evictions << " evictions" << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << "Error rendering tiles: " << e.what() << std::endl;
+    }
+}
+
 /**
  * Example 2: Importing shapefile and performing spatial query
  * @param db_name Path to the SQLite database file
+ * @param options command-line options (bulk-load profile)
  * @return 0 on success, 1 on failure
  *
  * This example shows how to import a shapefile into a Spatialite database and
  * perform a spatial query to find the corresponding state name for given points.
  */
-int run_example_2(std::string db_name)
+int run_example_2(std::string db_name, const ExampleOptions &options)
 {
     sqlite3 *db_handle;
     std::string table_name = "location";
@@ -231,10 +945,6 @@ int run_example_2(std::string db_name)
     char *err_msg = NULL;
     void *cache;
 
-    // Setting environment variable to allow calling ImportSHP function
-    // Otherwise, it will throw an error
-    setenv("SPATIALITE_SECURITY", "relaxed", 1);
-
     // Open a new database connection
     std::cout << "Opening database: " << db_name << std::endl;
     
@@ -255,6 +965,15 @@ int run_example_2(std::string db_name)
     cache = spatialite_alloc_connection();
     spatialite_init_ex(db_handle, cache, 0);
 
+    // Switch to the bulk-load profile before anything is written
+    BulkLoadSettings bulk_settings;
+    if (options.bulk_load && begin_bulk_load(db_handle, bulk_settings) != 0) {
+        sqlite3_close(db_handle);
+        spatialite_cleanup_ex(cache);
+        spatialite_shutdown();
+        return 1;
+    }
+
     // Check if spatial_ref_sys table exists
     if (! spatial_metadata_exists(db_handle)) {
         // Initialize the Spatialite library
@@ -270,53 +989,71 @@ int run_example_2(std::string db_name)
         }
     }
 
-    // Importing the shapefile
-    std::cout << "Importing shapefile: " << shp_file_path << std::endl;
+    int table_srid = 0;
+    ret = import_states(db_handle, table_name, shp_file_path, options, table_srid);
 
-    sql_cmd = "SELECT ImportSHP('" + shp_file_path + "', '" + table_name + "', 'UTF-8')";
-    std::cout << sql_cmd << std::endl;
-    ret = sqlite3_exec(db_handle, sql_cmd.c_str(), NULL, NULL, &err_msg);
+    // Restore the connection settings
+    if (ret == 0 && options.bulk_load) {
+        ret = end_bulk_load(db_handle, bulk_settings);
+    }
 
-    if (ret != SQLITE_OK) {
-        std::cerr << "Error importing shapefile: " << err_msg << std::endl;
-        handle_error(db_handle, cache, err_msg);
+    if (ret != 0) {
+        sqlite3_close(db_handle);
+        spatialite_cleanup_ex(cache);
+        spatialite_shutdown();
         return 1;
     }
 
     // Checking what are the correspoding State names for the following points
     std::cout << "Checking what are the correspoding State names for the following points:" << std::endl;
 
-    const std::vector<std::pair<std::string, std::string>> places = {
-        {"Rio de Janeiro", "POINT(-43.1729 -22.9068)"},
-        {"Foz do Iguacu", "POINT(-54.5854 -25.5165)"},
-        {"Fernando de Noronha", "POINT(-32.423786 -3.853808)"},
-        {"Null Island", "POINT(0 0)"},
-        {"New York", "POINT(-74.0060 40.7128)"},
+    const std::vector<std::pair<std::string, Point>> places = {
+        {"Rio de Janeiro", {-43.1729, -22.9068}},
+        {"Foz do Iguacu", {-54.5854, -25.5165}},
+        {"Fernando de Noronha", {-32.423786, -3.853808}},
+        {"Null Island", {0, 0}},
+        {"New York", {-74.0060, 40.7128}},
     };
 
-    for (const auto& place : places) {
-        sql_cmd = "SELECT NM_UF FROM " + table_name + " WHERE ST_Within(GeomFromText('" + place.second + "', 4326), geometry) =1";
-        
-        sqlite3_stmt *stmt;
-        ret = sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL);
-        
-        if (ret != SQLITE_OK)
-        {
-            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
-            sqlite3_close(db_handle);
-            spatialite_cleanup_ex(cache);
-            spatialite_shutdown();
-            return 1;
-        }
+    if (locate_places(db_handle, table_name, table_srid, places, options) != 0) {
+        sqlite3_close(db_handle);
+        spatialite_cleanup_ex(cache);
+        spatialite_shutdown();
+        return 1;
+    }
 
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW) {
-            std::cout << place.first << " ---> " << sqlite3_column_text(stmt, 0) << std::endl;
-        } else {
-            std::cout << place.first << " ---> " << "Not found" << std::endl;
-        }
+    // Listing the neighbours of a state from the precomputed adjacency table
+    if (options.adjacency) {
+        list_neighbours(db_handle, table_name);
+    }
 
-        sqlite3_finalize(stmt);
+    // Reporting the largest states from the precomputed measures, and the
+    // cost of recomputing them on every query
+    if (options.measures) {
+        report_measures(db_handle, table_name);
+    }
+
+    // Distance from each place to the nearest state line, from an index of
+    // the border segments rather than of the whole states
+    if (options.nearest_border) {
+        report_nearest_borders(db_handle, table_name, table_srid, places);
+    }
+
+    // Importing GPS tracks and listing where they cross state lines
+    if (!options.tracks_file_path.empty()) {
+        report_border_crossings(db_handle, table_name, table_srid, options);
+    }
+
+    // Finding the region of each place in the dissolved table, through its
+    // spatial index
+    if (!options.dissolve.empty()) {
+        report_regions(db_handle, table_name, table_srid, places);
+    }
+
+    // Rendering the states as map tiles, clipped and simplified to the
+    // pixel size of the zoom level
+    if (options.display_zoom >= 0) {
+        render_tiles(db_handle, table_name, options);
     }
 
     // Close the database connection
@@ -342,8 +1079,12 @@ int run_example_2(std::string db_name)
  *
  * This example shows how to create a table of points and perform spatial queries
  * to find the closest point to given locations.
+ *
+ * The closest points are found three ways: sorting by the geodesic
+ * ST_Distance, sorting by the planar one, and locating each location in
+ * the Voronoi diagram of the points, built once.
  */
-int run_example_3(std::string db_name) {
+int run_example_3(std::string db_name, const ExampleOptions &options) {
     sqlite3 *db_handle;
     std::string table_name = "points";
     std::string sql_cmd;
@@ -531,14 +1272,217 @@ int run_example_3(std::string db_name) {
     diff = end - start;
     std::cout << "Time to find closest point to each location (approximative): " << diff.count() << " seconds" << std::endl;
 
-    // Close the database connection
-    ret = sqlite3_close(db_handle);
+    // Locating the locations in the Voronoi cells of the cities, with no
+    // distance sort
+    std::cout << "Finding closest point to each location... Precise, from the Voronoi diagram" << std::endl;
 
-    if (ret != SQLITE_OK) {
-        std::cerr << "Error closing database connection: " << sqlite3_errmsg(db_handle) << std::endl;
-        // return 1;
+    std::map<int64_t, std::string> city_names;
+    std::vector<JoinPoint> sites;
+    {
+        sqlite3_stmt *stmt;
+        sql_cmd = "SELECT rowid, name FROM " + table_name;
+        if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                city_names[sqlite3_column_int64(stmt, 0)] = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+            }
+            sqlite3_finalize(stmt);
+        }
     }
-
+    if (read_join_points(db_handle, table_name, "geometry", sites) != 0) {
+        sqlite3_close(db_handle);
+        spatialite_cleanup_ex(cache);
+        spatialite_shutdown();
+        return 1;
+    }
+
+    start = std::chrono::high_resolution_clock::now();
+    const NearestSiteIndex voronoi(sites);
+    end = std::chrono::high_resolution_clock::now();
+    diff = end - start;
+    std::cout << "Voronoi diagram of " << voronoi.num_sites() << " cities (" << voronoi.num_triangles()
+        << " Delaunay triangles) built in " << diff.count() << " seconds" << std::endl;
+
+    start = std::chrono::high_resolution_clock::now();
+    for (const auto& location : locations) {
+        Point p;
+        if (sscanf(location.second.c_str(), "POINT(%lf %lf)", &p.x, &p.y) != 2) continue;
+
+        const SiteMatch match = voronoi.nearest(p);
+        std::cout << "Location: " << location.first << " - " << location.second << std::endl;
+        if (match.id >= 0) {
+            std::cout << "The closest city is: " << city_names[match.id] << " - " << match.distance << std::endl;
+        } else {
+            std::cout << "No closest point found." << std::endl;
+        }
+    }
+    end = std::chrono::high_resolution_clock::now();
+    diff = end - start;
+    std::cout << "Time to find closest point to each location (Voronoi): " << diff.count() << " seconds" << std::endl;
+
+    // Query cost on random points over Brazil
+    {
+        const int samples = 100000;
+        std::mt19937 random(42);
+        std::uniform_real_distribution<double> random_x(-74, -34);
+        std::uniform_real_distribution<double> random_y(-34, 6);
+        double total_distance = 0;
+        start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < samples; i++) {
+            total_distance += voronoi.nearest(Point{random_x(random), random_y(random)}).distance;
+        }
+        end = std::chrono::high_resolution_clock::now();
+        diff = end - start;
+        std::printf("Closest city of %d random points in %f seconds, mean distance %.1f km\n", samples,
+                    diff.count(), total_distance / samples / 1000);
+    }
+
+    // The same locations asked again are answered from the result cache
+    if (options.cache_precision >= 0) {
+        std::cout << "Finding closest point to each location... Cached, twice" << std::endl;
+
+        sql_cmd = "SELECT name, ST_Distance(geometry, MakePoint(?, ?, 4326), 0) AS distance FROM " + table_name +
+            " ORDER BY distance LIMIT 1;";
+        sqlite3_stmt *stmt;
+        ret = sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL);
+
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+            handle_error(db_handle, cache, err_msg);
+            return 1;
+        }
+
+        auto closest = [&](const Point &p) -> std::string {
+            sqlite3_bind_double(stmt, 1, p.x);
+            sqlite3_bind_double(stmt, 2, p.y);
+            std::string result = "No closest point found.";
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                result = std::string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0))) + " - " +
+                    reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+            }
+            sqlite3_reset(stmt);
+            return result;
+        };
+
+        ResultCache<std::string> results(options.cache_precision);
+        start = std::chrono::high_resolution_clock::now();
+        for (int round = 0; round < 2; round++) {
+            for (const auto& location : locations) {
+                Point p;
+                if (sscanf(location.second.c_str(), "POINT(%lf %lf)", &p.x, &p.y) != 2) continue;
+                std::cout << "Location: " << location.first << " - The closest city is: " << results.get(p, closest)
+                    << std::endl;
+            }
+        }
+        end = std::chrono::high_resolution_clock::now();
+        diff = end - start;
+        sqlite3_finalize(stmt);
+
+        const CacheStats cache_stats = results.stats();
+        std::cout << "Time to find closest point to each location (cached): " << diff.count() << " seconds, "
+            << cache_stats.hits << " hits, " << cache_stats.misses << " misses" << std::endl;
+    }
+
+    // Joining the cities with the locations, then with the border of
+    // Parana, by distance
+    if (options.within_km > 0) {
+        const double distance = options.within_km * 1000;
+        try {
+            ThreadPool pool(options.threads);
+
+            std::map<int64_t, std::string> names;
+            sqlite3_stmt *stmt;
+            sql_cmd = "SELECT id, name FROM " + table_name;
+            if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) == SQLITE_OK) {
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                    names[sqlite3_column_int64(stmt, 0)] = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+                }
+                sqlite3_finalize(stmt);
+            }
+
+            std::vector<JoinPoint> cities;
+            std::vector<JoinPoint> others;
+            if (read_join_points(db_handle, table_name, "geometry", cities) != 0) {
+                throw std::runtime_error("cannot read " + table_name);
+            }
+            for (size_t i = 0; i < locations.size(); i++) {
+                Point p;
+                if (sscanf(locations[i].second.c_str(), "POINT(%lf %lf)", &p.x, &p.y) != 2) continue;
+                others.push_back(JoinPoint{static_cast<int64_t>(i), p});
+            }
+
+            std::cout << "Cities within " << options.within_km << " km of the locations:" << std::endl;
+            for (const DistanceMatch &match : points_within_distance(cities, others, distance, true, pool)) {
+                std::printf("%s ---> %s (%.1f km)\n", names[match.left].c_str(),
+                            locations[match.right].first.c_str(), match.distance / 1000);
+            }
+
+            // The states are there when example 2 ran on the same database
+            int border_srid = 0;
+            sql_cmd = "SELECT srid FROM geometry_columns WHERE f_table_name = 'location'";
+            if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) == SQLITE_OK) {
+                if (sqlite3_step(stmt) == SQLITE_ROW) border_srid = sqlite3_column_int(stmt, 0);
+                sqlite3_finalize(stmt);
+            }
+
+            if (border_srid == 0) {
+                std::cout << "No location table: run example 2 on the same database to join with the state borders"
+                    << std::endl;
+            } else {
+                BorderIndex borders(db_handle, "location", "Geometry", "SIGLA_UF");
+                const int64_t parana = borders.feature("PR");
+
+                // The cities in the SRID of the states
+                Geometry city_points;
+                city_points.type = GeometryType::MultiPoint;
+                city_points.srid = 4326;
+                for (const JoinPoint &city : cities) {
+                    city_points.points.push_back(city.point);
+                }
+                ProjContext proj;
+                if (!proj.transform(city_points, border_srid)) {
+                    throw std::runtime_error("cannot reproject the cities: " + proj.last_error());
+                }
+                for (size_t i = 0; i < cities.size(); i++) {
+                    cities[i].point = city_points.points[i];
+                }
+
+                std::cout << "Cities within " << options.within_km << " km of the border of PR:" << std::endl;
+                for (const DistanceMatch &match : points_near_borders(cities, borders, distance, pool, parana)) {
+                    std::printf("%s ---> %.1f km\n", names[match.left].c_str(), match.distance / 1000);
+                }
+
+                // The same join on many random points over the states
+                const BBox extent = borders.extent();
+                std::mt19937 random(42);
+                std::uniform_real_distribution<double> random_x(extent.min_x, extent.max_x);
+                std::uniform_real_distribution<double> random_y(extent.min_y, extent.max_y);
+                std::vector<JoinPoint> random_points;
+                for (int64_t i = 0; i < 200000; i++) {
+                    random_points.push_back(JoinPoint{i, Point{random_x(random), random_y(random)}});
+                }
+
+                DistanceJoinStats join_stats;
+                start = std::chrono::high_resolution_clock::now();
+                points_near_borders(random_points, borders, distance, pool, parana, &join_stats);
+                diff = std::chrono::high_resolution_clock::now() - start;
+                std::cout << "Join of " << random_points.size() << " random points with the border of PR: "
+                    << join_stats.matches << " within " << options.within_km << " km, " << join_stats.candidates
+                    << " distances computed, " << join_stats.partitions << " partitions on " << pool.size()
+                    << " threads, in " << diff.count() << " seconds" << std::endl;
+            }
+        } catch (const std::exception &e) {
+            std::cerr << "Error joining by distance: " << e.what() << std::endl;
+        }
+    }
+
+    // Close the database connection
+    ret = sqlite3_close(db_handle);
+
+    if (ret != SQLITE_OK) {
+        std::cerr << "Error closing database connection: " << sqlite3_errmsg(db_handle) << std::endl;
+        // return 1;
+    }
+
     // Shutdown the Spatialite library
     spatialite_cleanup_ex(cache);
     spatialite_shutdown();
@@ -547,6 +1491,490 @@ int run_example_3(std::string db_name) {
     return 0;
 }
 
+/**
+ * Example 4: Importing a FlatGeobuf file and querying its spatial index
+ * @param db_name Path to the SQLite database file
+ * @param options command-line options (FlatGeobuf file and optional bbox)
+ * @return 0 on success, 1 on failure
+ *
+ * This example answers a bounding box query directly from the packed Hilbert
+ * R-tree stored in the FlatGeobuf file, without loading anything into SQLite,
+ * and then streams every feature into a `location` table.
+ */
+int run_example_4(std::string db_name, const ExampleOptions &options)
+{
+    sqlite3 *db_handle;
+    std::string table_name = "location";
+    std::string sql_cmd;
+    int ret;
+    char *err_msg = NULL;
+    void *cache;
+
+    if (options.fgb_file_path.empty()) {
+        std::cerr << "Example 4 requires a FlatGeobuf file (--fgb-file)" << std::endl;
+        return 1;
+    }
+
+    // Reading the FlatGeobuf header and, if asked, querying its index
+    try {
+        FlatGeobufReader reader(options.fgb_file_path);
+
+        std::cout << "FlatGeobuf file: " << options.fgb_file_path << std::endl;
+        std::cout << "  Features: " << reader.features_count()
+            << ", geometry type: " << geometry_type_name(reader.geometry_type())
+            << ", SRID: " << reader.srid()
+            << ", spatial index: " << (reader.has_index() ? "yes" : "no") << std::endl;
+
+        if (options.has_bbox) {
+            auto start = std::chrono::high_resolution_clock::now();
+            std::vector<FgbFeature> features = reader.query(options.bbox);
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> diff = end - start;
+
+            std::cout << "Features intersecting the bounding box: " << features.size() << std::endl;
+            for (const auto &feature : features) {
+                // Show the first text attribute, usually the feature name
+                std::string label = "(no name)";
+                for (const auto &value : feature.values) {
+                    if (value.kind == FgbValue::Text) {
+                        label = value.bytes;
+                        break;
+                    }
+                }
+                std::cout << "  " << label << " - " << feature.geometry.num_vertices() << " vertices" << std::endl;
+            }
+            std::cout << "Time to query the FlatGeobuf index: " << diff.count() << " seconds" << std::endl;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error reading FlatGeobuf file: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Open a new database connection
+    std::cout << "Opening database: " << db_name << std::endl;
+
+    ret = sqlite3_open_v2(
+        db_name.c_str(),
+        &db_handle,
+        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+        NULL
+    );
+
+    if (ret != SQLITE_OK) {
+        std::cerr << "Error opening database: " << sqlite3_errmsg(db_handle) << std::endl;
+        sqlite3_close(db_handle);
+        return 1;
+    }
+
+    // Initialize the SpatiaLite connection
+    cache = spatialite_alloc_connection();
+    spatialite_init_ex(db_handle, cache, 0);
+
+    // Switch to the bulk-load profile before anything is written
+    BulkLoadSettings bulk_settings;
+    if (options.bulk_load && begin_bulk_load(db_handle, bulk_settings) != 0) {
+        sqlite3_close(db_handle);
+        spatialite_cleanup_ex(cache);
+        spatialite_shutdown();
+        return 1;
+    }
+
+    // Check if spatial_ref_sys table exists
+    if (! spatial_metadata_exists(db_handle)) {
+        // Initialize the Spatialite library
+        std::cout << "Initializing Spatialite..." << std::endl;
+
+        sql_cmd = "SELECT InitSpatialMetaData(1);";
+        ret = sqlite3_exec(db_handle, sql_cmd.c_str(), NULL, NULL, &err_msg);
+
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error initializing Spatialite: " << err_msg << std::endl;
+            handle_error(db_handle, cache, err_msg);
+            return 1;
+        }
+    }
+
+    // Importing the FlatGeobuf file
+    std::cout << "Importing FlatGeobuf file: " << options.fgb_file_path << std::endl;
+
+    ImportStats stats(table_name);
+    if (import_flatgeobuf(db_handle, options.fgb_file_path, table_name, options.encoding, &stats) != 0) {
+        sqlite3_close(db_handle);
+        spatialite_cleanup_ex(cache);
+        spatialite_shutdown();
+        return 1;
+    }
+
+    // Check and repair the geometries before anything queries them
+    if (options.validate) {
+        ImportStats::Timer validate_timer(&stats, ImportStats::Validate);
+        ThreadPool pool(options.threads);
+        if (validate_geometries(db_handle, table_name, "Geometry", pool, options.encoding) != 0) {
+            sqlite3_close(db_handle);
+            spatialite_cleanup_ex(cache);
+            spatialite_shutdown();
+            return 1;
+        }
+    }
+
+    // Build the spatial index in one STR-packed pass and restore the connection settings
+    if (options.bulk_load) {
+        ImportStats::Timer index_timer(&stats, ImportStats::Index);
+        ret = build_str_spatial_index(db_handle, table_name, "Geometry", true);
+        index_timer.stop();
+        if (ret != 0 || end_bulk_load(db_handle, bulk_settings) != 0) {
+            sqlite3_close(db_handle);
+            spatialite_cleanup_ex(cache);
+            spatialite_shutdown();
+            return 1;
+        }
+    }
+
+    // Print the throughput summary
+    stats.report();
+
+    // Close the database connection
+    ret = sqlite3_close(db_handle);
+
+    if (ret != SQLITE_OK) {
+        std::cerr << "Error closing database: " << sqlite3_errmsg(db_handle) << std::endl;
+    }
+
+    // Shutdown the Spatialite library
+    spatialite_cleanup_ex(cache);
+    spatialite_shutdown();
+
+    std::cout << "Example 4 Done." << std::endl;
+    return 0;
+}
+
+/**
+ * Example 5: Streaming a large GeoJSON file into the points table
+ * @param db_name Path to the SQLite database file
+ * @param options command-line options (GeoJSON file)
+ * @return 0 on success, 1 on failure
+ *
+ * This example loads a GeoJSON FeatureCollection or a newline-delimited
+ * GeoJSON file of points of interest with an incremental parser. Features
+ * are encoded straight to SpatiaLite BLOBs and inserted in batches, so
+ * memory use stays flat whatever the size of the file.
+ *
+ * With a bounding box, the points inside it are then paged through with a
+ * ViewportCursor, each page served by a new cursor resumed from the
+ * continuation token of the previous one.
+ *
+ * With a clustering radius, the points are clustered by density (DBSCAN)
+ * in parallel, and the cluster of each one is stored in a cluster_id
+ * column.
+ *
+ * With a heatmap path, the points are rasterized into a kernel density
+ * grid over the bounding box (or their extent), written as an ESRI float
+ * grid.
+ */
+int run_example_5(std::string db_name, const ExampleOptions &options)
+{
+    sqlite3 *db_handle;
+    std::string table_name = "points";
+    std::string sql_cmd;
+    int ret;
+    char *err_msg = NULL;
+    void *cache;
+
+    if (options.geojson_file_path.empty()) {
+        std::cerr << "Example 5 requires a GeoJSON file (--geojson-file)" << std::endl;
+        return 1;
+    }
+
+    // Open a new database connection
+    std::cout << "Opening database: " << db_name << std::endl;
+
+    ret = sqlite3_open_v2(
+        db_name.c_str(),
+        &db_handle,
+        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+        NULL
+    );
+
+    if (ret != SQLITE_OK) {
+        std::cerr << "Error opening database: " << sqlite3_errmsg(db_handle) << std::endl;
+        sqlite3_close(db_handle);
+        return 1;
+    }
+
+    // Initialize the SpatiaLite connection
+    cache = spatialite_alloc_connection();
+    spatialite_init_ex(db_handle, cache, 0);
+
+    // Switch to the bulk-load profile before anything is written
+    BulkLoadSettings bulk_settings;
+    if (options.bulk_load && begin_bulk_load(db_handle, bulk_settings) != 0) {
+        sqlite3_close(db_handle);
+        spatialite_cleanup_ex(cache);
+        spatialite_shutdown();
+        return 1;
+    }
+
+    // Check if spatial_ref_sys table exists
+    if (! spatial_metadata_exists(db_handle)) {
+        // Initialize the Spatialite library
+        std::cout << "Initializing Spatialite..." << std::endl;
+
+        sql_cmd = "SELECT InitSpatialMetaData(1);";
+        ret = sqlite3_exec(db_handle, sql_cmd.c_str(), NULL, NULL, &err_msg);
+
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error initializing Spatialite: " << err_msg << std::endl;
+            handle_error(db_handle, cache, err_msg);
+            return 1;
+        }
+    }
+
+    // The import appends to an existing table, whose rows keep their ids
+    bool table_was_empty = true;
+    if (options.bulk_load) {
+        sqlite3_stmt *stmt;
+        sql_cmd = "SELECT EXISTS (SELECT 1 FROM " + table_name + ")";
+        if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) == SQLITE_OK) {
+            table_was_empty = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 0;
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    // Importing the GeoJSON file
+    std::cout << "Importing GeoJSON file: " << options.geojson_file_path << std::endl;
+
+    ImportStats stats(table_name);
+    if (import_geojson(db_handle, options.geojson_file_path, table_name, GeometryType::Point, 10000, &stats) != 0) {
+        sqlite3_close(db_handle);
+        spatialite_cleanup_ex(cache);
+        spatialite_shutdown();
+        return 1;
+    }
+
+    // Build the spatial index in one STR-packed pass and restore the connection settings
+    if (options.bulk_load) {
+        ImportStats::Timer index_timer(&stats, ImportStats::Index);
+        ret = build_str_spatial_index(db_handle, table_name, "geometry", table_was_empty);
+        index_timer.stop();
+        if (ret != 0 || end_bulk_load(db_handle, bulk_settings) != 0) {
+            sqlite3_close(db_handle);
+            spatialite_cleanup_ex(cache);
+            spatialite_shutdown();
+            return 1;
+        }
+    }
+
+    // Print the throughput summary
+    stats.report();
+
+    // Clustering the points by density
+    if (options.cluster_distance > 0) {
+        try {
+            ThreadPool pool(options.threads);
+            auto start = std::chrono::high_resolution_clock::now();
+            std::vector<JoinPoint> points;
+            if (read_join_points(db_handle, table_name, "geometry", points) != 0) {
+                throw std::runtime_error("cannot read " + table_name);
+            }
+            auto clustering_start = std::chrono::high_resolution_clock::now();
+            DbscanStats cluster_stats;
+            const std::vector<int64_t> clusters = dbscan(points, options.cluster_distance,
+                                                         options.cluster_min_points, true, pool, &cluster_stats);
+            auto clustering_end = std::chrono::high_resolution_clock::now();
+            if (store_clusters(db_handle, table_name, points, clusters) != 0) {
+                throw std::runtime_error("cannot store the clusters");
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+
+            std::chrono::duration<double> read_elapsed = clustering_start - start;
+            std::chrono::duration<double> clustering_elapsed = clustering_end - clustering_start;
+            std::chrono::duration<double> store_elapsed = end - clustering_end;
+            std::cout << "Clustered " << points.size() << " points within " << options.cluster_distance << " m, at least "
+                << options.cluster_min_points << " per core point: " << cluster_stats.clusters << " clusters, "
+                << cluster_stats.core_points << " core points, " << cluster_stats.noise << " noise" << std::endl;
+            std::cout << "  read " << read_elapsed.count() << " s, cluster " << clustering_elapsed.count() << " s ("
+                << cluster_stats.partitions << " partitions on " << pool.size() << " threads, "
+                << cluster_stats.cross_links << " links across partitions), store " << store_elapsed.count() << " s"
+                << std::endl;
+
+            // The largest clusters, from the stored column
+            sqlite3_stmt *stmt;
+            sql_cmd = "SELECT cluster_id, Count(*), Avg(X(geometry)), Avg(Y(geometry)) FROM " + table_name +
+                " WHERE cluster_id IS NOT NULL GROUP BY cluster_id ORDER BY Count(*) DESC LIMIT 3";
+            if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) == SQLITE_OK) {
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                    std::printf("Cluster %lld: %lld points around (%.5f %.5f)\n", sqlite3_column_int64(stmt, 0),
+                                sqlite3_column_int64(stmt, 1), sqlite3_column_double(stmt, 2),
+                                sqlite3_column_double(stmt, 3));
+                }
+                sqlite3_finalize(stmt);
+            }
+        } catch (const std::exception &e) {
+            std::cerr << "Error clustering the points: " << e.what() << std::endl;
+        }
+    }
+
+    // Rasterizing the points into a heatmap
+    if (!options.heatmap_path.empty()) {
+        try {
+            ThreadPool pool(options.threads);
+            std::vector<JoinPoint> rows;
+            if (read_join_points(db_handle, table_name, "geometry", rows) != 0) {
+                throw std::runtime_error("cannot read " + table_name);
+            }
+            std::vector<Point> points;
+            BBox extent;
+            for (const JoinPoint &row : rows) {
+                points.push_back(row.point);
+                extent.expand(row.point.x, row.point.y);
+            }
+
+            // Points on one meridian or parallel, or a single point, span
+            // no area; the grid then covers the reach of their kernel
+            if (!extent.empty() && (extent.max_x == extent.min_x || extent.max_y == extent.min_y)) {
+                double dx, dy;
+                search_window(kernel_reach(options.kernel, options.kernel_bandwidth), true,
+                              std::max(std::fabs(extent.min_y), std::fabs(extent.max_y)), dx, dy);
+                if (extent.max_x == extent.min_x) {
+                    extent.expand(extent.min_x - dx, extent.min_y);
+                    extent.expand(extent.max_x + dx, extent.max_y);
+                }
+                if (extent.max_y == extent.min_y) {
+                    extent.expand(extent.min_x, extent.min_y - dy);
+                    extent.expand(extent.max_x, extent.max_y + dy);
+                }
+            }
+
+            auto start = std::chrono::high_resolution_clock::now();
+            DensityGrid grid;
+            DensityStats density_stats;
+            if (kernel_density(points, options.has_bbox ? options.bbox : extent, options.heatmap_cells,
+                               options.kernel, options.kernel_bandwidth, true, pool, grid, &density_stats) != 0) {
+                throw std::runtime_error("cannot rasterize the points");
+            }
+            std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+            if (write_density_grid(grid, options.heatmap_path) != 0) {
+                throw std::runtime_error("cannot write " + options.heatmap_path);
+            }
+
+            const size_t peak = std::max_element(grid.values.begin(), grid.values.end()) - grid.values.begin();
+            std::cout << "Heatmap of " << points.size() << " points: " << grid.width << "x" << grid.height
+                << " cells of " << grid.cell_size << " degrees, bandwidth " << options.kernel_bandwidth << " m, in "
+                << elapsed.count() << " seconds (" << density_stats.busy_tiles << " of " << density_stats.tiles
+                << " tiles on " << pool.size() << " threads)" << std::endl;
+            std::printf("Peak density %.1f points/km2 at (%.5f %.5f), written to %s\n", grid.values[peak],
+                        grid.bbox.min_x + (peak % grid.width + 0.5) * grid.cell_size,
+                        grid.bbox.max_y - (peak / grid.width + 0.5) * grid.cell_size, options.heatmap_path.c_str());
+        } catch (const std::exception &e) {
+            std::cerr << "Error building the heatmap: " << e.what() << std::endl;
+        }
+    }
+
+    // Paging through the points of the viewport
+    if (options.has_bbox) {
+        // Without --bulk-load the table may have no spatial index yet
+        if (!options.bulk_load) {
+            sqlite3_stmt *stmt;
+            int indexed = 0;
+            sql_cmd = "SELECT spatial_index_enabled FROM geometry_columns WHERE f_table_name = Lower('" + table_name +
+                "') AND f_geometry_column = 'geometry'";
+            if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) == SQLITE_OK) {
+                if (sqlite3_step(stmt) == SQLITE_ROW) indexed = sqlite3_column_int(stmt, 0);
+                sqlite3_finalize(stmt);
+            }
+
+            int created = 0;
+            sql_cmd = "SELECT CreateSpatialIndex('" + table_name + "', 'geometry')";
+            if (indexed == 0 && sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) == SQLITE_OK) {
+                if (sqlite3_step(stmt) == SQLITE_ROW) created = sqlite3_column_int(stmt, 0);
+                sqlite3_finalize(stmt);
+            }
+            if (indexed == 0 && created != 1) {
+                handle_error(db_handle, cache,
+                             sqlite3_mprintf("cannot create the spatial index of %s: %s", table_name.c_str(),
+                                             sqlite3_errmsg(db_handle)));
+                return 1;
+            }
+        }
+
+        std::cout << "Paging through the points in " << options.bbox.min_x << "," << options.bbox.min_y << ","
+            << options.bbox.max_x << "," << options.bbox.max_y << ":" << std::endl;
+
+        try {
+            auto start = std::chrono::high_resolution_clock::now();
+            uint64_t total = 0;
+            uint64_t pages = 0;
+            std::string token;
+            do {
+                // A new cursor per page, as a stateless server would do
+                std::unique_ptr<ViewportCursor> cursor;
+                if (token.empty()) {
+                    cursor.reset(new ViewportCursor(db_handle, table_name, "geometry", options.bbox));
+                    std::cout << "Viewport split into " << cursor->tiles_per_side() << "x"
+                        << cursor->tiles_per_side() << " tiles" << std::endl;
+                } else {
+                    cursor.reset(new ViewportCursor(db_handle, table_name, "geometry", token));
+                }
+
+                const std::vector<ViewportFeature> page = cursor->next_page();
+                token = cursor->token();
+                if (page.empty()) break;
+
+                total += page.size();
+                pages++;
+                if (pages <= 3) {
+                    std::cout << "Page " << pages << ": " << page.size() << " points, rowids " << page.front().rowid
+                        << " to " << page.back().rowid << ", next token " << (token.empty() ? "(none)" : token)
+                        << std::endl;
+                }
+            } while (!token.empty());
+            std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+            std::cout << "Read " << total << " points in " << pages << " pages in " << elapsed.count()
+                << " seconds" << std::endl;
+        } catch (const std::exception &e) {
+            std::cerr << "Error paging through the viewport: " << e.what() << std::endl;
+        }
+    }
+
+    // Close the database connection
+    ret = sqlite3_close(db_handle);
+
+    if (ret != SQLITE_OK) {
+        std::cerr << "Error closing database: " << sqlite3_errmsg(db_handle) << std::endl;
+    }
+
+    // Shutdown the Spatialite library
+    spatialite_cleanup_ex(cache);
+    spatialite_shutdown();
+
+    std::cout << "Example 5 Done." << std::endl;
+    return 0;
+}
+
+/**
+ * Parses a bounding box given as "min_x,min_y,max_x,max_y"
+ *
+ * @param text text to parse
+ * @param bbox parsed bounding box
+ * @return true if the text holds four numbers in the right order
+ */
+bool parse_bbox(const char *text, BBox &bbox)
+{
+    double min_x, min_y, max_x, max_y;
+    if (std::sscanf(text, "%lf,%lf,%lf,%lf", &min_x, &min_y, &max_x, &max_y) != 4) {
+        return false;
+    }
+    if (min_x > max_x || min_y > max_y) {
+        return false;
+    }
+    bbox = BBox();
+    bbox.expand(min_x, min_y);
+    bbox.expand(max_x, max_y);
+    return true;
+}
+
 /**
  * Prints the usage message for the application.
  *
@@ -560,6 +1988,30 @@ void show_usage()
     std::cout << "  -h, --help              Show this help message" << std::endl;
     std::cout << "  -i, --example-id <id>   ID of the example to run" << std::endl;
     std::cout << "  -n, --db-name <name>    Name of the database file (if not provided, in-memory)" << std::endl;
+    std::cout << "  -f, --fgb-file <path>   FlatGeobuf file to import (example 4)" << std::endl;
+    std::cout << "  -b, --bbox <box>        Bounding box min_x,min_y,max_x,max_y to query (examples 4, 5)" << std::endl;
+    std::cout << "  -C, --cluster <m,n>     Cluster the points by density, n neighbours within m metres (DBSCAN) (example 5)" << std::endl;
+    std::cout << "  -H, --heatmap <path>    Write a kernel density grid of the points (ESRI .flt/.hdr) (example 5)" << std::endl;
+    std::cout << "  -K, --kernel <name,m>   Heatmap kernel (gaussian, epanechnikov, quartic) and bandwidth in metres (default: quartic,1000)" << std::endl;
+    std::cout << "  -r, --resolution <n>    Heatmap cells along the longer side of the bbox (default: 1024, at most 16384)" << std::endl;
+    std::cout << "  -g, --geojson-file <path> GeoJSON or newline-delimited GeoJSON file to import (example 5)" << std::endl;
+    std::cout << "  -B, --bulk-load         First-time load: fast PRAGMAs and STR-packed spatial index (examples 2, 4, 5)" << std::endl;
+    std::cout << "  -z, --compress          Store geometries as compressed SpatiaLite BLOBs (examples 2, 4)" << std::endl;
+    std::cout << "  -q, --quantize <digits> Round coordinates to the given number of decimals (examples 2, 4)" << std::endl;
+    std::cout << "  -V, --validate          Check geometries with GEOS and repair invalid ones (examples 2, 4)" << std::endl;
+    std::cout << "  -t, --threads <n>       Number of worker threads (default: one per CPU)" << std::endl;
+    std::cout << "  -s, --target-srid <srid> Reproject the shapefile to this EPSG code while importing (example 2)" << std::endl;
+    std::cout << "  -E, --charset <name>    Character set of the shapefile attributes without a .cpg file (default: UTF-8) (example 2)" << std::endl;
+    std::cout << "  -m, --measures          Store the geodesic area and perimeter of every state, in parallel (example 2)" << std::endl;
+    std::cout << "  -A, --adjacency         Precompute which states share borders, in parallel (example 2)" << std::endl;
+    std::cout << "  -T, --topology          Also store the borders as shared arcs, TopoJSON style (example 2)" << std::endl;
+    std::cout << "  -e, --engine <name>     Point lookup engine: sql (SpatiaLite), parts, triangles or slabs (in memory) (example 2)" << std::endl;
+    std::cout << "  -D, --dissolve <column|csv> Merge the states into regions by a column or a key,region mapping in a .csv file (example 2)" << std::endl;
+    std::cout << "  -N, --nearest-border    Distance from each place to the nearest state line, from a segment index (example 2)" << std::endl;
+    std::cout << "  -k, --tracks <path>     CSV of GPS fixes (track,time,lon,lat) to store as tracks and check for state line crossings (example 2)" << std::endl;
+    std::cout << "  -d, --display-zoom <z>  Render the states as clipped, simplified map tiles of zoom z (example 2)" << std::endl;
+    std::cout << "  -W, --within <km>       Join the cities with the locations and the border of PR by distance (example 3)" << std::endl;
+    std::cout << "  -c, --cache <digits>    Cache lookup results by longitude/latitude rounded to the given decimals (examples 2, 3)" << std::endl;
 }
 
 /**
@@ -575,6 +2027,70 @@ void show_usage()
  *  -i, --example-id <id>   ID of the example to run (1 or 2).
  *  -n, --db-name <name>    Name of the database file to use. If not
  *                          provided, an in-memory database will be used.
+ *  -f, --fgb-file <path>   FlatGeobuf file to import (example 4).
+ *  -b, --bbox <box>        Bounding box "min_x,min_y,max_x,max_y" to query
+ *                          from the FlatGeobuf index (example 4), or to
+ *                          page through with a viewport cursor (example 5).
+ *  -C, --cluster <m,n>     Cluster the points by density (DBSCAN): points
+ *                          with n neighbours within m metres are core
+ *                          points, and store the cluster of each one
+ *                          (example 5).
+ *  -H, --heatmap <path>    Rasterize the points into a kernel density grid
+ *                          over the bounding box, written as an ESRI float
+ *                          grid (example 5).
+ *  -K, --kernel <name,m>   Kernel of the heatmap, "gaussian",
+ *                          "epanechnikov" or "quartic", and its bandwidth
+ *                          in metres.
+ *  -r, --resolution <n>    Number of heatmap cells along the longer side
+ *                          of the bounding box, at most 16384.
+ *  -g, --geojson-file <path> GeoJSON or newline-delimited GeoJSON file
+ *                          to import (example 5).
+ *  -B, --bulk-load         Use the bulk-load profile for first-time imports
+ *                          (examples 2, 4 and 5).
+ *  -z, --compress          Store geometries as compressed SpatiaLite BLOBs
+ *                          (examples 2 and 4).
+ *  -q, --quantize <digits> Round coordinates to the given number of decimal
+ *                          digits before storing them (examples 2 and 4).
+ *  -V, --validate          Check the imported geometries with GEOS and
+ *                          repair the invalid ones (examples 2 and 4).
+ *  -t, --threads <n>       Number of worker threads, 0 for one per CPU.
+ *  -s, --target-srid <srid> EPSG code to reproject the shapefile to while
+ *                          importing it (example 2).
+ *  -E, --charset <name>    Character set of the shapefile attributes when
+ *                          there is no .cpg file, "UTF-8" by default
+ *                          (example 2).
+ *  -m, --measures          Store the area and perimeter of every state on
+ *                          the ellipsoid as columns (example 2).
+ *  -A, --adjacency         Build the table of neighbouring states and their
+ *                          shared border length (example 2).
+ *  -T, --topology          Also store the state borders as unique arcs
+ *                          referenced by each ring (example 2).
+ *  -e, --engine <name>     Point lookup engine: "sql" runs ST_Within in
+ *                          SpatiaLite, "parts" the in-memory per-part
+ *                          index, "triangles" the in-memory index of the
+ *                          triangulated states, "slabs" the in-memory slab
+ *                          decomposition of the states (example 2).
+ *  -N, --nearest-border    Find the nearest state line to each place and
+ *                          its distance, from an index of the border
+ *                          segments (example 2).
+ *  -k, --tracks <path>     CSV file of GPS fixes, "track,time,lon,lat",
+ *                          stored as LINESTRING rows of a <table>_tracks
+ *                          table and checked for state line crossings
+ *                          (example 2).
+ *  -D, --dissolve <column|csv> Merge the states into a regions table, by
+ *                          the value of a column, or by a .csv file whose
+ *                          header names the key column and whose lines
+ *                          map each key to its region (example 2).
+ *  -d, --display-zoom <z>  Render the states as map tiles of the given
+ *                          zoom level, clipped and simplified to the
+ *                          pixel size, at most 16 x 16 tiles (example 2).
+ *  -W, --within <km>       Find the cities within the given distance of
+ *                          the locations, and of the border of Parana
+ *                          when example 2 stored the states in the same
+ *                          database (example 3).
+ *  -c, --cache <digits>    Cache lookup results keyed by longitude and
+ *                          latitude rounded to the given number of decimal
+ *                          digits (examples 2 and 3).
  *
  * @param argc Number of command-line arguments.
  * @param argv Array of command-line arguments.
@@ -586,6 +2102,7 @@ int main (int argc, char *argv[])
     bool in_memory_db = true;
     std::string db_name;
     uint8_t example_id = 0;
+    ExampleOptions options;
 
     auto parse_args = [&]() {
         std::cout << "parsing arguments..." << std::endl;
@@ -597,11 +2114,35 @@ int main (int argc, char *argv[])
             {"help", no_argument, nullptr, 'h'},
             {"example-id", required_argument, nullptr, 'i'},
             {"db-name", required_argument, nullptr, 'n'},
+            {"fgb-file", required_argument, nullptr, 'f'},
+            {"bbox", required_argument, nullptr, 'b'},
+            {"geojson-file", required_argument, nullptr, 'g'},
+            {"bulk-load", no_argument, nullptr, 'B'},
+            {"compress", no_argument, nullptr, 'z'},
+            {"quantize", required_argument, nullptr, 'q'},
+            {"validate", no_argument, nullptr, 'V'},
+            {"threads", required_argument, nullptr, 't'},
+            {"target-srid", required_argument, nullptr, 's'},
+            {"charset", required_argument, nullptr, 'E'},
+            {"measures", no_argument, nullptr, 'm'},
+            {"adjacency", no_argument, nullptr, 'A'},
+            {"topology", no_argument, nullptr, 'T'},
+            {"engine", required_argument, nullptr, 'e'},
+            {"cache", required_argument, nullptr, 'c'},
+            {"display-zoom", required_argument, nullptr, 'd'},
+            {"dissolve", required_argument, nullptr, 'D'},
+            {"nearest-border", no_argument, nullptr, 'N'},
+            {"within", required_argument, nullptr, 'W'},
+            {"tracks", required_argument, nullptr, 'k'},
+            {"cluster", required_argument, nullptr, 'C'},
+            {"heatmap", required_argument, nullptr, 'H'},
+            {"kernel", required_argument, nullptr, 'K'},
+            {"resolution", required_argument, nullptr, 'r'},
 
             {nullptr, 0, nullptr, 0}
         };
 
-        while ((c = getopt_long(argc, argv, "i:n:h", long_options, &option_index)) != -1)
+        while ((c = getopt_long(argc, argv, "i:n:f:b:g:Bzq:Vt:s:E:mATe:c:d:D:NW:k:C:H:K:r:h", long_options, &option_index)) != -1)
         {
             switch (c) {
                 case 'i':
@@ -611,6 +2152,136 @@ int main (int argc, char *argv[])
                     db_name = optarg;
                     in_memory_db = false;
                     break;
+                case 'f':
+                    options.fgb_file_path = optarg;
+                    break;
+                case 'b':
+                    if (! parse_bbox(optarg, options.bbox)) {
+                        std::cerr << "Invalid bounding box: " << optarg << std::endl;
+                        std::exit(1);
+                    }
+                    options.has_bbox = true;
+                    break;
+                case 'g':
+                    options.geojson_file_path = optarg;
+                    break;
+                case 'B':
+                    options.bulk_load = true;
+                    break;
+                case 'z':
+                    options.encoding.compressed = true;
+                    break;
+                case 'q':
+                    options.encoding.precision = atoi(optarg);
+                    if (options.encoding.precision < 0 || options.encoding.precision > 15) {
+                        std::cerr << "Invalid number of decimal digits: " << optarg << std::endl;
+                        std::exit(1);
+                    }
+                    break;
+                case 'V':
+                    options.validate = true;
+                    break;
+                case 't': {
+                    char *end;
+                    const long threads = std::strtol(optarg, &end, 10);
+                    if (end == optarg || *end != '\0' || threads < 0 ||
+                        threads > static_cast<long>(ThreadPool::MAX_THREADS)) {
+                        std::cerr << "Invalid number of threads: " << optarg << std::endl;
+                        std::exit(1);
+                    }
+                    options.threads = static_cast<unsigned>(threads);
+                    break;
+                }
+                case 'm':
+                    options.measures = true;
+                    break;
+                case 'A':
+                    options.adjacency = true;
+                    break;
+                case 'T':
+                    options.topology = true;
+                    break;
+                case 'e':
+                    options.engine = optarg;
+                    if (options.engine != "sql" && options.engine != "parts" && options.engine != "triangles" &&
+                        options.engine != "slabs") {
+                        std::cerr << "Unknown lookup engine: " << optarg << std::endl;
+                        std::exit(1);
+                    }
+                    break;
+                case 'd':
+                    options.display_zoom = atoi(optarg);
+                    if (options.display_zoom < 0 || options.display_zoom > static_cast<int>(DisplayQuery::MAX_ZOOM)) {
+                        std::cerr << "Invalid zoom level: " << optarg << std::endl;
+                        std::exit(1);
+                    }
+                    break;
+                case 'D':
+                    options.dissolve = optarg;
+                    break;
+                case 'N':
+                    options.nearest_border = true;
+                    break;
+                case 'k':
+                    options.tracks_file_path = optarg;
+                    break;
+                case 'C':
+                    if (std::sscanf(optarg, "%lf,%d", &options.cluster_distance, &options.cluster_min_points) != 2 ||
+                        !(options.cluster_distance > 0) || options.cluster_min_points < 1) {
+                        std::cerr << "Invalid clustering parameters: " << optarg << std::endl;
+                        std::exit(1);
+                    }
+                    break;
+                case 'H':
+                    options.heatmap_path = optarg;
+                    break;
+                case 'K': {
+                    const std::string value = optarg;
+                    const size_t comma = value.find(',');
+                    if (comma != std::string::npos) {
+                        options.kernel_bandwidth = atof(value.c_str() + comma + 1);
+                    }
+                    if (!parse_density_kernel(value.substr(0, comma), options.kernel) ||
+                        !(options.kernel_bandwidth > 0)) {
+                        std::cerr << "Invalid kernel: " << optarg << std::endl;
+                        std::exit(1);
+                    }
+                    break;
+                }
+                case 'r': {
+                    char *end;
+                    const long cells = std::strtol(optarg, &end, 10);
+                    if (end == optarg || *end != '\0' || cells <= 0 || cells > MAX_DENSITY_RESOLUTION) {
+                        std::cerr << "Invalid resolution: " << optarg << std::endl;
+                        std::exit(1);
+                    }
+                    options.heatmap_cells = static_cast<uint32_t>(cells);
+                    break;
+                }
+                case 'W':
+                    options.within_km = atof(optarg);
+                    if (!(options.within_km > 0)) {
+                        std::cerr << "Invalid distance: " << optarg << std::endl;
+                        std::exit(1);
+                    }
+                    break;
+                case 'c':
+                    options.cache_precision = atoi(optarg);
+                    if (options.cache_precision < 0 || options.cache_precision > 15) {
+                        std::cerr << "Invalid number of decimal digits: " << optarg << std::endl;
+                        std::exit(1);
+                    }
+                    break;
+                case 's':
+                    options.target_srid = atoi(optarg);
+                    if (options.target_srid <= 0) {
+                        std::cerr << "Invalid SRID: " << optarg << std::endl;
+                        std::exit(1);
+                    }
+                    break;
+                case 'E':
+                    options.charset = optarg;
+                    break;
                 case 'h':
                 case '?':
                     show_usage();
@@ -639,10 +2310,16 @@ int main (int argc, char *argv[])
             return run_example_1(db_name);
         case 2:
             std::cout << "Running example 2..." << std::endl;
-            return run_example_2(db_name);
+            return run_example_2(db_name, options);
         case 3:
             std::cout << "Running example 3..." << std::endl;
-            return run_example_3(db_name);
+            return run_example_3(db_name, options);
+        case 4:
+            std::cout << "Running example 4..." << std::endl;
+            return run_example_4(db_name, options);
+        case 5:
+            std::cout << "Running example 5..." << std::endl;
+            return run_example_5(db_name, options);
         default:
             std::cerr << "Unknown example ID: " << example_id << std::endl;
             return 1;
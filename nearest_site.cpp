@@ -0,0 +1,373 @@
+#include "nearest_site.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+#include "geo_distance.h"
+
+namespace {
+
+// Relative margin on the spherical distances within which the geodesic
+// distances decide; the ratio of geodesic to spherical distance varies by
+// less than that over the ellipsoid
+const double REFINE_MARGIN = 0.01;
+
+// When no site is farther than this from the plane of the first three,
+// relative to the distance between the first two, the sites are taken to
+// be on one circle. Being relative, it holds for the cities of a region
+// as for sites all over the globe.
+const double COPLANAR_RATIO = 1e-9;
+
+// Cells per side of the start grid, at most
+const uint32_t MAX_GRID_SIZE = 512;
+
+const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+struct Face {
+    uint32_t v[3];         // counterclockwise seen from outside the hull
+    uint32_t next[3];      // face across edge v[i], v[(i + 1) % 3]
+    bool alive;
+    std::vector<uint32_t> outside;   // sites above the face, not yet in the hull
+};
+
+double squared_chord(double ax, double ay, double az, double bx, double by, double bz)
+{
+    return (ax - bx) * (ax - bx) + (ay - by) * (ay - by) + (az - bz) * (az - bz);
+}
+
+} // namespace
+
+NearestSiteIndex::NearestSiteIndex(const std::vector<JoinPoint> &sites)
+{
+    // One site per position
+    std::map<std::pair<double, double>, size_t> seen;
+    for (const JoinPoint &site : sites) {
+        if (!seen.emplace(std::make_pair(site.point.x, site.point.y), points_.size()).second) continue;
+        ids_.push_back(site.id);
+        points_.push_back(site.point);
+
+        const double lon = site.point.x * DEG_TO_RAD;
+        const double lat = site.point.y * DEG_TO_RAD;
+        unit_.push_back(Vec3{std::cos(lat) * std::cos(lon), std::cos(lat) * std::sin(lon), std::sin(lat)});
+    }
+
+    build_triangulation();
+    build_start_grid();
+}
+
+void NearestSiteIndex::build_triangulation()
+{
+    const uint32_t n = static_cast<uint32_t>(unit_.size());
+    offsets_.assign(n + 1, 0);
+
+    // Signed volume: positive when p is above the plane of abc, seen from
+    // the side where abc turns counterclockwise
+    auto orient = [&](uint32_t a, uint32_t b, uint32_t c, uint32_t p) {
+        const Vec3 &A = unit_[a], &B = unit_[b], &C = unit_[c], &P = unit_[p];
+        const double ux = B.x - A.x, uy = B.y - A.y, uz = B.z - A.z;
+        const double vx = C.x - A.x, vy = C.y - A.y, vz = C.z - A.z;
+        return (P.x - A.x) * (uy * vz - uz * vy) + (P.y - A.y) * (uz * vx - ux * vz) +
+            (P.z - A.z) * (ux * vy - uy * vx);
+    };
+
+    // Initial tetrahedron: two far apart sites, the farthest from their
+    // line, then the farthest from their plane
+    uint32_t t[4] = {0, NONE, NONE, NONE};
+    double best = 0;
+    for (uint32_t i = 1; i < n; i++) {
+        const double d = squared_chord(unit_[0].x, unit_[0].y, unit_[0].z, unit_[i].x, unit_[i].y, unit_[i].z);
+        if (d > best) {
+            best = d;
+            t[1] = i;
+        }
+    }
+    const double spread = std::sqrt(best);
+    best = 0;
+    for (uint32_t i = 1; t[1] != NONE && i < n; i++) {
+        const Vec3 &a = unit_[t[0]], &b = unit_[t[1]], &c = unit_[i];
+        const double ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+        const double vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+        const double cx = uy * vz - uz * vy, cy = uz * vx - ux * vz, cz = ux * vy - uy * vx;
+        const double d = cx * cx + cy * cy + cz * cz;
+        if (d > best) {
+            best = d;
+            t[2] = i;
+        }
+    }
+    const double base_area = std::sqrt(best);
+    best = 0;
+    for (uint32_t i = 1; t[2] != NONE && i < n; i++) {
+        const double d = std::fabs(orient(t[0], t[1], t[2], i));
+        if (d > best) {
+            best = d;
+            t[3] = i;
+        }
+    }
+    // orient() is the distance to the plane times the norm of the cross
+    // product of the base triangle
+    if (t[3] == NONE || best < COPLANAR_RATIO * spread * base_area) {
+        // Fewer than four sites, or all on one circle: no triangulation,
+        // every query checks every site
+        for (uint32_t i = 0; i < n; i++) unplaced_.push_back(i);
+        return;
+    }
+    if (orient(t[0], t[1], t[2], t[3]) > 0) std::swap(t[1], t[2]);
+
+    std::vector<Face> faces;
+    auto add_face = [&](uint32_t a, uint32_t b, uint32_t c) {
+        Face face;
+        face.v[0] = a;
+        face.v[1] = b;
+        face.v[2] = c;
+        face.next[0] = face.next[1] = face.next[2] = NONE;
+        face.alive = true;
+        faces.push_back(std::move(face));
+        return static_cast<uint32_t>(faces.size() - 1);
+    };
+    // t3 is below abc, so these four are counterclockwise from outside
+    add_face(t[0], t[1], t[2]);
+    add_face(t[0], t[3], t[1]);
+    add_face(t[1], t[3], t[2]);
+    add_face(t[2], t[3], t[0]);
+    {
+        std::map<std::pair<uint32_t, uint32_t>, uint32_t> edges;
+        for (uint32_t f = 0; f < 4; f++) {
+            for (int i = 0; i < 3; i++) edges[std::make_pair(faces[f].v[i], faces[f].v[(i + 1) % 3])] = f;
+        }
+        for (uint32_t f = 0; f < 4; f++) {
+            for (int i = 0; i < 3; i++) faces[f].next[i] = edges[std::make_pair(faces[f].v[(i + 1) % 3], faces[f].v[i])];
+        }
+    }
+
+    // Hands a site to the face it is farthest above; every site on the
+    // sphere is above some face of the hull of the others unless it is on
+    // a circle with three of them
+    auto assign = [&](uint32_t p, const std::vector<uint32_t> &candidates) {
+        double farthest = 0;
+        uint32_t chosen = NONE;
+        for (uint32_t f : candidates) {
+            const double d = orient(faces[f].v[0], faces[f].v[1], faces[f].v[2], p);
+            if (d > farthest) {
+                farthest = d;
+                chosen = f;
+            }
+        }
+        if (chosen != NONE) {
+            faces[chosen].outside.push_back(p);
+        } else {
+            unplaced_.push_back(p);
+        }
+    };
+
+    const std::vector<uint32_t> first_faces = {0, 1, 2, 3};
+    for (uint32_t p = 0; p < n; p++) {
+        if (p != t[0] && p != t[1] && p != t[2] && p != t[3]) assign(p, first_faces);
+    }
+
+    std::vector<uint32_t> pending = first_faces;
+    std::vector<uint32_t> visible;
+    std::vector<uint32_t> stack;
+    std::vector<uint32_t> mark;
+    std::vector<std::pair<uint32_t, int>> horizon;
+    std::vector<uint32_t> new_faces;
+    std::unordered_map<uint32_t, uint32_t> face_from;
+    uint32_t stamp = 0;
+
+    while (!pending.empty()) {
+        const uint32_t f = pending.back();
+        pending.pop_back();
+        if (!faces[f].alive || faces[f].outside.empty()) continue;
+
+        // Farthest site above the face
+        uint32_t p = faces[f].outside[0];
+        double farthest = -1;
+        for (uint32_t q : faces[f].outside) {
+            const double d = orient(faces[f].v[0], faces[f].v[1], faces[f].v[2], q);
+            if (d > farthest) {
+                farthest = d;
+                p = q;
+            }
+        }
+
+        // Faces it sees, and the horizon edges around them
+        stamp++;
+        mark.resize(faces.size(), 0);
+        visible.clear();
+        horizon.clear();
+        stack.assign(1, f);
+        mark[f] = stamp;
+        while (!stack.empty()) {
+            const uint32_t g = stack.back();
+            stack.pop_back();
+            visible.push_back(g);
+            for (int i = 0; i < 3; i++) {
+                const uint32_t h = faces[g].next[i];
+                if (mark[h] == stamp) continue;
+                if (orient(faces[h].v[0], faces[h].v[1], faces[h].v[2], p) > 0) {
+                    mark[h] = stamp;
+                    stack.push_back(h);
+                } else {
+                    horizon.emplace_back(g, i);
+                }
+            }
+        }
+
+        // A cone of new faces from the horizon to the site
+        new_faces.clear();
+        face_from.clear();
+        for (const auto &edge : horizon) {
+            const Face &g = faces[edge.first];
+            const uint32_t a = g.v[edge.second];
+            const uint32_t b = g.v[(edge.second + 1) % 3];
+            const uint32_t outer = g.next[edge.second];
+            const uint32_t face = add_face(a, b, p);
+            faces[face].next[0] = outer;
+            for (int i = 0; i < 3; i++) {
+                if (faces[outer].v[i] == b && faces[outer].v[(i + 1) % 3] == a) faces[outer].next[i] = face;
+            }
+            face_from[a] = face;
+            new_faces.push_back(face);
+        }
+        for (uint32_t face : new_faces) {
+            // Edge b-p borders the new face starting at b, across its edge p-b
+            const uint32_t after = face_from[faces[face].v[1]];
+            faces[face].next[1] = after;
+            faces[after].next[2] = face;
+        }
+
+        // The sites above the faces replaced go to the new ones
+        for (uint32_t g : visible) {
+            faces[g].alive = false;
+            for (uint32_t q : faces[g].outside) {
+                if (q != p) assign(q, new_faces);
+            }
+            std::vector<uint32_t>().swap(faces[g].outside);
+        }
+        pending.insert(pending.end(), new_faces.begin(), new_faces.end());
+    }
+
+    // Neighbours of each site, from the edges of the hull
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    for (const Face &face : faces) {
+        if (!face.alive) continue;
+        num_triangles_++;
+        for (int i = 0; i < 3; i++) {
+            edges.emplace_back(face.v[i], face.v[(i + 1) % 3]);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    for (const auto &edge : edges) offsets_[edge.first + 1]++;
+    for (uint32_t i = 0; i < n; i++) offsets_[i + 1] += offsets_[i];
+    neighbours_.resize(edges.size());
+    std::vector<uint32_t> fill(offsets_.begin(), offsets_.end() - 1);
+    for (const auto &edge : edges) neighbours_[fill[edge.first]++] = edge.second;
+}
+
+void NearestSiteIndex::build_start_grid()
+{
+    if (points_.empty()) return;
+
+    for (const Point &p : points_) grid_extent_.expand(p.x, p.y);
+    grid_size_ = std::max<uint32_t>(1, std::min<uint32_t>(MAX_GRID_SIZE,
+                                                          static_cast<uint32_t>(std::sqrt(points_.size()))));
+    grid_.assign(static_cast<size_t>(grid_size_) * grid_size_, 0);
+
+    // The site nearest to the centre of each cell, each walk starting from
+    // the result of the previous cell
+    const double cell_x = (grid_extent_.max_x - grid_extent_.min_x) / grid_size_;
+    const double cell_y = (grid_extent_.max_y - grid_extent_.min_y) / grid_size_;
+    uint32_t site = 0;
+    for (uint32_t row = 0; row < grid_size_; row++) {
+        for (uint32_t column = 0; column < grid_size_; column++) {
+            const double lon = (grid_extent_.min_x + (column + 0.5) * cell_x) * DEG_TO_RAD;
+            const double lat = (grid_extent_.min_y + (row + 0.5) * cell_y) * DEG_TO_RAD;
+            site = walk(Vec3{std::cos(lat) * std::cos(lon), std::cos(lat) * std::sin(lon), std::sin(lat)}, site);
+            grid_[static_cast<size_t>(row) * grid_size_ + column] = site;
+        }
+        site = grid_[static_cast<size_t>(row) * grid_size_];
+    }
+}
+
+uint32_t NearestSiteIndex::grid_start(const Point &p) const
+{
+    auto cell = [&](double value, double min, double max) {
+        if (!(max > min)) return 0u;
+        const double position = (value - min) / (max - min) * grid_size_;
+        return static_cast<uint32_t>(std::min<double>(grid_size_ - 1, std::max(0.0, position)));
+    };
+    const uint32_t column = cell(p.x, grid_extent_.min_x, grid_extent_.max_x);
+    const uint32_t row = cell(p.y, grid_extent_.min_y, grid_extent_.max_y);
+    return grid_[static_cast<size_t>(row) * grid_size_ + column];
+}
+
+uint32_t NearestSiteIndex::walk(const Vec3 &q, uint32_t start) const
+{
+    uint32_t site = start;
+    double best = squared_chord(q.x, q.y, q.z, unit_[site].x, unit_[site].y, unit_[site].z);
+    while (true) {
+        uint32_t next = site;
+        for (uint32_t k = offsets_[site]; k < offsets_[site + 1]; k++) {
+            const Vec3 &u = unit_[neighbours_[k]];
+            const double d = squared_chord(q.x, q.y, q.z, u.x, u.y, u.z);
+            if (d < best) {
+                best = d;
+                next = neighbours_[k];
+            }
+        }
+        if (next == site) return site;
+        site = next;
+    }
+}
+
+SiteMatch NearestSiteIndex::nearest(const Point &p) const
+{
+    SiteMatch match;
+    if (points_.empty()) return match;
+
+    const double lon = p.x * DEG_TO_RAD;
+    const double lat = p.y * DEG_TO_RAD;
+    const Vec3 q{std::cos(lat) * std::cos(lon), std::cos(lat) * std::sin(lon), std::sin(lat)};
+    const uint32_t site = walk(q, grid_start(p));
+
+    // The cell found, its Voronoi neighbours and the unplaced sites: the
+    // nearest of them on the sphere first, with no buffer per query
+    auto visit_candidates = [&](auto &&visit) {
+        visit(site);
+        for (uint32_t k = offsets_[site]; k < offsets_[site + 1]; k++) visit(neighbours_[k]);
+        for (uint32_t i : unplaced_) visit(i);
+    };
+    auto chord_to = [&](uint32_t i) {
+        return std::sqrt(squared_chord(q.x, q.y, q.z, unit_[i].x, unit_[i].y, unit_[i].z));
+    };
+    uint32_t nearest = site;
+    double nearest_chord = chord_to(site);
+    visit_candidates([&](uint32_t i) {
+        const double chord = chord_to(i);
+        if (chord < nearest_chord || (chord == nearest_chord && i < nearest)) {
+            nearest_chord = chord;
+            nearest = i;
+        }
+    });
+
+    // Near an edge of the cell, the ellipsoid decides. Angles, not chords,
+    // scale with the geodesic distance.
+    auto angle = [](double chord) { return 2 * std::asin(std::min(1.0, chord / 2)); };
+    const double limit = angle(nearest_chord) * (1 + REFINE_MARGIN);
+    const uint32_t spherical = nearest;
+    match.distance = point_distance(p, points_[nearest], true);
+    visit_candidates([&](uint32_t i) {
+        if (i == spherical || angle(chord_to(i)) > limit) return;
+        const double d = point_distance(p, points_[i], true);
+        if (d < match.distance) {
+            match.distance = d;
+            nearest = i;
+        }
+    });
+    match.id = ids_[nearest];
+    return match;
+}
@@ -0,0 +1,88 @@
+#ifndef NEAREST_SITE_H
+#define NEAREST_SITE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "distance_join.h"
+#include "geometry.h"
+
+/**
+ * Nearest site found by a NearestSiteIndex
+ */
+struct SiteMatch {
+    int64_t id = -1;        // id of the nearest site, -1 if there is none
+    double distance = 0;    // geodesic distance to it, in metres
+};
+
+/**
+ * Spherical Voronoi diagram of a set of sites (cities, stores...), for
+ * nearest-site queries
+ *
+ * Finding the closest site with ST_Distance ... ORDER BY ... LIMIT 1
+ * measures the distance to every site on every query. Here the Delaunay
+ * triangulation of the sites on the sphere, the dual of their Voronoi
+ * diagram, is built once, as the convex hull of the sites mapped to the
+ * unit sphere (quickhull). A query then locates its Voronoi cell by a
+ * greedy walk over the triangulation: from a site, move to the neighbour
+ * nearest to the point as long as one is nearer; on a Delaunay
+ * triangulation the walk ends at the nearest site. It starts from the
+ * site stored for the cell of a coarse longitude/latitude grid holding
+ * the point, so it takes a few steps whatever the number of sites.
+ *
+ * The sphere is only a model of the ellipsoid: when the point is within
+ * 1% of the same distance from the site found and one of its Voronoi
+ * neighbours, i.e. near an edge of the cell, the geodesic distances on
+ * GRS 80 decide between them.
+ *
+ * The index is immutable once built and can be shared between threads.
+ */
+class NearestSiteIndex {
+public:
+    /**
+     * Builds the diagram of a set of sites
+     *
+     * @param sites sites, as longitude/latitude, with their ids; of sites
+     *        at the same position, only the first one is ever returned
+     */
+    explicit NearestSiteIndex(const std::vector<JoinPoint> &sites);
+
+    /**
+     * Finds the nearest site to a point
+     *
+     * @param p longitude/latitude of the point
+     * @return nearest site and its distance, id -1 if there are no sites
+     */
+    SiteMatch nearest(const Point &p) const;
+
+    size_t num_sites() const { return points_.size(); }
+    size_t num_triangles() const { return num_triangles_; }
+
+private:
+    struct Vec3 {
+        double x, y, z;
+    };
+
+    void build_triangulation();
+    void build_start_grid();
+    uint32_t walk(const Vec3 &q, uint32_t start) const;
+    uint32_t grid_start(const Point &p) const;
+
+    std::vector<int64_t> ids_;
+    std::vector<Point> points_;
+    std::vector<Vec3> unit_;
+    // Delaunay neighbours of site i: neighbours_[offsets_[i] .. offsets_[i + 1])
+    std::vector<uint32_t> offsets_;
+    std::vector<uint32_t> neighbours_;
+    // Sites the triangulation could not place (four or more on one circle
+    // up to rounding); they are checked on every query
+    std::vector<uint32_t> unplaced_;
+    size_t num_triangles_ = 0;
+
+    // Start site of the walk for each cell of the grid
+    BBox grid_extent_;
+    uint32_t grid_size_ = 0;
+    std::vector<uint32_t> grid_;
+};
+
+#endif // NEAREST_SITE_H
@@ -0,0 +1,241 @@
+#include "packed_rtree.h"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+/**
+ * Hilbert curve index of a point on a 2^16 x 2^16 grid
+ *
+ * Branch-free implementation by rawrunprotected, also used by
+ * FlatGeobuf, so trees we build sort the same way as the files we read.
+ */
+uint32_t hilbert(uint32_t x, uint32_t y)
+{
+    uint32_t a = x ^ y;
+    uint32_t b = 0xFFFF ^ a;
+    uint32_t c = 0xFFFF ^ (x | y);
+    uint32_t d = x & (y ^ 0xFFFF);
+
+    uint32_t A = a | (b >> 1);
+    uint32_t B = (a >> 1) ^ a;
+    uint32_t C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+    uint32_t D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+    a = A; b = B; c = C; d = D;
+    A = ((a & (a >> 2)) ^ (b & (b >> 2)));
+    B = ((a & (b >> 2)) ^ (b & ((a ^ b) >> 2)));
+    C ^= ((a & (c >> 2)) ^ (b & (d >> 2)));
+    D ^= ((b & (c >> 2)) ^ ((a ^ b) & (d >> 2)));
+
+    a = A; b = B; c = C; d = D;
+    A = ((a & (a >> 4)) ^ (b & (b >> 4)));
+    B = ((a & (b >> 4)) ^ (b & ((a ^ b) >> 4)));
+    C ^= ((a & (c >> 4)) ^ (b & (d >> 4)));
+    D ^= ((b & (c >> 4)) ^ ((a ^ b) & (d >> 4)));
+
+    a = A; b = B; c = C; d = D;
+    C ^= ((a & (c >> 8)) ^ (b & (d >> 8)));
+    D ^= ((b & (c >> 8)) ^ ((a ^ b) & (d >> 8)));
+
+    a = C ^ (C >> 1);
+    b = D ^ (D >> 1);
+
+    uint32_t i0 = x ^ y;
+    uint32_t i1 = b | (0xFFFF ^ (i0 | a));
+
+    i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+    i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+    i0 = (i0 | (i0 << 2)) & 0x33333333;
+    i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+    i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+    i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+    i1 = (i1 | (i1 << 2)) & 0x33333333;
+    i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+    return (i1 << 1) | i0;
+}
+
+} // namespace
+
+PackedRTree::PackedRTree(std::vector<NodeItem> items, uint16_t node_size)
+    : num_items_(items.size()), node_size_(node_size)
+{
+    if (node_size_ < 2) {
+        throw std::invalid_argument("Packed R-tree node size must be at least 2");
+    }
+    if (num_items_ == 0) return;
+
+    init_levels();
+    storage_.resize(num_nodes_);
+    std::copy(items.begin(), items.end(), storage_.begin() + level_bounds_.front().first);
+
+    // Each parent covers up to node_size consecutive nodes of the level below
+    for (size_t i = 0; i + 1 < level_bounds_.size(); i++) {
+        uint64_t pos = level_bounds_[i].first;
+        const uint64_t end = level_bounds_[i].second;
+        uint64_t parent = level_bounds_[i + 1].first;
+
+        while (pos < end) {
+            NodeItem node = storage_[pos];
+            node.offset = pos;
+            for (uint16_t j = 1; j < node_size_ && pos + j < end; j++) {
+                const NodeItem &child = storage_[pos + j];
+                node.min_x = std::min(node.min_x, child.min_x);
+                node.min_y = std::min(node.min_y, child.min_y);
+                node.max_x = std::max(node.max_x, child.max_x);
+                node.max_y = std::max(node.max_y, child.max_y);
+            }
+            storage_[parent++] = node;
+            pos += node_size_;
+        }
+    }
+
+    data_ = reinterpret_cast<const uint8_t *>(storage_.data());
+}
+
+PackedRTree::PackedRTree(const uint8_t *data, uint64_t num_items, uint16_t node_size)
+    : data_(data), num_items_(num_items), node_size_(node_size)
+{
+    if (node_size_ < 2) {
+        throw std::invalid_argument("Packed R-tree node size must be at least 2");
+    }
+    if (num_items_ > 0) {
+        init_levels();
+    }
+}
+
+PackedRTree::PackedRTree(const PackedRTree &other)
+    : storage_(other.storage_),
+      data_(other.data_),
+      num_items_(other.num_items_),
+      num_nodes_(other.num_nodes_),
+      node_size_(other.node_size_),
+      level_bounds_(other.level_bounds_)
+{
+    if (!storage_.empty()) {
+        data_ = reinterpret_cast<const uint8_t *>(storage_.data());
+    }
+}
+
+PackedRTree &PackedRTree::operator=(const PackedRTree &other)
+{
+    if (this != &other) {
+        PackedRTree copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+void PackedRTree::init_levels()
+{
+    // Same level computation as FlatGeobuf's generateLevelBounds(), so the
+    // serialized size matches what writers put in the file
+    std::vector<uint64_t> level_num_nodes;
+    uint64_t n = num_items_;
+    num_nodes_ = n;
+    level_num_nodes.push_back(n);
+    do {
+        n = (n + node_size_ - 1) / node_size_;
+        num_nodes_ += n;
+        level_num_nodes.push_back(n);
+    } while (n != 1);
+
+    level_bounds_.clear();
+    uint64_t offset = num_nodes_;
+    for (uint64_t count : level_num_nodes) {
+        offset -= count;
+        level_bounds_.emplace_back(offset, offset + count);
+    }
+}
+
+uint64_t PackedRTree::tree_size(uint64_t num_items, uint16_t node_size)
+{
+    if (num_items == 0 || node_size < 2) return 0;
+
+    uint64_t n = num_items;
+    uint64_t num_nodes = n;
+    do {
+        n = (n + node_size - 1) / node_size;
+        num_nodes += n;
+    } while (n != 1);
+    return num_nodes * sizeof(NodeItem);
+}
+
+std::vector<PackedRTree::SearchResult> PackedRTree::search(const BBox &box) const
+{
+    std::vector<SearchResult> results;
+    visit(box, [&](const NodeItem &item, uint64_t index) {
+        results.push_back({item.offset, index});
+        return true;
+    });
+    return results;
+}
+
+BBox PackedRTree::extent() const
+{
+    BBox box;
+    if (num_items_ == 0) return box;
+
+    // The top level holds a single node covering everything
+    const NodeItem root = node(0);
+    box.expand(root.min_x, root.min_y);
+    box.expand(root.max_x, root.max_y);
+    return box;
+}
+
+void hilbert_sort(std::vector<NodeItem> &items, const BBox &extent)
+{
+    const double hilbert_max = (1 << 16) - 1;
+    const double width = extent.max_x - extent.min_x;
+    const double height = extent.max_y - extent.min_y;
+
+    std::vector<std::pair<uint32_t, size_t>> keys(items.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        const NodeItem &item = items[i];
+        double x = 0.0;
+        double y = 0.0;
+        if (width > 0) {
+            x = hilbert_max * ((item.min_x + item.max_x) / 2 - extent.min_x) / width;
+        }
+        if (height > 0) {
+            y = hilbert_max * ((item.min_y + item.max_y) / 2 - extent.min_y) / height;
+        }
+        x = std::min(std::max(x, 0.0), hilbert_max);
+        y = std::min(std::max(y, 0.0), hilbert_max);
+        keys[i] = {hilbert(static_cast<uint32_t>(x), static_cast<uint32_t>(y)), i};
+    }
+
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<NodeItem> sorted;
+    sorted.reserve(items.size());
+    for (const auto &key : keys) {
+        sorted.push_back(items[key.second]);
+    }
+    items.swap(sorted);
+}
+
+void str_sort(std::vector<NodeItem> &items, size_t node_size)
+{
+    if (items.size() <= node_size || node_size == 0) return;
+
+    auto center_x = [](const NodeItem &a, const NodeItem &b) {
+        return a.min_x + a.max_x < b.min_x + b.max_x;
+    };
+    auto center_y = [](const NodeItem &a, const NodeItem &b) {
+        return a.min_y + a.max_y < b.min_y + b.max_y;
+    };
+
+    const size_t num_leaves = (items.size() + node_size - 1) / node_size;
+    const size_t num_slices = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(num_leaves))));
+    const size_t slice_size = num_slices * node_size;
+
+    std::sort(items.begin(), items.end(), center_x);
+    for (size_t first = 0; first < items.size(); first += slice_size) {
+        const size_t last = std::min(first + slice_size, items.size());
+        std::sort(items.begin() + first, items.begin() + last, center_y);
+    }
+}
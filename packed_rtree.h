@@ -0,0 +1,238 @@
+#ifndef PACKED_RTREE_H
+#define PACKED_RTREE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "geometry.h"
+
+/**
+ * A node of a packed R-tree, laid out exactly as in FlatGeobuf files:
+ * four little-endian doubles followed by a 64 bit offset.
+ *
+ * For leaf nodes the offset is caller data (a byte offset into the
+ * FlatGeobuf feature section, a row id, an array index...). For inner
+ * nodes it is the index of the node's first child.
+ */
+struct NodeItem {
+    double min_x;
+    double min_y;
+    double max_x;
+    double max_y;
+    uint64_t offset;
+
+    bool intersects(const BBox &box) const
+    {
+        return !(box.min_x > max_x || box.max_x < min_x ||
+                 box.min_y > max_y || box.max_y < min_y);
+    }
+};
+
+static_assert(sizeof(NodeItem) == 40, "NodeItem must match the FlatGeobuf layout");
+
+/**
+ * Static, bulk loaded R-tree stored as a flat array of nodes, top level
+ * first. This is the index format FlatGeobuf writes after its header, so
+ * the same class can either own a tree built in memory or walk one that
+ * lives in a memory mapped file.
+ */
+class PackedRTree {
+public:
+    struct SearchResult {
+        uint64_t offset;    // leaf offset
+        uint64_t index;     // position of the leaf in insertion order
+    };
+
+    /**
+     * Builds a tree from leaf items, in the order given. Sort them first
+     * (see hilbert_sort()) to get a tight tree.
+     *
+     * @param items leaf items
+     * @param node_size maximum number of children per node (>= 2)
+     */
+    PackedRTree(std::vector<NodeItem> items, uint16_t node_size = 16);
+
+    /**
+     * Wraps a serialized tree without copying it
+     *
+     * @param data pointer to the first node
+     * @param num_items number of leaves
+     * @param node_size node size used when the tree was written
+     */
+    PackedRTree(const uint8_t *data, uint64_t num_items, uint16_t node_size);
+
+    PackedRTree() = default;
+    PackedRTree(const PackedRTree &other);
+    PackedRTree &operator=(const PackedRTree &other);
+    PackedRTree(PackedRTree &&other) = default;
+    PackedRTree &operator=(PackedRTree &&other) = default;
+
+    /**
+     * Size in bytes of a serialized tree
+     *
+     * @param num_items number of leaves
+     * @param node_size maximum number of children per node
+     * @return size in bytes, 0 when there are no items
+     */
+    static uint64_t tree_size(uint64_t num_items, uint16_t node_size);
+
+    /**
+     * Visits every leaf whose box intersects the query box
+     *
+     * @param box query box
+     * @param visit callable invoked as visit(const NodeItem &leaf, uint64_t index);
+     *              returning false stops the search
+     */
+    template <typename Visitor>
+    void visit(const BBox &box, Visitor &&visit) const;
+
+    /**
+     * Visits the leaves in increasing order of a lower bound of their
+     * distance to something, best first
+     *
+     * @param bound callable invoked as bound(const NodeItem &node), returning
+     *              a lower bound of the distance to anything inside the
+     *              node's box, e.g. the distance to the box; it must not
+     *              decrease from a node to its children
+     * @param visit callable invoked as visit(const NodeItem &leaf, uint64_t index,
+     *              double bound); returning false stops the search, which is
+     *              how a nearest neighbour search ends once the bound exceeds
+     *              the best distance found
+     */
+    template <typename Bound, typename Visitor>
+    void visit_nearest(Bound &&bound, Visitor &&visit) const;
+
+    /**
+     * Collects every leaf whose box intersects the query box
+     *
+     * @param box query box
+     * @return matching leaves, in tree order
+     */
+    std::vector<SearchResult> search(const BBox &box) const;
+
+    uint64_t num_items() const { return num_items_; }
+    uint64_t num_nodes() const { return num_nodes_; }
+    uint16_t node_size() const { return node_size_; }
+    bool empty() const { return num_items_ == 0; }
+
+    /**
+     * @param i node position in the flat array
+     * @return copy of the node (the backing memory may be unaligned)
+     */
+    NodeItem node(uint64_t i) const
+    {
+        NodeItem item;
+        std::memcpy(&item, data_ + i * sizeof(NodeItem), sizeof(NodeItem));
+        return item;
+    }
+
+    /**
+     * @param i leaf position, in insertion order
+     * @return copy of the leaf
+     */
+    NodeItem leaf(uint64_t i) const { return node(num_nodes_ - num_items_ + i); }
+
+    BBox extent() const;
+
+private:
+    void init_levels();
+
+    std::vector<NodeItem> storage_;
+    const uint8_t *data_ = nullptr;
+    uint64_t num_items_ = 0;
+    uint64_t num_nodes_ = 0;
+    uint16_t node_size_ = 16;
+    // [first, last) node positions of each level, leaves first
+    std::vector<std::pair<uint64_t, uint64_t>> level_bounds_;
+};
+
+/**
+ * Sorts items along a Hilbert curve over the given extent, the same
+ * ordering FlatGeobuf writers use
+ *
+ * @param items items to sort in place
+ * @param extent extent of all the items
+ */
+void hilbert_sort(std::vector<NodeItem> &items, const BBox &extent);
+
+/**
+ * Sorts items in Sort-Tile-Recursive order: vertical slices by x, each
+ * slice sorted by y, so that every run of node_size items forms a
+ * compact tile
+ *
+ * @param items items to sort in place
+ * @param node_size number of items per leaf node of the target tree
+ */
+void str_sort(std::vector<NodeItem> &items, size_t node_size);
+
+template <typename Visitor>
+void PackedRTree::visit(const BBox &box, Visitor &&visit) const
+{
+    if (num_items_ == 0) return;
+
+    const uint64_t leaves_first = level_bounds_.front().first;
+    std::vector<std::pair<uint64_t, size_t>> stack;
+    stack.emplace_back(0, level_bounds_.size() - 1);
+
+    while (!stack.empty()) {
+        const uint64_t node_index = stack.back().first;
+        const size_t level = stack.back().second;
+        stack.pop_back();
+
+        const bool is_leaf = node_index >= leaves_first;
+        const uint64_t level_end = level_bounds_[level].second;
+        const uint64_t end = std::min<uint64_t>(node_index + node_size_, level_end);
+
+        for (uint64_t pos = node_index; pos < end; pos++) {
+            const NodeItem item = node(pos);
+            if (!item.intersects(box)) continue;
+
+            if (is_leaf) {
+                if (!visit(item, pos - leaves_first)) return;
+            } else {
+                stack.emplace_back(item.offset, level - 1);
+            }
+        }
+    }
+}
+
+template <typename Bound, typename Visitor>
+void PackedRTree::visit_nearest(Bound &&bound, Visitor &&visit) const
+{
+    if (num_items_ == 0) return;
+
+    // Leaves are queued like inner nodes, so they come out in order too
+    struct Entry {
+        double bound;
+        uint64_t node_index;
+        size_t level;
+        bool operator>(const Entry &other) const { return bound > other.bound; }
+    };
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    const size_t root_level = level_bounds_.size() - 1;
+    queue.push(Entry{bound(node(0)), 0, root_level});
+
+    const uint64_t leaves_first = level_bounds_.front().first;
+    while (!queue.empty()) {
+        const Entry entry = queue.top();
+        queue.pop();
+
+        const NodeItem item = node(entry.node_index);
+        if (entry.level == 0) {
+            if (!visit(item, entry.node_index - leaves_first, entry.bound)) return;
+            continue;
+        }
+
+        const uint64_t end = std::min<uint64_t>(item.offset + node_size_, level_bounds_[entry.level - 1].second);
+        for (uint64_t pos = item.offset; pos < end; pos++) {
+            queue.push(Entry{bound(node(pos)), pos, entry.level - 1});
+        }
+    }
+}
+
+#endif // PACKED_RTREE_H
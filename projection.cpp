@@ -0,0 +1,202 @@
+#include "projection.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Lowest PROJ confidence (0-100) accepted when identifying ESRI WKT
+const int MIN_IDENTIFY_CONFIDENCE = 70;
+
+/**
+ * Reads the EPSG code of an AUTHORITY["EPSG","4674"] or ID["EPSG",4674]
+ * node whose body starts at pos
+ */
+int parse_authority(const std::string &wkt, size_t pos)
+{
+    const size_t auth_begin = wkt.find('"', pos);
+    if (auth_begin == std::string::npos) return 0;
+    const size_t auth_end = wkt.find('"', auth_begin + 1);
+    if (auth_end == std::string::npos) return 0;
+
+    std::string auth = wkt.substr(auth_begin + 1, auth_end - auth_begin - 1);
+    for (char &c : auth) {
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    if (auth != "EPSG") return 0;
+
+    size_t i = auth_end + 1;
+    while (i < wkt.size() && (wkt[i] == ',' || wkt[i] == '"' || std::isspace(static_cast<unsigned char>(wkt[i])))) {
+        i++;
+    }
+    return std::atoi(wkt.c_str() + i);
+}
+
+/**
+ * Looks for an EPSG authority on the root node of a WKT definition,
+ * skipping the ones of its datum, ellipsoid, units and so on
+ */
+int root_authority(const std::string &wkt)
+{
+    int depth = 0;
+    for (size_t i = 0; i < wkt.size(); i++) {
+        const char c = wkt[i];
+        if (c == '"') {
+            // Skip quoted names; an escaped "" reads as two names
+            i = wkt.find('"', i + 1);
+            if (i == std::string::npos) return 0;
+        } else if (c == '[' || c == '(') {
+            depth++;
+        } else if (c == ']' || c == ')') {
+            depth--;
+        } else if (c == ',' && depth == 1) {
+            size_t begin = i + 1;
+            while (begin < wkt.size() && std::isspace(static_cast<unsigned char>(wkt[begin]))) begin++;
+            size_t end = begin;
+            while (end < wkt.size() && std::isalpha(static_cast<unsigned char>(wkt[end]))) end++;
+
+            const std::string keyword = wkt.substr(begin, end - begin);
+            if ((keyword == "AUTHORITY" || keyword == "ID") && end < wkt.size() &&
+                (wkt[end] == '[' || wkt[end] == '(')) {
+                return parse_authority(wkt, end + 1);
+            }
+        }
+    }
+    return 0;
+}
+
+int epsg_code(const PJ *obj)
+{
+    const char *auth = proj_get_id_auth_name(obj, 0);
+    const char *code = proj_get_id_code(obj, 0);
+    if (auth == nullptr || code == nullptr || strcmp(auth, "EPSG") != 0) return 0;
+    return std::atoi(code);
+}
+
+} // namespace
+
+int srid_from_wkt(const std::string &wkt)
+{
+    const int srid = root_authority(wkt);
+    if (srid > 0) return srid;
+
+    try {
+        ProjContext context;
+        PJ *crs = proj_create_from_wkt(context.handle(), wkt.c_str(), NULL, NULL, NULL);
+        if (crs == nullptr) return 0;
+
+        int result = epsg_code(crs);
+        if (result == 0) {
+            int *confidence = nullptr;
+            PJ_OBJ_LIST *matches = proj_identify(context.handle(), crs, "EPSG", NULL, &confidence);
+            if (matches != nullptr && proj_list_get_count(matches) > 0 &&
+                confidence[0] >= MIN_IDENTIFY_CONFIDENCE) {
+                PJ *best = proj_list_get(context.handle(), matches, 0);
+                result = epsg_code(best);
+                proj_destroy(best);
+            }
+            proj_int_list_destroy(confidence);
+            proj_list_destroy(matches);
+        }
+        proj_destroy(crs);
+        return result;
+    } catch (const std::exception &) {
+        return 0;
+    }
+}
+
+int shapefile_srid(const std::string &shp_path)
+{
+    std::ifstream prj_file(shp_path + ".prj");
+    if (!prj_file) return 0;
+
+    std::stringstream wkt;
+    wkt << prj_file.rdbuf();
+    return srid_from_wkt(wkt.str());
+}
+
+ProjContext::ProjContext()
+{
+    handle_ = proj_context_create();
+    if (handle_ == nullptr) {
+        throw std::runtime_error("Cannot initialize PROJ");
+    }
+    proj_log_func(handle_, this, &ProjContext::log_handler);
+}
+
+ProjContext::~ProjContext()
+{
+    for (auto &entry : transformations_) {
+        proj_destroy(entry.second);
+    }
+    proj_context_destroy(handle_);
+}
+
+void ProjContext::log_handler(void *context, int level, const char *message)
+{
+    // Debug and trace messages would overwrite the error they follow
+    if (level != PJ_LOG_ERROR) return;
+    static_cast<ProjContext *>(context)->last_error_ = message;
+}
+
+PJ *ProjContext::transformation(int source_srid, int target_srid)
+{
+    const std::pair<int, int> key(source_srid, target_srid);
+    auto found = transformations_.find(key);
+    if (found != transformations_.end()) return found->second;
+
+    const std::string source = "EPSG:" + std::to_string(source_srid);
+    const std::string target = "EPSG:" + std::to_string(target_srid);
+    PJ *pj = proj_create_crs_to_crs(handle_, source.c_str(), target.c_str(), NULL);
+    if (pj == nullptr) return nullptr;
+
+    // Longitude/easting first, whatever the axis order of the CRS
+    PJ *normalized = proj_normalize_for_visualization(handle_, pj);
+    proj_destroy(pj);
+    if (normalized == nullptr) return nullptr;
+
+    transformations_[key] = normalized;
+    return normalized;
+}
+
+bool ProjContext::transform(Geometry &geom, int target_srid)
+{
+    if (geom.srid == target_srid) return true;
+
+    PJ *pj = transformation(geom.srid, target_srid);
+    if (pj == nullptr) return false;
+
+    auto transform_points = [&](std::vector<Point> &points) {
+        if (points.empty()) return true;
+        const size_t count = points.size();
+        proj_trans_generic(pj, PJ_FWD, &points[0].x, sizeof(Point), count, &points[0].y, sizeof(Point), count,
+                           NULL, 0, 0, NULL, 0, 0);
+
+        // Vertices PROJ cannot transform come back as HUGE_VAL
+        for (const Point &p : points) {
+            if (!std::isfinite(p.x) || !std::isfinite(p.y)) {
+                last_error_ = "coordinates outside the area of use of EPSG:" + std::to_string(target_srid);
+                return false;
+            }
+        }
+        return true;
+    };
+
+    if (!transform_points(geom.points)) return false;
+    for (auto &line : geom.lines) {
+        if (!transform_points(line)) return false;
+    }
+    for (auto &polygon : geom.polygons) {
+        for (auto &ring : polygon.rings) {
+            if (!transform_points(ring)) return false;
+        }
+    }
+
+    geom.srid = target_srid;
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef PROJECTION_H
+#define PROJECTION_H
+
+#include <map>
+#include <string>
+#include <utility>
+
+#include <proj.h>
+
+#include "geometry.h"
+
+/**
+ * Finds the EPSG code of a coordinate reference system given as WKT
+ *
+ * @param wkt WKT1 (OGC or ESRI flavour) or WKT2 definition
+ * @return EPSG code, 0 if the CRS cannot be identified
+ *
+ * An EPSG AUTHORITY (or ID) on the root node is used as is. ESRI WKT, as
+ * found in most .prj files, carries no authority: PROJ matches it against
+ * its database instead, so GCS_SIRGAS_2000 resolves to 4674.
+ */
+int srid_from_wkt(const std::string &wkt);
+
+/**
+ * Reads the SRID of a shapefile from its .prj file
+ *
+ * @param shp_path shapefile path without extension
+ * @return EPSG code, 0 if there is no .prj file or its CRS is unknown
+ */
+int shapefile_srid(const std::string &shp_path);
+
+/**
+ * A PROJ context with its transformations cached by SRID pair
+ *
+ * Like GEOS contexts, PROJ contexts and the transformations created in
+ * them must not be shared between threads: create one per worker (see
+ * ThreadPool). Creating a transformation queries the PROJ database, so
+ * each one is created once per context and reused for every geometry.
+ * PROJ log messages are caught in the context and can be read back with
+ * last_error().
+ *
+ * The constructor throws std::runtime_error if PROJ cannot be initialized.
+ */
+class ProjContext {
+public:
+    ProjContext();
+    ~ProjContext();
+
+    ProjContext(const ProjContext &) = delete;
+    ProjContext &operator=(const ProjContext &) = delete;
+
+    PJ_CONTEXT *handle() const { return handle_; }
+
+    /**
+     * Reprojects a geometry in place
+     *
+     * @param geom geometry to reproject, from its own SRID
+     * @param target_srid EPSG code to reproject to
+     * @return false if the transformation cannot be created or a vertex
+     *         falls outside its domain (see last_error())
+     *
+     * Coordinates are passed to PROJ one coordinate array (ring, line or
+     * point list) at a time, in x/y order for both geographic and projected
+     * systems.
+     */
+    bool transform(Geometry &geom, int target_srid);
+
+    /**
+     * Message of the last PROJ error raised in this context
+     */
+    const std::string &last_error() const { return last_error_; }
+
+private:
+    static void log_handler(void *context, int level, const char *message);
+
+    PJ *transformation(int source_srid, int target_srid);
+
+    PJ_CONTEXT *handle_;
+    std::map<std::pair<int, int>, PJ *> transformations_;
+    std::string last_error_;
+};
+
+#endif // PROJECTION_H
@@ -0,0 +1,191 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "geometry.h"
+
+/**
+ * Counters of a result cache
+ */
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;   // entries dropped to make room
+    uint64_t entries = 0;     // entries held now
+
+    double hit_rate() const
+    {
+        const uint64_t lookups = hits + misses;
+        return lookups > 0 ? static_cast<double>(hits) / lookups : 0;
+    }
+};
+
+/**
+ * Sharded, thread-safe LRU cache
+ *
+ * Keys are spread over independently locked shards, each with its own
+ * LRU list and a share of the capacity. Values are computed outside the
+ * lock: two threads missing on the same key at once both compute it.
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ShardedLruCache {
+public:
+    /**
+     * @param capacity maximum number of entries
+     */
+    explicit ShardedLruCache(size_t capacity = 65536)
+        : capacity_per_shard_(std::max<size_t>(1, capacity / SHARDS))
+    {
+    }
+
+    /**
+     * Returns the cached value of a key, computing and caching it on a miss
+     *
+     * @param key key to look up
+     * @param compute callable invoked as compute() on a miss
+     * @return cached or computed value
+     */
+    template <typename Compute>
+    Value get(const Key &key, Compute &&compute)
+    {
+        Shard &shard = shard_of(key);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto found = shard.map.find(key);
+            if (found != shard.map.end()) {
+                shard.hits++;
+                shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+                return found->second->second;
+            }
+            shard.misses++;
+        }
+
+        Value value = compute();
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.map.find(key);
+        if (found != shard.map.end()) {
+            // Another thread computed it meanwhile
+            found->second->second = value;
+            shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+            return value;
+        }
+        if (shard.map.size() >= capacity_per_shard_) {
+            shard.map.erase(shard.lru.back().first);
+            shard.lru.pop_back();
+            shard.evictions++;
+        }
+        shard.lru.emplace_front(key, value);
+        shard.map.emplace(key, shard.lru.begin());
+        return value;
+    }
+
+    CacheStats stats() const
+    {
+        CacheStats total;
+        for (const Shard &shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total.hits += shard.hits;
+            total.misses += shard.misses;
+            total.evictions += shard.evictions;
+            total.entries += shard.map.size();
+        }
+        return total;
+    }
+
+private:
+    static const size_t SHARDS = 16;
+
+    using Entry = std::pair<Key, Value>;
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru;   // most recently used first
+        std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> map;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    // High bits pick the shard, so the maps' buckets still see all the low bits
+    Shard &shard_of(const Key &key)
+    {
+        return shards_[(static_cast<uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ULL) >> 60];
+    }
+
+    size_t capacity_per_shard_;
+    Shard shards_[SHARDS];
+};
+
+/**
+ * Thread-safe LRU cache of lookup results keyed by location
+ *
+ * Locations are longitude/latitude in degrees, whatever the CRS the
+ * lookups run in, so that a number of digits means the same distance
+ * everywhere. They are rounded to a fixed number of decimal digits, so
+ * fixes a few centimetres apart (the same depot, a driver parked in the
+ * same place) share an entry: 4 digits is about 11 m. Choose the
+ * precision so that no answer changes within a cell of that size, or
+ * accept that points that close to a border may get their neighbour's
+ * answer.
+ */
+template <typename Value>
+class ResultCache {
+public:
+    /**
+     * @param precision decimal digits kept in the keys (0 to 15; 180
+     *        degrees times 10^15 still fits the 64 bit keys)
+     * @param capacity maximum number of entries
+     */
+    explicit ResultCache(int precision, size_t capacity = 65536)
+        : scale_(std::pow(10.0, precision)), cache_(capacity)
+    {
+    }
+
+    /**
+     * Returns the cached result for a point, computing and caching it on a
+     * miss
+     *
+     * @param p longitude/latitude of the point to look up
+     * @param compute callable invoked as compute(p) on a miss
+     * @return cached or computed result
+     */
+    template <typename Compute>
+    Value get(const Point &p, Compute &&compute)
+    {
+        const Key key{std::llround(p.x * scale_), std::llround(p.y * scale_)};
+        return cache_.get(key, [&]() { return compute(p); });
+    }
+
+    CacheStats stats() const { return cache_.stats(); }
+
+private:
+    struct Key {
+        int64_t x;
+        int64_t y;
+
+        bool operator==(const Key &other) const { return x == other.x && y == other.y; }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const
+        {
+            const uint64_t h = static_cast<uint64_t>(key.x) * 0x9E3779B97F4A7C15ULL ^
+                               (static_cast<uint64_t>(key.y) + 0x632BE59BD9B4E019ULL);
+            return static_cast<size_t>(h ^ (h >> 29));
+        }
+    };
+
+    double scale_;
+    ShardedLruCache<Key, Value, KeyHash> cache_;
+};
+
+#endif // RESULT_CACHE_H
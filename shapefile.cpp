@@ -0,0 +1,628 @@
+#include "shapefile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <iconv.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "import_stats.h"
+#include "projection.h"
+#include "sql_util.h"
+#include "thread_pool.h"
+
+namespace {
+
+const int32_t SHP_FILE_CODE = 9994;
+const size_t SHP_HEADER_SIZE = 100;
+const size_t DBF_HEADER_SIZE = 32;
+const size_t DBF_FIELD_SIZE = 32;
+
+// Records read, reprojected in parallel and inserted at a time
+const size_t IMPORT_BATCH_SIZE = 256;
+
+// Shape types, Z and M variants are 10 and 20 apart
+enum ShapeType { SHP_NULL = 0, SHP_POINT = 1, SHP_POLYLINE = 3, SHP_POLYGON = 5, SHP_MULTIPOINT = 8 };
+
+[[noreturn]] void corrupt(const std::string &path)
+{
+    throw std::runtime_error("Corrupt shapefile: " + path);
+}
+
+uint32_t load_be32(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+template <typename T>
+T load_le(const uint8_t *p)
+{
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+const uint8_t *map_file(const std::string &path, size_t &size)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file: " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("Empty file: " + path);
+    }
+    size = static_cast<size_t>(st.st_size);
+
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("Cannot map file: " + path);
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    return static_cast<const uint8_t *>(mapped);
+}
+
+GeometryType shape_geometry_type(int32_t shape_type)
+{
+    switch (shape_type % 10) {
+        case SHP_POINT: return GeometryType::Point;
+        case SHP_POLYLINE: return GeometryType::MultiLineString;
+        case SHP_POLYGON: return GeometryType::MultiPolygon;
+        case SHP_MULTIPOINT: return GeometryType::MultiPoint;
+        default: return GeometryType::Unknown;
+    }
+}
+
+/**
+ * Twice the signed area of a ring, positive for counter-clockwise rings
+ * and negative for clockwise ones
+ */
+double signed_area(const Ring &ring)
+{
+    double area = 0;
+    for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+        area += (ring[j].x - ring[i].x) * (ring[j].y + ring[i].y);
+    }
+    return area;
+}
+
+/**
+ * Groups the rings of a polygon record into polygons
+ */
+std::vector<Polygon> assemble_polygons(std::vector<Ring> &rings)
+{
+    std::vector<Polygon> polygons;
+    std::vector<double> outer_areas;
+    std::vector<BBox> outer_boxes;
+    std::vector<Ring *> holes;
+
+    for (auto &ring : rings) {
+        if (ring.size() < 4) continue;
+        const double area = signed_area(ring);
+        if (area < 0) {
+            BBox box;
+            for (const auto &p : ring) box.expand(p.x, p.y);
+            polygons.emplace_back();
+            polygons.back().rings.push_back(std::move(ring));
+            outer_areas.push_back(-area);
+            outer_boxes.push_back(box);
+        } else {
+            holes.push_back(&ring);
+        }
+    }
+
+    for (Ring *hole : holes) {
+        const Point &p = hole->front();
+        size_t best = polygons.size();
+        for (size_t i = 0; i < polygons.size(); i++) {
+            if (outer_boxes[i].contains(p.x, p.y) && ring_contains(polygons[i].rings.front(), p) &&
+                (best == polygons.size() || outer_areas[i] < outer_areas[best])) {
+                best = i;
+            }
+        }
+
+        // A counter-clockwise ring outside every outer ring is a badly
+        // oriented outer ring
+        if (best == polygons.size()) {
+            polygons.emplace_back();
+            polygons.back().rings.push_back(std::move(*hole));
+            outer_areas.push_back(0);
+            outer_boxes.emplace_back();
+        } else {
+            polygons[best].rings.push_back(std::move(*hole));
+        }
+    }
+    return polygons;
+}
+
+/**
+ * iconv name of a code page as written in a .cpg file: ESRI writes code
+ * pages as bare numbers, "1252" for Windows-1252 and "88591" for ISO 8859-1
+ */
+std::string code_page_charset(const std::string &code_page)
+{
+    if (code_page.empty() || code_page.find_first_not_of("0123456789") != std::string::npos) {
+        return code_page;
+    }
+    if (code_page == "65001") {
+        return "UTF-8";
+    }
+    if (code_page.compare(0, 4, "8859") == 0 && code_page.size() > 4) {
+        return "ISO-8859-" + code_page.substr(4);
+    }
+    return "CP" + code_page;
+}
+
+bool is_utf8(const std::string &charset)
+{
+    std::string name;
+    for (char c : charset) {
+        if (c != '-' && c != '_') name += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    return name == "UTF8";
+}
+
+std::string trim(const char *text, size_t length)
+{
+    size_t begin = 0;
+    while (begin < length && (text[begin] == ' ' || text[begin] == '\0')) begin++;
+    while (length > begin && (text[length - 1] == ' ' || text[length - 1] == '\0')) length--;
+    return std::string(text + begin, length - begin);
+}
+
+const char *sql_column_type(const DbfField &field)
+{
+    switch (field.type) {
+        case 'N':
+        case 'F':
+            return field.decimals == 0 ? "INTEGER" : "DOUBLE";
+        case 'L':
+            return "INTEGER";
+        default:
+            return "TEXT";
+    }
+}
+
+void bind_value(sqlite3_stmt *stmt, int index, const DbfField &field, const std::string &value)
+{
+    char *end;
+    switch (field.type) {
+        case 'N':
+        case 'F':
+            if (field.decimals == 0) {
+                const long long number = std::strtoll(value.c_str(), &end, 10);
+                if (*end == '\0') {
+                    sqlite3_bind_int64(stmt, index, number);
+                    return;
+                }
+            }
+            {
+                // Overflowed fields are filled with '*'
+                const double number = std::strtod(value.c_str(), &end);
+                if (*end == '\0') {
+                    sqlite3_bind_double(stmt, index, number);
+                } else {
+                    sqlite3_bind_null(stmt, index);
+                }
+            }
+            return;
+        case 'L':
+            if (value == "T" || value == "t" || value == "Y" || value == "y") {
+                sqlite3_bind_int(stmt, index, 1);
+            } else if (value == "F" || value == "f" || value == "N" || value == "n") {
+                sqlite3_bind_int(stmt, index, 0);
+            } else {
+                sqlite3_bind_null(stmt, index);
+            }
+            return;
+        default:
+            sqlite3_bind_text(stmt, index, value.data(), value.size(), SQLITE_STATIC);
+            return;
+    }
+}
+
+} // namespace
+
+ShapefileReader::ShapefileReader(const std::string &path, const std::string &charset)
+    : path_(path), charset_(charset)
+{
+    // The .cpg file, when there is one, names the code page of the .dbf text
+    std::ifstream cpg(path + ".cpg");
+    std::string code_page;
+    if (cpg && std::getline(cpg, code_page)) {
+        code_page = trim(code_page);
+        if (!code_page.empty()) charset_ = code_page_charset(code_page);
+    }
+    if (!is_utf8(charset_)) {
+        converter_ = iconv_open("UTF-8", charset_.c_str());
+        if (converter_ == reinterpret_cast<iconv_t>(-1)) {
+            throw std::runtime_error("Unsupported character set " + charset_ + " for " + path + ".dbf");
+        }
+    }
+
+    try {
+        shp_ = map_file(path + ".shp", shp_size_);
+    } catch (...) {
+        close_converter();
+        throw;
+    }
+    try {
+        dbf_ = map_file(path + ".dbf", dbf_size_);
+    } catch (...) {
+        munmap(const_cast<uint8_t *>(shp_), shp_size_);
+        close_converter();
+        throw;
+    }
+
+    try {
+        if (shp_size_ < SHP_HEADER_SIZE || static_cast<int32_t>(load_be32(shp_)) != SHP_FILE_CODE) {
+            throw std::runtime_error("Not a shapefile: " + path + ".shp");
+        }
+        geometry_type_ = shape_geometry_type(load_le<int32_t>(shp_ + 32));
+        extent_.min_x = load_le<double>(shp_ + 36);
+        extent_.min_y = load_le<double>(shp_ + 44);
+        extent_.max_x = load_le<double>(shp_ + 52);
+        extent_.max_y = load_le<double>(shp_ + 60);
+
+        // The file length in the header is in 16 bit words
+        shp_end_ = std::min<size_t>(static_cast<size_t>(load_be32(shp_ + 24)) * 2, shp_size_);
+
+        if (dbf_size_ < DBF_HEADER_SIZE) corrupt(path + ".dbf");
+        num_records_ = load_le<uint32_t>(dbf_ + 4);
+        dbf_header_size_ = load_le<uint16_t>(dbf_ + 8);
+        dbf_record_size_ = load_le<uint16_t>(dbf_ + 10);
+        if (dbf_header_size_ > dbf_size_ ||
+            dbf_header_size_ + static_cast<uint64_t>(num_records_) * dbf_record_size_ > dbf_size_) {
+            corrupt(path + ".dbf");
+        }
+
+        // Field descriptors follow the header up to a 0x0D terminator; the
+        // first byte of every record is the deletion flag
+        size_t offset = 1;
+        for (size_t pos = DBF_HEADER_SIZE; pos + DBF_FIELD_SIZE <= dbf_header_size_ && dbf_[pos] != 0x0D;
+             pos += DBF_FIELD_SIZE) {
+            const char *name = reinterpret_cast<const char *>(dbf_ + pos);
+            DbfField field;
+            field.name = to_utf8(std::string(name, strnlen(name, 11)));
+            field.type = static_cast<char>(dbf_[pos + 11]);
+            field.length = dbf_[pos + 16];
+            field.decimals = dbf_[pos + 17];
+            fields_.push_back(field);
+            field_offsets_.push_back(offset);
+            offset += field.length;
+        }
+        if (offset > dbf_record_size_) corrupt(path + ".dbf");
+    } catch (...) {
+        munmap(const_cast<uint8_t *>(shp_), shp_size_);
+        munmap(const_cast<uint8_t *>(dbf_), dbf_size_);
+        close_converter();
+        throw;
+    }
+}
+
+ShapefileReader::~ShapefileReader()
+{
+    munmap(const_cast<uint8_t *>(shp_), shp_size_);
+    munmap(const_cast<uint8_t *>(dbf_), dbf_size_);
+    close_converter();
+}
+
+void ShapefileReader::close_converter()
+{
+    if (converter_ != reinterpret_cast<iconv_t>(-1)) {
+        iconv_close(converter_);
+        converter_ = reinterpret_cast<iconv_t>(-1);
+    }
+}
+
+std::string ShapefileReader::to_utf8(const std::string &text)
+{
+    if (converter_ == reinterpret_cast<iconv_t>(-1)) {
+        return text;
+    }
+
+    // Plain ASCII reads the same in every supported code page
+    bool ascii = true;
+    for (char c : text) {
+        if (static_cast<unsigned char>(c) >= 0x80) {
+            ascii = false;
+            break;
+        }
+    }
+    if (ascii) {
+        return text;
+    }
+
+    // A code page character takes at most 4 bytes in UTF-8
+    std::string utf8(text.size() * 4, '\0');
+    char *in = const_cast<char *>(text.data());
+    size_t in_left = text.size();
+    char *out = &utf8[0];
+    size_t out_left = utf8.size();
+    iconv(converter_, NULL, NULL, NULL, NULL);
+    if (iconv(converter_, &in, &in_left, &out, &out_left) == static_cast<size_t>(-1)) {
+        throw std::runtime_error("Invalid " + charset_ + " text in " + path_ + ".dbf");
+    }
+    utf8.resize(utf8.size() - out_left);
+    return utf8;
+}
+
+bool ShapefileReader::next(ShapefileRecord &record)
+{
+    uint64_t skipped = 0;
+    while (record_index_ < num_records_ && shp_cursor_ + 8 <= shp_end_) {
+        // Record header: big-endian record number and content length in words
+        const size_t content_size = static_cast<size_t>(load_be32(shp_ + shp_cursor_ + 4)) * 2;
+        const uint8_t *content = shp_ + shp_cursor_ + 8;
+        if (shp_cursor_ + 8 + content_size > shp_end_) corrupt(path_ + ".shp");
+        const uint8_t *row = dbf_ + dbf_header_size_ + static_cast<size_t>(record_index_) * dbf_record_size_;
+
+        shp_cursor_ += 8 + content_size;
+        record_index_++;
+
+        // Deleted records keep their place in both files, flagged by a '*'
+        if (row[0] == '*') {
+            skipped += 8 + content_size + dbf_record_size_;
+            continue;
+        }
+
+        record.geometry = Geometry();
+        read_shape(content, content_size, record.geometry);
+        read_attributes(row, record);
+        record.size = skipped + 8 + content_size + dbf_record_size_;
+        return true;
+    }
+    return false;
+}
+
+void ShapefileReader::read_shape(const uint8_t *content, size_t size, Geometry &geom) const
+{
+    if (size < 4) corrupt(path_ + ".shp");
+    const int32_t shape_type = load_le<int32_t>(content);
+    if (shape_type == SHP_NULL) return;
+
+    switch (shape_type % 10) {
+        case SHP_POINT: {
+            if (size < 20) corrupt(path_ + ".shp");
+            geom.type = GeometryType::Point;
+            geom.points.push_back({load_le<double>(content + 4), load_le<double>(content + 12)});
+            return;
+        }
+        case SHP_MULTIPOINT: {
+            // type, bbox, point count, points
+            if (size < 40) corrupt(path_ + ".shp");
+            const uint32_t num_points = load_le<uint32_t>(content + 36);
+            if (40 + static_cast<uint64_t>(num_points) * 16 > size) corrupt(path_ + ".shp");
+            geom.type = GeometryType::MultiPoint;
+            geom.points.resize(num_points);
+            std::memcpy(geom.points.data(), content + 40, num_points * sizeof(Point));
+            return;
+        }
+        case SHP_POLYLINE:
+        case SHP_POLYGON: {
+            // type, bbox, part count, point count, part starts, points
+            if (size < 44) corrupt(path_ + ".shp");
+            const uint32_t num_parts = load_le<uint32_t>(content + 36);
+            const uint32_t num_points = load_le<uint32_t>(content + 40);
+            const uint64_t points_start = 44 + static_cast<uint64_t>(num_parts) * 4;
+            if (points_start + static_cast<uint64_t>(num_points) * 16 > size) corrupt(path_ + ".shp");
+
+            std::vector<Ring> parts(num_parts);
+            for (uint32_t i = 0; i < num_parts; i++) {
+                const uint32_t from = load_le<uint32_t>(content + 44 + 4 * i);
+                const uint32_t to = i + 1 < num_parts ? load_le<uint32_t>(content + 48 + 4 * i) : num_points;
+                if (from > to || to > num_points) corrupt(path_ + ".shp");
+                parts[i].resize(to - from);
+                std::memcpy(parts[i].data(), content + points_start + 16 * static_cast<uint64_t>(from),
+                            (to - from) * sizeof(Point));
+            }
+
+            if (shape_type % 10 == SHP_POLYLINE) {
+                geom.type = GeometryType::MultiLineString;
+                geom.lines = std::move(parts);
+            } else {
+                geom.type = GeometryType::MultiPolygon;
+                geom.polygons = assemble_polygons(parts);
+            }
+            return;
+        }
+        default:
+            throw std::runtime_error("Unsupported shape type " + std::to_string(shape_type) + " in " + path_ + ".shp");
+    }
+}
+
+void ShapefileReader::read_attributes(const uint8_t *row, ShapefileRecord &record)
+{
+    record.values.resize(fields_.size());
+    record.nulls.resize(fields_.size());
+    for (size_t i = 0; i < fields_.size(); i++) {
+        record.values[i] = to_utf8(trim(reinterpret_cast<const char *>(row + field_offsets_[i]), fields_[i].length));
+        record.nulls[i] = record.values[i].empty();
+    }
+}
+
+int import_shapefile(sqlite3 *db_handle, const std::string &shp_path, const std::string &table_name, int srid,
+                     const BlobEncoding &encoding, ImportStats *stats, int target_srid, ThreadPool *pool,
+                     const std::string &charset)
+{
+    std::string sql_cmd;
+    int ret;
+    char *err_msg = NULL;
+    sqlite3_stmt *stmt = NULL;
+
+    const bool reproject = target_srid > 0 && target_srid != srid;
+    const int table_srid = reproject ? target_srid : srid;
+
+    try {
+        // One PROJ context per worker, each caching its transformation
+        std::unique_ptr<ThreadPool> own_pool;
+        std::vector<std::unique_ptr<ProjContext>> contexts;
+        if (reproject) {
+            if (pool == NULL) {
+                own_pool.reset(new ThreadPool(1));
+                pool = own_pool.get();
+            }
+            for (unsigned i = 0; i < pool->size(); i++) {
+                contexts.emplace_back(new ProjContext());
+            }
+        }
+
+        ShapefileReader reader(shp_path, charset);
+        if (stats != NULL) {
+            stats->set_total_bytes(reader.total_bytes());
+        }
+
+        // Create the table the way ImportSHP would, and fill it, in a
+        // single transaction
+        ret = sqlite3_exec(db_handle, "BEGIN TRANSACTION;", NULL, NULL, &err_msg);
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error starting transaction: " << err_msg << std::endl;
+            sqlite3_free(err_msg);
+            return 1;
+        }
+
+        sql_cmd = "CREATE TABLE " + quote_identifier(table_name) + " (PK_UID INTEGER PRIMARY KEY AUTOINCREMENT";
+        std::string insert_columns;
+        std::string insert_values;
+        for (const auto &field : reader.fields()) {
+            sql_cmd += ", " + quote_identifier(field.name) + " " + sql_column_type(field);
+            insert_columns += quote_identifier(field.name) + ", ";
+            insert_values += "?, ";
+        }
+        sql_cmd += ")";
+
+        ret = sqlite3_exec(db_handle, sql_cmd.c_str(), NULL, NULL, &err_msg);
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error creating table: " << err_msg << std::endl;
+            sqlite3_free(err_msg);
+            sqlite3_exec(db_handle, "ROLLBACK;", NULL, NULL, NULL);
+            return 1;
+        }
+
+        // AddGeometryColumn() returns 0 instead of failing, e.g. on an SRID
+        // missing from spatial_ref_sys
+        int added = 0;
+        sql_cmd = "SELECT AddGeometryColumn(" + quote_literal(table_name) + ", 'Geometry', " +
+            std::to_string(table_srid) + ", " + quote_literal(geometry_type_name(reader.geometry_type())) + ", 'XY')";
+        if (!query_int(db_handle, sql_cmd, added) || added != 1) {
+            std::cerr << "Error adding geometry column to " << table_name << std::endl;
+            sqlite3_exec(db_handle, "ROLLBACK;", NULL, NULL, NULL);
+            return 1;
+        }
+
+        sql_cmd = "INSERT INTO " + quote_identifier(table_name) + " (" + insert_columns +
+            "Geometry) VALUES (" + insert_values + "?)";
+        ret = sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL);
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+            sqlite3_exec(db_handle, "ROLLBACK;", NULL, NULL, NULL);
+            return 1;
+        }
+
+        const std::vector<DbfField> &fields = reader.fields();
+        const int geometry_index = static_cast<int>(fields.size()) + 1;
+        std::vector<ShapefileRecord> batch(IMPORT_BATCH_SIZE);
+        std::vector<uint8_t> blob;
+        uint64_t count = 0;
+
+        while (true) {
+            ImportStats::Timer parse_timer(stats, ImportStats::Parse);
+            size_t batch_count = 0;
+            while (batch_count < batch.size() && reader.next(batch[batch_count])) {
+                batch[batch_count].geometry.srid = srid;
+                batch_count++;
+            }
+            parse_timer.stop();
+            if (batch_count == 0) break;
+
+            if (reproject) {
+                ImportStats::Timer reproject_timer(stats, ImportStats::Reproject);
+                pool->parallel_for(batch_count, [&](size_t index, unsigned worker) {
+                    Geometry &geom = batch[index].geometry;
+                    if (geom.type == GeometryType::Unknown) return;
+                    if (!contexts[worker]->transform(geom, target_srid)) {
+                        throw std::runtime_error("cannot reproject record " + std::to_string(count + index) +
+                                                 " to EPSG:" + std::to_string(target_srid) + ": " +
+                                                 contexts[worker]->last_error());
+                    }
+                });
+            }
+
+            for (size_t b = 0; b < batch_count; b++) {
+                ShapefileRecord &record = batch[b];
+
+                ImportStats::Timer encode_timer(stats, ImportStats::Encode);
+                quantize_geometry(record.geometry, encoding.precision);
+                const bool has_geometry = record.geometry.type != GeometryType::Unknown;
+                if (has_geometry) {
+                    promote_to_multi(record.geometry);
+                    blob = encode_spatialite_blob(record.geometry, encoding.compressed);
+                }
+                encode_timer.stop();
+
+                ImportStats::Timer insert_timer(stats, ImportStats::Insert);
+                for (size_t i = 0; i < fields.size(); i++) {
+                    if (record.nulls[i]) {
+                        sqlite3_bind_null(stmt, static_cast<int>(i) + 1);
+                    } else {
+                        bind_value(stmt, static_cast<int>(i) + 1, fields[i], record.values[i]);
+                    }
+                }
+                if (has_geometry) {
+                    sqlite3_bind_blob(stmt, geometry_index, blob.data(), blob.size(), SQLITE_STATIC);
+                } else {
+                    sqlite3_bind_null(stmt, geometry_index);
+                }
+
+                ret = sqlite3_step(stmt);
+                if (ret != SQLITE_DONE) {
+                    std::cerr << "Error inserting record " << count << ": " << sqlite3_errmsg(db_handle) << std::endl;
+                    sqlite3_finalize(stmt);
+                    sqlite3_exec(db_handle, "ROLLBACK;", NULL, NULL, NULL);
+                    return 1;
+                }
+                sqlite3_reset(stmt);
+                insert_timer.stop();
+                count++;
+
+                if (stats != NULL) {
+                    stats->add_record(record.size, record.geometry.num_vertices());
+                    stats->progress();
+                }
+            }
+        }
+        sqlite3_finalize(stmt);
+        stmt = NULL;
+
+        ImportStats::Timer commit_timer(stats, ImportStats::Insert);
+        ret = sqlite3_exec(db_handle, "COMMIT;", NULL, NULL, &err_msg);
+        if (ret != SQLITE_OK) {
+            std::cerr << "Error committing transaction: " << err_msg << std::endl;
+            sqlite3_free(err_msg);
+            return 1;
+        }
+        commit_timer.stop();
+
+        std::cout << "Imported " << count << " records into " << table_name << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << "Error importing shapefile: " << e.what() << std::endl;
+        sqlite3_finalize(stmt);
+        sqlite3_exec(db_handle, "ROLLBACK;", NULL, NULL, NULL);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,142 @@
+#ifndef SHAPEFILE_H
+#define SHAPEFILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <iconv.h>
+#include <sqlite3.h>
+
+#include "geometry.h"
+
+class ImportStats;
+class ThreadPool;
+
+/**
+ * A dBase field of the .dbf attribute table
+ */
+struct DbfField {
+    std::string name;
+    char type;          // 'C' character, 'N'/'F' numeric, 'D' date, 'L' logical
+    uint8_t length;
+    uint8_t decimals;
+};
+
+struct ShapefileRecord {
+    Geometry geometry;                 // type Unknown for null shapes
+    std::vector<std::string> values;   // trimmed field values, in field order
+    std::vector<bool> nulls;           // true where the field is blank
+    uint64_t size = 0;                 // bytes taken by the record in the .shp and .dbf files
+};
+
+/**
+ * Reader for ESRI shapefiles (.shp geometries and .dbf attributes)
+ *
+ * Both files are memory mapped and read sequentially. Points, multipoints,
+ * polylines and polygons are supported, Z and M values are dropped. The
+ * rings of a polygon record are grouped into polygons: clockwise rings are
+ * outer rings, and every counter-clockwise ring becomes a hole of the
+ * smallest outer ring containing it.
+ *
+ * Field names and values are converted to UTF-8 from the code page named
+ * by the .cpg file next to the .shp file, or from the given character set
+ * when there is none.
+ *
+ * The constructor throws std::runtime_error if the files cannot be mapped
+ * or are not valid; next() throws std::runtime_error on a corrupt record.
+ */
+class ShapefileReader {
+public:
+    /**
+     * @param path shapefile path without extension, as given to ImportSHP
+     * @param charset iconv name of the character set of the .dbf text,
+     *        used when there is no .cpg file
+     */
+    explicit ShapefileReader(const std::string &path, const std::string &charset = "UTF-8");
+    ~ShapefileReader();
+
+    ShapefileReader(const ShapefileReader &) = delete;
+    ShapefileReader &operator=(const ShapefileReader &) = delete;
+
+    GeometryType geometry_type() const { return geometry_type_; }
+    const std::vector<DbfField> &fields() const { return fields_; }
+    uint32_t num_records() const { return num_records_; }
+    const BBox &extent() const { return extent_; }
+
+    /**
+     * Character set the .dbf text is read in
+     */
+    const std::string &charset() const { return charset_; }
+
+    /**
+     * Size in bytes of the .shp and .dbf files together
+     */
+    uint64_t total_bytes() const { return shp_size_ + dbf_size_; }
+
+    /**
+     * Reads the next record, skipping the records marked deleted in the
+     * .dbf file
+     *
+     * @param record decoded record
+     * @return true if a record was read, false after the last one
+     */
+    bool next(ShapefileRecord &record);
+
+private:
+    void read_shape(const uint8_t *content, size_t size, Geometry &geom) const;
+    void read_attributes(const uint8_t *row, ShapefileRecord &record);
+    std::string to_utf8(const std::string &text);
+    void close_converter();
+
+    std::string path_;
+    std::string charset_;
+    iconv_t converter_ = reinterpret_cast<iconv_t>(-1);   // none when the text is UTF-8
+    const uint8_t *shp_ = nullptr;
+    size_t shp_size_ = 0;
+    size_t shp_end_ = 0;       // end of the records, from the file header
+    const uint8_t *dbf_ = nullptr;
+    size_t dbf_size_ = 0;
+
+    GeometryType geometry_type_ = GeometryType::Unknown;
+    BBox extent_;
+    std::vector<DbfField> fields_;
+    std::vector<size_t> field_offsets_;
+    uint32_t num_records_ = 0;
+    uint16_t dbf_header_size_ = 0;
+    uint16_t dbf_record_size_ = 0;
+
+    size_t shp_cursor_ = 100;  // offset of the next .shp record
+    uint32_t record_index_ = 0;
+};
+
+/**
+ * Imports a shapefile into a new SpatiaLite table
+ *
+ * @param db_handle handle to the database connection
+ * @param shp_path shapefile path without extension
+ * @param table_name name of the table to create
+ * @param srid SRID of the shapefile (see shapefile_srid())
+ * @param encoding how geometries are stored (compression, quantization)
+ * @param stats throughput counters to update (may be NULL)
+ * @param target_srid SRID to reproject the geometries to, 0 to keep srid
+ * @param pool threads to reproject on (may be NULL: the calling thread)
+ * @param charset character set of the .dbf text when there is no .cpg
+ *        file, as ImportSHP takes it
+ * @return 0 on success, 1 on failure
+ *
+ * The table is laid out like the ones ImportSHP creates: a PK_UID primary
+ * key, one column per .dbf field and a "Geometry" column, with polygons
+ * stored as MULTIPOLYGON and polylines as MULTILINESTRING. Attribute text
+ * is stored as UTF-8, converted from the code page of the .cpg file, or
+ * from charset.
+ *
+ * When reprojecting, records are read in batches and each worker runs
+ * PROJ with its own context; the geometry column is registered with the
+ * target SRID, and quantization applies to the reprojected coordinates.
+ */
+int import_shapefile(sqlite3 *db_handle, const std::string &shp_path, const std::string &table_name, int srid,
+                     const BlobEncoding &encoding = BlobEncoding(), ImportStats *stats = NULL, int target_srid = 0,
+                     ThreadPool *pool = NULL, const std::string &charset = "UTF-8");
+
+#endif // SHAPEFILE_H
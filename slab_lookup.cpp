@@ -0,0 +1,153 @@
+#include "slab_lookup.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "sql_util.h"
+
+SlabLookup::SlabLookup(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                       const std::string &label_column)
+{
+    sqlite3_stmt *stmt;
+    std::string sql_cmd = "SELECT " + quote_identifier(label_column) + ", " + quote_identifier(geometry_column) +
+        " FROM " + quote_identifier(table_name) + " WHERE " + quote_identifier(geometry_column) + " IS NOT NULL";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        throw std::runtime_error("Cannot read " + table_name + ": " + sqlite3_errmsg(db_handle));
+    }
+
+    // One leaf per feature
+    std::vector<NodeItem> items;
+    BBox extent;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Geometry geom;
+        const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 1));
+        if (!decode_spatialite_blob(blob, sqlite3_column_bytes(stmt, 1), geom)) continue;
+
+        Feature feature;
+        const unsigned char *label = sqlite3_column_text(stmt, 0);
+        feature.label = label != NULL ? reinterpret_cast<const char *>(label) : "";
+
+        // Every ring of every part: the even-odd rule handles the holes and
+        // the islands alike. Horizontal edges never cross a slab.
+        BBox box;
+        for (const auto &polygon : geom.polygons) {
+            for (const Ring &ring : polygon.rings) {
+                for (size_t i = 1; i < ring.size(); i++) {
+                    const Point &a = ring[i - 1];
+                    const Point &b = ring[i];
+                    box.expand(a.x, a.y);
+                    if (a.y == b.y) continue;
+                    feature.edges.push_back(a.y < b.y ? Edge{a, b} : Edge{b, a});
+                }
+            }
+        }
+        if (feature.edges.empty()) continue;
+
+        decompose(feature);
+        extent.expand(box);
+        items.push_back(NodeItem{box.min_x, box.min_y, box.max_x, box.max_y, features_.size()});
+        features_.push_back(std::move(feature));
+    }
+    sqlite3_finalize(stmt);
+
+    hilbert_sort(items, extent);
+    index_ = PackedRTree(std::move(items));
+}
+
+void SlabLookup::decompose(Feature &feature)
+{
+    std::vector<double> &ys = feature.slab_y;
+    for (const Edge &edge : feature.edges) {
+        ys.push_back(edge.a.y);
+        ys.push_back(edge.b.y);
+    }
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+    const size_t num_slabs = ys.size() - 1;
+    auto slab_of = [&](double y) {
+        return static_cast<size_t>(std::lower_bound(ys.begin(), ys.end(), y) - ys.begin());
+    };
+
+    // Count the edges of each slab, then fill them in place
+    std::vector<uint32_t> &offsets = feature.slab_offsets;
+    offsets.assign(num_slabs + 1, 0);
+    for (const Edge &edge : feature.edges) {
+        for (size_t s = slab_of(edge.a.y), end = slab_of(edge.b.y); s < end; s++) {
+            offsets[s + 1]++;
+        }
+    }
+    for (size_t s = 0; s < num_slabs; s++) {
+        offsets[s + 1] += offsets[s];
+    }
+
+    std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+    feature.slab_edges.resize(offsets.back());
+    for (uint32_t e = 0; e < feature.edges.size(); e++) {
+        const Edge &edge = feature.edges[e];
+        for (size_t s = slab_of(edge.a.y), end = slab_of(edge.b.y); s < end; s++) {
+            feature.slab_edges[next[s]++] = e;
+        }
+    }
+
+    // Edges do not cross inside a slab, so their order at mid-height holds
+    // for the whole slab
+    for (size_t s = 0; s < num_slabs; s++) {
+        const double y = (ys[s] + ys[s + 1]) / 2;
+        std::sort(feature.slab_edges.begin() + offsets[s], feature.slab_edges.begin() + offsets[s + 1],
+                  [&](uint32_t a, uint32_t b) { return feature.edges[a].x_at(y) < feature.edges[b].x_at(y); });
+    }
+}
+
+bool SlabLookup::contains(const Feature &feature, const Point &p)
+{
+    // Slab [slab_y[s], slab_y[s + 1]) holding p.y
+    const std::vector<double> &ys = feature.slab_y;
+    if (!(p.y >= ys.front() && p.y < ys.back())) return false;
+    const size_t s = static_cast<size_t>(std::upper_bound(ys.begin(), ys.end(), p.y) - ys.begin()) - 1;
+
+    // Number of edges right of the point
+    const auto first = feature.slab_edges.begin() + feature.slab_offsets[s];
+    const auto last = feature.slab_edges.begin() + feature.slab_offsets[s + 1];
+    const auto right = std::upper_bound(first, last, p.x, [&](double x, uint32_t e) {
+        return x < feature.edges[e].x_at(p.y);
+    });
+    return (last - right) % 2 == 1;
+}
+
+int64_t SlabLookup::find(const Point &p, LookupStats *stats) const
+{
+    if (stats != NULL) stats->lookups++;
+
+    BBox box;
+    box.expand(p.x, p.y);
+
+    int64_t found = -1;
+    index_.visit(box, [&](const NodeItem &leaf, uint64_t) {
+        if (stats != NULL) stats->slabs_searched++;
+        if (contains(features_[leaf.offset], p)) {
+            found = static_cast<int64_t>(leaf.offset);
+            return false;
+        }
+        return true;
+    });
+    return found;
+}
+
+size_t SlabLookup::num_slabs() const
+{
+    size_t total = 0;
+    for (const Feature &feature : features_) {
+        total += feature.slab_y.size() - 1;
+    }
+    return total;
+}
+
+size_t SlabLookup::num_slab_edges() const
+{
+    size_t total = 0;
+    for (const Feature &feature : features_) {
+        total += feature.slab_edges.size();
+    }
+    return total;
+}
@@ -0,0 +1,95 @@
+#ifndef SLAB_LOOKUP_H
+#define SLAB_LOOKUP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "geometry.h"
+#include "packed_rtree.h"
+#include "state_lookup.h"
+
+/**
+ * In-memory point-in-polygon lookup over a slab decomposition of each
+ * feature
+ *
+ * The distinct y coordinates of the vertices of a feature cut it into
+ * horizontal slabs. No vertex lies strictly inside a slab, so the edges
+ * crossing it do not cross each other there and can be sorted by x once
+ * and for all. A lookup finds the slab of the point with a binary search
+ * on y and the number of edges right of the point with a binary search
+ * on x; the point is inside when that number is odd. Both searches are
+ * O(log n) in the number of vertices, whatever the shape of the feature,
+ * at the price of storing each edge in every slab it spans.
+ *
+ * The lookup is immutable once built and can be shared between threads.
+ */
+class SlabLookup {
+public:
+    /**
+     * Loads the polygons of a table and decomposes each feature into slabs
+     *
+     * @param db_handle handle to the database connection
+     * @param table_name table holding the polygons
+     * @param geometry_column geometry column of the table
+     * @param label_column column returned for the matching feature
+     *
+     * Throws std::runtime_error if the table cannot be read.
+     */
+    SlabLookup(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+               const std::string &label_column);
+
+    /**
+     * Finds the feature containing a point
+     *
+     * @param p point, in the SRID of the table
+     * @param stats counters to update (may be NULL)
+     * @return index of the feature, -1 if no feature contains the point
+     */
+    int64_t find(const Point &p, LookupStats *stats = NULL) const;
+
+    /**
+     * @param feature feature index returned by find()
+     * @return value of the label column for the feature
+     */
+    const std::string &label(int64_t feature) const { return features_[feature].label; }
+
+    size_t num_features() const { return features_.size(); }
+    BBox extent() const { return index_.extent(); }
+
+    /**
+     * @return total number of slabs of all the features
+     */
+    size_t num_slabs() const;
+
+    /**
+     * @return total number of edge entries stored in the slabs
+     */
+    size_t num_slab_edges() const;
+
+private:
+    struct Edge {
+        Point a;   // lower end
+        Point b;   // upper end
+
+        double x_at(double y) const { return a.x + (b.x - a.x) * (y - a.y) / (b.y - a.y); }
+    };
+
+    struct Feature {
+        std::string label;
+        std::vector<Edge> edges;
+        std::vector<double> slab_y;           // lower bound of each slab, then the top of the last one
+        std::vector<uint32_t> slab_offsets;   // first entry of each slab in slab_edges, then the end
+        std::vector<uint32_t> slab_edges;     // edge indexes, slab by slab, sorted by x
+    };
+
+    static void decompose(Feature &feature);
+    static bool contains(const Feature &feature, const Point &p);
+
+    std::vector<Feature> features_;
+    PackedRTree index_;   // one leaf per feature, offsets are indexes into features_
+};
+
+#endif // SLAB_LOOKUP_H
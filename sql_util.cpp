@@ -0,0 +1,98 @@
+#include "sql_util.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+
+std::string quote_identifier(const std::string &name)
+{
+    std::string quoted = "\"";
+    for (char c : name) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+std::string quote_literal(const std::string &text)
+{
+    std::string quoted = "'";
+    for (char c : text) {
+        if (c == '\'') quoted += '\'';
+        quoted += c;
+    }
+    return quoted + "'";
+}
+
+int exec(sqlite3 *db_handle, const std::string &sql_cmd, const char *what)
+{
+    char *err_msg = NULL;
+    int ret = sqlite3_exec(db_handle, sql_cmd.c_str(), NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+        std::cerr << "Error " << what << ": " << err_msg << std::endl;
+        sqlite3_free(err_msg);
+        return 1;
+    }
+    return 0;
+}
+
+bool query_text(sqlite3 *db_handle, const std::string &sql_cmd, std::string &value)
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return false;
+    }
+
+    bool found = (sqlite3_step(stmt) == SQLITE_ROW);
+    if (found) {
+        const unsigned char *text = sqlite3_column_text(stmt, 0);
+        value = text != NULL ? reinterpret_cast<const char *>(text) : "";
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+bool query_int(sqlite3 *db_handle, const std::string &sql_cmd, int &value)
+{
+    std::string text;
+    if (!query_text(db_handle, sql_cmd, text)) return false;
+
+    char *end;
+    errno = 0;
+    const long number = std::strtol(text.c_str(), &end, 10);
+    if (end == text.c_str() || *end != '\0' || errno == ERANGE || number < INT_MIN || number > INT_MAX) {
+        std::cerr << "Unexpected result \"" << text << "\" of " << sql_cmd << std::endl;
+        return false;
+    }
+    value = static_cast<int>(number);
+    return true;
+}
+
+int add_column(sqlite3 *db_handle, const std::string &table, const std::string &column, const char *type)
+{
+    sqlite3_stmt *stmt;
+    bool exists = false;
+    std::string sql_cmd = "PRAGMA table_info(" + table + ")";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *name = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+        exists = exists || sqlite3_stricmp(name, column.c_str()) == 0;
+    }
+    sqlite3_finalize(stmt);
+
+    if (exists) return 0;
+    return exec(db_handle, "ALTER TABLE " + table + " ADD COLUMN " + column + " " + type, "adding column");
+}
+
+std::string trim(const std::string &text)
+{
+    const size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) return std::string();
+    const size_t last = text.find_last_not_of(" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
@@ -0,0 +1,71 @@
+#ifndef SQL_UTIL_H
+#define SQL_UTIL_H
+
+#include <string>
+
+#include <sqlite3.h>
+
+/**
+ * Quotes a table or column name for SQL, doubling embedded quotes
+ *
+ * @param name identifier to quote
+ * @return the identifier between double quotes
+ */
+std::string quote_identifier(const std::string &name);
+
+/**
+ * Quotes a string literal for SQL, doubling embedded quotes
+ *
+ * @param text text to quote
+ * @return the text between single quotes
+ */
+std::string quote_literal(const std::string &text);
+
+/**
+ * Runs SQL statements that return no rows, reporting any error on stderr
+ *
+ * @param db_handle database connection
+ * @param sql_cmd statements to run
+ * @param what what the statements do, for the error message
+ * @return 0 on success, 1 on failure
+ */
+int exec(sqlite3 *db_handle, const std::string &sql_cmd, const char *what);
+
+/**
+ * Runs a statement and returns the first column of its first row as text
+ *
+ * @param db_handle database connection
+ * @param sql_cmd statement to run
+ * @param value text of the first column (empty if NULL)
+ * @return true if the statement returned a row
+ */
+bool query_text(sqlite3 *db_handle, const std::string &sql_cmd, std::string &value);
+
+/**
+ * Runs a statement and returns the first column of its first row as an
+ * integer, reporting a missing row or a non-integer result on stderr
+ *
+ * @param db_handle database connection
+ * @param sql_cmd statement to run
+ * @param value integer in the first column
+ * @return true if the statement returned an integer
+ */
+bool query_int(sqlite3 *db_handle, const std::string &sql_cmd, int &value);
+
+/**
+ * Adds a column to a table unless it already exists
+ *
+ * @param db_handle database connection
+ * @param table quoted table name
+ * @param column column name
+ * @param type SQL type of the column
+ * @return 0 on success, 1 on failure
+ */
+int add_column(sqlite3 *db_handle, const std::string &table, const std::string &column, const char *type);
+
+/**
+ * @return the text without leading and trailing blanks and line breaks
+ */
+std::string trim(const std::string &text);
+
+#endif // SQL_UTIL_H
@@ -0,0 +1,139 @@
+#include "state_lookup.h"
+
+#include <stdexcept>
+
+#include "sql_util.h"
+
+bool polygon_contains(const Polygon &polygon, const Point &p, LookupStats *stats)
+{
+    if (polygon.rings.empty()) return false;
+
+    if (stats != NULL) stats->rings_tested++;
+    if (!ring_contains(polygon.rings[0], p)) return false;
+
+    for (size_t i = 1; i < polygon.rings.size(); i++) {
+        if (stats != NULL) stats->rings_tested++;
+        if (ring_contains(polygon.rings[i], p)) return false;
+    }
+    return true;
+}
+
+StateLookup::StateLookup(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                         const std::string &label_column, uint32_t grid_size)
+{
+    sqlite3_stmt *stmt;
+    std::string sql_cmd = "SELECT " + quote_identifier(label_column) + ", " + quote_identifier(geometry_column) +
+        " FROM " + quote_identifier(table_name) + " WHERE " + quote_identifier(geometry_column) + " IS NOT NULL";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        throw std::runtime_error("Cannot read " + table_name + ": " + sqlite3_errmsg(db_handle));
+    }
+
+    // One leaf per polygon part
+    std::vector<NodeItem> items;
+    BBox extent;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Geometry geom;
+        const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 1));
+        if (!decode_spatialite_blob(blob, sqlite3_column_bytes(stmt, 1), geom)) continue;
+
+        const unsigned char *label = sqlite3_column_text(stmt, 0);
+        const int64_t feature = static_cast<int64_t>(labels_.size());
+        labels_.push_back(label != NULL ? reinterpret_cast<const char *>(label) : "");
+
+        for (auto &polygon : geom.polygons) {
+            if (polygon.rings.empty() || polygon.rings[0].size() < 4) continue;
+
+            BBox box;
+            for (const Point &p : polygon.rings[0]) {
+                box.expand(p.x, p.y);
+            }
+            extent.expand(box);
+            items.push_back(NodeItem{box.min_x, box.min_y, box.max_x, box.max_y, parts_.size()});
+            parts_.push_back(Part{feature, std::move(polygon)});
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    hilbert_sort(items, extent);
+    index_ = PackedRTree(std::move(items));
+
+    // Rasterize the borders, then classify the regions between them
+    grid_ = CoverageGrid(extent, grid_size);
+    if (!grid_.empty()) {
+        for (const Part &part : parts_) {
+            for (const Ring &ring : part.polygon.rings) {
+                for (size_t i = 1; i < ring.size(); i++) {
+                    grid_.mark_segment(ring[i - 1], ring[i]);
+                }
+            }
+        }
+        grid_.fill([this](const Point &center) { return find_in_parts(center, NULL); });
+    }
+}
+
+int64_t StateLookup::find(const Point &p, LookupStats *stats) const
+{
+    if (stats != NULL) stats->lookups++;
+    if (grid_.empty()) return find_in_parts(p, stats);
+
+    const int32_t value = grid_.value(p);
+    if (value != CoverageGrid::MIXED) {
+        if (stats != NULL) stats->grid_hits++;
+        return value >= 0 ? value : -1;
+    }
+
+    // Sub-cell of the point; the top bit marks sub-cells known to hold an edge
+    const double sub_width = grid_.cell_width() / SUBDIVISIONS;
+    const double sub_height = grid_.cell_height() / SUBDIVISIONS;
+    const uint64_t sub_col = static_cast<uint64_t>((p.x - grid_.extent().min_x) / sub_width);
+    const uint64_t sub_row = static_cast<uint64_t>((p.y - grid_.extent().min_y) / sub_height);
+    const uint64_t key = (sub_row << 32) | sub_col;
+    const uint64_t has_edges = 1ULL << 63;
+
+    if (negative_cache_.contains(key)) {
+        if (stats != NULL) stats->cache_hits++;
+        return -1;
+    }
+
+    const int64_t found = find_in_parts(p, stats);
+    if (found < 0 && !negative_cache_.contains(key | has_edges)) {
+        // With no edge in it, the whole sub-cell is as empty as the point
+        BBox box;
+        box.expand(grid_.extent().min_x + sub_col * sub_width, grid_.extent().min_y + sub_row * sub_height);
+        box.expand(box.min_x + sub_width, box.min_y + sub_height);
+        negative_cache_.insert(edges_cross(box) ? key | has_edges : key);
+    }
+    return found;
+}
+
+bool StateLookup::edges_cross(const BBox &box) const
+{
+    bool crossed = false;
+    index_.visit(box, [&](const NodeItem &leaf, uint64_t) {
+        for (const Ring &ring : parts_[leaf.offset].polygon.rings) {
+            for (size_t i = 1; i < ring.size() && !crossed; i++) {
+                crossed = segment_intersects_box(ring[i - 1], ring[i], box);
+            }
+        }
+        return !crossed;
+    });
+    return crossed;
+}
+
+int64_t StateLookup::find_in_parts(const Point &p, LookupStats *stats) const
+{
+    BBox box;
+    box.expand(p.x, p.y);
+
+    int64_t found = -1;
+    index_.visit(box, [&](const NodeItem &leaf, uint64_t) {
+        const Part &part = parts_[leaf.offset];
+        if (stats != NULL) stats->parts_tested++;
+        if (polygon_contains(part.polygon, p, stats)) {
+            found = part.feature;
+            return false;
+        }
+        return true;
+    });
+    return found;
+}
@@ -0,0 +1,110 @@
+#ifndef STATE_LOOKUP_H
+#define STATE_LOOKUP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "coverage_grid.h"
+#include "geometry.h"
+#include "packed_rtree.h"
+
+/**
+ * Work done by lookups, to compare engines and indexes
+ */
+struct LookupStats {
+    uint64_t lookups = 0;        // points looked up
+    uint64_t grid_hits = 0;      // answered by the coverage grid alone
+    uint64_t cache_hits = 0;     // rejected by the negative cache
+    uint64_t parts_tested = 0;   // polygon parts whose bbox matched the point
+    uint64_t rings_tested = 0;   // rings traversed by the point-in-polygon test
+    uint64_t triangles_tested = 0;   // triangles whose bbox matched the point
+    uint64_t slabs_searched = 0;     // features whose slabs were binary searched
+};
+
+/**
+ * In-memory point-in-polygon lookup over a polygon table
+ *
+ * Every polygon part of every feature is indexed on its own, with its own
+ * bounding box, in a packed Hilbert R-tree. A lookup only runs the ring
+ * test on the parts whose bbox contains the point: a point in the ocean
+ * between Pernambuco and Fernando de Noronha, inside the state's overall
+ * MBR but outside the bbox of each of its parts, is rejected by the tree
+ * without traversing any ring.
+ *
+ * In front of the tree, a coverage grid answers most points in O(1):
+ * points outside the dataset extent, in cells with no feature or in cells
+ * inside a single feature (see CoverageGrid). Points in cells crossed by
+ * a border go to the tree; when they miss, the sub-cell around them is
+ * checked once for ring edges, and if it has none it goes to a negative
+ * cache, so repeated bad or offshore GPS fixes next to the coast are
+ * rejected without a ring test either.
+ *
+ * The lookup can be shared between threads: the negative cache is the
+ * only state find() updates, and it is locked per shard.
+ */
+class StateLookup {
+public:
+    /**
+     * Loads the polygons of a table
+     *
+     * @param db_handle handle to the database connection
+     * @param table_name table holding the polygons
+     * @param geometry_column geometry column of the table
+     * @param label_column column returned for the matching feature
+     * @param grid_size cells per side of the coverage grid, 0 for none
+     *
+     * Throws std::runtime_error if the table cannot be read.
+     */
+    StateLookup(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                const std::string &label_column, uint32_t grid_size = 512);
+
+    /**
+     * Finds the feature containing a point
+     *
+     * @param p point, in the SRID of the table
+     * @param stats counters to update (may be NULL)
+     * @return index of the feature, -1 if no feature contains the point
+     */
+    int64_t find(const Point &p, LookupStats *stats = NULL) const;
+
+    /**
+     * @param feature feature index returned by find()
+     * @return value of the label column for the feature
+     */
+    const std::string &label(int64_t feature) const { return labels_[feature]; }
+
+    size_t num_features() const { return labels_.size(); }
+    size_t num_parts() const { return parts_.size(); }
+    const CoverageGrid &grid() const { return grid_; }
+    size_t negative_cache_size() const { return negative_cache_.size(); }
+    BBox extent() const { return index_.extent(); }
+
+private:
+    struct Part {
+        int64_t feature;
+        Polygon polygon;
+    };
+
+    // Negative cache sub-cells per grid cell side
+    static const uint32_t SUBDIVISIONS = 16;
+
+    int64_t find_in_parts(const Point &p, LookupStats *stats) const;
+    bool edges_cross(const BBox &box) const;
+
+    std::vector<std::string> labels_;
+    std::vector<Part> parts_;
+    PackedRTree index_;   // leaf offsets are indexes into parts_
+    CoverageGrid grid_;
+    mutable NegativeCache negative_cache_;
+};
+
+/**
+ * @return true if the point is inside the exterior ring of the polygon
+ *         and outside all of its holes
+ */
+bool polygon_contains(const Polygon &polygon, const Point &p, LookupStats *stats = NULL);
+
+#endif // STATE_LOOKUP_H
@@ -0,0 +1,1882 @@
+/**
+ * Checks of the parsers and of the in-memory indexes and algorithms
+ * against brute force: every index must return what a scan of all the
+ * data returns.
+ *
+ * Run by ctest; exits with 1 if any check fails.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <sqlite3.h>
+
+#include "adjacency.h"
+#include "border_index.h"
+#include "coverage_grid.h"
+#include "density_clustering.h"
+#include "display_query.h"
+#include "distance_join.h"
+#include "geo_distance.h"
+#include "geojson.h"
+#include "geometry.h"
+#include "geos_context.h"
+#include "import_registry.h"
+#include "kernel_density.h"
+#include "nearest_site.h"
+#include "packed_rtree.h"
+#include "result_cache.h"
+#include "shapefile.h"
+#include "slab_lookup.h"
+#include "sql_util.h"
+#include "state_lookup.h"
+#include "thread_pool.h"
+#include "topology.h"
+#include "trajectory.h"
+#include "triangle_lookup.h"
+#include "triangulation.h"
+#include "validation.h"
+#include "viewport_cursor.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char *what, const char *file, int line)
+{
+    if (!ok) {
+        failures++;
+        std::cerr << file << ":" << line << ": check failed: " << what << std::endl;
+    }
+}
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+/**
+ * Writes a scratch file in the working directory
+ */
+std::string write_file(const std::string &name, const std::string &content)
+{
+    const std::string path = "spatial_tests_" + name;
+    std::ofstream file(path, std::ios::binary);
+    file << content;
+    return path;
+}
+
+void test_packed_rtree()
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> coordinate(0, 1000);
+    std::uniform_real_distribution<double> size(0, 20);
+
+    std::vector<NodeItem> items;
+    BBox extent;
+    for (uint64_t i = 0; i < 5000; i++) {
+        const double x = coordinate(random);
+        const double y = coordinate(random);
+        items.push_back(NodeItem{x, y, x + size(random), y + size(random), i});
+        extent.expand(items.back().min_x, items.back().min_y);
+        extent.expand(items.back().max_x, items.back().max_y);
+    }
+    const std::vector<NodeItem> all = items;
+    hilbert_sort(items, extent);
+    const PackedRTree tree(items);
+
+    for (int query = 0; query < 200; query++) {
+        BBox box;
+        box.expand(coordinate(random), coordinate(random));
+        box.expand(box.min_x + size(random) * 5, box.min_y + size(random) * 5);
+
+        std::set<uint64_t> found;
+        tree.visit(box, [&](const NodeItem &leaf, uint64_t) {
+            found.insert(leaf.offset);
+            return true;
+        });
+        std::set<uint64_t> expected;
+        for (const NodeItem &item : all) {
+            if (item.intersects(box)) expected.insert(item.offset);
+        }
+        CHECK(found == expected);
+
+        // Nearest box to a point, best first
+        const Point p{coordinate(random), coordinate(random)};
+        auto box_distance = [&](const NodeItem &node) {
+            const double dx = std::max(0.0, std::max(node.min_x - p.x, p.x - node.max_x));
+            const double dy = std::max(0.0, std::max(node.min_y - p.y, p.y - node.max_y));
+            return std::sqrt(dx * dx + dy * dy);
+        };
+        double nearest = std::numeric_limits<double>::infinity();
+        tree.visit_nearest(box_distance, [&](const NodeItem &leaf, uint64_t, double bound) {
+            if (bound >= nearest) return false;
+            nearest = box_distance(leaf);
+            return true;
+        });
+        double expected_nearest = std::numeric_limits<double>::infinity();
+        for (const NodeItem &item : all) expected_nearest = std::min(expected_nearest, box_distance(item));
+        CHECK(nearest == expected_nearest);
+    }
+}
+
+void test_geojson_reader()
+{
+    const std::string path = write_file("collection.geojson",
+        "{\"type\": \"FeatureCollection\", \"features\": [\n"
+        "  {\"type\": \"Feature\", \"properties\": {\"name\": \"Sao Paulo\", \"pop\": 12},\n"
+        "   \"geometry\": {\"type\": \"Point\", \"coordinates\": [-46.6333, -23.55]}},\n"
+        "  {\"type\": \"Feature\", \"properties\": {\"name\": \"square\"},\n"
+        "   \"geometry\": {\"type\": \"Polygon\", \"coordinates\": [[[0, 0], [2, 0], [2, 2], [0, 2], [0, 0]],\n"
+        "                                                         [[0.5, 0.5], [1, 0.5], [1, 1], [0.5, 0.5]]]}}\n"
+        "]}\n");
+    {
+        GeoJsonReader reader(path);
+        GeoJsonFeature feature;
+        CHECK(reader.next(feature));
+        CHECK(feature.name == "Sao Paulo");
+        CHECK(feature.properties.find("\"pop\"") != std::string::npos);
+        CHECK(feature.geometry.type == GeometryType::Point);
+        CHECK(feature.geometry.points.size() == 1);
+        CHECK(feature.geometry.points[0].x == -46.6333 && feature.geometry.points[0].y == -23.55);
+
+        CHECK(reader.next(feature));
+        CHECK(feature.geometry.type == GeometryType::Polygon);
+        CHECK(feature.geometry.polygons.size() == 1);
+        CHECK(feature.geometry.polygons[0].rings.size() == 2);
+        CHECK(feature.geometry.polygons[0].rings[0].size() == 5);
+        CHECK(!reader.next(feature));
+    }
+    std::remove(path.c_str());
+
+    // Newline-delimited, and malformed JSON
+    const std::string lines = write_file("lines.ndjson",
+        "{\"type\": \"Feature\", \"properties\": {}, \"geometry\": {\"type\": \"Point\", \"coordinates\": [1, 2]}}\n"
+        "{\"type\": \"Feature\", \"properties\": {}, \"geometry\": {\"type\": \"Point\", \"coordinates\": [3, 4]}}\n"
+        "{\"type\": \"Feature\", \"geometry\": {\"type\": \"Point\", \"coordinates\": [5,\n");
+    {
+        GeoJsonReader reader(lines);
+        GeoJsonFeature feature;
+        CHECK(reader.next(feature) && feature.geometry.points[0].x == 1);
+        CHECK(reader.next(feature) && feature.geometry.points[0].y == 4);
+        bool thrown = false;
+        try {
+            reader.next(feature);
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+    std::remove(lines.c_str());
+}
+
+/**
+ * XXH64 with seed 0 of a whole buffer, straight from the specification
+ */
+uint64_t reference_xxh64(const std::string &data)
+{
+    const uint64_t p1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t p2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t p3 = 0x165667B19E3779F9ULL;
+    const uint64_t p4 = 0x85EBCA77C2B2AE63ULL;
+    const uint64_t p5 = 0x27D4EB2F165667C5ULL;
+    auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+    auto read = [&](size_t at, int bytes) {
+        uint64_t value = 0;
+        for (int i = bytes - 1; i >= 0; i--) {
+            value = (value << 8) | static_cast<uint8_t>(data[at + i]);
+        }
+        return value;
+    };
+    auto round = [&](uint64_t acc, uint64_t input) { return rotl(acc + input * p2, 31) * p1; };
+
+    const size_t n = data.size();
+    size_t at = 0;
+    uint64_t h;
+    if (n >= 32) {
+        uint64_t v[4] = {p1 + p2, p2, 0, 0 - p1};
+        for (; at + 32 <= n; at += 32) {
+            for (int i = 0; i < 4; i++) {
+                v[i] = round(v[i], read(at + 8 * i, 8));
+            }
+        }
+        h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+        for (int i = 0; i < 4; i++) {
+            h = (h ^ round(0, v[i])) * p1 + p4;
+        }
+    } else {
+        h = p5;
+    }
+    h += n;
+    for (; at + 8 <= n; at += 8) {
+        h = rotl(h ^ round(0, read(at, 8)), 27) * p1 + p4;
+    }
+    if (at + 4 <= n) {
+        h = rotl(h ^ (read(at, 4) * p1), 23) * p2 + p3;
+        at += 4;
+    }
+    for (; at < n; at++) {
+        h = rotl(h ^ (read(at, 1) * p5), 11) * p1;
+    }
+    h = (h ^ (h >> 33)) * p2;
+    h = (h ^ (h >> 29)) * p3;
+    return h ^ (h >> 32);
+}
+
+std::string hex64(uint64_t value)
+{
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(value));
+    return hex;
+}
+
+/**
+ * Plain SQLite stand-ins for SpatiaLite's DropTable(NULL, name, 1) and
+ * RenameTable(NULL, from, to)
+ */
+void run_sql(sqlite3_context *context, const std::string &sql_cmd)
+{
+    sqlite3 *db_handle = sqlite3_context_db_handle(context);
+    if (sqlite3_exec(db_handle, sql_cmd.c_str(), NULL, NULL, NULL) != SQLITE_OK) {
+        sqlite3_result_error(context, sqlite3_errmsg(db_handle), -1);
+        return;
+    }
+    sqlite3_result_int(context, 1);
+}
+
+void drop_table(sqlite3_context *context, int, sqlite3_value **argv)
+{
+    const char *name = reinterpret_cast<const char *>(sqlite3_value_text(argv[1]));
+    run_sql(context, "DROP TABLE IF EXISTS " + quote_identifier(name));
+}
+
+void rename_table(sqlite3_context *context, int, sqlite3_value **argv)
+{
+    const char *from = reinterpret_cast<const char *>(sqlite3_value_text(argv[1]));
+    const char *to = reinterpret_cast<const char *>(sqlite3_value_text(argv[2]));
+    run_sql(context, "ALTER TABLE " + quote_identifier(from) + " RENAME TO " + quote_identifier(to));
+}
+
+std::string registered_hash(sqlite3 *db_handle)
+{
+    std::string hash;
+    query_text(db_handle, "SELECT content_hash FROM import_registry", hash);
+    return hash;
+}
+
+void test_import_registry()
+{
+    // Published XXH64 values
+    CHECK(hex64(reference_xxh64("")) == "ef46db3751d8e999");
+    CHECK(hex64(reference_xxh64("abc")) == "44bc2cf5ad770999");
+
+    sqlite3 *db_handle;
+    CHECK(sqlite3_open(":memory:", &db_handle) == SQLITE_OK);
+    sqlite3_create_function(db_handle, "DropTable", 3, SQLITE_UTF8, NULL, drop_table, NULL, NULL);
+    sqlite3_create_function(db_handle, "RenameTable", 3, SQLITE_UTF8, NULL, rename_table, NULL, NULL);
+
+    int imports = 0;
+    const ImportFunction import_into = [&](sqlite3 *db, const std::string &table_name) {
+        imports++;
+        return exec(db, "CREATE TABLE " + quote_identifier(table_name) + " (id INTEGER)", "creating table");
+    };
+
+    // Sources of every length around the 32 byte stripes and the 1 MiB
+    // read chunks, split over three files: the registry hashes their
+    // concatenation
+    std::mt19937 random(54);
+    const size_t lengths[] = {0, 1, 3, 4, 7, 8, 12, 31, 32, 33, 63, 64, 65, 100, 1000, (1 << 20) - 1, 1 << 20,
+                              (1 << 20) + 37, 3 * (1 << 20) + 5};
+    for (size_t length : lengths) {
+        std::string content(length, '\0');
+        for (char &c : content) {
+            c = static_cast<char>(random());
+        }
+        const size_t first = length / 3;
+        const size_t second = length - length / 4;
+        const std::vector<std::string> files = {
+            write_file("source.shp", content.substr(0, first)),
+            write_file("source.shx", content.substr(first, second - first)),
+            write_file("source.dbf", content.substr(second)),
+        };
+
+        bool imported = false;
+        CHECK(import_if_changed(db_handle, "source " + std::to_string(length), files, "boundaries", import_into, {},
+                                &imported) == 0);
+        CHECK(imported);
+        CHECK(registered_hash(db_handle) == hex64(reference_xxh64(content)));
+        for (const auto &file : files) {
+            std::remove(file.c_str());
+        }
+    }
+    CHECK(imports == static_cast<int>(sizeof(lengths) / sizeof(lengths[0])));
+
+    // A touched source with the same content is skipped on its hash,
+    // changing one byte imports it again
+    std::string content(5000, 'x');
+    const std::vector<std::string> files = {write_file("source.shp", content)};
+    bool imported = false;
+    CHECK(import_if_changed(db_handle, "same", files, "boundaries", import_into, {}, &imported) == 0 && imported);
+    const struct timespec times[2] = {{0, UTIME_OMIT}, {1000000000, 0}};
+    CHECK(utimensat(AT_FDCWD, files[0].c_str(), times, 0) == 0);
+    CHECK(import_if_changed(db_handle, "same", files, "boundaries", import_into, {}, &imported) == 0 && !imported);
+
+    content[2500] = 'y';
+    write_file("source.shp", content);
+    CHECK(import_if_changed(db_handle, "same", files, "boundaries", import_into, {}, &imported) == 0 && imported);
+    CHECK(registered_hash(db_handle) == hex64(reference_xxh64(content)));
+    std::remove(files[0].c_str());
+    sqlite3_close(db_handle);
+}
+
+template <typename T>
+void put_le(std::string &out, T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+void put_be32(std::string &out, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<char>((value >> shift) & 0xFF));
+}
+
+/**
+ * Square ring, clockwise (an outer ring in a shapefile) or counter-clockwise
+ * (a hole)
+ */
+Ring square_ring(double min_x, double min_y, double size, bool clockwise)
+{
+    const double max_x = min_x + size;
+    const double max_y = min_y + size;
+    if (clockwise) {
+        return Ring{{min_x, min_y}, {min_x, max_y}, {max_x, max_y}, {max_x, min_y}, {min_x, min_y}};
+    }
+    return Ring{{min_x, min_y}, {max_x, min_y}, {max_x, max_y}, {min_x, max_y}, {min_x, min_y}};
+}
+
+/**
+ * Writes a polygon shapefile (.shp and .dbf) with a NAME and a CODE field
+ *
+ * @param records the parts of each record, no parts for a null shape
+ * @param names NAME of each record, as stored in the .dbf file
+ * @param deleted records flagged as deleted in the .dbf file
+ * @return path without extension
+ */
+std::string write_polygon_shapefile(const std::string &name, const std::vector<std::vector<Ring>> &records,
+                                    const std::vector<std::string> &names, const std::set<size_t> &deleted)
+{
+    std::string shp_records;
+    for (size_t r = 0; r < records.size(); r++) {
+        std::string content;
+        if (records[r].empty()) {
+            put_le<int32_t>(content, 0);
+        } else {
+            BBox box;
+            uint32_t num_points = 0;
+            for (const Ring &ring : records[r]) {
+                for (const Point &p : ring) box.expand(p.x, p.y);
+                num_points += ring.size();
+            }
+            put_le<int32_t>(content, 5);
+            for (double value : {box.min_x, box.min_y, box.max_x, box.max_y}) put_le(content, value);
+            put_le<uint32_t>(content, records[r].size());
+            put_le<uint32_t>(content, num_points);
+            uint32_t start = 0;
+            for (const Ring &ring : records[r]) {
+                put_le<uint32_t>(content, start);
+                start += ring.size();
+            }
+            for (const Ring &ring : records[r]) {
+                for (const Point &p : ring) {
+                    put_le(content, p.x);
+                    put_le(content, p.y);
+                }
+            }
+        }
+        put_be32(shp_records, r + 1);
+        put_be32(shp_records, content.size() / 2);
+        shp_records += content;
+    }
+
+    std::string shp;
+    put_be32(shp, 9994);
+    shp.append(20, '\0');
+    put_be32(shp, (100 + shp_records.size()) / 2);
+    put_le<int32_t>(shp, 1000);
+    put_le<int32_t>(shp, 5);
+    shp.append(64, '\0');
+    shp += shp_records;
+
+    // NAME C(12), CODE N(4,0)
+    std::string dbf;
+    dbf.push_back(3);
+    dbf.append(3, '\0');
+    put_le<uint32_t>(dbf, records.size());
+    put_le<uint16_t>(dbf, 32 + 2 * 32 + 1);
+    put_le<uint16_t>(dbf, 1 + 12 + 4);
+    dbf.append(20, '\0');
+    for (const auto &field : {std::make_tuple("NAME", 'C', 12), std::make_tuple("CODE", 'N', 4)}) {
+        std::string descriptor(32, '\0');
+        descriptor.replace(0, std::strlen(std::get<0>(field)), std::get<0>(field));
+        descriptor[11] = std::get<1>(field);
+        descriptor[16] = static_cast<char>(std::get<2>(field));
+        dbf += descriptor;
+    }
+    dbf.push_back(0x0D);
+    for (size_t r = 0; r < records.size(); r++) {
+        const std::string code = std::to_string(r);
+        dbf.push_back(deleted.count(r) ? '*' : ' ');
+        dbf += names[r] + std::string(12 - names[r].size(), ' ');
+        dbf += std::string(4 - code.size(), ' ') + code;
+    }
+    dbf.push_back(0x1A);
+
+    write_file(name + ".shp", shp);
+    write_file(name + ".dbf", dbf);
+    return "spatial_tests_" + name;
+}
+
+// First vertex of a ring, which identifies the squares of the test
+typedef std::pair<double, double> Corner;
+
+Corner corner(const Ring &ring)
+{
+    return Corner(ring.front().x, ring.front().y);
+}
+
+void test_shapefile_reader()
+{
+    // Records of squares laid on a grid: clockwise outer rings, some with a
+    // counter-clockwise hole, some of those with a clockwise island in the
+    // hole, itself with a hole, the parts of each record in random order
+    std::mt19937 random(6);
+    std::uniform_int_distribution<int> coin(0, 1);
+    std::vector<std::vector<Ring>> records;
+    std::vector<std::map<Corner, std::multiset<Corner>>> expected;
+    for (int r = 0; r < 40; r++) {
+        std::vector<Ring> parts;
+        std::map<Corner, std::multiset<Corner>> holes;
+        for (int cell = 0; cell < 16; cell++) {
+            if (coin(random) == 0) continue;
+            const double x = (cell % 4) * 10.0;
+            const double y = (cell / 4) * 10.0 - 30;
+            parts.push_back(square_ring(x + 1, y + 1, 8, true));
+            holes[corner(parts.back())];
+            if (coin(random) == 0) continue;
+            parts.push_back(square_ring(x + 3, y + 3, 4, false));
+            holes[Corner(x + 1, y + 1)].insert(corner(parts.back()));
+            if (coin(random) == 0) continue;
+            parts.push_back(square_ring(x + 4, y + 4, 2, true));
+            holes[corner(parts.back())];
+            if (coin(random) == 0) continue;
+            parts.push_back(square_ring(x + 4.5, y + 4.5, 1, false));
+            holes[Corner(x + 4, y + 4)].insert(corner(parts.back()));
+        }
+        std::shuffle(parts.begin(), parts.end(), random);
+        records.push_back(parts);
+        expected.push_back(holes);
+    }
+    records[5].clear();
+    std::vector<std::string> names;
+    for (size_t r = 0; r < records.size(); r++) names.push_back("R" + std::to_string(r));
+    const std::set<size_t> deleted = {3, 17};
+    const std::string path = write_polygon_shapefile("polygons", records, names, deleted);
+
+    {
+        ShapefileReader reader(path);
+        CHECK(reader.geometry_type() == GeometryType::MultiPolygon);
+        CHECK(reader.num_records() == records.size());
+        CHECK(reader.fields().size() == 2 && reader.fields()[0].name == "NAME" && reader.fields()[1].type == 'N');
+
+        ShapefileRecord record;
+        for (size_t r = 0; r < records.size(); r++) {
+            if (deleted.count(r)) continue;
+            CHECK(reader.next(record));
+            CHECK(record.values.size() == 2 && record.values[0] == "R" + std::to_string(r) &&
+                  record.values[1] == std::to_string(r));
+            if (records[r].empty()) {
+                CHECK(record.geometry.type == GeometryType::Unknown);
+                continue;
+            }
+
+            // Every outer ring with the holes it contains, and nothing else
+            std::map<Corner, std::multiset<Corner>> found;
+            for (const Polygon &polygon : record.geometry.polygons) {
+                std::multiset<Corner> &holes = found[corner(polygon.rings.front())];
+                for (size_t i = 1; i < polygon.rings.size(); i++) holes.insert(corner(polygon.rings[i]));
+            }
+            CHECK(record.geometry.polygons.size() == found.size());
+            CHECK(found == expected[r]);
+        }
+        CHECK(!reader.next(record));
+    }
+    std::remove((path + ".shp").c_str());
+    std::remove((path + ".dbf").c_str());
+}
+
+void test_shapefile_charset()
+{
+    const std::vector<std::vector<Ring>> records(3, std::vector<Ring>(1, square_ring(0, 0, 1, true)));
+    const std::vector<std::string> latin1 = {"Paran\xe1", "Goi\xe1s", "S\xe3o Paulo"};
+    const std::vector<std::string> utf8 = {"Paran\xc3\xa1", "Goi\xc3\xa1s", "S\xc3\xa3o Paulo"};
+    auto read_names = [&](const std::string &path, const std::string &charset) {
+        ShapefileReader reader(path, charset);
+        std::vector<std::string> values;
+        ShapefileRecord record;
+        while (reader.next(record)) values.push_back(record.values[0]);
+        return values;
+    };
+
+    // The code page of the .cpg file, as ESRI writes it, wins over the charset
+    const std::string path = write_polygon_shapefile("latin1", records, latin1, std::set<size_t>());
+    write_file("latin1.cpg", "88591\r\n");
+    CHECK(read_names(path, "UTF-8") == utf8);
+    CHECK(ShapefileReader(path).charset() == "ISO-8859-1");
+
+    // Without a .cpg file, the charset applies
+    std::remove((path + ".cpg").c_str());
+    CHECK(read_names(path, "ISO-8859-1") == utf8);
+    CHECK(read_names(path, "UTF-8") == latin1);
+    bool thrown = false;
+    try {
+        read_names(path, "NO-SUCH-CHARSET");
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    std::remove((path + ".shp").c_str());
+    std::remove((path + ".dbf").c_str());
+
+    // UTF-8 text is kept as is
+    const std::string utf8_path = write_polygon_shapefile("utf8", records, utf8, std::set<size_t>());
+    write_file("utf8.cpg", "UTF-8");
+    CHECK(read_names(utf8_path, "CP1252") == utf8);
+    for (const char *extension : {".shp", ".dbf", ".cpg"}) std::remove((utf8_path + extension).c_str());
+}
+
+void test_spatialite_blob()
+{
+    Geometry polygon;
+    polygon.type = GeometryType::Polygon;
+    polygon.srid = 4326;
+    polygon.polygons.push_back(Polygon{{{{0, 0}, {3, 0}, {3, 2}, {0, 2}, {0, 0}}, {{1, 1}, {2, 1}, {2, 1.5}, {1, 1}}}});
+
+    for (bool compressed : {false, true}) {
+        const std::vector<uint8_t> blob = encode_spatialite_blob(polygon, compressed);
+        Geometry decoded;
+        CHECK(decode_spatialite_blob(blob.data(), blob.size(), decoded));
+        CHECK(decoded.type == GeometryType::Polygon && decoded.srid == 4326);
+        CHECK(decoded.polygons.size() == 1 && decoded.polygons[0].rings.size() == 2);
+        if (decoded.polygons.size() == 1 && decoded.polygons[0].rings.size() == 2) {
+            for (size_t r = 0; r < 2; r++) {
+                const Ring &expected = polygon.polygons[0].rings[r];
+                const Ring &ring = decoded.polygons[0].rings[r];
+                CHECK(ring.size() == expected.size());
+                for (size_t i = 0; i < std::min(ring.size(), expected.size()); i++) {
+                    // Compressed rings store float offsets from the previous vertex
+                    CHECK(std::fabs(ring[i].x - expected[i].x) < 1e-6 && std::fabs(ring[i].y - expected[i].y) < 1e-6);
+                }
+            }
+        }
+    }
+}
+
+void test_validation()
+{
+    // Random star-shaped polygons: vertices in angle order make a valid
+    // ring, shuffled vertices a self-intersecting one
+    std::mt19937 random(7);
+    std::uniform_real_distribution<double> unit(0, 1);
+    std::vector<Geometry> geometries;
+    for (int i = 0; i < 300; i++) {
+        Ring ring;
+        for (int k = 0; k < 12; k++) {
+            const double angle = k * 2 * 3.14159265358979323846 / 12;
+            const double radius = 5 + 5 * unit(random);
+            ring.push_back(Point{i * 30 + radius * std::cos(angle), radius * std::sin(angle)});
+        }
+        if (i % 3 == 0) std::shuffle(ring.begin(), ring.end(), random);
+        ring.push_back(ring.front());
+
+        Geometry polygon;
+        polygon.type = GeometryType::MultiPolygon;
+        polygon.srid = 3857;
+        polygon.polygons.push_back(Polygon{{ring}});
+        geometries.push_back(polygon);
+    }
+
+    // A bow tie, which MakeValid splits into two triangles of area 1
+    Geometry bow_tie;
+    bow_tie.type = GeometryType::MultiPolygon;
+    bow_tie.srid = 3857;
+    bow_tie.polygons.push_back(Polygon{{{{0, 0}, {2, 2}, {2, 0}, {0, 2}, {0, 0}}}});
+    geometries.push_back(bow_tie);
+
+    sqlite3 *db_handle;
+    CHECK(sqlite3_open(":memory:", &db_handle) == SQLITE_OK);
+    CHECK(sqlite3_exec(db_handle, "CREATE TABLE shapes (geom BLOB)", NULL, NULL, NULL) == SQLITE_OK);
+    sqlite3_stmt *stmt;
+    CHECK(sqlite3_prepare_v2(db_handle, "INSERT INTO shapes VALUES (?)", -1, &stmt, NULL) == SQLITE_OK);
+    for (const Geometry &geom : geometries) {
+        const std::vector<uint8_t> blob = encode_spatialite_blob(geom);
+        sqlite3_bind_blob(stmt, 1, blob.data(), blob.size(), SQLITE_TRANSIENT);
+        CHECK(sqlite3_step(stmt) == SQLITE_DONE);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    ThreadPool pool(4);
+    ValidationSummary summary;
+    CHECK(validate_geometries(db_handle, "shapes", "geom", pool, BlobEncoding(), &summary) == 0);
+    CHECK(summary.checked == geometries.size() && summary.failed == 0);
+
+    // Every geometry GEOS finds invalid, and only those, is repaired into
+    // a valid geometry of the same type
+    GeosContext geos;
+    uint64_t invalid = 0;
+    CHECK(sqlite3_prepare_v2(db_handle, "SELECT is_valid, was_repaired, geom FROM shapes ORDER BY rowid", -1, &stmt,
+                             NULL) == SQLITE_OK);
+    for (const Geometry &original : geometries) {
+        CHECK(sqlite3_step(stmt) == SQLITE_ROW);
+        GeosGeometry before = geos.to_geos(original);
+        const bool was_invalid = GEOSisValid_r(geos.handle(), before.get()) == 0;
+        invalid += was_invalid ? 1 : 0;
+        CHECK(sqlite3_column_int(stmt, 0) == 1);
+        CHECK(sqlite3_column_int(stmt, 1) == (was_invalid ? 1 : 0));
+
+        Geometry stored;
+        CHECK(decode_spatialite_blob(static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 2)),
+                                     sqlite3_column_bytes(stmt, 2), stored));
+        CHECK(stored.type == GeometryType::MultiPolygon && stored.srid == 3857);
+        GeosGeometry after = geos.to_geos(stored);
+        CHECK(after && GEOSisValid_r(geos.handle(), after.get()) == 1);
+        if (!was_invalid) {
+            CHECK(encode_spatialite_blob(stored) == encode_spatialite_blob(original));
+        }
+        if (&original == &geometries.back()) {
+            double area = 0;
+            CHECK(stored.polygons.size() == 2 && GEOSArea_r(geos.handle(), after.get(), &area) == 1 &&
+                  std::fabs(area - 2) < 1e-12);
+        }
+    }
+    sqlite3_finalize(stmt);
+    CHECK(summary.invalid == invalid && summary.repaired == invalid && invalid > geometries.size() / 4);
+    sqlite3_close(db_handle);
+}
+
+void test_adjacency()
+{
+    // A 5 x 4 grid of squares of side 10, the one of cell 7 widened to
+    // overlap cell 8 by a sliver, and a square inside cell 6
+    std::vector<Ring> rings;
+    for (int cell = 0; cell < 20; cell++) {
+        rings.push_back(square_ring((cell % 5) * 10.0, (cell / 5) * 10.0, 10, true));
+    }
+    rings[7][2].x += 1e-9;
+    rings[7][3].x += 1e-9;
+    rings.push_back(square_ring(12, 12, 6, true));
+
+    sqlite3 *db_handle;
+    CHECK(sqlite3_open(":memory:", &db_handle) == SQLITE_OK);
+    CHECK(sqlite3_exec(db_handle, "CREATE TABLE cells (id INTEGER, geom BLOB)", NULL, NULL, NULL) == SQLITE_OK);
+    sqlite3_stmt *stmt;
+    CHECK(sqlite3_prepare_v2(db_handle, "INSERT INTO cells VALUES (?, ?)", -1, &stmt, NULL) == SQLITE_OK);
+    for (size_t i = 0; i < rings.size(); i++) {
+        Geometry polygon;
+        polygon.type = GeometryType::MultiPolygon;
+        polygon.srid = 3857;
+        polygon.polygons.push_back(Polygon{{rings[i]}});
+        const std::vector<uint8_t> blob = encode_spatialite_blob(polygon);
+        sqlite3_bind_int64(stmt, 1, i);
+        sqlite3_bind_blob(stmt, 2, blob.data(), blob.size(), SQLITE_TRANSIENT);
+        CHECK(sqlite3_step(stmt) == SQLITE_DONE);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    ThreadPool pool(4);
+    AdjacencySummary summary;
+    CHECK(build_adjacency(db_handle, "cells", "geom", "id", "cells_adjacency", pool, &summary) == 0);
+
+    // Grid cells sharing an edge are neighbours along 10, cells sharing a
+    // corner along 0; the inner square overlaps cell 6 and meets nothing else
+    std::map<std::pair<int64_t, int64_t>, double> expected;
+    for (int a = 0; a < 20; a++) {
+        for (int b = 0; b < 20; b++) {
+            const int dx = std::abs(a % 5 - b % 5);
+            const int dy = std::abs(a / 5 - b / 5);
+            if (a == b || dx > 1 || dy > 1) continue;
+            expected[std::make_pair(a, b)] = dx + dy == 1 ? 10 : 0;
+        }
+    }
+    std::map<std::pair<int64_t, int64_t>, double> found;
+    CHECK(sqlite3_prepare_v2(db_handle, "SELECT id, neighbour_id, border_length FROM cells_adjacency", -1, &stmt,
+                             NULL) == SQLITE_OK);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        found[std::make_pair(sqlite3_column_int64(stmt, 0), sqlite3_column_int64(stmt, 1))] =
+            sqlite3_column_double(stmt, 2);
+    }
+    sqlite3_finalize(stmt);
+
+    CHECK(summary.failed == 0 && summary.adjacent * 2 == expected.size());
+    CHECK(found.size() == expected.size());
+    for (const auto &pair : expected) {
+        const auto match = found.find(pair.first);
+        CHECK(match != found.end());
+        if (match == found.end()) continue;
+        // The sliver replaces the edge shared by 7 and 8
+        const bool sliver = std::min(pair.first.first, pair.first.second) == 7 &&
+                            std::max(pair.first.first, pair.first.second) == 8;
+        CHECK(sliver ? match->second < 1e-6 : std::fabs(match->second - pair.second) < 1e-6);
+    }
+    sqlite3_close(db_handle);
+}
+
+double segment_distance(const Point &p, const Point &a, const Point &b)
+{
+    Point nearest;
+    return std::sqrt(nearest_on_segment(p, a, b, 1.0, nearest));
+}
+
+/**
+ * A grid of cells whose shared edges are the same jagged lines on both
+ * sides, as in a clean administrative layer
+ *
+ * @return one ring per cell, row by row
+ */
+std::vector<Ring> jagged_grid(int columns, int rows, std::mt19937 &random)
+{
+    std::uniform_real_distribution<double> jitter(-10, 10);
+    std::uniform_real_distribution<double> noise(-3, 3);
+    std::vector<std::vector<Point>> nodes(columns + 1, std::vector<Point>(rows + 1));
+    for (int i = 0; i <= columns; i++) {
+        for (int j = 0; j <= rows; j++) nodes[i][j] = Point{i * 100 + jitter(random), j * 100 + jitter(random)};
+    }
+    auto edge = [&](const Point &a, const Point &b) {
+        std::vector<Point> line(1, a);
+        const double length = std::hypot(b.x - a.x, b.y - a.y);
+        for (int k = 1; k < 40; k++) {
+            const double offset = noise(random);
+            line.push_back(Point{a.x + (b.x - a.x) * k / 40 - (b.y - a.y) / length * offset,
+                                 a.y + (b.y - a.y) * k / 40 + (b.x - a.x) / length * offset});
+        }
+        line.push_back(b);
+        return line;
+    };
+    std::vector<std::vector<std::vector<Point>>> horizontal(columns, std::vector<std::vector<Point>>(rows + 1));
+    std::vector<std::vector<std::vector<Point>>> vertical(columns + 1, std::vector<std::vector<Point>>(rows));
+    for (int i = 0; i <= columns; i++) {
+        for (int j = 0; j <= rows; j++) {
+            if (i < columns) horizontal[i][j] = edge(nodes[i][j], nodes[i + 1][j]);
+            if (j < rows) vertical[i][j] = edge(nodes[i][j], nodes[i][j + 1]);
+        }
+    }
+
+    std::vector<Ring> rings;
+    for (int j = 0; j < rows; j++) {
+        for (int i = 0; i < columns; i++) {
+            Ring ring = horizontal[i][j];
+            ring.insert(ring.end(), vertical[i + 1][j].begin() + 1, vertical[i + 1][j].end());
+            ring.insert(ring.end(), horizontal[i][j + 1].rbegin() + 1, horizontal[i][j + 1].rend());
+            ring.insert(ring.end(), vertical[i][j].rbegin() + 1, vertical[i][j].rend());
+            rings.push_back(ring);
+        }
+    }
+    return rings;
+}
+
+void test_topology_display()
+{
+    std::mt19937 random(8);
+    const std::vector<Ring> rings = jagged_grid(6, 5, random);
+    std::vector<Geometry> geometries;
+    for (const Ring &ring : rings) {
+        Geometry polygon;
+        polygon.type = GeometryType::MultiPolygon;
+        polygon.srid = 3857;
+        polygon.polygons.push_back(Polygon{{ring}});
+        geometries.push_back(polygon);
+    }
+
+    // Every ring comes back from its arcs, up to its first vertex, and
+    // every inner edge is one arc shared by two cells
+    const Topology topology = build_topology(geometries);
+    CHECK(topology.rings.size() == rings.size());
+    // 71 edges of 41 vertices, the two edges at each corner of the grid
+    // making one arc, 49 inner edges
+    CHECK(topology.arcs.size() == 67 && topology.arc_vertices == 71 * 41 - 4);
+    std::vector<int> references(topology.arcs.size(), 0);
+    for (const TopoRing &topo_ring : topology.rings) {
+        const Ring &ring = rings[topo_ring.feature];
+        const Ring rebuilt = topology_ring(topology.arcs, topo_ring.arcs);
+        CHECK(rebuilt.size() == ring.size());
+        size_t shift = 0;
+        while (shift + 1 < ring.size() && !(ring[shift].x == rebuilt[0].x && ring[shift].y == rebuilt[0].y)) shift++;
+        bool same = rebuilt.size() == ring.size();
+        for (size_t i = 0; same && i + 1 < ring.size(); i++) {
+            const Point &p = ring[(shift + i) % (ring.size() - 1)];
+            same = p.x == rebuilt[i].x && p.y == rebuilt[i].y;
+        }
+        CHECK(same);
+        for (int64_t ref : topo_ring.arcs) references[ref < 0 ? ~ref : ref]++;
+    }
+    CHECK(std::count(references.begin(), references.end(), 2) == 49);
+
+    // The cells in a plain table, and their topology in the tables
+    // build_topology_tables() stores
+    sqlite3 *db_handle;
+    CHECK(sqlite3_open(":memory:", &db_handle) == SQLITE_OK);
+    CHECK(sqlite3_exec(db_handle, "CREATE TABLE cells (label TEXT, geom BLOB);"
+                       "CREATE TABLE cells_topo_arcs (arc_id INTEGER PRIMARY KEY, num_vertices INTEGER, Geometry BLOB);"
+                       "CREATE TABLE cells_topo_rings (feature_id INTEGER, polygon INTEGER, ring INTEGER, arcs TEXT)",
+                       NULL, NULL, NULL) == SQLITE_OK);
+    sqlite3_stmt *stmt;
+    CHECK(sqlite3_prepare_v2(db_handle, "INSERT INTO cells VALUES (?, ?)", -1, &stmt, NULL) == SQLITE_OK);
+    for (size_t i = 0; i < geometries.size(); i++) {
+        const std::vector<uint8_t> blob = encode_spatialite_blob(geometries[i]);
+        sqlite3_bind_text(stmt, 1, ("C" + std::to_string(i)).c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_blob(stmt, 2, blob.data(), blob.size(), SQLITE_TRANSIENT);
+        CHECK(sqlite3_step(stmt) == SQLITE_DONE);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    CHECK(sqlite3_prepare_v2(db_handle, "INSERT INTO cells_topo_arcs VALUES (?, ?, ?)", -1, &stmt, NULL) == SQLITE_OK);
+    for (size_t i = 0; i < topology.arcs.size(); i++) {
+        Geometry line;
+        line.type = GeometryType::LineString;
+        line.srid = 3857;
+        line.lines.push_back(topology.arcs[i]);
+        const std::vector<uint8_t> blob = encode_spatialite_blob(line);
+        sqlite3_bind_int64(stmt, 1, i);
+        sqlite3_bind_int64(stmt, 2, topology.arcs[i].size());
+        sqlite3_bind_blob(stmt, 3, blob.data(), blob.size(), SQLITE_TRANSIENT);
+        CHECK(sqlite3_step(stmt) == SQLITE_DONE);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    CHECK(sqlite3_prepare_v2(db_handle, "INSERT INTO cells_topo_rings VALUES (?, ?, ?, ?)", -1, &stmt, NULL) ==
+          SQLITE_OK);
+    for (const TopoRing &topo_ring : topology.rings) {
+        std::string arcs = "[";
+        for (int64_t ref : topo_ring.arcs) arcs += (arcs.size() > 1 ? ", " : "") + std::to_string(ref);
+        sqlite3_bind_int64(stmt, 1, topo_ring.feature + 1);
+        sqlite3_bind_int64(stmt, 2, topo_ring.polygon);
+        sqlite3_bind_int64(stmt, 3, topo_ring.ring);
+        sqlite3_bind_text(stmt, 4, (arcs + "]").c_str(), -1, SQLITE_TRANSIENT);
+        CHECK(sqlite3_step(stmt) == SQLITE_DONE);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    ThreadPool pool(4);
+    DisplayQuery display(db_handle, "cells", "geom", "label", pool);
+    DisplayQuery stored(db_handle, "cells", "geom", "label", pool, 1024, "cells_topo");
+    CHECK(display.num_features() == rings.size() && stored.num_features() == rings.size());
+
+    for (uint32_t z = 0; z <= 2; z++) {
+        for (uint32_t x = 0; x < (1u << z); x++) {
+            for (uint32_t y = 0; y < (1u << z); y++) {
+                const BBox box = display.tile_bbox(z, x, y);
+                const double pixel_size = (box.max_x - box.min_x) / DisplayQuery::TILE_PIXELS;
+                const std::shared_ptr<const DisplayTile> tile = display.tile(z, x, y);
+                const std::shared_ptr<const DisplayTile> same_tile = stored.tile(z, x, y);
+
+                // Both sources give the same tile
+                CHECK(tile->features.size() == same_tile->features.size());
+                for (size_t i = 0; i < std::min(tile->features.size(), same_tile->features.size()); i++) {
+                    CHECK(tile->features[i].label == same_tile->features[i].label);
+                    CHECK(encode_spatialite_blob(tile->features[i].geometry) ==
+                          encode_spatialite_blob(same_tile->features[i].geometry));
+                }
+
+                std::vector<std::set<std::pair<double, double>>> shown(rings.size());
+                for (const DisplayFeature &feature : tile->features) {
+                    const Ring &original = rings[feature.feature];
+                    for (const Polygon &polygon : feature.geometry.polygons) {
+                        for (const Point &p : polygon.rings[0]) shown[feature.feature].insert(std::make_pair(p.x, p.y));
+                    }
+
+                    // Every vertex of the tile is within a pixel of the outline
+                    for (const Point &p : original) {
+                        if (p.x < box.min_x || p.x > box.max_x || p.y < box.min_y || p.y > box.max_y) continue;
+                        double nearest = std::numeric_limits<double>::infinity();
+                        for (const Polygon &polygon : feature.geometry.polygons) {
+                            const Ring &ring = polygon.rings[0];
+                            for (size_t i = 0; i + 1 < ring.size(); i++) {
+                                nearest = std::min(nearest, segment_distance(p, ring[i], ring[i + 1]));
+                            }
+                        }
+                        CHECK(nearest <= pixel_size * (1 + 1e-9));
+                    }
+                }
+
+                // Neighbours show the same vertices along their shared border
+                for (size_t a = 0; a < rings.size(); a++) {
+                    std::set<std::pair<double, double>> border_a;
+                    for (const Point &p : rings[a]) border_a.insert(std::make_pair(p.x, p.y));
+                    for (size_t b = a + 1; b < rings.size(); b++) {
+                        std::set<std::pair<double, double>> border;
+                        for (const Point &p : rings[b]) {
+                            if (border_a.count(std::make_pair(p.x, p.y))) border.insert(std::make_pair(p.x, p.y));
+                        }
+                        std::set<std::pair<double, double>> shown_a, shown_b;
+                        for (const auto &p : shown[a]) if (border.count(p)) shown_a.insert(p);
+                        for (const auto &p : shown[b]) if (border.count(p)) shown_b.insert(p);
+                        CHECK(shown_a == shown_b || shown[a].empty() || shown[b].empty());
+                    }
+                }
+            }
+        }
+    }
+    sqlite3_close(db_handle);
+}
+
+/**
+ * Closed star-shaped ring around a center, with radii drawn in
+ * [min_radius, max_radius]
+ */
+Ring star_ring(const Point &center, int vertices, double min_radius, double max_radius, std::mt19937 &random)
+{
+    std::uniform_real_distribution<double> radius(min_radius, max_radius);
+    Ring ring;
+    for (int k = 0; k < vertices; k++) {
+        const double angle = k * 2 * 3.14159265358979323846 / vertices;
+        const double r = radius(random);
+        ring.push_back(Point{center.x + r * std::cos(angle), center.y + r * std::sin(angle)});
+    }
+    ring.push_back(ring.front());
+    return ring;
+}
+
+/**
+ * Features for the point-in-polygon lookups: one star per 10x10 cell of a
+ * 4x3 grid, every third one with a hole, every fourth one with a second
+ * part in a corner of its cell
+ */
+std::vector<Geometry> lookup_features()
+{
+    std::mt19937 random(62);
+    std::vector<Geometry> features;
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 4; col++) {
+            const int i = row * 4 + col;
+            const Point center{col * 10 + 5.0, row * 10 + 5.0};
+            Polygon polygon;
+            polygon.rings.push_back(star_ring(center, 40 + 20 * i, 2, 4.8, random));
+            if (i % 3 == 0) {
+                polygon.rings.push_back(star_ring(center, 15, 0.5, 1.5, random));
+            }
+
+            Geometry feature;
+            feature.type = GeometryType::MultiPolygon;
+            feature.srid = 4326;
+            feature.polygons.push_back(polygon);
+            if (i % 4 == 1) {
+                const double x = center.x + 3.9;
+                const double y = center.y + 3.9;
+                feature.polygons.push_back(Polygon{{{{x, y}, {x + 1, y}, {x + 1, y + 1}, {x, y + 1}, {x, y}}}});
+            }
+            features.push_back(feature);
+        }
+    }
+    return features;
+}
+
+/**
+ * Stores the features in a "states (name, geom)" table, named "S<index>"
+ */
+void store_features(sqlite3 *db_handle, const std::vector<Geometry> &features)
+{
+    CHECK(sqlite3_exec(db_handle, "CREATE TABLE states (name TEXT, geom BLOB)", NULL, NULL, NULL) == SQLITE_OK);
+    sqlite3_stmt *stmt;
+    CHECK(sqlite3_prepare_v2(db_handle, "INSERT INTO states VALUES (?, ?)", -1, &stmt, NULL) == SQLITE_OK);
+    for (size_t i = 0; i < features.size(); i++) {
+        const std::string name = "S" + std::to_string(i);
+        const std::vector<uint8_t> blob = encode_spatialite_blob(features[i]);
+        sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_blob(stmt, 2, blob.data(), blob.size(), SQLITE_TRANSIENT);
+        CHECK(sqlite3_step(stmt) == SQLITE_DONE);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+}
+
+/**
+ * Feature containing a point, by testing every ring of every feature
+ */
+int64_t brute_force_find(const std::vector<Geometry> &features, const Point &p)
+{
+    for (size_t i = 0; i < features.size(); i++) {
+        for (const Polygon &polygon : features[i].polygons) {
+            bool inside = ring_contains(polygon.rings[0], p);
+            for (size_t k = 1; k < polygon.rings.size() && inside; k++) {
+                inside = !ring_contains(polygon.rings[k], p);
+            }
+            if (inside) return static_cast<int64_t>(i);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Random points over the extent of the features and a margin around it,
+ * followed by repeats of a few of them, as repeated GPS fixes
+ */
+std::vector<Point> lookup_points(size_t count, std::mt19937 &random)
+{
+    std::uniform_real_distribution<double> x(-3, 43);
+    std::uniform_real_distribution<double> y(-3, 33);
+    std::vector<Point> points;
+    for (size_t i = 0; i < count; i++) {
+        points.push_back(Point{x(random), y(random)});
+    }
+    for (size_t i = 0; i < count / 4; i++) {
+        points.push_back(points[i % 200]);
+    }
+    return points;
+}
+
+void test_coverage_grid()
+{
+    const std::vector<Geometry> features = lookup_features();
+    BBox extent;
+    for (const Geometry &feature : features) {
+        for (const Polygon &polygon : feature.polygons) {
+            for (const Point &p : polygon.rings[0]) {
+                extent.expand(p.x, p.y);
+            }
+        }
+    }
+
+    // Every cell a segment touches is MIXED, and every other cell holds the
+    // feature found at any point inside it
+    const uint32_t size = 64;
+    CoverageGrid grid(extent, size);
+    for (const Geometry &feature : features) {
+        for (const Polygon &polygon : feature.polygons) {
+            for (const Ring &ring : polygon.rings) {
+                for (size_t i = 1; i < ring.size(); i++) {
+                    grid.mark_segment(ring[i - 1], ring[i]);
+                }
+            }
+        }
+    }
+    grid.fill([&](const Point &center) { return brute_force_find(features, center); });
+
+    std::mt19937 random(620);
+    std::uniform_real_distribution<double> unit(0, 1);
+    size_t mixed = 0;
+    for (uint32_t row = 0; row < size; row++) {
+        for (uint32_t col = 0; col < size; col++) {
+            BBox cell;
+            cell.expand(extent.min_x + col * grid.cell_width(), extent.min_y + row * grid.cell_height());
+            cell.expand(cell.min_x + grid.cell_width(), cell.min_y + grid.cell_height());
+            const Point center{(cell.min_x + cell.max_x) / 2, (cell.min_y + cell.max_y) / 2};
+
+            bool crossed = false;
+            for (const Geometry &feature : features) {
+                for (const Polygon &polygon : feature.polygons) {
+                    for (const Ring &ring : polygon.rings) {
+                        for (size_t i = 1; i < ring.size() && !crossed; i++) {
+                            crossed = segment_intersects_box(ring[i - 1], ring[i], cell);
+                        }
+                    }
+                }
+            }
+            const int32_t value = grid.value(center);
+            if (crossed) {
+                CHECK(value == CoverageGrid::MIXED);
+            }
+            if (value == CoverageGrid::MIXED) {
+                mixed++;
+                continue;
+            }
+            for (int k = 0; k < 10; k++) {
+                const Point p{cell.min_x + unit(random) * grid.cell_width(),
+                              cell.min_y + unit(random) * grid.cell_height()};
+                const int64_t expected = brute_force_find(features, p);
+                CHECK(value == (expected >= 0 ? expected : CoverageGrid::EMPTY));
+            }
+        }
+    }
+    CHECK(mixed == grid.count(CoverageGrid::MIXED) && mixed > 0 && mixed < size * size * 3 / 4);
+    CHECK(grid.count(CoverageGrid::EMPTY) > 0 && grid.count(4) > 0);
+    CHECK(grid.value(Point{extent.max_x + 1, extent.min_y}) == CoverageGrid::EMPTY);
+
+    // The negative cache keeps its keys up to its capacity
+    NegativeCache cache(16 * 4);
+    for (uint64_t key = 0; key < 1000; key++) {
+        cache.insert(key);
+    }
+    size_t kept = 0;
+    for (uint64_t key = 0; key < 1000; key++) {
+        kept += cache.contains(key) ? 1 : 0;
+    }
+    CHECK(cache.size() == kept && kept <= 16 * 4 && kept >= 16);
+    CHECK(!cache.contains(5000));
+
+    // Lookups through the grid and the negative cache, from many threads,
+    // find what a scan of every ring finds
+    sqlite3 *db_handle;
+    CHECK(sqlite3_open(":memory:", &db_handle) == SQLITE_OK);
+    store_features(db_handle, features);
+    StateLookup plain(db_handle, "states", "geom", "name", 0);
+    StateLookup lookup(db_handle, "states", "geom", "name", 32);
+    sqlite3_close(db_handle);
+    CHECK(lookup.num_features() == features.size() && lookup.label(3) == "S3");
+
+    const std::vector<Point> points = lookup_points(20000, random);
+    std::vector<int64_t> found(points.size());
+    ThreadPool pool(4);
+    std::vector<LookupStats> stats(pool.size());
+    pool.parallel_for(points.size(), [&](size_t i, unsigned worker) {
+        found[i] = lookup.find(points[i], &stats[worker]);
+    }, 64);
+
+    LookupStats total;
+    for (const LookupStats &s : stats) {
+        total.grid_hits += s.grid_hits;
+        total.cache_hits += s.cache_hits;
+    }
+    size_t inside = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        const int64_t expected = brute_force_find(features, points[i]);
+        CHECK(found[i] == expected);
+        CHECK(plain.find(points[i]) == expected);
+        inside += expected >= 0 ? 1 : 0;
+    }
+    CHECK(inside > points.size() / 4 && inside < points.size() * 3 / 4);
+    CHECK(total.grid_hits > points.size() / 2 && total.cache_hits > 0 && lookup.negative_cache_size() > 0);
+}
+
+void test_result_cache()
+{
+    // Against one LRU list per shard, kept by linear search: the same
+    // gets hit and miss, and the same entries are evicted
+    const size_t capacity = 16 * 8;
+    ShardedLruCache<uint64_t, uint64_t> cache(capacity);
+    std::vector<std::vector<uint64_t>> shards(16);   // most recently used first
+    CacheStats expected;
+    auto value_of = [](uint64_t key) { return key * 31 + 7; };
+
+    std::mt19937 random(63);
+    std::geometric_distribution<uint64_t> skewed(0.01);
+    for (int i = 0; i < 50000; i++) {
+        const uint64_t key = skewed(random);
+        std::vector<uint64_t> &lru = shards[(std::hash<uint64_t>()(key) * 0x9E3779B97F4A7C15ULL) >> 60];
+        auto found = std::find(lru.begin(), lru.end(), key);
+        const bool hit = found != lru.end();
+        if (hit) {
+            lru.erase(found);
+            expected.hits++;
+        } else {
+            expected.misses++;
+            if (lru.size() == capacity / 16) {
+                lru.pop_back();
+                expected.evictions++;
+            }
+        }
+        lru.insert(lru.begin(), key);
+
+        bool computed = false;
+        const uint64_t value = cache.get(key, [&]() {
+            computed = true;
+            return value_of(key);
+        });
+        CHECK(value == value_of(key));
+        CHECK(computed == !hit);
+    }
+    for (const auto &lru : shards) {
+        expected.entries += lru.size();
+    }
+    const CacheStats stats = cache.stats();
+    CHECK(stats.hits == expected.hits && stats.misses == expected.misses);
+    CHECK(stats.evictions == expected.evictions && stats.entries == expected.entries);
+    CHECK(expected.hits > 0 && expected.evictions > 0);
+
+    // From many threads, every get returns the value of its key and is
+    // counted once
+    ShardedLruCache<uint64_t, uint64_t> shared(capacity);
+    ThreadPool pool(4);
+    std::vector<int> wrong(pool.size(), 0);
+    pool.parallel_for(100000, [&](size_t i, unsigned worker) {
+        const uint64_t key = (i * 2654435761ULL) % 1000;
+        wrong[worker] += shared.get(key, [&]() { return value_of(key); }) == value_of(key) ? 0 : 1;
+    }, 256);
+    const CacheStats shared_stats = shared.stats();
+    CHECK(std::count(wrong.begin(), wrong.end(), 0) == static_cast<long>(wrong.size()));
+    CHECK(shared_stats.hits + shared_stats.misses == 100000 && shared_stats.entries <= capacity);
+
+    // Locations are keyed on their rounded longitude/latitude: 4 digits
+    // share an entry between points 1e-5 degrees apart, unless the rounding
+    // separates them
+    ResultCache<int64_t> results(4);
+    std::set<std::pair<int64_t, int64_t>> keys;
+    std::uniform_real_distribution<double> lon(-50, -49.99);
+    std::uniform_real_distribution<double> lat(-20, -19.99);
+    uint64_t computed = 0;
+    for (int i = 0; i < 20000; i++) {
+        const Point p{lon(random), lat(random)};
+        keys.insert({std::llround(p.x * 1e4), std::llround(p.y * 1e4)});
+        const int64_t found = results.get(p, [&](const Point &q) {
+            computed++;
+            return std::llround(q.x * 1e4) * 1000000 + std::llround(q.y * 1e4);
+        });
+        CHECK(found == std::llround(p.x * 1e4) * 1000000 + std::llround(p.y * 1e4));
+    }
+    CHECK(computed == keys.size() && computed < 20000);
+}
+
+void test_triangulation()
+{
+    // Each polygon is cut into at most V + 2H - 2 counter-clockwise
+    // triangles (V distinct vertices, H holes; fewer when a bridge to a hole
+    // makes vertices collinear) that cover it exactly: their areas add up
+    // to the polygon's, and a point is in the polygon when it is in one of
+    // them, and then in no other
+    const std::vector<Geometry> features = lookup_features();
+    std::vector<Polygon> polygons;
+    for (const Geometry &feature : features) {
+        polygons.insert(polygons.end(), feature.polygons.begin(), feature.polygons.end());
+    }
+
+    // A comb of 20 teeth, with two holes in its back
+    Ring comb{{0, 0}, {40, 0}};
+    for (int tooth = 19; tooth >= 0; tooth--) {
+        comb.push_back(Point{tooth * 2.0 + 1.5, 3});
+        comb.push_back(Point{tooth * 2.0 + 1.5, 10});
+        comb.push_back(Point{tooth * 2.0 + 0.5, 10});
+        comb.push_back(Point{tooth * 2.0 + 0.5, 3});
+    }
+    comb.push_back(Point{0, 3});
+    comb.push_back(comb.front());
+    polygons.push_back(Polygon{{comb, {{5, 1}, {5, 2}, {6, 2}, {6, 1}, {5, 1}},
+                                {{30, 1}, {32, 1}, {31, 2.5}, {30, 1}}}});
+
+    std::mt19937 random(64);
+    for (const Polygon &polygon : polygons) {
+        std::vector<Point> vertices;
+        size_t distinct = 0;
+        double area = 0;
+        for (size_t k = 0; k < polygon.rings.size(); k++) {
+            const Ring &ring = polygon.rings[k];
+            vertices.insert(vertices.end(), ring.begin(), ring.end());
+            distinct += ring.size() - 1;
+            double twice = 0;
+            for (size_t i = 1; i < ring.size(); i++) {
+                twice += ring[i - 1].x * ring[i].y - ring[i].x * ring[i - 1].y;
+            }
+            area += (k == 0 ? 1 : -1) * std::fabs(twice) / 2;
+        }
+
+        const std::vector<uint32_t> indices = triangulate(polygon);
+        const size_t holes = polygon.rings.size() - 1;
+        CHECK(indices.size() <= 3 * (distinct + 2 * holes - 2) && indices.size() >= 3 * (distinct - 2));
+        double covered = 0;
+        bool counter_clockwise = true;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            const Point &a = vertices[indices[t]];
+            const Point &b = vertices[indices[t + 1]];
+            const Point &c = vertices[indices[t + 2]];
+            const double twice = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+            counter_clockwise = counter_clockwise && twice > 0;
+            covered += twice / 2;
+        }
+        CHECK(counter_clockwise);
+        CHECK(std::fabs(covered - area) < 1e-9 * area);
+
+        BBox box;
+        for (const Point &p : polygon.rings[0]) {
+            box.expand(p.x, p.y);
+        }
+        std::uniform_real_distribution<double> x(box.min_x, box.max_x);
+        std::uniform_real_distribution<double> y(box.min_y, box.max_y);
+        for (int i = 0; i < 500; i++) {
+            const Point p{x(random), y(random)};
+            int in_triangles = 0;
+            for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+                in_triangles += triangle_contains(vertices[indices[t]], vertices[indices[t + 1]],
+                                                  vertices[indices[t + 2]], p) ? 1 : 0;
+            }
+            const bool inside = polygon_contains(polygon, p);
+            CHECK(in_triangles == (inside ? 1 : 0));
+        }
+    }
+
+    // The triangle lookup finds what a scan of every ring finds
+    sqlite3 *db_handle;
+    CHECK(sqlite3_open(":memory:", &db_handle) == SQLITE_OK);
+    store_features(db_handle, features);
+    TriangleLookup lookup(db_handle, "states", "geom", "name");
+    sqlite3_close(db_handle);
+    CHECK(lookup.num_features() == features.size() && lookup.label(5) == "S5");
+
+    LookupStats stats;
+    for (const Point &p : lookup_points(20000, random)) {
+        CHECK(lookup.find(p, &stats) == brute_force_find(features, p));
+    }
+    CHECK(stats.triangles_tested > 0 && stats.rings_tested == 0);
+}
+
+void test_slab_lookup()
+{
+    // The star features, and below them a comb, whose horizontal edges
+    // share their y with many vertices
+    std::vector<Geometry> features = lookup_features();
+    Ring comb{{0, -12}, {40, -12}};
+    for (int tooth = 19; tooth >= 0; tooth--) {
+        comb.push_back(Point{tooth * 2.0 + 1.5, -9});
+        comb.push_back(Point{tooth * 2.0 + 1.5, -2});
+        comb.push_back(Point{tooth * 2.0 + 0.5, -2});
+        comb.push_back(Point{tooth * 2.0 + 0.5, -9});
+    }
+    comb.push_back(Point{0, -9});
+    comb.push_back(comb.front());
+    Geometry comb_feature = features[0];
+    comb_feature.polygons = {Polygon{{comb, {{5, -11}, {5, -10}, {6, -10}, {6, -11}, {5, -11}}}}};
+    features.push_back(comb_feature);
+
+    // Slabs between the distinct y of each feature, each edge stored in
+    // every slab it spans
+    size_t slabs = 0;
+    size_t slab_edges = 0;
+    std::vector<double> vertex_ys;
+    for (const Geometry &feature : features) {
+        std::set<double> ys;
+        for (const Polygon &polygon : feature.polygons) {
+            for (const Ring &ring : polygon.rings) {
+                for (const Point &p : ring) {
+                    ys.insert(p.y);
+                }
+            }
+        }
+        slabs += ys.size() - 1;
+        for (const Polygon &polygon : feature.polygons) {
+            for (const Ring &ring : polygon.rings) {
+                for (size_t i = 1; i < ring.size(); i++) {
+                    const double low = std::min(ring[i - 1].y, ring[i].y);
+                    const double high = std::max(ring[i - 1].y, ring[i].y);
+                    for (double y : ys) {
+                        slab_edges += y >= low && y < high ? 1 : 0;
+                    }
+                }
+            }
+        }
+        vertex_ys.insert(vertex_ys.end(), ys.begin(), ys.end());
+    }
+
+    sqlite3 *db_handle;
+    CHECK(sqlite3_open(":memory:", &db_handle) == SQLITE_OK);
+    store_features(db_handle, features);
+    SlabLookup lookup(db_handle, "states", "geom", "name");
+    sqlite3_close(db_handle);
+    CHECK(lookup.num_features() == features.size() && lookup.label(12) == "S12");
+    CHECK(lookup.num_slabs() == slabs && lookup.num_slab_edges() == slab_edges);
+
+    // Random points, points in the comb and points exactly at the height
+    // of a vertex, where a slab starts, find what a scan of every ring finds
+    std::mt19937 random(65);
+    std::vector<Point> points = lookup_points(20000, random);
+    std::uniform_real_distribution<double> x(-1, 41);
+    std::uniform_real_distribution<double> y(-13, -1);
+    std::uniform_int_distribution<size_t> vertex_y(0, vertex_ys.size() - 1);
+    for (int i = 0; i < 5000; i++) {
+        points.push_back(Point{x(random), y(random)});
+        points.push_back(Point{x(random), vertex_ys[vertex_y(random)]});
+    }
+    LookupStats stats;
+    size_t inside = 0;
+    for (const Point &p : points) {
+        const int64_t expected = brute_force_find(features, p);
+        CHECK(lookup.find(p, &stats) == expected);
+        inside += expected >= 0 ? 1 : 0;
+    }
+    CHECK(inside > points.size() / 4 && stats.slabs_searched > 0);
+}
+
+/**
+ * Plain SQLite stand-ins for SpatiaLite's X() and Y() of a POINT BLOB
+ */
+void point_coordinate(sqlite3_context *context, sqlite3_value *value, bool y)
+{
+    Geometry geom;
+    const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_value_blob(value));
+    if (blob == NULL || !decode_spatialite_blob(blob, sqlite3_value_bytes(value), geom) || geom.points.empty()) {
+        sqlite3_result_null(context);
+        return;
+    }
+    sqlite3_result_double(context, y ? geom.points[0].y : geom.points[0].x);
+}
+
+void point_x(sqlite3_context *context, int, sqlite3_value **argv)
+{
+    point_coordinate(context, argv[0], false);
+}
+
+void point_y(sqlite3_context *context, int, sqlite3_value **argv)
+{
+    point_coordinate(context, argv[0], true);
+}
+
+void test_viewport_cursor()
+{
+    // A POINT table with its R-tree and metadata as SpatiaLite lays them
+    // out, with gaps in the rowids, points stacked on one location and
+    // points on the edges of the viewport
+    sqlite3 *db_handle;
+    CHECK(sqlite3_open(":memory:", &db_handle) == SQLITE_OK);
+    sqlite3_create_function(db_handle, "X", 1, SQLITE_UTF8, NULL, point_x, NULL, NULL);
+    sqlite3_create_function(db_handle, "Y", 1, SQLITE_UTF8, NULL, point_y, NULL, NULL);
+    CHECK(sqlite3_exec(db_handle,
+                       "CREATE TABLE geometry_columns (f_table_name TEXT, f_geometry_column TEXT, "
+                       "geometry_type INTEGER, spatial_index_enabled INTEGER);"
+                       "INSERT INTO geometry_columns VALUES ('places', 'geom', 1, 1);"
+                       "CREATE TABLE places (id INTEGER PRIMARY KEY, geom BLOB);"
+                       "CREATE VIRTUAL TABLE idx_places_geom USING rtree(pkid, xmin, xmax, ymin, ymax);",
+                       NULL, NULL, NULL) == SQLITE_OK);
+
+    const BBox viewport{20.5, 10, 70.25, 60};
+    std::mt19937 random(66);
+    std::uniform_real_distribution<double> coordinate(0, 100);
+    std::vector<Point> points;
+    for (int i = 0; i < 3000; i++) {
+        points.push_back(Point{coordinate(random), coordinate(random)});
+    }
+    for (int i = 0; i < 40; i++) {
+        points.push_back(Point{viewport.min_x, viewport.min_y + i});
+        points.push_back(Point{viewport.min_x + i, viewport.max_y});
+        points.push_back(Point{std::nextafter(viewport.max_x, 100.0), viewport.min_y + i});
+        points.push_back(Point{33.3, 44.4});
+    }
+
+    sqlite3_stmt *insert_row;
+    sqlite3_stmt *insert_box;
+    CHECK(sqlite3_prepare_v2(db_handle, "INSERT INTO places VALUES (?, ?)", -1, &insert_row, NULL) == SQLITE_OK);
+    CHECK(sqlite3_prepare_v2(db_handle, "INSERT INTO idx_places_geom VALUES (?, ?, ?, ?, ?)", -1, &insert_box,
+                             NULL) == SQLITE_OK);
+    std::set<int64_t> expected;
+    for (size_t i = 0; i < points.size(); i++) {
+        const int64_t rowid = 3 * static_cast<int64_t>(i) + 1;
+        Geometry geom;
+        geom.type = GeometryType::Point;
+        geom.srid = 4326;
+        geom.points.push_back(points[i]);
+        const std::vector<uint8_t> blob = encode_spatialite_blob(geom);
+        sqlite3_bind_int64(insert_row, 1, rowid);
+        sqlite3_bind_blob(insert_row, 2, blob.data(), blob.size(), SQLITE_TRANSIENT);
+        CHECK(sqlite3_step(insert_row) == SQLITE_DONE);
+        sqlite3_reset(insert_row);
+        sqlite3_bind_int64(insert_box, 1, rowid);
+        sqlite3_bind_double(insert_box, 2, points[i].x);
+        sqlite3_bind_double(insert_box, 3, points[i].x);
+        sqlite3_bind_double(insert_box, 4, points[i].y);
+        sqlite3_bind_double(insert_box, 5, points[i].y);
+        CHECK(sqlite3_step(insert_box) == SQLITE_DONE);
+        sqlite3_reset(insert_box);
+        if (viewport.contains(points[i].x, points[i].y)) {
+            expected.insert(rowid);
+        }
+    }
+    sqlite3_finalize(insert_row);
+    sqlite3_finalize(insert_box);
+
+    // Read in one go, then one page per cursor resumed from the token of
+    // the previous one: both return every point of the viewport once
+    for (size_t page_size : {1, 7, 100, 5000}) {
+        std::vector<int64_t> streamed;
+        ViewportCursor cursor(db_handle, "places", "geom", viewport, page_size);
+        ViewportFeature feature;
+        while (cursor.next(feature)) {
+            CHECK(feature.geometry.type == GeometryType::Point);
+            streamed.push_back(feature.rowid);
+        }
+        CHECK(cursor.done() && cursor.token().empty());
+        CHECK(std::set<int64_t>(streamed.begin(), streamed.end()) == expected);
+        CHECK(streamed.size() == expected.size());
+
+        std::vector<int64_t> paged;
+        std::string token;
+        int pages = 0;
+        do {
+            std::unique_ptr<ViewportCursor> resumed;
+            if (token.empty()) {
+                resumed.reset(new ViewportCursor(db_handle, "places", "geom", viewport, page_size));
+            } else {
+                resumed.reset(new ViewportCursor(db_handle, "places", "geom", token, page_size));
+            }
+            const std::vector<ViewportFeature> page = resumed->next_page();
+            CHECK(page.size() <= page_size);
+            for (const ViewportFeature &f : page) {
+                paged.push_back(f.rowid);
+            }
+            token = resumed->token();
+            pages++;
+        } while (!token.empty() && pages < 10000);
+        CHECK(paged == streamed);
+        if (page_size == 7) {
+            CHECK(cursor.tiles_per_side() > 1 && pages >= static_cast<int>(expected.size() / 7));
+        }
+    }
+
+    bool rejected = false;
+    try {
+        ViewportCursor bad(db_handle, "places", "geom", std::string("1,2,3"), 10);
+    } catch (const std::runtime_error &) {
+        rejected = true;
+    }
+    CHECK(rejected);
+    sqlite3_close(db_handle);
+}
+
+void test_border_index()
+{
+    // A grid of star-shaped, non-overlapping polygons, in a projected CRS
+    std::mt19937 random(2);
+    std::uniform_real_distribution<double> unit(0, 1);
+    std::vector<std::string> labels;
+    std::vector<Ring> rings;
+    for (int row = 0; row < 4; row++) {
+        for (int column = 0; column < 5; column++) {
+            const Point centre{column * 100.0 + 50, row * 100.0 + 50};
+            Ring ring;
+            for (int k = 0; k < 24; k++) {
+                const double angle = k * 2 * 3.14159265358979323846 / 24;
+                const double radius = 20 + 25 * unit(random);
+                ring.push_back(Point{centre.x + radius * std::cos(angle), centre.y + radius * std::sin(angle)});
+            }
+            ring.push_back(ring.front());
+            labels.push_back("F" + std::to_string(rings.size()));
+            rings.push_back(ring);
+        }
+    }
+
+    sqlite3 *db_handle;
+    CHECK(sqlite3_open(":memory:", &db_handle) == SQLITE_OK);
+    CHECK(sqlite3_exec(db_handle, "CREATE TABLE features (label TEXT, geom BLOB)", NULL, NULL, NULL) == SQLITE_OK);
+    sqlite3_stmt *stmt;
+    CHECK(sqlite3_prepare_v2(db_handle, "INSERT INTO features VALUES (?, ?)", -1, &stmt, NULL) == SQLITE_OK);
+    for (size_t i = 0; i < rings.size(); i++) {
+        Geometry polygon;
+        polygon.type = GeometryType::Polygon;
+        polygon.srid = 3857;
+        polygon.polygons.push_back(Polygon{{rings[i]}});
+        const std::vector<uint8_t> blob = encode_spatialite_blob(polygon);
+        sqlite3_bind_text(stmt, 1, labels[i].c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_blob(stmt, 2, blob.data(), blob.size(), SQLITE_TRANSIENT);
+        CHECK(sqlite3_step(stmt) == SQLITE_DONE);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    const BorderIndex borders(db_handle, "features", "geom", "label");
+    CHECK(!borders.geographic());
+    CHECK(borders.num_features() == rings.size());
+
+    std::uniform_real_distribution<double> x(-50, 550);
+    std::uniform_real_distribution<double> y(-50, 450);
+    for (int query = 0; query < 2000; query++) {
+        const Point p{x(random), y(random)};
+
+        int64_t inside = -1;
+        double expected = std::numeric_limits<double>::infinity();
+        int64_t expected_feature = -1;
+        for (size_t f = 0; f < rings.size(); f++) {
+            if (ring_contains(rings[f], p)) inside = static_cast<int64_t>(f);
+        }
+        const int64_t inside_feature = inside >= 0 ? borders.feature(labels[inside]) : -1;
+        CHECK(borders.containing(p) == inside_feature);
+
+        for (size_t f = 0; f < rings.size(); f++) {
+            if (static_cast<int64_t>(f) == inside) continue;
+            for (size_t i = 0; i + 1 < rings[f].size(); i++) {
+                const double d = segment_distance(p, rings[f][i], rings[f][i + 1]);
+                if (d < expected) {
+                    expected = d;
+                    expected_feature = static_cast<int64_t>(f);
+                }
+            }
+        }
+        const BorderMatch match = borders.nearest(p, inside_feature);
+        CHECK(std::fabs(match.distance - expected) < 1e-9);
+        CHECK(match.feature >= 0 && borders.label(match.feature) == labels[expected_feature]);
+    }
+    sqlite3_close(db_handle);
+}
+
+void test_tracks_csv()
+{
+    const std::string path = write_file("tracks.csv",
+        "track,time,lon,lat\n"
+        "a,2024-05-01T10:00:30Z,-46.1,-23.1\n"
+        "a,1714557600,-46.0,-23.0\n"
+        "b,1714557600.5,-45.0,-22.0\n"
+        "b,2024-05-01 10:01:00,-45.1,-22.1\n");
+    std::vector<Track> tracks;
+    CHECK(read_tracks_csv(path, tracks) == 0);
+    CHECK(tracks.size() == 2);
+    if (tracks.size() == 2) {
+        // Sorted by time: 1714557600 is 2024-05-01T10:00:00Z
+        CHECK(tracks[0].name == "a" && tracks[0].times.size() == 2);
+        CHECK(tracks[0].times[0] == 1714557600 && tracks[0].times[1] == 1714557630);
+        CHECK(tracks[0].points[0].x == -46.0);
+        CHECK(tracks[1].times[0] == 1714557600.5 && tracks[1].times[1] == 1714557660);
+        CHECK(format_time(tracks[0].times[0]) == "2024-05-01T10:00:00Z");
+    }
+    std::remove(path.c_str());
+
+    // An epoch too large for any integer type is an error, not a date
+    const std::string bad = write_file("bad_tracks.csv",
+        "track,time,lon,lat\n"
+        "a,99999999999999999999,0,0\n");
+    std::vector<Track> rejected;
+    CHECK(read_tracks_csv(bad, rejected) != 0);
+    std::remove(bad.c_str());
+}
+
+/**
+ * Runs dbscan() and checks it against brute force: core points, their
+ * connected components, and every other point in the cluster of its
+ * nearest core point
+ *
+ * @return number of clusters
+ */
+int64_t check_dbscan(const std::vector<JoinPoint> &points, double distance, size_t min_points, bool geographic)
+{
+    ThreadPool pool(4);
+    const std::vector<int64_t> clusters = dbscan(points, distance, min_points, geographic, pool);
+
+    const size_t n = points.size();
+    std::vector<std::vector<size_t>> neighbours(n);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            if (point_distance(points[i].point, points[j].point, geographic) <= distance) neighbours[i].push_back(j);
+        }
+    }
+    std::vector<bool> core(n);
+    for (size_t i = 0; i < n; i++) core[i] = neighbours[i].size() >= min_points;
+
+    std::vector<int64_t> component(n, -1);
+    int64_t num_components = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!core[i] || component[i] >= 0) continue;
+        std::vector<size_t> stack(1, i);
+        component[i] = num_components;
+        while (!stack.empty()) {
+            const size_t k = stack.back();
+            stack.pop_back();
+            for (size_t j : neighbours[k]) {
+                if (core[j] && component[j] < 0) {
+                    component[j] = num_components;
+                    stack.push_back(j);
+                }
+            }
+        }
+        num_components++;
+    }
+
+    // Clusters are numbered in order of first appearance
+    std::vector<int64_t> number(num_components, -1);
+    int64_t next = 0;
+    for (size_t i = 0; i < n; i++) {
+        int64_t owner = core[i] ? component[i] : -1;
+        if (!core[i]) {
+            double nearest = std::numeric_limits<double>::infinity();
+            for (size_t j : neighbours[i]) {
+                const double d = point_distance(points[i].point, points[j].point, geographic);
+                if (core[j] && d < nearest) {
+                    nearest = d;
+                    owner = component[j];
+                }
+            }
+        }
+        int64_t expected = -1;
+        if (owner >= 0) {
+            if (number[owner] < 0) number[owner] = next++;
+            expected = number[owner];
+        }
+        CHECK(clusters[i] == expected);
+    }
+    return next;
+}
+
+void test_dbscan()
+{
+    // Blobs of points around a few cities, and noise between them
+    std::mt19937 random(3);
+    std::normal_distribution<double> spread(0, 0.01);
+    std::uniform_real_distribution<double> noise_x(-47, -43);
+    std::uniform_real_distribution<double> noise_y(-24, -22);
+    const Point centres[] = {{-46.63, -23.55}, {-43.2, -22.9}, {-45.9, -23.2}, {-46.4, -23.9}};
+    std::vector<JoinPoint> points;
+    for (int i = 0; i < 800; i++) {
+        const Point &centre = centres[i % 4];
+        points.push_back(JoinPoint{i, Point{centre.x + spread(random), centre.y + spread(random)}});
+    }
+    for (int i = 0; i < 200; i++) {
+        points.push_back(JoinPoint{800 + i, Point{noise_x(random), noise_y(random)}});
+    }
+    CHECK(check_dbscan(points, 500, 5, true) >= 4);
+
+    // Enough projected points for several partitions, whose clusters
+    // span partition boundaries
+    std::uniform_real_distribution<double> coordinate(0, 10000);
+    points.clear();
+    for (int i = 0; i < 12000; i++) points.push_back(JoinPoint{i, Point{coordinate(random), coordinate(random)}});
+    CHECK(check_dbscan(points, 60, 4, false) > 1);
+}
+
+void test_kernel_density()
+{
+    std::mt19937 random(5);
+    std::uniform_real_distribution<double> x(-500, 10500);
+    std::uniform_real_distribution<double> y(-500, 6500);
+    std::vector<Point> points;
+    for (int i = 0; i < 300; i++) points.push_back(Point{x(random), y(random)});
+
+    BBox bbox;
+    bbox.expand(0, 0);
+    bbox.expand(10000, 6000);
+    const double bandwidth = 700;
+    const double pi = 3.14159265358979323846;
+    ThreadPool pool(4);
+
+    for (DensityKernel kernel : {DensityKernel::Gaussian, DensityKernel::Epanechnikov, DensityKernel::Quartic}) {
+        DensityGrid grid;
+        CHECK(kernel_density(points, bbox, 300, kernel, bandwidth, false, pool, grid) == 0);
+        CHECK(grid.width == 300 && grid.height == 180);
+        CHECK(grid.values.size() == static_cast<size_t>(grid.width) * grid.height);
+
+        // Every point against every cell whose centre is within reach
+        const double reach = kernel_reach(kernel, bandwidth);
+        double max_difference = 0;
+        double peak = 0;
+        for (uint32_t row = 0; row < grid.height; row++) {
+            for (uint32_t column = 0; column < grid.width; column++) {
+                const double cx = grid.bbox.min_x + (column + 0.5) * grid.cell_size;
+                const double cy = grid.bbox.max_y - (row + 0.5) * grid.cell_size;
+                double expected = 0;
+                for (const Point &p : points) {
+                    if (std::fabs(cx - p.x) > reach || std::fabs(cy - p.y) > reach) continue;
+                    const double u = ((cx - p.x) * (cx - p.x) + (cy - p.y) * (cy - p.y)) / (bandwidth * bandwidth);
+                    const double t = std::max(0.0, 1 - u);
+                    switch (kernel) {
+                        case DensityKernel::Gaussian:
+                            expected += std::exp(-0.5 * u) / (2 * pi);
+                            break;
+                        case DensityKernel::Epanechnikov:
+                            expected += t * 2 / pi;
+                            break;
+                        case DensityKernel::Quartic:
+                            expected += t * t * 3 / pi;
+                            break;
+                    }
+                }
+                expected *= 1e6 / (bandwidth * bandwidth);
+                peak = std::max(peak, expected);
+                max_difference = std::max(max_difference,
+                                          std::fabs(expected - grid.values[static_cast<size_t>(row) * grid.width + column]));
+            }
+        }
+        CHECK(peak > 0);
+        CHECK(max_difference <= 1e-4 * peak);
+    }
+
+    // Grids of more than MAX_DENSITY_CELLS are refused
+    BBox square;
+    square.expand(0, 0);
+    square.expand(10000, 10000);
+    DensityGrid grid;
+    CHECK(kernel_density(points, square, MAX_DENSITY_RESOLUTION + 1, DensityKernel::Quartic, bandwidth, false, pool,
+                         grid) != 0);
+}
+
+void test_nearest_site()
+{
+    std::mt19937 random(4);
+    std::uniform_real_distribution<double> lon(-180, 180);
+    std::uniform_real_distribution<double> lat(-89, 89);
+
+    // Sites all over the globe, sites of one region, and sites on the
+    // equator, all on one circle
+    std::vector<std::vector<JoinPoint>> site_sets(3);
+    for (int i = 0; i < 500; i++) site_sets[0].push_back(JoinPoint{i, Point{lon(random), lat(random)}});
+    std::uniform_real_distribution<double> region_x(-46.8, -46.4);
+    std::uniform_real_distribution<double> region_y(-23.8, -23.4);
+    for (int i = 0; i < 300; i++) site_sets[1].push_back(JoinPoint{i, Point{region_x(random), region_y(random)}});
+    for (int i = 0; i < 12; i++) site_sets[2].push_back(JoinPoint{i, Point{i * 30.0 - 180, 0}});
+
+    for (size_t set = 0; set < site_sets.size(); set++) {
+        const std::vector<JoinPoint> &sites = site_sets[set];
+        const NearestSiteIndex index(sites);
+        CHECK(index.num_sites() == sites.size());
+
+        for (int query = 0; query < 2000; query++) {
+            const Point p = set == 1 ? Point{region_x(random), region_y(random)} : Point{lon(random), lat(random)};
+            double expected = std::numeric_limits<double>::infinity();
+            for (const JoinPoint &site : sites) expected = std::min(expected, point_distance(p, site.point, true));
+
+            const SiteMatch match = index.nearest(p);
+            CHECK(match.id >= 0 && std::fabs(match.distance - expected) < 1e-6);
+        }
+    }
+}
+
+} // namespace
+
+int main()
+{
+    const struct {
+        const char *name;
+        void (*run)();
+    } tests[] = {
+        {"packed_rtree", test_packed_rtree},
+        {"geojson_reader", test_geojson_reader},
+        {"import_registry", test_import_registry},
+        {"shapefile_reader", test_shapefile_reader},
+        {"shapefile_charset", test_shapefile_charset},
+        {"spatialite_blob", test_spatialite_blob},
+        {"validation", test_validation},
+        {"adjacency", test_adjacency},
+        {"topology_display", test_topology_display},
+        {"coverage_grid", test_coverage_grid},
+        {"result_cache", test_result_cache},
+        {"triangulation", test_triangulation},
+        {"slab_lookup", test_slab_lookup},
+        {"viewport_cursor", test_viewport_cursor},
+        {"border_index", test_border_index},
+        {"tracks_csv", test_tracks_csv},
+        {"dbscan", test_dbscan},
+        {"kernel_density", test_kernel_density},
+        {"nearest_site", test_nearest_site},
+    };
+
+    for (const auto &test : tests) {
+        const int before = failures;
+        try {
+            test.run();
+        } catch (const std::exception &e) {
+            failures++;
+            std::cerr << test.name << ": " << e.what() << std::endl;
+        }
+        std::cout << (failures == before ? "PASS " : "FAIL ") << test.name << std::endl;
+    }
+    std::cout << failures << " failed checks" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
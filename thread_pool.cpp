@@ -0,0 +1,96 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned num_threads)
+{
+    if (num_threads == 0) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    for (unsigned worker = 1; worker < num_threads; worker++) {
+        threads_.emplace_back(&ThreadPool::worker_loop, this, worker);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    start_.notify_all();
+    for (auto &thread : threads_) {
+        thread.join();
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t index, unsigned worker)> &body,
+                              size_t chunk)
+{
+    if (count == 0) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        body_ = &body;
+        count_ = count;
+        chunk_ = chunk > 0 ? chunk : 1;
+        next_ = 0;
+        error_ = nullptr;
+        busy_ = static_cast<unsigned>(threads_.size());
+        generation_++;
+    }
+    start_.notify_all();
+
+    run_chunks(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return busy_ == 0; });
+    body_ = nullptr;
+
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+void ThreadPool::worker_loop(unsigned worker)
+{
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+            if (stopping_) return;
+            seen = generation_;
+        }
+
+        run_chunks(worker);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--busy_ == 0) {
+            done_.notify_one();
+        }
+    }
+}
+
+void ThreadPool::run_chunks(unsigned worker)
+{
+    while (true) {
+        const size_t begin = next_.fetch_add(chunk_);
+        if (begin >= count_) return;
+        const size_t end = std::min(begin + chunk_, count_);
+
+        try {
+            for (size_t index = begin; index < end; index++) {
+                (*body_)(index, worker);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+            // Stop handing out work
+            next_ = count_;
+            return;
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads running parallel loops
+ *
+ * The calling thread takes part in every loop as worker 0, so a pool of
+ * size 1 runs everything inline without starting any thread. Work is
+ * handed out in chunks from a shared counter, which keeps all workers
+ * busy when items take very different times, as polygons of a few dozen
+ * and a few hundred thousand vertices do.
+ *
+ * Per-thread resources (GEOS or PROJ contexts, scratch buffers) are best
+ * kept in a vector indexed by the worker number passed to the loop body.
+ */
+class ThreadPool {
+public:
+    // Upper bound accepted for a requested number of workers
+    static const unsigned MAX_THREADS = 1024;
+
+    /**
+     * @param num_threads number of workers including the calling thread,
+     *        0 for one per hardware thread
+     */
+    explicit ThreadPool(unsigned num_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * Number of workers, including the calling thread
+     */
+    unsigned size() const { return static_cast<unsigned>(threads_.size()) + 1; }
+
+    /**
+     * Runs body(index, worker) for every index in [0, count) and waits for
+     * all of them to finish
+     *
+     * @param count number of items
+     * @param body loop body; worker is in [0, size())
+     * @param chunk number of consecutive indices handed out at once
+     *
+     * The first exception thrown by the body is rethrown in the caller,
+     * once every worker has stopped.
+     */
+    void parallel_for(size_t count, const std::function<void(size_t index, unsigned worker)> &body,
+                      size_t chunk = 1);
+
+private:
+    void worker_loop(unsigned worker);
+    void run_chunks(unsigned worker);
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    bool stopping_ = false;
+    uint64_t generation_ = 0;
+    unsigned busy_ = 0;
+
+    // Current loop
+    const std::function<void(size_t, unsigned)> *body_ = nullptr;
+    size_t count_ = 0;
+    size_t chunk_ = 1;
+    std::atomic<size_t> next_{0};
+    std::exception_ptr error_;
+};
+
+#endif // THREAD_POOL_H
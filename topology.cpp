@@ -0,0 +1,469 @@
+#include "topology.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "sql_util.h"
+
+namespace {
+
+bool same_point(const Point &a, const Point &b)
+{
+    return a.x == b.x && a.y == b.y;
+}
+
+bool point_less(const Point &a, const Point &b)
+{
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+uint64_t point_hash(const Point &p)
+{
+    // + 0.0 folds -0.0 into 0.0, which compares equal to it
+    const double x = p.x + 0.0;
+    const double y = p.y + 0.0;
+    uint64_t hx, hy;
+    std::memcpy(&hx, &x, sizeof(hx));
+    std::memcpy(&hy, &y, sizeof(hy));
+    return hx * 0x9E3779B97F4A7C15ULL ^ (hy + 0x632BE59BD9B4E019ULL + (hx << 6) + (hx >> 2));
+}
+
+struct PointHash {
+    size_t operator()(const Point &p) const { return static_cast<size_t>(point_hash(p)); }
+};
+
+struct PointEqual {
+    bool operator()(const Point &a, const Point &b) const { return same_point(a, b); }
+};
+
+// Neighbours of a vertex the first time a ring went through it
+struct Visit {
+    Point prev;
+    Point next;
+};
+
+using JunctionSet = std::unordered_set<Point, PointHash, PointEqual>;
+
+/**
+ * Number of distinct vertices of a closed ring (the closing vertex
+ * repeats the first one)
+ */
+size_t ring_size(const Ring &ring)
+{
+    if (ring.size() > 1 && same_point(ring.front(), ring.back())) return ring.size() - 1;
+    return ring.size();
+}
+
+/**
+ * Marks the vertices where rings stop following the same path
+ */
+JunctionSet find_junctions(const std::vector<const Ring *> &rings)
+{
+    std::unordered_map<Point, Visit, PointHash, PointEqual> visits;
+    JunctionSet junctions;
+
+    for (const Ring *ring : rings) {
+        const size_t n = ring_size(*ring);
+        for (size_t i = 0; i < n; i++) {
+            const Point &p = (*ring)[i];
+            const Point &prev = (*ring)[(i + n - 1) % n];
+            const Point &next = (*ring)[(i + 1) % n];
+
+            auto inserted = visits.emplace(p, Visit{prev, next});
+            if (inserted.second) continue;
+
+            const Visit &first = inserted.first->second;
+            const bool same_path = (same_point(first.prev, prev) && same_point(first.next, next)) ||
+                                   (same_point(first.prev, next) && same_point(first.next, prev));
+            if (!same_path) {
+                junctions.insert(p);
+            }
+        }
+    }
+    return junctions;
+}
+
+/**
+ * Whether an arc reads smaller backwards; arcs are stored in their
+ * smaller direction so that both neighbours find the same one
+ */
+bool reversed_is_smaller(const std::vector<Point> &arc)
+{
+    for (size_t i = 0, j = arc.size() - 1; i < j; i++, j--) {
+        if (point_less(arc[j], arc[i])) return true;
+        if (point_less(arc[i], arc[j])) return false;
+    }
+    return false;
+}
+
+uint64_t arc_hash(const std::vector<Point> &arc)
+{
+    uint64_t hash = arc.size();
+    for (const Point &p : arc) {
+        hash = hash * 31 + point_hash(p);
+    }
+    return hash;
+}
+
+bool same_arc(const std::vector<Point> &a, const std::vector<Point> &b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (!same_point(a[i], b[i])) return false;
+    }
+    return true;
+}
+
+/**
+ * Deduplicates arcs as rings are cut
+ */
+class ArcIndex {
+public:
+    explicit ArcIndex(Topology &topology) : topology_(topology) {}
+
+    /**
+     * @param arc arc in ring order
+     * @return reference to the stored arc, ~index if stored reversed
+     */
+    int64_t add(std::vector<Point> arc)
+    {
+        const bool reversed = reversed_is_smaller(arc);
+        if (reversed) {
+            std::reverse(arc.begin(), arc.end());
+        }
+
+        const uint64_t hash = arc_hash(arc);
+        int64_t index = -1;
+        auto range = by_hash_.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (same_arc(topology_.arcs[it->second], arc)) {
+                index = static_cast<int64_t>(it->second);
+                break;
+            }
+        }
+        if (index < 0) {
+            index = static_cast<int64_t>(topology_.arcs.size());
+            topology_.arc_vertices += arc.size();
+            topology_.arcs.push_back(std::move(arc));
+            by_hash_.emplace(hash, static_cast<size_t>(index));
+        }
+        return reversed ? ~index : index;
+    }
+
+private:
+    Topology &topology_;
+    std::unordered_multimap<uint64_t, size_t> by_hash_;
+};
+
+/**
+ * Cuts a ring at its junctions
+ */
+std::vector<int64_t> cut_ring(const Ring &ring, const JunctionSet &junctions, ArcIndex &index)
+{
+    const size_t n = ring_size(ring);
+    std::vector<int64_t> refs;
+
+    size_t start = n;
+    for (size_t i = 0; i < n && start == n; i++) {
+        if (junctions.count(ring[i]) > 0) start = i;
+    }
+
+    if (start == n) {
+        // No junction: one closed arc, starting at its smallest vertex so
+        // that an identical ring gives the same arc
+        size_t first = 0;
+        for (size_t i = 1; i < n; i++) {
+            if (point_less(ring[i], ring[first])) first = i;
+        }
+        std::vector<Point> arc;
+        arc.reserve(n + 1);
+        for (size_t step = 0; step <= n; step++) {
+            arc.push_back(ring[(first + step) % n]);
+        }
+        refs.push_back(index.add(std::move(arc)));
+        return refs;
+    }
+
+    std::vector<Point> arc;
+    arc.push_back(ring[start]);
+    for (size_t step = 1; step <= n; step++) {
+        const Point &p = ring[(start + step) % n];
+        arc.push_back(p);
+        if (step == n || junctions.count(p) > 0) {
+            refs.push_back(index.add(std::move(arc)));
+            arc.clear();
+            arc.push_back(p);
+        }
+    }
+    return refs;
+}
+
+std::string json_array(const std::vector<int64_t> &values)
+{
+    std::string json = "[";
+    for (size_t i = 0; i < values.size(); i++) {
+        if (i > 0) json += ",";
+        json += std::to_string(values[i]);
+    }
+    return json + "]";
+}
+
+/**
+ * Reads back a JSON array written by json_array()
+ *
+ * @return false if the text is not an array of integers
+ */
+bool parse_json_array(const char *json, std::vector<int64_t> &values)
+{
+    values.clear();
+    while (*json == ' ') json++;
+    if (*json++ != '[') return false;
+    while (*json == ' ') json++;
+    if (*json == ']') return true;
+    while (true) {
+        char *end;
+        values.push_back(std::strtoll(json, &end, 10));
+        if (end == json) return false;
+        json = end;
+        while (*json == ' ') json++;
+        if (*json == ']') return true;
+        if (*json++ != ',') return false;
+    }
+}
+
+} // namespace
+
+Topology build_topology(const std::vector<Geometry> &geometries)
+{
+    Topology topology;
+
+    std::vector<const Ring *> rings;
+    for (const auto &geom : geometries) {
+        for (const auto &polygon : geom.polygons) {
+            for (const auto &ring : polygon.rings) {
+                if (ring_size(ring) < 3) continue;
+                rings.push_back(&ring);
+                topology.ring_vertices += ring.size();
+            }
+        }
+    }
+    const JunctionSet junctions = find_junctions(rings);
+
+    ArcIndex index(topology);
+    for (size_t f = 0; f < geometries.size(); f++) {
+        const auto &polygons = geometries[f].polygons;
+        for (size_t p = 0; p < polygons.size(); p++) {
+            for (size_t r = 0; r < polygons[p].rings.size(); r++) {
+                const Ring &ring = polygons[p].rings[r];
+                if (ring_size(ring) < 3) continue;
+
+                TopoRing topo_ring;
+                topo_ring.feature = f;
+                topo_ring.polygon = p;
+                topo_ring.ring = r;
+                topo_ring.arcs = cut_ring(ring, junctions, index);
+                topology.rings.push_back(std::move(topo_ring));
+            }
+        }
+    }
+    return topology;
+}
+
+Ring topology_ring(const std::vector<std::vector<Point>> &arcs, const std::vector<int64_t> &refs)
+{
+    Ring ring;
+    for (int64_t ref : refs) {
+        const bool reversed = ref < 0;
+        const std::vector<Point> &arc = arcs[reversed ? ~ref : ref];
+
+        // Consecutive arcs share their junction vertex
+        const size_t skip = ring.empty() ? 0 : 1;
+        if (reversed) {
+            ring.insert(ring.end(), arc.rbegin() + skip, arc.rend());
+        } else {
+            ring.insert(ring.end(), arc.begin() + skip, arc.end());
+        }
+    }
+    return ring;
+}
+
+int build_topology_tables(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                          const std::string &topology_prefix)
+{
+    const std::string arcs_table = topology_prefix + "_arcs";
+    const std::string rings_table = topology_prefix + "_rings";
+
+    // Read the polygons
+    sqlite3_stmt *stmt;
+    std::string sql_cmd = "SELECT rowid, " + quote_identifier(geometry_column) + " FROM " +
+        quote_identifier(table_name) + " WHERE " + quote_identifier(geometry_column) + " IS NOT NULL";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+
+    std::vector<int64_t> rowids;
+    std::vector<Geometry> geometries;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Geometry geom;
+        const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 1));
+        if (!decode_spatialite_blob(blob, sqlite3_column_bytes(stmt, 1), geom)) continue;
+        rowids.push_back(sqlite3_column_int64(stmt, 0));
+        geometries.push_back(std::move(geom));
+    }
+    sqlite3_finalize(stmt);
+
+    const int srid = geometries.empty() ? 0 : geometries[0].srid;
+    const Topology topology = build_topology(geometries);
+    geometries.clear();
+
+    // Store it
+    if (exec(db_handle, "BEGIN TRANSACTION;", "starting transaction") != 0) {
+        return 1;
+    }
+    auto fail = [&]() {
+        exec(db_handle, "ROLLBACK;", "rolling back");
+        return 1;
+    };
+
+    if (exec(db_handle, "SELECT DropTable(NULL, " + quote_literal(arcs_table) + ", 1)", "dropping arcs table") != 0 ||
+        exec(db_handle, "DROP TABLE IF EXISTS " + quote_identifier(rings_table), "dropping rings table") != 0 ||
+        exec(db_handle, "CREATE TABLE " + quote_identifier(arcs_table) +
+             " (arc_id INTEGER PRIMARY KEY, num_vertices INTEGER)", "creating arcs table") != 0 ||
+        exec(db_handle, "SELECT AddGeometryColumn(" + quote_literal(arcs_table) + ", 'Geometry', " +
+             std::to_string(srid) + ", 'LINESTRING', 'XY')", "adding geometry column") != 0 ||
+        exec(db_handle, "CREATE TABLE " + quote_identifier(rings_table) + " (feature_id INTEGER NOT NULL, "
+             "polygon INTEGER NOT NULL, ring INTEGER NOT NULL, arcs TEXT NOT NULL, "
+             "PRIMARY KEY (feature_id, polygon, ring)) WITHOUT ROWID", "creating rings table") != 0) {
+        return fail();
+    }
+
+    sql_cmd = "INSERT INTO " + quote_identifier(arcs_table) + " (arc_id, num_vertices, Geometry) VALUES (?, ?, ?)";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return fail();
+    }
+    Geometry line;
+    line.type = GeometryType::LineString;
+    line.srid = srid;
+    line.lines.resize(1);
+    for (size_t i = 0; i < topology.arcs.size(); i++) {
+        line.lines[0] = topology.arcs[i];
+        const std::vector<uint8_t> blob = encode_spatialite_blob(line);
+        sqlite3_bind_int64(stmt, 1, static_cast<int64_t>(i));
+        sqlite3_bind_int64(stmt, 2, static_cast<int64_t>(topology.arcs[i].size()));
+        sqlite3_bind_blob(stmt, 3, blob.data(), blob.size(), SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "Error inserting arc " << i << ": " << sqlite3_errmsg(db_handle) << std::endl;
+            sqlite3_finalize(stmt);
+            return fail();
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    sql_cmd = "INSERT INTO " + quote_identifier(rings_table) + " (feature_id, polygon, ring, arcs) VALUES (?, ?, ?, ?)";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return fail();
+    }
+    for (const TopoRing &ring : topology.rings) {
+        const std::string arcs = json_array(ring.arcs);
+        sqlite3_bind_int64(stmt, 1, rowids[ring.feature]);
+        sqlite3_bind_int64(stmt, 2, static_cast<int64_t>(ring.polygon));
+        sqlite3_bind_int64(stmt, 3, static_cast<int64_t>(ring.ring));
+        sqlite3_bind_text(stmt, 4, arcs.c_str(), -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "Error inserting ring: " << sqlite3_errmsg(db_handle) << std::endl;
+            sqlite3_finalize(stmt);
+            return fail();
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    if (exec(db_handle, "COMMIT;", "committing transaction") != 0) {
+        return 1;
+    }
+
+    const double saved = topology.ring_vertices > 0
+        ? 100.0 * (1.0 - static_cast<double>(topology.arc_vertices) / topology.ring_vertices) : 0;
+    char percent[32];
+    std::snprintf(percent, sizeof(percent), "%.1f", saved);
+    std::cout << "Built topology of " << table_name << ": " << topology.arcs.size() << " arcs, "
+        << topology.ring_vertices << " ring vertices stored as " << topology.arc_vertices << " arc vertices ("
+        << percent << "% fewer)" << std::endl;
+    return 0;
+}
+
+int read_topology_tables(sqlite3 *db_handle, const std::string &topology_prefix, Topology &topology,
+                         std::vector<int64_t> &feature_ids, int &srid)
+{
+    topology = Topology();
+    feature_ids.clear();
+    srid = 0;
+
+    sqlite3_stmt *stmt;
+    std::string sql_cmd = "SELECT arc_id, Geometry FROM " + quote_identifier(topology_prefix + "_arcs") +
+        " ORDER BY arc_id";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Geometry line;
+        const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 1));
+        if (sqlite3_column_int64(stmt, 0) != static_cast<int64_t>(topology.arcs.size()) ||
+            !decode_spatialite_blob(blob, sqlite3_column_bytes(stmt, 1), line) || line.lines.size() != 1) {
+            std::cerr << "Error reading arc " << topology.arcs.size() << " of " << topology_prefix << std::endl;
+            sqlite3_finalize(stmt);
+            return 1;
+        }
+        srid = line.srid;
+        topology.arc_vertices += line.lines[0].size();
+        topology.arcs.push_back(std::move(line.lines[0]));
+    }
+    sqlite3_finalize(stmt);
+
+    sql_cmd = "SELECT feature_id, polygon, ring, arcs FROM " + quote_identifier(topology_prefix + "_rings") +
+        " ORDER BY feature_id, polygon, ring";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const int64_t feature_id = sqlite3_column_int64(stmt, 0);
+        if (feature_ids.empty() || feature_ids.back() != feature_id) {
+            feature_ids.push_back(feature_id);
+        }
+
+        TopoRing ring;
+        ring.feature = feature_ids.size() - 1;
+        ring.polygon = static_cast<size_t>(sqlite3_column_int64(stmt, 1));
+        ring.ring = static_cast<size_t>(sqlite3_column_int64(stmt, 2));
+        const unsigned char *arcs = sqlite3_column_text(stmt, 3);
+        bool valid = arcs != NULL && parse_json_array(reinterpret_cast<const char *>(arcs), ring.arcs);
+        for (int64_t ref : ring.arcs) {
+            valid = valid && (ref < 0 ? ~ref : ref) < static_cast<int64_t>(topology.arcs.size());
+        }
+        if (!valid) {
+            std::cerr << "Error reading the arcs of feature " << feature_id << " of " << topology_prefix << std::endl;
+            sqlite3_finalize(stmt);
+            return 1;
+        }
+
+        // Consecutive arcs share a vertex
+        topology.ring_vertices += 1;
+        for (int64_t ref : ring.arcs) {
+            topology.ring_vertices += topology.arcs[ref < 0 ? ~ref : ref].size() - 1;
+        }
+        topology.rings.push_back(std::move(ring));
+    }
+    sqlite3_finalize(stmt);
+    return 0;
+}
@@ -0,0 +1,97 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "geometry.h"
+
+/**
+ * Arc references of one polygon ring
+ *
+ * As in TopoJSON, a reference i >= 0 is arc i as stored and ~i (-i - 1)
+ * is arc i reversed. Joining the arcs, without repeating the vertex they
+ * share, gives back the ring.
+ */
+struct TopoRing {
+    size_t feature = 0;   // index of the geometry the ring belongs to
+    size_t polygon = 0;   // polygon of the geometry
+    size_t ring = 0;      // ring of the polygon, 0 for the exterior ring
+    std::vector<int64_t> arcs;
+};
+
+/**
+ * Shared-edge topology of a set of polygonal geometries
+ */
+struct Topology {
+    std::vector<std::vector<Point>> arcs;   // unique arcs, each stored once
+    std::vector<TopoRing> rings;            // every ring, as arc references
+    uint64_t ring_vertices = 0;             // vertices of the input rings
+    uint64_t arc_vertices = 0;              // vertices of the unique arcs
+};
+
+/**
+ * Splits polygon rings into arcs shared between neighbours
+ *
+ * @param geometries polygonal geometries; other types are skipped
+ * @return arcs and the arc references of every ring
+ *
+ * A vertex is a junction where rings stop following the same path: when
+ * it is visited again with neighbours other than the ones it had the
+ * first time, in either direction. Rings are cut at their junctions and
+ * identical arcs, in either direction, are stored once; a border shared
+ * by two states becomes one arc referenced by both. Rings without a
+ * junction become a single closed arc, also shared if another ring
+ * follows it exactly (an enclave and the hole it fills). Borders must
+ * share their vertices exactly, as they do in topologically clean data
+ * such as IBGE's, for arcs to be shared.
+ */
+Topology build_topology(const std::vector<Geometry> &geometries);
+
+/**
+ * Rebuilds a ring from its arc references
+ *
+ * @param arcs arcs the references point into: the arcs of a topology, or
+ *        versions of them simplified with their end points kept
+ * @param refs arc references of the ring
+ * @return closed ring
+ */
+Ring topology_ring(const std::vector<std::vector<Point>> &arcs, const std::vector<int64_t> &refs);
+
+/**
+ * Builds the topology of a polygon table and stores it in two tables
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table holding the polygons
+ * @param geometry_column geometry column of the table
+ * @param topology_prefix prefix of the tables to (re)create
+ * @return 0 on success, 1 on failure
+ *
+ * `<prefix>_arcs` holds the unique arcs (arc_id, num_vertices and a
+ * LINESTRING "Geometry" column in the SRID of the table).
+ * `<prefix>_rings` holds, for each ring of each feature (feature_id is
+ * the rowid of the feature), its arc references as a JSON array:
+ * (feature_id, polygon, ring, arcs). The polygon table keeps its
+ * geometries: the tables are what DisplayQuery reads, and simplifying the
+ * arcs instead of the polygons keeps neighbouring borders identical.
+ */
+int build_topology_tables(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                          const std::string &topology_prefix);
+
+/**
+ * Reads the topology stored by build_topology_tables()
+ *
+ * @param db_handle handle to the database connection
+ * @param topology_prefix prefix of the tables
+ * @param topology arcs and rings; the feature of a ring indexes feature_ids
+ * @param feature_ids rowid of each feature, in increasing order
+ * @param srid SRID of the arcs
+ * @return 0 on success, 1 on failure
+ */
+int read_topology_tables(sqlite3 *db_handle, const std::string &topology_prefix, Topology &topology,
+                         std::vector<int64_t> &feature_ids, int &srid);
+
+#endif // TOPOLOGY_H
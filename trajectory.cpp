@@ -0,0 +1,364 @@
+#include "trajectory.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+
+#include "border_index.h"
+#include "sql_util.h"
+#include "thread_pool.h"
+
+namespace {
+
+// Consecutive track segments sharing one border index query
+const size_t TRACK_RUN_SIZE = 32;
+
+// Intersections closer than this along the track (in segments) are the
+// same crossing, seen from the two states sharing the border
+const double SAME_CROSSING = 1e-9;
+
+/**
+ * Days from 1970-01-01 to a date of the proleptic Gregorian calendar
+ * (Howard Hinnant's days_from_civil)
+ */
+int64_t days_from_civil(int64_t y, int m, int d)
+{
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const int64_t yoe = y - era * 400;
+    const int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/**
+ * Inverse of days_from_civil()
+ */
+void civil_from_days(int64_t z, int64_t &y, int &m, int &d)
+{
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const int64_t doe = z - era * 146097;
+    const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const int64_t mp = (5 * doy + 2) / 153;
+    d = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+    m = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+    y = yoe + era * 400 + (m <= 2);
+}
+
+/**
+ * Parses an ISO 8601 UTC time (2024-05-01T10:00:00Z, fractional seconds
+ * allowed) or a number of seconds since the epoch
+ */
+bool parse_time(const std::string &text, double &seconds)
+{
+    // Epoch seconds first: read as a date, their digits would overflow %d
+    const char *begin = text.c_str();
+    char *end = NULL;
+    errno = 0;
+    const long long whole = std::strtoll(begin, &end, 10);
+    if (end != begin && errno == 0) {
+        if (*end == '\0') {
+            seconds = static_cast<double>(whole);
+            return true;
+        }
+        if (*end == '.') {
+            seconds = std::strtod(begin, &end);
+            return *end == '\0';
+        }
+    }
+
+    int year, month, day, hour, minute;
+    double second;
+    if (std::sscanf(begin, "%d-%d-%d%*1[T ]%d:%d:%lf", &year, &month, &day, &hour, &minute, &second) != 6) {
+        return false;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > 31) return false;
+    seconds = days_from_civil(year, month, day) * 86400.0 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+/**
+ * Position and time at a parameter along a track: the integer part is
+ * the segment, the fraction the position on it
+ */
+void track_at(const Track &track, double param, Point &point, double &time)
+{
+    const size_t last = track.points.size() - 1;
+    size_t i = std::min(static_cast<size_t>(param), last);
+    double t = param - i;
+    if (i == last && last > 0) {
+        i = last - 1;
+        t = 1;
+    }
+    const size_t j = std::min(i + 1, last);
+    point = Point{track.points[i].x + (track.points[j].x - track.points[i].x) * t,
+                  track.points[i].y + (track.points[j].y - track.points[i].y) * t};
+    time = track.times[i] + (track.times[j] - track.times[i]) * t;
+}
+
+double orient(const Point &a, const Point &b, const Point &c)
+{
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+/**
+ * Crossings of one track; runs on a worker thread
+ */
+void track_crossings(const Track &track, size_t index, const BorderIndex &borders,
+                     std::vector<BorderCrossing> &crossings)
+{
+    if (track.points.size() < 2) return;
+
+    struct Segment {
+        Point a;
+        Point b;
+        BBox box;
+    };
+
+    // Parameters along the track of every intersection with a boundary
+    std::vector<double> params;
+    std::vector<Segment> candidates;
+    const size_t num_segments = track.points.size() - 1;
+    for (size_t first = 0; first < num_segments; first += TRACK_RUN_SIZE) {
+        const size_t last = std::min(first + TRACK_RUN_SIZE, num_segments);
+
+        BBox run_box;
+        for (size_t i = first; i <= last; i++) {
+            run_box.expand(track.points[i].x, track.points[i].y);
+        }
+        candidates.clear();
+        borders.visit_segments(run_box, [&](int64_t, const Point &a, const Point &b) {
+            Segment segment{a, b, BBox()};
+            segment.box.expand(a.x, a.y);
+            segment.box.expand(b.x, b.y);
+            candidates.push_back(segment);
+        });
+
+        for (size_t i = first; i < last; i++) {
+            const Point &p = track.points[i];
+            const Point &q = track.points[i + 1];
+            BBox box;
+            box.expand(p.x, p.y);
+            box.expand(q.x, q.y);
+
+            for (const Segment &segment : candidates) {
+                if (!box.intersects(segment.box)) continue;
+
+                // Half-open on both segments, so that a crossing through a
+                // shared vertex is counted once
+                const double o1 = orient(p, q, segment.a);
+                const double o2 = orient(p, q, segment.b);
+                if ((o1 > 0) == (o2 > 0)) continue;
+                const double o3 = orient(segment.a, segment.b, p);
+                const double o4 = orient(segment.a, segment.b, q);
+                if ((o3 > 0) == (o4 > 0)) continue;
+
+                params.push_back(i + o3 / (o3 - o4));
+            }
+        }
+    }
+    std::sort(params.begin(), params.end());
+
+    // One transition per group of coincident intersections; the state
+    // after it is the one halfway to the next group
+    int64_t current = borders.containing(track.points[0]);
+    for (size_t g = 0; g < params.size();) {
+        size_t next = g + 1;
+        while (next < params.size() && params[next] - params[g] < SAME_CROSSING) next++;
+        const double until = next < params.size() ? params[next] : static_cast<double>(num_segments);
+
+        Point probe;
+        double probe_time;
+        track_at(track, (params[g] + until) / 2, probe, probe_time);
+        const int64_t state = borders.containing(probe);
+        if (state != current) {
+            BorderCrossing crossing;
+            crossing.track = index;
+            crossing.from = current;
+            crossing.to = state;
+            track_at(track, params[g], crossing.point, crossing.time);
+            crossings.push_back(crossing);
+            current = state;
+        }
+        g = next;
+    }
+}
+
+} // namespace
+
+int read_tracks_csv(const std::string &path, std::vector<Track> &tracks)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Error opening tracks " << path << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, size_t> by_name;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        if (line_number == 1 || trim(line).empty()) continue;   // header
+
+        std::vector<std::string> fields;
+        size_t begin = 0;
+        while (true) {
+            const size_t comma = line.find(',', begin);
+            fields.push_back(trim(line.substr(begin, comma == std::string::npos ? std::string::npos : comma - begin)));
+            if (comma == std::string::npos) break;
+            begin = comma + 1;
+        }
+
+        double time;
+        char *end_x = NULL;
+        char *end_y = NULL;
+        Point p{0, 0};
+        if (fields.size() == 4) {
+            p.x = std::strtod(fields[2].c_str(), &end_x);
+            p.y = std::strtod(fields[3].c_str(), &end_y);
+        }
+        if (fields.size() != 4 || !parse_time(fields[1], time) || end_x == fields[2].c_str() ||
+            end_y == fields[3].c_str()) {
+            std::cerr << "Error in tracks " << path << ", line " << line_number << ": expected track,time,lon,lat"
+                << std::endl;
+            return 1;
+        }
+
+        auto found = by_name.find(fields[0]);
+        if (found == by_name.end()) {
+            found = by_name.emplace(fields[0], tracks.size()).first;
+            tracks.push_back(Track());
+            tracks.back().name = fields[0];
+        }
+        Track &track = tracks[found->second];
+        track.points.push_back(p);
+        track.times.push_back(time);
+    }
+
+    // Fixes may come out of order from the loggers
+    for (Track &track : tracks) {
+        std::vector<size_t> order(track.points.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return track.times[a] < track.times[b]; });
+
+        Track sorted;
+        sorted.name = track.name;
+        for (size_t i : order) {
+            sorted.points.push_back(track.points[i]);
+            sorted.times.push_back(track.times[i]);
+        }
+        track = std::move(sorted);
+    }
+    return 0;
+}
+
+int store_tracks(sqlite3 *db_handle, const std::string &table_name, const std::vector<Track> &tracks, int srid)
+{
+    if (exec(db_handle, "BEGIN TRANSACTION;", "starting transaction") != 0) {
+        return 1;
+    }
+    auto fail = [&]() {
+        exec(db_handle, "ROLLBACK;", "rolling back");
+        return 1;
+    };
+
+    if (exec(db_handle, "SELECT DropTable(NULL, " + quote_literal(table_name) + ", 1)", "dropping tracks table") != 0 ||
+        exec(db_handle, "CREATE TABLE " + quote_identifier(table_name) +
+             " (id INTEGER PRIMARY KEY, name TEXT NOT NULL, start_time TEXT, end_time TEXT, num_points INTEGER, "
+             "times TEXT)", "creating tracks table") != 0 ||
+        exec(db_handle, "SELECT AddGeometryColumn(" + quote_literal(table_name) + ", 'Geometry', " +
+             std::to_string(srid) + ", 'LINESTRING', 'XY')", "adding geometry column") != 0) {
+        return fail();
+    }
+
+    sqlite3_stmt *stmt;
+    const std::string sql_cmd = "INSERT INTO " + quote_identifier(table_name) +
+        " (name, start_time, end_time, num_points, times, Geometry) VALUES (?, ?, ?, ?, ?, ?)";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return fail();
+    }
+
+    for (const Track &track : tracks) {
+        if (track.points.size() < 2) continue;   // not a LINESTRING
+
+        Geometry line;
+        line.type = GeometryType::LineString;
+        line.srid = srid;
+        line.lines.push_back(track.points);
+        const std::vector<uint8_t> blob = encode_spatialite_blob(line);
+
+        std::string times = "[";
+        char number[32];
+        for (size_t i = 0; i < track.times.size(); i++) {
+            std::snprintf(number, sizeof(number), "%s%.3f", i > 0 ? "," : "", track.times[i]);
+            times += number;
+        }
+        times += "]";
+
+        sqlite3_bind_text(stmt, 1, track.name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, format_time(track.times.front()).c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, format_time(track.times.back()).c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 4, static_cast<int64_t>(track.points.size()));
+        sqlite3_bind_text(stmt, 5, times.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_blob(stmt, 6, blob.data(), blob.size(), SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "Error inserting track " << track.name << ": " << sqlite3_errmsg(db_handle) << std::endl;
+            sqlite3_finalize(stmt);
+            return fail();
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    if (exec(db_handle, "SELECT CreateSpatialIndex(" + quote_literal(table_name) + ", 'Geometry')",
+             "creating spatial index") != 0 ||
+        exec(db_handle, "COMMIT;", "committing transaction") != 0) {
+        return fail();
+    }
+    return 0;
+}
+
+std::vector<BorderCrossing> find_border_crossings(const std::vector<Track> &tracks, const BorderIndex &borders,
+                                                  ThreadPool &pool)
+{
+    std::vector<std::vector<BorderCrossing>> per_track(tracks.size());
+    pool.parallel_for(tracks.size(), [&](size_t index, unsigned) {
+        track_crossings(tracks[index], index, borders, per_track[index]);
+    });
+
+    std::vector<BorderCrossing> crossings;
+    for (const auto &track : per_track) {
+        crossings.insert(crossings.end(), track.begin(), track.end());
+    }
+    return crossings;
+}
+
+std::string format_time(double seconds)
+{
+    const int64_t whole = static_cast<int64_t>(std::floor(seconds));
+    int64_t days = whole / 86400;
+    int64_t rest = whole % 86400;
+    if (rest < 0) {
+        rest += 86400;
+        days--;
+    }
+
+    int64_t year;
+    int month, day;
+    civil_from_days(days, year, month, day);
+
+    char text[32];
+    std::snprintf(text, sizeof(text), "%04lld-%02d-%02dT%02d:%02d:%02dZ", static_cast<long long>(year), month, day,
+                  static_cast<int>(rest / 3600), static_cast<int>(rest / 60 % 60), static_cast<int>(rest % 60));
+    return text;
+}
@@ -0,0 +1,84 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "geometry.h"
+
+class BorderIndex;
+class ThreadPool;
+
+/**
+ * A GPS track: timestamped positions, in time order
+ */
+struct Track {
+    std::string name;
+    std::vector<Point> points;
+    std::vector<double> times;   // seconds since 1970-01-01 UTC, one per point
+};
+
+/**
+ * A state line crossed by a track
+ */
+struct BorderCrossing {
+    size_t track;    // index of the track
+    double time;     // interpolated between the fixes around the crossing
+    Point point;     // in the SRID of the border index
+    int64_t from;    // feature left, -1 when outside all of them
+    int64_t to;      // feature entered, -1 when outside all of them
+};
+
+/**
+ * Reads GPS fixes from a CSV file into tracks
+ *
+ * @param path file to read; a header line, then one "track,time,lon,lat"
+ *        line per fix, time being ISO 8601 UTC (2024-05-01T10:00:00Z) or
+ *        seconds since the epoch
+ * @param tracks tracks, in order of first appearance, each sorted by time
+ * @return 0 on success, 1 on failure
+ */
+int read_tracks_csv(const std::string &path, std::vector<Track> &tracks);
+
+/**
+ * Stores tracks as LINESTRINGs
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table to (re)create, with columns (id, name,
+ *        start_time, end_time, num_points, times) and a LINESTRING
+ *        "Geometry" column with a spatial index; times is a JSON array
+ *        with the time of every vertex
+ * @param tracks tracks to store, in the given SRID
+ * @param srid SRID of the track coordinates
+ * @return 0 on success, 1 on failure
+ */
+int store_tracks(sqlite3 *db_handle, const std::string &table_name, const std::vector<Track> &tracks, int srid);
+
+/**
+ * Finds where tracks cross the boundaries of a border index
+ *
+ * @param tracks tracks, in the SRID of the border index
+ * @param borders boundary segments of the features
+ * @param pool threads, one track per task
+ * @return crossings, by track then time
+ *
+ * Each run of consecutive track segments fetches the boundary segments
+ * around it from the index once, and every track segment is intersected
+ * with those whose box it meets, so a crossing is found wherever it is,
+ * however short the stay in a state. The intersections along the track
+ * are then sorted; the two coincident ones of a shared border become a
+ * single transition, and the state after each one is checked with a
+ * point-in-polygon test, which drops the tracks only touching a line.
+ */
+std::vector<BorderCrossing> find_border_crossings(const std::vector<Track> &tracks, const BorderIndex &borders,
+                                                  ThreadPool &pool);
+
+/**
+ * Formats a time as ISO 8601 UTC, e.g. 2024-05-01T10:00:00Z
+ */
+std::string format_time(double seconds);
+
+#endif // TRAJECTORY_H
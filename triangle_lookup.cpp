@@ -0,0 +1,85 @@
+#include "triangle_lookup.h"
+
+#include <stdexcept>
+
+#include "sql_util.h"
+#include "triangulation.h"
+
+bool triangle_contains(const Point &a, const Point &b, const Point &c, const Point &p)
+{
+    // Unnormalized barycentric coordinates: all of the same sign inside
+    const double d1 = (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+    const double d2 = (c.x - b.x) * (p.y - b.y) - (c.y - b.y) * (p.x - b.x);
+    const double d3 = (a.x - c.x) * (p.y - c.y) - (a.y - c.y) * (p.x - c.x);
+    const bool has_negative = d1 < 0 || d2 < 0 || d3 < 0;
+    const bool has_positive = d1 > 0 || d2 > 0 || d3 > 0;
+    return !(has_negative && has_positive);
+}
+
+TriangleLookup::TriangleLookup(sqlite3 *db_handle, const std::string &table_name,
+                               const std::string &geometry_column, const std::string &label_column)
+{
+    sqlite3_stmt *stmt;
+    std::string sql_cmd = "SELECT " + quote_identifier(label_column) + ", " + quote_identifier(geometry_column) +
+        " FROM " + quote_identifier(table_name) + " WHERE " + quote_identifier(geometry_column) + " IS NOT NULL";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        throw std::runtime_error("Cannot read " + table_name + ": " + sqlite3_errmsg(db_handle));
+    }
+
+    // One leaf per triangle
+    std::vector<NodeItem> items;
+    BBox extent;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Geometry geom;
+        const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 1));
+        if (!decode_spatialite_blob(blob, sqlite3_column_bytes(stmt, 1), geom)) continue;
+
+        const unsigned char *label = sqlite3_column_text(stmt, 0);
+        const int64_t feature = static_cast<int64_t>(labels_.size());
+        labels_.push_back(label != NULL ? reinterpret_cast<const char *>(label) : "");
+
+        for (const auto &polygon : geom.polygons) {
+            std::vector<Point> vertices;
+            for (const Ring &ring : polygon.rings) {
+                vertices.insert(vertices.end(), ring.begin(), ring.end());
+            }
+
+            const std::vector<uint32_t> indices = triangulate(polygon);
+            for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+                const Triangle triangle{vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]],
+                                        feature};
+                BBox box;
+                box.expand(triangle.a.x, triangle.a.y);
+                box.expand(triangle.b.x, triangle.b.y);
+                box.expand(triangle.c.x, triangle.c.y);
+                extent.expand(box);
+                items.push_back(NodeItem{box.min_x, box.min_y, box.max_x, box.max_y, triangles_.size()});
+                triangles_.push_back(triangle);
+            }
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    hilbert_sort(items, extent);
+    index_ = PackedRTree(std::move(items));
+}
+
+int64_t TriangleLookup::find(const Point &p, LookupStats *stats) const
+{
+    if (stats != NULL) stats->lookups++;
+
+    BBox box;
+    box.expand(p.x, p.y);
+
+    int64_t found = -1;
+    index_.visit(box, [&](const NodeItem &leaf, uint64_t) {
+        const Triangle &triangle = triangles_[leaf.offset];
+        if (stats != NULL) stats->triangles_tested++;
+        if (triangle_contains(triangle.a, triangle.b, triangle.c, p)) {
+            found = triangle.feature;
+            return false;
+        }
+        return true;
+    });
+    return found;
+}
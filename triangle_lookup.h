@@ -0,0 +1,77 @@
+#ifndef TRIANGLE_LOOKUP_H
+#define TRIANGLE_LOOKUP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "geometry.h"
+#include "packed_rtree.h"
+#include "state_lookup.h"
+
+/**
+ * In-memory point-in-polygon lookup over the triangles of a polygon table
+ *
+ * Every polygon is triangulated once (see triangulate()) and each triangle
+ * is a leaf of a packed Hilbert R-tree. A lookup visits the few triangles
+ * whose bbox holds the point and runs a constant-time barycentric test on
+ * each, instead of counting crossings over every edge of a ring: the cost
+ * no longer depends on how detailed the coastline is.
+ *
+ * The lookup is immutable once built and can be shared between threads.
+ */
+class TriangleLookup {
+public:
+    /**
+     * Loads and triangulates the polygons of a table
+     *
+     * @param db_handle handle to the database connection
+     * @param table_name table holding the polygons
+     * @param geometry_column geometry column of the table
+     * @param label_column column returned for the matching feature
+     *
+     * Throws std::runtime_error if the table cannot be read.
+     */
+    TriangleLookup(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                   const std::string &label_column);
+
+    /**
+     * Finds the feature containing a point
+     *
+     * @param p point, in the SRID of the table
+     * @param stats counters to update (may be NULL)
+     * @return index of the feature, -1 if no feature contains the point
+     */
+    int64_t find(const Point &p, LookupStats *stats = NULL) const;
+
+    /**
+     * @param feature feature index returned by find()
+     * @return value of the label column for the feature
+     */
+    const std::string &label(int64_t feature) const { return labels_[feature]; }
+
+    size_t num_features() const { return labels_.size(); }
+    size_t num_triangles() const { return triangles_.size(); }
+    BBox extent() const { return index_.extent(); }
+
+private:
+    struct Triangle {
+        Point a;
+        Point b;
+        Point c;
+        int64_t feature;
+    };
+
+    std::vector<std::string> labels_;
+    std::vector<Triangle> triangles_;
+    PackedRTree index_;   // leaf offsets are indexes into triangles_
+};
+
+/**
+ * @return true if the point is inside or on the edge of the triangle abc
+ */
+bool triangle_contains(const Point &a, const Point &b, const Point &c, const Point &p);
+
+#endif // TRIANGLE_LOOKUP_H
@@ -0,0 +1,584 @@
+#include "triangulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+
+namespace {
+
+// Rings with fewer vertices are clipped without the z-order index
+const size_t Z_ORDER_THRESHOLD = 80;
+
+/**
+ * Vertex of a ring, in a circular doubly linked list and in a list sorted
+ * by z-order
+ */
+struct Node {
+    uint32_t i;            // vertex index in the input
+    double x;
+    double y;
+    Node *prev = nullptr;
+    Node *next = nullptr;
+    int32_t z = 0;         // z-order of the vertex
+    Node *prev_z = nullptr;
+    Node *next_z = nullptr;
+    bool steiner = false;  // single-vertex hole, kept by filter_points()
+};
+
+// Twice the signed area of the triangle pqr, negative for a left turn
+double area(const Node *p, const Node *q, const Node *r)
+{
+    return (q->y - p->y) * (r->x - q->x) - (q->x - p->x) * (r->y - q->y);
+}
+
+bool equals(const Node *a, const Node *b)
+{
+    return a->x == b->x && a->y == b->y;
+}
+
+bool point_in_triangle(double ax, double ay, double bx, double by, double cx, double cy, double px, double py)
+{
+    return (cx - px) * (ay - py) >= (ax - px) * (cy - py) &&
+           (ax - px) * (by - py) >= (bx - px) * (ay - py) &&
+           (bx - px) * (cy - py) >= (cx - px) * (by - py);
+}
+
+int sign(double value)
+{
+    return (value > 0) - (value < 0);
+}
+
+// For collinear p, q, r: true if q lies on the segment pr
+bool on_segment(const Node *p, const Node *q, const Node *r)
+{
+    return q->x <= std::max(p->x, r->x) && q->x >= std::min(p->x, r->x) &&
+           q->y <= std::max(p->y, r->y) && q->y >= std::min(p->y, r->y);
+}
+
+bool intersects(const Node *p1, const Node *q1, const Node *p2, const Node *q2)
+{
+    const int o1 = sign(area(p1, q1, p2));
+    const int o2 = sign(area(p1, q1, q2));
+    const int o3 = sign(area(p2, q2, p1));
+    const int o4 = sign(area(p2, q2, q1));
+
+    if (o1 != o2 && o3 != o4) return true;
+    if (o1 == 0 && on_segment(p1, p2, q1)) return true;
+    if (o2 == 0 && on_segment(p1, q2, q1)) return true;
+    if (o3 == 0 && on_segment(p2, p1, q2)) return true;
+    if (o4 == 0 && on_segment(p2, q1, q2)) return true;
+    return false;
+}
+
+// True if the diagonal ab crosses an edge of the polygon
+bool intersects_polygon(const Node *a, const Node *b)
+{
+    const Node *p = a;
+    do {
+        if (p->i != a->i && p->next->i != a->i && p->i != b->i && p->next->i != b->i &&
+            intersects(p, p->next, a, b)) {
+            return true;
+        }
+        p = p->next;
+    } while (p != a);
+    return false;
+}
+
+// True if the diagonal ab starts inside the polygon at a
+bool locally_inside(const Node *a, const Node *b)
+{
+    return area(a->prev, a, a->next) < 0 ?
+        area(a, b, a->next) >= 0 && area(a, a->prev, b) >= 0 :
+        area(a, b, a->prev) < 0 || area(a, a->next, b) < 0;
+}
+
+// True if the middle of the diagonal ab is inside the polygon
+bool middle_inside(const Node *a, const Node *b)
+{
+    const Node *p = a;
+    bool inside = false;
+    const double px = (a->x + b->x) / 2;
+    const double py = (a->y + b->y) / 2;
+    do {
+        if ((p->y > py) != (p->next->y > py) && p->next->y != p->y &&
+            px < (p->next->x - p->x) * (py - p->y) / (p->next->y - p->y) + p->x) {
+            inside = !inside;
+        }
+        p = p->next;
+    } while (p != a);
+    return inside;
+}
+
+bool sector_contains_sector(const Node *m, const Node *p)
+{
+    return area(m->prev, m, p->prev) < 0 && area(p->next, m, m->next) < 0;
+}
+
+bool is_valid_diagonal(const Node *a, const Node *b)
+{
+    return a->next->i != b->i && a->prev->i != b->i && !intersects_polygon(a, b) &&
+           ((locally_inside(a, b) && locally_inside(b, a) && middle_inside(a, b) &&
+             (area(a->prev, a, b->prev) != 0 || area(a, b->prev, b) != 0)) ||
+            (equals(a, b) && area(a->prev, a, a->next) > 0 && area(b->prev, b, b->next) > 0));
+}
+
+void remove_node(Node *p)
+{
+    p->next->prev = p->prev;
+    p->prev->next = p->next;
+    if (p->prev_z != nullptr) p->prev_z->next_z = p->next_z;
+    if (p->next_z != nullptr) p->next_z->prev_z = p->prev_z;
+}
+
+Node *leftmost(Node *start)
+{
+    Node *p = start;
+    Node *left = start;
+    do {
+        if (p->x < left->x || (p->x == left->x && p->y < left->y)) left = p;
+        p = p->next;
+    } while (p != start);
+    return left;
+}
+
+// Interleaves the bits of the 15 bit cell coordinates
+int32_t z_order(double x, double y, double min_x, double min_y, double inv_size)
+{
+    uint32_t ix = static_cast<uint32_t>((x - min_x) * inv_size);
+    uint32_t iy = static_cast<uint32_t>((y - min_y) * inv_size);
+
+    ix = (ix | (ix << 8)) & 0x00FF00FF;
+    ix = (ix | (ix << 4)) & 0x0F0F0F0F;
+    ix = (ix | (ix << 2)) & 0x33333333;
+    ix = (ix | (ix << 1)) & 0x55555555;
+
+    iy = (iy | (iy << 8)) & 0x00FF00FF;
+    iy = (iy | (iy << 4)) & 0x0F0F0F0F;
+    iy = (iy | (iy << 2)) & 0x33333333;
+    iy = (iy | (iy << 1)) & 0x55555555;
+
+    return static_cast<int32_t>(ix | (iy << 1));
+}
+
+/**
+ * Ear clipping state for one polygon
+ */
+class Earcut {
+public:
+    explicit Earcut(const Polygon &polygon)
+    {
+        if (polygon.rings.empty()) return;
+
+        size_t num_vertices = 0;
+        for (const Ring &ring : polygon.rings) {
+            num_vertices += ring.size();
+        }
+        triangles_.reserve(num_vertices * 3);
+
+        uint32_t first = 0;
+        Node *outer = linked_list(polygon.rings[0], first, true);
+        first += static_cast<uint32_t>(polygon.rings[0].size());
+        if (outer == nullptr || outer->next == outer->prev) return;
+
+        if (polygon.rings.size() > 1) {
+            std::vector<Node *> holes;
+            for (size_t r = 1; r < polygon.rings.size(); r++) {
+                Node *list = linked_list(polygon.rings[r], first, false);
+                first += static_cast<uint32_t>(polygon.rings[r].size());
+                if (list == nullptr) continue;
+                if (list == list->next) list->steiner = true;
+                holes.push_back(leftmost(list));
+            }
+            std::sort(holes.begin(), holes.end(), [](const Node *a, const Node *b) {
+                return a->x < b->x || (a->x == b->x && a->y < b->y);
+            });
+            for (Node *hole : holes) {
+                outer = eliminate_hole(hole, outer);
+            }
+        }
+
+        if (num_vertices > Z_ORDER_THRESHOLD) {
+            BBox box;
+            for (const Point &p : polygon.rings[0]) {
+                box.expand(p.x, p.y);
+            }
+            min_x_ = box.min_x;
+            min_y_ = box.min_y;
+            const double size = std::max(box.max_x - box.min_x, box.max_y - box.min_y);
+            inv_size_ = size > 0 ? 32767 / size : 0;
+        }
+
+        earcut_linked(outer, 0);
+    }
+
+    std::vector<uint32_t> &triangles() { return triangles_; }
+
+private:
+    Node *create_node(uint32_t i, double x, double y)
+    {
+        nodes_.emplace_back();
+        Node *p = &nodes_.back();
+        p->i = i;
+        p->x = x;
+        p->y = y;
+        return p;
+    }
+
+    Node *insert_node(uint32_t i, const Point &point, Node *last)
+    {
+        Node *p = create_node(i, point.x, point.y);
+        if (last == nullptr) {
+            p->prev = p;
+            p->next = p;
+        } else {
+            p->next = last->next;
+            p->prev = last;
+            last->next->prev = p;
+            last->next = p;
+        }
+        return p;
+    }
+
+    // Links the vertices of a ring, counter-clockwise or clockwise
+    Node *linked_list(const Ring &ring, uint32_t first, bool counter_clockwise)
+    {
+        if (ring.empty()) return nullptr;
+
+        double doubled_area = 0;
+        for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+            doubled_area += ring[j].x * ring[i].y - ring[i].x * ring[j].y;
+        }
+
+        Node *last = nullptr;
+        if (counter_clockwise == (doubled_area > 0)) {
+            for (size_t i = 0; i < ring.size(); i++) {
+                last = insert_node(first + static_cast<uint32_t>(i), ring[i], last);
+            }
+        } else {
+            for (size_t i = ring.size(); i-- > 0;) {
+                last = insert_node(first + static_cast<uint32_t>(i), ring[i], last);
+            }
+        }
+
+        // Drops the closing vertex
+        if (last != nullptr && equals(last, last->next)) {
+            remove_node(last);
+            last = last->next;
+        }
+        return last;
+    }
+
+    // Removes duplicate and collinear vertices
+    Node *filter_points(Node *start, Node *end = nullptr)
+    {
+        if (start == nullptr) return start;
+        if (end == nullptr) end = start;
+
+        Node *p = start;
+        bool again;
+        do {
+            again = false;
+            if (!p->steiner && (equals(p, p->next) || area(p->prev, p, p->next) == 0)) {
+                remove_node(p);
+                p = end = p->prev;
+                if (p == p->next) break;
+                again = true;
+            } else {
+                p = p->next;
+            }
+        } while (again || p != end);
+        return end;
+    }
+
+    void earcut_linked(Node *ear, int pass)
+    {
+        if (ear == nullptr) return;
+        if (pass == 0 && inv_size_ > 0) index_curve(ear);
+
+        Node *stop = ear;
+        while (ear->prev != ear->next) {
+            Node *prev = ear->prev;
+            Node *next = ear->next;
+
+            if (inv_size_ > 0 ? is_ear_hashed(ear) : is_ear(ear)) {
+                triangles_.push_back(prev->i);
+                triangles_.push_back(ear->i);
+                triangles_.push_back(next->i);
+                remove_node(ear);
+
+                // Skipping the next vertex leads to fewer sliver triangles
+                ear = next->next;
+                stop = next->next;
+                continue;
+            }
+
+            ear = next;
+            if (ear == stop) {
+                // No ear left: filter, cure and finally split the polygon
+                if (pass == 0) {
+                    earcut_linked(filter_points(ear), 1);
+                } else if (pass == 1) {
+                    earcut_linked(cure_local_intersections(filter_points(ear)), 2);
+                } else {
+                    split_earcut(ear);
+                }
+                break;
+            }
+        }
+    }
+
+    bool is_ear(const Node *ear) const
+    {
+        const Node *a = ear->prev;
+        const Node *b = ear;
+        const Node *c = ear->next;
+        if (area(a, b, c) >= 0) return false;   // reflex
+
+        const double x0 = std::min({a->x, b->x, c->x});
+        const double y0 = std::min({a->y, b->y, c->y});
+        const double x1 = std::max({a->x, b->x, c->x});
+        const double y1 = std::max({a->y, b->y, c->y});
+
+        for (const Node *p = c->next; p != a; p = p->next) {
+            if (p->x >= x0 && p->x <= x1 && p->y >= y0 && p->y <= y1 &&
+                point_in_triangle(a->x, a->y, b->x, b->y, c->x, c->y, p->x, p->y) &&
+                area(p->prev, p, p->next) >= 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool blocks_ear(const Node *p, const Node *a, const Node *b, const Node *c,
+                    double x0, double y0, double x1, double y1) const
+    {
+        return p->x >= x0 && p->x <= x1 && p->y >= y0 && p->y <= y1 && p != a && p != c &&
+               point_in_triangle(a->x, a->y, b->x, b->y, c->x, c->y, p->x, p->y) &&
+               area(p->prev, p, p->next) >= 0;
+    }
+
+    // Same as is_ear(), only visiting the vertices in the z-range of the ear
+    bool is_ear_hashed(const Node *ear) const
+    {
+        const Node *a = ear->prev;
+        const Node *b = ear;
+        const Node *c = ear->next;
+        if (area(a, b, c) >= 0) return false;
+
+        const double x0 = std::min({a->x, b->x, c->x});
+        const double y0 = std::min({a->y, b->y, c->y});
+        const double x1 = std::max({a->x, b->x, c->x});
+        const double y1 = std::max({a->y, b->y, c->y});
+        const int32_t min_z = z_order(x0, y0, min_x_, min_y_, inv_size_);
+        const int32_t max_z = z_order(x1, y1, min_x_, min_y_, inv_size_);
+
+        const Node *p = ear->prev_z;
+        const Node *n = ear->next_z;
+        while (p != nullptr && p->z >= min_z && n != nullptr && n->z <= max_z) {
+            if (blocks_ear(p, a, b, c, x0, y0, x1, y1)) return false;
+            p = p->prev_z;
+            if (blocks_ear(n, a, b, c, x0, y0, x1, y1)) return false;
+            n = n->next_z;
+        }
+        for (; p != nullptr && p->z >= min_z; p = p->prev_z) {
+            if (blocks_ear(p, a, b, c, x0, y0, x1, y1)) return false;
+        }
+        for (; n != nullptr && n->z <= max_z; n = n->next_z) {
+            if (blocks_ear(n, a, b, c, x0, y0, x1, y1)) return false;
+        }
+        return true;
+    }
+
+    // Clips the triangles of small self-intersections (a, p, p.next, b)
+    Node *cure_local_intersections(Node *start)
+    {
+        Node *p = start;
+        do {
+            Node *a = p->prev;
+            Node *b = p->next->next;
+            if (!equals(a, b) && intersects(a, p, p->next, b) && locally_inside(a, b) && locally_inside(b, a)) {
+                triangles_.push_back(a->i);
+                triangles_.push_back(p->i);
+                triangles_.push_back(b->i);
+                remove_node(p);
+                remove_node(p->next);
+                p = start = b;
+            }
+            p = p->next;
+        } while (p != start);
+        return filter_points(p);
+    }
+
+    // Splits the polygon along a valid diagonal and triangulates both halves
+    void split_earcut(Node *start)
+    {
+        Node *a = start;
+        do {
+            for (Node *b = a->next->next; b != a->prev; b = b->next) {
+                if (a->i != b->i && is_valid_diagonal(a, b)) {
+                    Node *c = split_polygon(a, b);
+                    a = filter_points(a, a->next);
+                    c = filter_points(c, c->next);
+                    earcut_linked(a, 0);
+                    earcut_linked(c, 0);
+                    return;
+                }
+            }
+            a = a->next;
+        } while (a != start);
+    }
+
+    // Joins a and b with a diagonal; returns the copy of b in the second polygon
+    Node *split_polygon(Node *a, Node *b)
+    {
+        Node *a2 = create_node(a->i, a->x, a->y);
+        Node *b2 = create_node(b->i, b->x, b->y);
+        Node *an = a->next;
+        Node *bp = b->prev;
+
+        a->next = b;
+        b->prev = a;
+        a2->next = an;
+        an->prev = a2;
+        b2->next = a2;
+        a2->prev = b2;
+        bp->next = b2;
+        b2->prev = bp;
+        return b2;
+    }
+
+    Node *eliminate_hole(Node *hole, Node *outer)
+    {
+        Node *bridge = find_hole_bridge(hole, outer);
+        if (bridge == nullptr) return outer;
+
+        Node *bridge_reverse = split_polygon(bridge, hole);
+        filter_points(bridge_reverse, bridge_reverse->next);
+        return filter_points(bridge, bridge->next);
+    }
+
+    // David Eberly's algorithm: finds a vertex of the outer ring visible
+    // from the leftmost vertex of the hole
+    Node *find_hole_bridge(Node *hole, Node *outer) const
+    {
+        Node *p = outer;
+        const double hx = hole->x;
+        const double hy = hole->y;
+        double qx = -INFINITY;
+        Node *m = nullptr;
+
+        // Closest edge crossed by a ray going left from the hole
+        do {
+            if (hy <= p->y && hy >= p->next->y && p->next->y != p->y) {
+                const double x = p->x + (hy - p->y) * (p->next->x - p->x) / (p->next->y - p->y);
+                if (x <= hx && x > qx) {
+                    qx = x;
+                    m = p->x < p->next->x ? p : p->next;
+                    if (x == hx) return m;   // the hole touches the outer ring
+                }
+            }
+            p = p->next;
+        } while (p != outer);
+        if (m == nullptr) return nullptr;
+
+        // Reflex vertices inside the triangle (hole, crossing, m) may hide
+        // m; pick the one with the smallest angle to the ray instead
+        const Node *stop = m;
+        const double mx = m->x;
+        const double my = m->y;
+        double tan_min = INFINITY;
+        p = m;
+        do {
+            if (hx >= p->x && p->x >= mx && hx != p->x &&
+                point_in_triangle(hy < my ? hx : qx, hy, mx, my, hy < my ? qx : hx, hy, p->x, p->y)) {
+                const double tan = std::fabs(hy - p->y) / (hx - p->x);
+                if (locally_inside(p, hole) &&
+                    (tan < tan_min ||
+                     (tan == tan_min && (p->x > m->x || (p->x == m->x && sector_contains_sector(m, p)))))) {
+                    m = p;
+                    tan_min = tan;
+                }
+            }
+            p = p->next;
+        } while (p != stop);
+        return m;
+    }
+
+    // Sorts the vertices of the ring in z-order
+    void index_curve(Node *start)
+    {
+        Node *p = start;
+        do {
+            p->z = z_order(p->x, p->y, min_x_, min_y_, inv_size_);
+            p->prev_z = p->prev;
+            p->next_z = p->next;
+            p = p->next;
+        } while (p != start);
+
+        p->prev_z->next_z = nullptr;
+        p->prev_z = nullptr;
+        sort_linked(p);
+    }
+
+    // Bottom-up merge sort of the z-order list
+    static Node *sort_linked(Node *list)
+    {
+        size_t in_size = 1;
+        size_t num_merges;
+        do {
+            Node *p = list;
+            Node *tail = nullptr;
+            list = nullptr;
+            num_merges = 0;
+
+            while (p != nullptr) {
+                num_merges++;
+                Node *q = p;
+                size_t p_size = 0;
+                for (size_t i = 0; i < in_size && q != nullptr; i++) {
+                    p_size++;
+                    q = q->next_z;
+                }
+                size_t q_size = in_size;
+
+                while (p_size > 0 || (q_size > 0 && q != nullptr)) {
+                    Node *e;
+                    if (p_size != 0 && (q_size == 0 || q == nullptr || p->z <= q->z)) {
+                        e = p;
+                        p = p->next_z;
+                        p_size--;
+                    } else {
+                        e = q;
+                        q = q->next_z;
+                        q_size--;
+                    }
+                    if (tail != nullptr) {
+                        tail->next_z = e;
+                    } else {
+                        list = e;
+                    }
+                    e->prev_z = tail;
+                    tail = e;
+                }
+                p = q;
+            }
+            tail->next_z = nullptr;
+            in_size *= 2;
+        } while (num_merges > 1);
+        return list;
+    }
+
+    std::deque<Node> nodes_;   // stable addresses
+    std::vector<uint32_t> triangles_;
+    double min_x_ = 0;
+    double min_y_ = 0;
+    double inv_size_ = 0;      // 0 when the z-order index is not used
+};
+
+} // namespace
+
+std::vector<uint32_t> triangulate(const Polygon &polygon)
+{
+    Earcut earcut(polygon);
+    return std::move(earcut.triangles());
+}
@@ -0,0 +1,27 @@
+#ifndef TRIANGULATION_H
+#define TRIANGULATION_H
+
+#include <cstdint>
+#include <vector>
+
+#include "geometry.h"
+
+/**
+ * Triangulates a polygon with holes by ear clipping
+ *
+ * Holes are first bridged to the exterior ring, then ears are clipped in
+ * z-order so that the "is any vertex inside this ear" test only looks at
+ * vertices near the ear; this keeps rings with hundreds of thousands of
+ * vertices (the Brazilian coastline) close to linear time. Degenerate
+ * input (self-touching rings, repeated vertices) is handled the way
+ * mapbox/earcut does: by removing collinear points, curing small local
+ * self-intersections and finally splitting the remaining polygon.
+ *
+ * @param polygon polygon to triangulate, rings closed
+ * @return vertex indices, three per triangle, counter-clockwise. A vertex
+ *         index counts the vertices of all the rings in order, as stored
+ *         (closing vertices included)
+ */
+std::vector<uint32_t> triangulate(const Polygon &polygon);
+
+#endif // TRIANGULATION_H
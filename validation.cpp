@@ -0,0 +1,189 @@
+#include "validation.h"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "geometry.h"
+#include "geos_context.h"
+#include "sql_util.h"
+#include "thread_pool.h"
+
+namespace {
+
+// Rows read, checked in parallel and written back at a time
+const int VALIDATION_BATCH_SIZE = 256;
+
+struct Row {
+    int64_t rowid = 0;
+    std::vector<uint8_t> blob;
+    bool is_valid = false;
+    bool invalid = false;                // GEOS found the original invalid
+    std::vector<uint8_t> repaired_blob;  // set when the geometry was repaired
+};
+
+bool is_multi(GeometryType type)
+{
+    return type == GeometryType::MultiPoint || type == GeometryType::MultiLineString ||
+           type == GeometryType::MultiPolygon;
+}
+
+/**
+ * Checks one geometry and repairs it if needed; runs on a worker thread
+ */
+void validate_row(const GeosContext &geos, Row &row, const BlobEncoding &encoding)
+{
+    Geometry geom;
+    if (!decode_spatialite_blob(row.blob.data(), row.blob.size(), geom)) return;
+
+    GeosGeometry geos_geom = geos.to_geos(geom);
+    if (!geos_geom) return;
+
+    // 1 valid, 0 invalid, 2 exception
+    const char valid = GEOSisValid_r(geos.handle(), geos_geom.get());
+    if (valid == 1) {
+        row.is_valid = true;
+        return;
+    }
+    if (valid != 0) return;
+    row.invalid = true;
+
+    GeosGeometry fixed = geos.wrap(GEOSMakeValid_r(geos.handle(), geos_geom.get()));
+    Geometry repaired;
+    if (!fixed || !geos.from_geos(fixed.get(), repaired, geom.srid)) return;
+
+    // The result is stored like the imported geometries, and must still
+    // fit the geometry column
+    quantize_geometry(repaired, encoding.precision);
+    if (is_multi(geom.type)) {
+        promote_to_multi(repaired);
+    }
+    if (repaired.type != geom.type) return;
+
+    row.repaired_blob = encode_spatialite_blob(repaired, encoding.compressed);
+    row.is_valid = true;
+}
+
+} // namespace
+
+int validate_geometries(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                        ThreadPool &pool, const BlobEncoding &encoding, ValidationSummary *summary)
+{
+    const std::string table = quote_identifier(table_name);
+    const std::string column = quote_identifier(geometry_column);
+    ValidationSummary counts;
+
+    std::vector<std::unique_ptr<GeosContext>> contexts;
+    try {
+        for (unsigned i = 0; i < pool.size(); i++) {
+            contexts.emplace_back(new GeosContext());
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error validating geometries: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (add_column(db_handle, table, "is_valid", "INTEGER") != 0 ||
+        add_column(db_handle, table, "was_repaired", "INTEGER") != 0) {
+        return 1;
+    }
+
+    sqlite3_stmt *select_stmt;
+    std::string sql_cmd = "SELECT rowid, " + column + " FROM " + table + " WHERE rowid > ? ORDER BY rowid LIMIT " +
+        std::to_string(VALIDATION_BATCH_SIZE);
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &select_stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        return 1;
+    }
+
+    sqlite3_stmt *update_stmt;
+    sql_cmd = "UPDATE " + table + " SET is_valid = ?1, was_repaired = ?2, " + column + " = COALESCE(?3, " + column +
+        ") WHERE rowid = ?4";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &update_stmt, NULL) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db_handle) << std::endl;
+        sqlite3_finalize(select_stmt);
+        return 1;
+    }
+
+    auto fail = [&]() {
+        sqlite3_finalize(select_stmt);
+        sqlite3_finalize(update_stmt);
+        exec(db_handle, "ROLLBACK;", "rolling back");
+        return 1;
+    };
+
+    if (exec(db_handle, "BEGIN TRANSACTION;", "starting transaction") != 0) {
+        sqlite3_finalize(select_stmt);
+        sqlite3_finalize(update_stmt);
+        return 1;
+    }
+
+    std::vector<Row> rows;
+    int64_t last_rowid = INT64_MIN;
+    while (true) {
+        // Read a batch
+        rows.clear();
+        sqlite3_bind_int64(select_stmt, 1, last_rowid);
+        while (sqlite3_step(select_stmt) == SQLITE_ROW) {
+            rows.emplace_back();
+            Row &row = rows.back();
+            row.rowid = sqlite3_column_int64(select_stmt, 0);
+            const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_column_blob(select_stmt, 1));
+            row.blob.assign(blob, blob + sqlite3_column_bytes(select_stmt, 1));
+        }
+        sqlite3_reset(select_stmt);
+        if (rows.empty()) break;
+        last_rowid = rows.back().rowid;
+
+        // Check it in parallel
+        try {
+            pool.parallel_for(rows.size(), [&](size_t index, unsigned worker) {
+                validate_row(*contexts[worker], rows[index], encoding);
+            });
+        } catch (const std::exception &e) {
+            std::cerr << "Error validating geometries: " << e.what() << std::endl;
+            return fail();
+        }
+
+        // Write it back
+        for (const Row &row : rows) {
+            if (row.blob.empty()) continue;  // NULL geometry
+
+            const bool repaired = !row.repaired_blob.empty();
+            sqlite3_bind_int(update_stmt, 1, row.is_valid ? 1 : 0);
+            sqlite3_bind_int(update_stmt, 2, repaired ? 1 : 0);
+            if (repaired) {
+                sqlite3_bind_blob(update_stmt, 3, row.repaired_blob.data(), row.repaired_blob.size(), SQLITE_STATIC);
+            } else {
+                sqlite3_bind_null(update_stmt, 3);
+            }
+            sqlite3_bind_int64(update_stmt, 4, row.rowid);
+
+            if (sqlite3_step(update_stmt) != SQLITE_DONE) {
+                std::cerr << "Error updating geometry " << row.rowid << ": " << sqlite3_errmsg(db_handle) << std::endl;
+                return fail();
+            }
+            sqlite3_reset(update_stmt);
+
+            counts.checked++;
+            counts.invalid += row.invalid ? 1 : 0;
+            counts.repaired += repaired ? 1 : 0;
+            counts.failed += row.is_valid ? 0 : 1;
+        }
+    }
+    sqlite3_finalize(select_stmt);
+    sqlite3_finalize(update_stmt);
+
+    if (exec(db_handle, "COMMIT;", "committing transaction") != 0) {
+        return 1;
+    }
+
+    std::cout << "Validated " << counts.checked << " geometries of " << table_name << " on " << pool.size()
+        << " threads: " << counts.invalid << " invalid, " << counts.repaired << " repaired, "
+        << counts.failed << " left invalid" << std::endl;
+
+    if (summary != NULL) {
+        *summary = counts;
+    }
+    return 0;
+}
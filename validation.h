@@ -0,0 +1,42 @@
+#ifndef VALIDATION_H
+#define VALIDATION_H
+
+#include <cstdint>
+#include <string>
+
+#include <sqlite3.h>
+
+class ThreadPool;
+struct BlobEncoding;
+
+struct ValidationSummary {
+    uint64_t checked = 0;    // geometries checked
+    uint64_t invalid = 0;    // geometries GEOS found invalid
+    uint64_t repaired = 0;   // invalid geometries replaced by their MakeValid() result
+    uint64_t failed = 0;     // geometries GEOS could not check or repair
+};
+
+/**
+ * Checks every geometry of a table with GEOS and repairs the invalid ones
+ *
+ * @param db_handle handle to the database connection
+ * @param table_name table holding the geometries
+ * @param geometry_column geometry column to check
+ * @param pool threads to run GEOS on, each with its own GEOS context
+ * @param encoding how the table stores its geometries; repaired ones are
+ *        quantized and compressed the same way
+ * @param summary counts of checked, invalid and repaired geometries (may be NULL)
+ * @return 0 on success, 1 on failure
+ *
+ * Adds `is_valid` and `was_repaired` columns to the table. Geometries are
+ * read in batches; GEOS checks the batch in parallel and runs MakeValid on
+ * the invalid ones, keeping the polygonal part of the result for polygon
+ * layers. The repaired geometry replaces the original and the flags are
+ * written in one transaction, so queries on the table only ever see valid
+ * geometries (is_valid = 1) or geometries GEOS could neither check nor
+ * repair (is_valid = 0, was_repaired = 0), which they can skip.
+ */
+int validate_geometries(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                        ThreadPool &pool, const BlobEncoding &encoding, ValidationSummary *summary = NULL);
+
+#endif // VALIDATION_H
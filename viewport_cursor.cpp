@@ -0,0 +1,185 @@
+#include "viewport_cursor.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+#include "sql_util.h"
+
+namespace {
+
+// Upper bound on the number of tiles per side of the viewport
+const uint32_t MAX_TILES = 1024;
+
+} // namespace
+
+ViewportCursor::ViewportCursor(sqlite3 *db_handle, const std::string &table_name,
+                               const std::string &geometry_column, const BBox &viewport, size_t page_size)
+    : viewport_(viewport), page_size_(std::max<size_t>(1, page_size))
+{
+    prepare(db_handle, table_name, geometry_column);
+    tiles_ = grid_size(db_handle);
+}
+
+ViewportCursor::ViewportCursor(sqlite3 *db_handle, const std::string &table_name,
+                               const std::string &geometry_column, const std::string &token, size_t page_size)
+    : page_size_(std::max<size_t>(1, page_size))
+{
+    // min_x,min_y,max_x,max_y,tiles,tile,after
+    int64_t after;
+    if (std::sscanf(token.c_str(), "%lf,%lf,%lf,%lf,%" SCNu32 ",%" SCNu32 ",%" SCNd64, &viewport_.min_x,
+                    &viewport_.min_y, &viewport_.max_x, &viewport_.max_y, &tiles_, &tile_, &after) != 7 ||
+        tiles_ == 0 || tiles_ > MAX_TILES || tile_ > tiles_ * tiles_) {
+        throw std::runtime_error("Invalid continuation token: " + token);
+    }
+    after_ = after;
+    prepare(db_handle, table_name, geometry_column);
+}
+
+ViewportCursor::~ViewportCursor()
+{
+    sqlite3_finalize(stmt_);
+}
+
+void ViewportCursor::prepare(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column)
+{
+    sqlite3_stmt *stmt;
+    std::string sql_cmd = "SELECT f_table_name, f_geometry_column, geometry_type FROM geometry_columns "
+        "WHERE Lower(f_table_name) = Lower(?) AND Lower(f_geometry_column) = Lower(?) AND spatial_index_enabled = 1";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        throw std::runtime_error(std::string("Cannot read geometry_columns: ") + sqlite3_errmsg(db_handle));
+    }
+    sqlite3_bind_text(stmt, 1, table_name.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, geometry_column.c_str(), -1, SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        sqlite3_finalize(stmt);
+        throw std::runtime_error("No spatial index on " + table_name + "." + geometry_column);
+    }
+    index_table_ = std::string("idx_") + reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)) + "_" +
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+    // POINT, POINT Z, POINT M and POINT ZM. The R-tree stores 32 bit float
+    // boxes rounded outwards, so even for points its test is approximate.
+    const bool points = sqlite3_column_int(stmt, 2) % 1000 == 1;
+    sqlite3_finalize(stmt);
+
+    const std::string geometry = "t." + quote_identifier(geometry_column);
+    sql_cmd = "SELECT t.rowid, " + geometry + " FROM " + quote_identifier(table_name) + " AS t "
+        "WHERE t.rowid IN (SELECT pkid FROM " + quote_identifier(index_table_) +
+        " WHERE xmin >= ?1 AND xmin < ?2 AND ymin >= ?3 AND ymin < ?4 AND xmax >= ?5 AND ymax >= ?6 AND pkid > ?7)";
+    if (points) {
+        sql_cmd += " AND X(" + geometry + ") BETWEEN ?5 AND ?9 AND Y(" + geometry + ") BETWEEN ?6 AND ?10";
+    } else {
+        sql_cmd += " AND ST_Intersects(" + geometry + ", BuildMbr(?5, ?6, ?9, ?10, ST_SRID(" + geometry + "))) = 1";
+    }
+    sql_cmd += " ORDER BY t.rowid LIMIT ?8";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt_, NULL) != SQLITE_OK) {
+        throw std::runtime_error("Cannot query " + table_name + ": " + sqlite3_errmsg(db_handle));
+    }
+}
+
+uint32_t ViewportCursor::grid_size(sqlite3 *db_handle) const
+{
+    // Tiles of about one page each
+    sqlite3_stmt *stmt;
+    const std::string sql_cmd = "SELECT count(*) FROM " + quote_identifier(index_table_) +
+        " WHERE xmin <= ? AND xmax >= ? AND ymin <= ? AND ymax >= ?";
+    if (sqlite3_prepare_v2(db_handle, sql_cmd.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        throw std::runtime_error("Cannot query " + index_table_ + ": " + sqlite3_errmsg(db_handle));
+    }
+    sqlite3_bind_double(stmt, 1, viewport_.max_x);
+    sqlite3_bind_double(stmt, 2, viewport_.min_x);
+    sqlite3_bind_double(stmt, 3, viewport_.max_y);
+    sqlite3_bind_double(stmt, 4, viewport_.min_y);
+    const int64_t count = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+    sqlite3_finalize(stmt);
+
+    const double tiles = std::ceil(std::sqrt(static_cast<double>(count) / page_size_));
+    return static_cast<uint32_t>(std::min<double>(std::max(tiles, 1.0), MAX_TILES));
+}
+
+double ViewportCursor::tile_edge(double min, double max, uint32_t i) const
+{
+    // First and last tiles are open towards the outside of the viewport,
+    // for the MBRs starting before it
+    if (i == 0) return -DBL_MAX;
+    if (i == tiles_) return std::nextafter(max, DBL_MAX);
+    return min + (max - min) * i / tiles_;
+}
+
+void ViewportCursor::bind_tile()
+{
+    const uint32_t col = tile_ % tiles_;
+    const uint32_t row = tile_ / tiles_;
+    sqlite3_bind_double(stmt_, 1, tile_edge(viewport_.min_x, viewport_.max_x, col));
+    sqlite3_bind_double(stmt_, 2, tile_edge(viewport_.min_x, viewport_.max_x, col + 1));
+    sqlite3_bind_double(stmt_, 3, tile_edge(viewport_.min_y, viewport_.max_y, row));
+    sqlite3_bind_double(stmt_, 4, tile_edge(viewport_.min_y, viewport_.max_y, row + 1));
+    sqlite3_bind_double(stmt_, 5, viewport_.min_x);
+    sqlite3_bind_double(stmt_, 6, viewport_.min_y);
+    sqlite3_bind_int64(stmt_, 7, after_);
+    sqlite3_bind_int64(stmt_, 8, static_cast<sqlite3_int64>(page_size_));
+    sqlite3_bind_double(stmt_, 9, viewport_.max_x);
+    sqlite3_bind_double(stmt_, 10, viewport_.max_y);
+}
+
+bool ViewportCursor::next(ViewportFeature &feature)
+{
+    while (!done()) {
+        if (!page_open_) {
+            bind_tile();
+            rows_in_page_ = 0;
+            page_open_ = true;
+        }
+
+        const int ret = sqlite3_step(stmt_);
+        if (ret == SQLITE_ROW) {
+            after_ = sqlite3_column_int64(stmt_, 0);
+            rows_in_page_++;
+
+            feature.rowid = after_;
+            feature.geometry = Geometry();
+            const uint8_t *blob = static_cast<const uint8_t *>(sqlite3_column_blob(stmt_, 1));
+            if (!decode_spatialite_blob(blob, sqlite3_column_bytes(stmt_, 1), feature.geometry)) {
+                feature.geometry = Geometry();
+            }
+            return true;
+        }
+
+        sqlite3_reset(stmt_);
+        page_open_ = false;
+        if (ret != SQLITE_DONE) {
+            throw std::runtime_error(std::string("Error reading viewport: ") +
+                                     sqlite3_errmsg(sqlite3_db_handle(stmt_)));
+        }
+
+        // A short page means the tile is exhausted
+        if (rows_in_page_ < page_size_) {
+            tile_++;
+            after_ = INT64_MIN;
+        }
+    }
+    return false;
+}
+
+std::vector<ViewportFeature> ViewportCursor::next_page()
+{
+    std::vector<ViewportFeature> page;
+    ViewportFeature feature;
+    while (page.size() < page_size_ && next(feature)) {
+        page.push_back(std::move(feature));
+    }
+    return page;
+}
+
+std::string ViewportCursor::token() const
+{
+    if (done()) return std::string();
+
+    char token[256];
+    std::snprintf(token, sizeof(token), "%.17g,%.17g,%.17g,%.17g,%" PRIu32 ",%" PRIu32 ",%" PRId64,
+                  viewport_.min_x, viewport_.min_y, viewport_.max_x, viewport_.max_y, tiles_, tile_, after_);
+    return token;
+}
@@ -0,0 +1,117 @@
+#ifndef VIEWPORT_CURSOR_H
+#define VIEWPORT_CURSOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "geometry.h"
+
+/**
+ * A feature returned by a ViewportCursor
+ */
+struct ViewportFeature {
+    int64_t rowid;
+    Geometry geometry;   // Unknown type if the BLOB could not be decoded
+};
+
+/**
+ * Resumable, streaming cursor over the features of a table intersecting a
+ * viewport, served from the table's SpatiaLite spatial index
+ *
+ * The viewport is cut into a grid of tiles sized so that each holds about
+ * one page of features, and every feature belongs to the tile holding the
+ * min corner of its MBR (clamped to the viewport). Features are returned
+ * tile by tile, in rowid order within a tile, one page per query:
+ *
+ *     rowid > last rowid returned AND MBR min corner in the tile
+ *     ORDER BY rowid LIMIT page size
+ *
+ * so a page costs an R-tree search of one tile, never an OFFSET scan, and
+ * only the current row is held in memory. The position after the last row
+ * returned is the keyset (tile, rowid), which token() serializes together
+ * with the viewport and the grid: a client, or a stateless server handling
+ * the next request, resumes exactly there by building a cursor from the
+ * token.
+ *
+ * Rows inserted or deleted between two pages behind the keyset are simply
+ * seen or missed, as with any keyset pagination; no row is returned twice.
+ */
+class ViewportCursor {
+public:
+    /**
+     * Starts a query
+     *
+     * @param db_handle handle to the database connection
+     * @param table_name table holding the features
+     * @param geometry_column geometry column, with a spatial index
+     * @param viewport area to query, in the SRID of the table
+     * @param page_size number of rows fetched per query
+     *
+     * Throws std::runtime_error if the column has no spatial index or the
+     * query cannot be prepared.
+     */
+    ViewportCursor(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                   const BBox &viewport, size_t page_size = 1000);
+
+    /**
+     * Resumes a query from a continuation token
+     *
+     * @param token value of token() of a previous cursor on the same table
+     *
+     * Also throws std::runtime_error if the token is malformed.
+     */
+    ViewportCursor(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column,
+                   const std::string &token, size_t page_size = 1000);
+
+    ~ViewportCursor();
+
+    ViewportCursor(const ViewportCursor &) = delete;
+    ViewportCursor &operator=(const ViewportCursor &) = delete;
+
+    /**
+     * Reads the next feature
+     *
+     * @param feature the feature read
+     * @return false when every feature has been read
+     *
+     * Throws std::runtime_error on a database error.
+     */
+    bool next(ViewportFeature &feature);
+
+    /**
+     * Reads up to page_size features
+     *
+     * @return features read, empty when every feature has been read
+     */
+    std::vector<ViewportFeature> next_page();
+
+    /**
+     * @return token resuming the query after the last feature read, empty
+     *         once every feature has been read
+     */
+    std::string token() const;
+
+    bool done() const { return tile_ >= tiles_ * tiles_; }
+    uint32_t tiles_per_side() const { return tiles_; }
+
+private:
+    void prepare(sqlite3 *db_handle, const std::string &table_name, const std::string &geometry_column);
+    uint32_t grid_size(sqlite3 *db_handle) const;
+    double tile_edge(double min, double max, uint32_t i) const;
+    void bind_tile();
+
+    BBox viewport_;
+    size_t page_size_;
+    uint32_t tiles_ = 0;                    // tiles per side of the viewport
+    uint32_t tile_ = 0;                     // current tile, row major
+    int64_t after_ = INT64_MIN;             // last rowid returned in the current tile
+    size_t rows_in_page_ = 0;
+    bool page_open_ = false;
+    std::string index_table_;
+    sqlite3_stmt *stmt_ = nullptr;
+};
+
+#endif // VIEWPORT_CURSOR_H